@@ -53,6 +53,14 @@ typedef struct qhasharr_slot_s qhasharr_slot_t;
 typedef struct qhasharr_data_s qhasharr_data_t;
 typedef struct qhasharr_obj_s qhasharr_obj_t;
 
+/* how truncated keys are verified */
+enum {
+    QHASHARR_KEYFP_XXH64   = (1),  /*!< 64-bit xxHash64 fingerprint (default) */
+    QHASHARR_KEYFP_MURMUR3 = (2),  /*!< 128-bit Murmur3 fingerprint */
+    QHASHARR_KEYFP_MD5     = (3),  /*!< 128-bit MD5 fingerprint */
+    QHASHARR_KEYFP_FULLKEY = (4)   /*!< store the whole key, exact comparison */
+};
+
 /* member functions
  *
  * All the member functions can be accessed in both ways:
@@ -60,6 +68,7 @@ typedef struct qhasharr_obj_s qhasharr_obj_t;
  *  - qhasharr_put(tbl, ...);  // where avoiding pointer overhead is preferred.
  */
 extern qhasharr_t *qhasharr(void *memory, size_t memsize);
+extern qhasharr_t *qhasharr_keyfp(void *memory, size_t memsize, int keyfp);
 extern size_t qhasharr_calculate_memsize(int max);
 
 extern bool qhasharr_put(qhasharr_t *tbl, const char *key, const void *value,
@@ -137,7 +146,7 @@ struct qhasharr_slot_s {
             uint8_t data[Q_HASHARR_DATASIZE];  /*!< value */
             uint8_t name[Q_HASHARR_NAMESIZE];  /*!< key string, can be cut */
             uint16_t namesize;                 /*!< original key length */
-            uint8_t namemd5[16];               /*!< md5 hash of the key */
+            uint8_t namefp[16];                /*!< fingerprint of the key */
         } pair;
 
         /*!< extended data block, used only when the count value is -2 */
@@ -151,6 +160,8 @@ struct qhasharr_slot_s {
  * qhasharr memory structure
  */
 struct qhasharr_data_s {
+    uint32_t magic;     /*!< table layout identifier */
+    int keyfp;          /*!< key fingerprint type, QHASHARR_KEYFP_* */
     int maxslots;       /*!< number of maximum slots */
     int usedslots;      /*!< number of used slots */
     int num;            /*!< number of stored keys */
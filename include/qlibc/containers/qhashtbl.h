@@ -49,7 +49,8 @@ typedef struct qhashtbl_s qhashtbl_t;
 typedef struct qhashtbl_obj_s qhashtbl_obj_t;
 
 enum {
-    QHASHTBL_THREADSAFE = (0x01)  /*!< make it thread-safe */
+    QHASHTBL_THREADSAFE = (0x01),  /*!< make it thread-safe */
+    QHASHTBL_HASH_XXH64 = (0x02)   /*!< hash keys with xxHash64 */
 };
 
 /* member functions
@@ -109,6 +110,9 @@ struct qhashtbl_s {
 
     void (*free) (qhashtbl_t *tbl);
 
+    /* private methods */
+    uint32_t (*hashfunc) (const void *data, size_t nbytes);
+
     /* private variables - do not access directly */
     void *qmutex;       /*!< initialized when QHASHTBL_THREADSAFE is given */
     size_t num;         /*!< number of objects in this table */
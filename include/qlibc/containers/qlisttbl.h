@@ -54,6 +54,7 @@ enum {
     QLISTTBL_CASEINSENSITIVE = (0x01 << 2), /*!< keys are case insensitive */
     QLISTTBL_INSERTTOP       = (0x01 << 3), /*!< insert new key at the top */
     QLISTTBL_LOOKUPFORWARD   = (0x01 << 4), /*!< find key from the top (default: backward) */
+    QLISTTBL_HASH_XXH64      = (0x01 << 5), /*!< hash keys with xxHash64 */
 };
 
 /* member functions
@@ -136,6 +137,7 @@ struct qlisttbl_s {
     /* private methods */
     bool (*namematch) (qlisttbl_obj_t *obj, const char *name, uint32_t hash);
     int (*namecmp) (const char *s1, const char *s2);
+    uint32_t (*hashfunc) (const void *data, size_t nbytes);
 
     /* private variables - do not access directly */
     bool unique;           /*!< keys are unique */
@@ -51,6 +51,10 @@ enum {
     QSTACK_THREADSAFE = (QLIST_THREADSAFE)  /*!< make it thread-safe */
 };
 
+/* bytes of array storage taken by one element of the given size */
+#define QSTACK_ARRAY_SLOTSIZE(size)                                     \
+    ((((size) + 7) & ~((size_t)7)) + ((sizeof(size_t) + 7) & ~((size_t)7)))
+
 /* member functions
  *
  * All the member functions can be accessed in both ways:
@@ -58,6 +62,7 @@ enum {
  *  - qstack_push(tbl, ...);  // where avoiding pointer overhead is preferred.
  */
 extern qstack_t *qstack(int options);
+extern qstack_t *qstack_array(size_t inlinesize, int options);
 extern size_t qstack_setsize(qstack_t *stack, size_t max);
 
 extern bool qstack_push(qstack_t *stack, const void *data, size_t size);
@@ -106,7 +111,16 @@ struct qstack_s {
     void (*free) (qstack_t *stack);
 
     /* private variables - do not access directly */
-    qlist_t  *list;  /*!< data container */
+    qlist_t  *list;  /*!< data container. NULL in array mode */
+
+    /* private variables for array mode */
+    void *qmutex;         /*!< initialized when QSTACK_THREADSAFE is given */
+    unsigned char *arr;   /*!< contiguous element storage */
+    size_t arrsize;       /*!< allocated bytes of arr */
+    size_t arrused;       /*!< used bytes of arr */
+    size_t num;           /*!< number of elements */
+    size_t max;           /*!< maximum number of elements. 0 means no limit */
+    size_t inlinesize;    /*!< bytes of storage allocated with the object */
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,92 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Asynchronous HTTP client.
+ *
+ * This is a qLibc extension running many HTTP requests concurrently on a
+ * qreactor event loop.
+ *
+ * @file qhttpasync.h
+ */
+
+#ifndef QHTTPASYNC_H
+#define QHTTPASYNC_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qhttpasync_s qhttpasync_t;
+typedef struct qhttpasync_req_s qhttpasync_req_t;
+
+/* public functions */
+extern qhttpasync_t *qhttpasync(qreactor_t *reactor, int maxperhost);
+extern bool qhttpasync_submit(qhttpasync_t *async, const char *destname,
+                              int port, qhttpasync_req_t *req);
+extern int qhttpasync_inflight(qhttpasync_t *async);
+extern void qhttpasync_free(qhttpasync_t *async);
+
+/**
+ * asynchronous request. It must stay valid until ondone() is called.
+ */
+struct qhttpasync_req_s {
+    const char *method;      /*!< request method, GET if NULL */
+    const char *uri;         /*!< URL encoded request URI */
+    qlisttbl_t *reqheaders;  /*!< additional request headers (can be NULL) */
+    const void *data;        /*!< request body (can be NULL) */
+    size_t size;             /*!< request body size */
+    int timeoutms;           /*!< timeout of the whole exchange, -1 for none */
+    bool compression;        /*!< ask for gzip/deflate content and decode it
+                                  before onbody(). needs zlib */
+
+    qlisttbl_t *resheaders;  /*!< response headers storage (can be NULL) */
+
+    /** called with the response code once the headers are read.
+     *  return false to abort. (can be NULL) */
+    bool (*onresponse) (qhttpasync_req_t *req, int rescode);
+    /** called with each piece of the response body as it arrives,
+     *  decompressed if compression is set. return false to abort.
+     *  (can be NULL) */
+    bool (*onbody) (qhttpasync_req_t *req, const void *data, size_t size);
+    /** called once at the end. error is 0 on success, otherwise errno like
+     *  ETIMEDOUT, ECONNRESET or ECANCELED. (can be NULL) */
+    void (*ondone) (qhttpasync_req_t *req, int rescode, int error);
+    void *userdata;          /*!< user data for the callbacks */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QHTTPASYNC_H */
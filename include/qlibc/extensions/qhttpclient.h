@@ -47,6 +47,8 @@ extern "C" {
 
 /* types */
 typedef struct qhttpclient_s  qhttpclient_t;
+typedef struct qhttppool_s  qhttppool_t;
+typedef struct qhttpclient_req_s  qhttpclient_req_t;
 
 /* constants */
 #define QHTTPCLIENT_NAME "qLibc"
@@ -54,6 +56,12 @@ typedef struct qhttpclient_s  qhttpclient_t;
 /* public functions */
 extern qhttpclient_t *qhttpclient(const char *hostname, int port);
 
+extern qhttppool_t *qhttppool(int maxperhost, int idletimeoutms);
+extern qhttpclient_t *qhttppool_get(qhttppool_t *pool, const char *destname,
+                                    int port);
+extern void qhttppool_put(qhttppool_t *pool, qhttpclient_t *client);
+extern void qhttppool_free(qhttppool_t *pool);
+
 /**
  * qhttpclient object structure
  */
@@ -63,6 +71,7 @@ struct qhttpclient_s {
     void (*settimeout) (qhttpclient_t *client, int timeoutms);
     void (*setkeepalive) (qhttpclient_t *client, bool keepalive);
     void (*setuseragent) (qhttpclient_t *client, const char *useragent);
+    bool (*setcompression) (qhttpclient_t *client, bool compression);
 
     bool (*open) (qhttpclient_t *client);
 
@@ -73,6 +82,11 @@ struct qhttpclient_s {
                  qlisttbl_t *reqheaders, qlisttbl_t *resheaders,
                  bool (*callback) (void *userdata, off_t recvbytes),
                  void *userdata);
+    bool (*download) (qhttpclient_t *client, const char *uri, int fd,
+                      int nconns, off_t *savesize, int *rescode,
+                      qlisttbl_t *reqheaders,
+                      bool (*callback) (void *userdata, off_t recvbytes),
+                      void *userdata);
     bool (*put) (qhttpclient_t *client, const char *uri, int fd,
                  off_t length, int *retcode, qlisttbl_t *userheaders,
                  qlisttbl_t *resheaders,
@@ -88,6 +102,8 @@ struct qhttpclient_s {
                          const char *uri, qlisttbl_t *reqheaders);
     int (*readresponse) (qhttpclient_t *client, qlisttbl_t *resheaders,
                          off_t *contentlength);
+    int (*pipeline) (qhttpclient_t *client, qhttpclient_req_t *reqs,
+                     int nreqs);
 
     ssize_t (*gets) (qhttpclient_t *client, char *buf, size_t bufsize);
     ssize_t (*read) (qhttpclient_t *client, void *buf, size_t nbytes);
@@ -102,16 +118,40 @@ struct qhttpclient_s {
     /* private variables - do not access directly */
     int socket;  /*!< socket descriptor */
     void *ssl;   /*!< will be used if SSL has been enabled at compile time */
+    struct qio_reader_s *reader;  /*!< buffered reader of the socket */
+    struct qhttpparser_s *parser; /*!< parser of the last response */
+    char *reqbuf;       /*!< reusable request serialization buffer */
+    size_t reqbufsize;  /*!< allocated size of reqbuf */
 
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;  /*!< address found at construction */
+    socklen_t addrlen;
     char *hostname;
     int port;
 
     int timeoutms;    /*< wait timeout milliseconds*/
     bool keepalive;   /*< keep-alive flag */
     char *useragent;  /*< user-agent name */
+    bool compression; /*< accept and decode gzip/deflate content */
 
     bool connclose;   /*< response keep-alive flag for a last request */
+    bool headreq;     /*< the last request sent was HEAD */
+    void *poolhost;   /*< pool host the client is leased from */
+};
+
+/**
+ * request of qhttpclient->pipeline()
+ */
+struct qhttpclient_req_s {
+    const char *method;      /*!< request method, GET if NULL */
+    const char *uri;         /*!< URL encoded request URI */
+    qlisttbl_t *reqheaders;  /*!< additional request headers (can be NULL) */
+    qlisttbl_t *resheaders;  /*!< response headers storage (can be NULL) */
+
+    /** called in order with the response body, which is NUL terminated or
+     *  NULL if there's no body. return false to stop the batch. */
+    bool (*callback) (qhttpclient_req_t *req, int rescode, void *data,
+                      size_t size);
+    void *userdata;          /*!< user data for the callback */
 };
 
 #ifdef __cplusplus
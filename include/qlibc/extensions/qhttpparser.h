@@ -0,0 +1,141 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Incremental HTTP response parser.
+ *
+ * This is a qLibc extension parsing HTTP/1.x responses fed in pieces.
+ *
+ * @file qhttpparser.h
+ */
+
+#ifndef QHTTPPARSER_H
+#define QHTTPPARSER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qhttpparser_s qhttpparser_t;
+typedef struct qhttpparser_header_s qhttpparser_header_t;
+typedef struct qhttpdecoder_s qhttpdecoder_t;
+
+/* constants */
+#define QHTTPPARSER_MAX_HEADERS (64)
+
+/* public functions */
+enum {
+    QHTTPPARSER_ERROR = -1, /*!< malformed response */
+    QHTTPPARSER_MORE = 0,   /*!< needs more data */
+    QHTTPPARSER_HEAD,       /*!< status line and headers are parsed */
+    QHTTPPARSER_BODY,       /*!< got a piece of the body */
+    QHTTPPARSER_DONE        /*!< end of the response */
+};
+
+/* well-known header tokens */
+enum {
+    QHTTP_HDR_UNKNOWN = 0,
+    QHTTP_HDR_ACCEPT_RANGES,
+    QHTTP_HDR_CONNECTION,
+    QHTTP_HDR_CONTENT_ENCODING,
+    QHTTP_HDR_CONTENT_LENGTH,
+    QHTTP_HDR_CONTENT_RANGE,
+    QHTTP_HDR_CONTENT_TYPE,
+    QHTTP_HDR_ETAG,
+    QHTTP_HDR_KEEP_ALIVE,
+    QHTTP_HDR_LAST_MODIFIED,
+    QHTTP_HDR_LOCATION,
+    QHTTP_HDR_TRANSFER_ENCODING,
+    QHTTP_HDR_MAX
+};
+
+extern void qhttpparser_init(qhttpparser_t *parser, bool nobody);
+extern int qhttpparser_parse(qhttpparser_t *parser, const char *buf,
+                             size_t size, size_t *consumed,
+                             const char **data, size_t *datasize);
+extern int qhttpparser_eof(qhttpparser_t *parser);
+
+extern const qhttpparser_header_t *qhttpparser_header(qhttpparser_t *parser,
+                                                      int token);
+extern const qhttpparser_header_t *qhttpparser_find(qhttpparser_t *parser,
+                                                    const char *name);
+extern bool qhttpparser_copyheaders(qhttpparser_t *parser, qlisttbl_t *tbl);
+
+extern qhttpdecoder_t *qhttpdecoder(qhttpparser_t *parser);
+extern bool qhttpdecoder_decode(qhttpdecoder_t *decoder, const void *data,
+                                size_t size,
+                                bool (*output)(void *userdata,
+                                               const void *data,
+                                               size_t size),
+                                void *userdata);
+extern bool qhttpdecoder_finish(qhttpdecoder_t *decoder);
+extern void qhttpdecoder_free(qhttpdecoder_t *decoder);
+
+/**
+ * header view. points into the parsed buffer, not NUL terminated.
+ */
+struct qhttpparser_header_s {
+    const char *name;   /*!< header name */
+    size_t namelen;     /*!< length of name */
+    const char *value;  /*!< header value without surrounding spaces */
+    size_t valuelen;    /*!< length of value */
+    int token;          /*!< QHTTP_HDR_* or QHTTP_HDR_UNKNOWN */
+};
+
+/**
+ * qhttpparser structure
+ */
+struct qhttpparser_s {
+    int version;            /*!< 10 for HTTP/1.0, 11 for HTTP/1.1 */
+    int status;             /*!< response code */
+    const char *reason;     /*!< reason phrase, not NUL terminated */
+    size_t reasonlen;       /*!< length of reason */
+    qhttpparser_header_t headers[QHTTPPARSER_MAX_HEADERS];
+    int nheaders;           /*!< number of headers */
+    off_t contentlength;    /*!< Content-Length, -1 if not given */
+    bool chunked;           /*!< chunked transfer encoding */
+    bool keepalive;         /*!< connection can be reused afterwards */
+
+    /* private variables - do not access directly */
+    int state;              /*!< parsing state */
+    bool nobody;            /*!< response to HEAD */
+    off_t remain;           /*!< body or chunk bytes left */
+    size_t scanned;         /*!< head bytes searched for the end */
+    signed char index[QHTTP_HDR_MAX];  /*!< header index by token */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QHTTPPARSER_H */
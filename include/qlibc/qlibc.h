@@ -47,6 +47,8 @@
 #include "containers/qgrow.h"
 
 /* utilities */
+#include "utilities/qaio.h"
+#include "utilities/qreactor.h"
 #include "utilities/qcount.h"
 #include "utilities/qencode.h"
 #include "utilities/qfile.h"
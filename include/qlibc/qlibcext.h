@@ -38,7 +38,9 @@
 #include "extensions/qconfig.h"
 #include "extensions/qaconf.h"
 #include "extensions/qlog.h"
+#include "extensions/qhttpparser.h"
 #include "extensions/qhttpclient.h"
+#include "extensions/qhttpasync.h"
 #include "extensions/qdatabase.h"
 #include "extensions/qtokenbucket.h"
 
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * qaio header file.
+ *
+ * @file qaio.h
+ */
+
+#ifndef QAIO_H
+#define QAIO_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qaio_s qaio_t;
+typedef struct qaio_event_s qaio_event_t;
+
+/* public functions */
+enum {
+    QAIO_USE_EPOLL = (0x01)  /*!< use epoll even if io_uring is available */
+};
+
+enum {
+    QAIO_READ = 1,    /*!< read */
+    QAIO_WRITE,       /*!< write */
+    QAIO_ACCEPT,      /*!< accept a connection */
+    QAIO_CONNECT,     /*!< connect */
+    QAIO_SENDFILE     /*!< file to descriptor transfer */
+};
+
+extern qaio_t *qaio(int depth, int options);
+
+extern bool qaio_read(qaio_t *aio, int fd, void *buf, size_t nbytes,
+                      int timeoutms, void *userdata);
+extern bool qaio_write(qaio_t *aio, int fd, const void *buf, size_t nbytes,
+                       int timeoutms, void *userdata);
+extern bool qaio_accept(qaio_t *aio, int fd, int timeoutms, void *userdata);
+extern bool qaio_connect(qaio_t *aio, int fd, const struct sockaddr *addr,
+                         socklen_t addrlen, int timeoutms, void *userdata);
+extern bool qaio_sendfile(qaio_t *aio, int outfd, int infd, off_t offset,
+                          size_t nbytes, int timeoutms, void *userdata);
+
+extern int qaio_submit(qaio_t *aio);
+extern int qaio_reap(qaio_t *aio, qaio_event_t *events, int maxevents,
+                     int timeoutms);
+extern int qaio_inflight(qaio_t *aio);
+extern const char *qaio_backend(qaio_t *aio);
+extern void qaio_free(qaio_t *aio);
+
+/**
+ * qaio completion event
+ */
+struct qaio_event_s {
+    int op;          /*!< operation, one of QAIO_READ, QAIO_WRITE, ... */
+    int fd;          /*!< file descriptor the operation was submitted on */
+    ssize_t result;  /*!< the number of bytes transferred, the accepted
+                          descriptor or 0 for connect. -errno on failure
+                          and -ETIMEDOUT on timeout. */
+    void *userdata;  /*!< user data given at submission */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QAIO_H */
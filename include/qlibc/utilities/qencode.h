@@ -37,20 +37,49 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include "../containers/qlisttbl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qquery_s qquery_t;
+
 extern qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query,
                                   char equalchar, char sepchar, int *count);
+extern int qparse_queries_view(char *query, size_t len, char equalchar,
+                               char sepchar, qquery_t *entries, int maxentries);
 extern char *qurl_encode(const void *bin, size_t size);
 extern size_t qurl_decode(char *str);
 extern char *qbase64_encode(const void *bin, size_t size);
 extern size_t qbase64_decode(char *str);
+extern size_t qbase64_encode_len(size_t size);
+extern size_t qbase64_decode_len(size_t len);
+extern ssize_t qbase64_encode_buf(char *buf, size_t bufsize, const void *bin,
+                                  size_t size);
+extern ssize_t qbase64_decode_buf(void *buf, size_t bufsize, const char *str,
+                                  size_t len);
 extern char *qhex_encode(const void *bin, size_t size);
 extern size_t qhex_decode(char *str);
+extern size_t qhex_encode_len(size_t size);
+extern size_t qhex_decode_len(size_t len);
+extern ssize_t qhex_encode_buf(char *buf, size_t bufsize, const void *bin,
+                               size_t size);
+extern ssize_t qhex_decode_buf(void *buf, size_t bufsize, const char *str,
+                               size_t len);
+
+/**
+ * Query entry returned by qparse_queries_view(). Name and value point into
+ * the parsed buffer and are not terminated by NULL character.
+ */
+struct qquery_s {
+    char *name;         /*!< name of the entry */
+    size_t namelen;     /*!< length of the name */
+    char *value;        /*!< value of the entry */
+    size_t valuelen;    /*!< length of the value */
+};
 
 #ifdef __cplusplus
 }
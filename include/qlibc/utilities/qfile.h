@@ -35,21 +35,46 @@
 #ifndef QFILE_H
 #define QFILE_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qfile_view_s qfile_view_t;
+
+/* qfile_map() access hints */
+enum {
+    QFILE_MAP_SEQUENTIAL = (0x01),  /*!< data will be read in order */
+    QFILE_MAP_RANDOM = (0x02),      /*!< data will be accessed randomly */
+    QFILE_MAP_WILLNEED = (0x04),    /*!< read ahead the whole range now */
+    QFILE_MAP_HUGEPAGE = (0x08)     /*!< back with huge pages if possible */
+};
+
+/* qfile_savev() options */
+enum {
+    QFILE_SAVE_APPEND = (0x01),     /*!< append instead of truncating */
+    QFILE_SAVE_ATOMIC = (0x02),     /*!< write to temp file and rename */
+    QFILE_SAVE_SYNC = (0x04)        /*!< flush to disk before returning */
+};
+
 extern bool qfile_lock(int fd);
 extern bool qfile_unlock(int fd);
 extern bool qfile_exist(const char *filepath);
 extern void *qfile_load(const char *filepath, size_t *nbytes);
 extern void *qfile_read(FILE *fp, size_t *nbytes);
+extern bool qfile_map(qfile_view_t *view, const char *filepath, off_t offset,
+                      size_t nbytes, int options);
+extern void qfile_unmap(qfile_view_t *view);
 extern ssize_t qfile_save(const char *filepath, const void *buf, size_t size,
                           bool append);
+extern ssize_t qfile_savev(const char *filepath, const struct iovec *iov,
+                           int iovcnt, int options);
 extern bool qfile_mkdir(const char *dirpath, mode_t mode, bool recursive);
 
 extern char *qfile_get_name(const char *filepath);
@@ -61,6 +86,19 @@ extern bool qfile_check_path(const char *path);
 extern char *qfile_correct_path(char *path);
 extern char *qfile_abspath(char *buf, size_t bufsize, const char *path);
 
+/**
+ * Read-only file view returned by qfile_map().
+ */
+struct qfile_view_s {
+    const void *data;   /*!< the first byte of the requested range */
+    size_t size;        /*!< the number of bytes in data */
+
+    /* private variables - do not access directly */
+    void *mapaddr;      /*!< mapped address or allocated buffer */
+    size_t mapsize;     /*!< mapped length */
+    bool mapped;        /*!< true if mapaddr is mapped by mmap() */
+};
+
 #ifdef __cplusplus
 }
 #endif
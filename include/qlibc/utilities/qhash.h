@@ -44,15 +44,116 @@
 extern "C" {
 #endif
 
+/* types */
+typedef struct qhashmd5_s qhashmd5_t;
+typedef struct qhashfnv1_32_s qhashfnv1_32_t;
+typedef struct qhashfnv1_64_s qhashfnv1_64_t;
+typedef struct qhashmurmur3_32_s qhashmurmur3_32_t;
+typedef struct qhashmurmur3_128_s qhashmurmur3_128_t;
+typedef struct qhashxxh64_s qhashxxh64_t;
+
 extern bool qhashmd5(const void *data, size_t nbytes, void *retbuf);
 extern bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
                           void *retbuf);
+extern void qhashmd5_init(qhashmd5_t *ctx);
+extern bool qhashmd5_update(qhashmd5_t *ctx, const void *data, size_t nbytes);
+extern bool qhashmd5_final(qhashmd5_t *ctx, void *retbuf);
 
 extern uint32_t qhashfnv1_32(const void *data, size_t nbytes);
+extern void qhashfnv1_32_init(qhashfnv1_32_t *ctx);
+extern bool qhashfnv1_32_update(qhashfnv1_32_t *ctx, const void *data,
+                                size_t nbytes);
+extern uint32_t qhashfnv1_32_final(qhashfnv1_32_t *ctx);
+
 extern uint64_t qhashfnv1_64(const void *data, size_t nbytes);
+extern void qhashfnv1_64_init(qhashfnv1_64_t *ctx);
+extern bool qhashfnv1_64_update(qhashfnv1_64_t *ctx, const void *data,
+                                size_t nbytes);
+extern uint64_t qhashfnv1_64_final(qhashfnv1_64_t *ctx);
 
 extern uint32_t qhashmurmur3_32(const void *data, size_t nbytes);
+extern void qhashmurmur3_32_init(qhashmurmur3_32_t *ctx);
+extern bool qhashmurmur3_32_update(qhashmurmur3_32_t *ctx, const void *data,
+                                   size_t nbytes);
+extern uint32_t qhashmurmur3_32_final(qhashmurmur3_32_t *ctx);
+
 extern bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf);
+extern void qhashmurmur3_128_init(qhashmurmur3_128_t *ctx);
+extern bool qhashmurmur3_128_update(qhashmurmur3_128_t *ctx, const void *data,
+                                    size_t nbytes);
+extern bool qhashmurmur3_128_final(qhashmurmur3_128_t *ctx, void *retbuf);
+
+extern uint64_t qhashxxh64(const void *data, size_t nbytes, uint64_t seed);
+extern bool qhashxxh64_file(const char *filepath, off_t offset, ssize_t nbytes,
+                            uint64_t *retval);
+extern void qhashxxh64_init(qhashxxh64_t *ctx, uint64_t seed);
+extern bool qhashxxh64_update(qhashxxh64_t *ctx, const void *data,
+                              size_t nbytes);
+extern uint64_t qhashxxh64_final(qhashxxh64_t *ctx);
+
+/**
+ * MD5 streaming context
+ */
+struct qhashmd5_s {
+    /* private variables - do not access directly */
+    uint32_t state[4];          /*!< state (ABCD) */
+    uint32_t count[2];          /*!< number of bits, modulo 2^64 */
+    unsigned char buffer[64];   /*!< input buffer */
+};
+
+/**
+ * FNV1 32-bit streaming context
+ */
+struct qhashfnv1_32_s {
+    /* private variables - do not access directly */
+    uint32_t h;         /*!< hash value */
+    bool done;          /*!< NUL byte reached */
+    bool empty;         /*!< no data fed */
+};
+
+/**
+ * FNV1 64-bit streaming context
+ */
+struct qhashfnv1_64_s {
+    /* private variables - do not access directly */
+    uint64_t h;         /*!< hash value */
+    bool done;          /*!< NUL byte reached */
+    bool empty;         /*!< no data fed */
+};
+
+/**
+ * Murmur3 32-bit streaming context
+ */
+struct qhashmurmur3_32_s {
+    /* private variables - do not access directly */
+    uint32_t h;                 /*!< hash value */
+    size_t total;               /*!< total number of bytes fed */
+    unsigned char tail[4];      /*!< bytes of incomplete block */
+    size_t tailsize;            /*!< number of bytes in tail */
+};
+
+/**
+ * Murmur3 128-bit streaming context
+ */
+struct qhashmurmur3_128_s {
+    /* private variables - do not access directly */
+    uint64_t h1, h2;            /*!< hash values */
+    size_t total;               /*!< total number of bytes fed */
+    unsigned char tail[16];     /*!< bytes of incomplete block */
+    size_t tailsize;            /*!< number of bytes in tail */
+};
+
+/**
+ * xxHash64 streaming context
+ */
+struct qhashxxh64_s {
+    /* private variables - do not access directly */
+    uint64_t total;         /*!< total number of bytes fed */
+    uint64_t v[4];          /*!< accumulator lanes */
+    uint64_t seed;          /*!< seed */
+    unsigned char mem[32];  /*!< bytes of incomplete stripe */
+    size_t memsize;         /*!< number of bytes in mem */
+};
 
 #ifdef __cplusplus
 }
@@ -38,21 +38,66 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qio_reader_s qio_reader_t;
+
 extern int qio_wait_readable(int fd, int timeoutms);
 extern int qio_wait_writable(int fd, int timeoutms);
 extern ssize_t qio_read(int fd, void *buf, size_t nbytes, int timeoutms);
 extern ssize_t qio_write(int fd, const void *data, size_t nbytes,
                          int timeoutms);
+extern ssize_t qio_readv(int fd, const struct iovec *iov, int iovcnt,
+                         int timeoutms);
+extern ssize_t qio_writev(int fd, const struct iovec *iov, int iovcnt,
+                          int timeoutms);
+extern int qio_sendmsgs(int fd, const struct iovec *msgs, int msgcnt,
+                        int timeoutms);
+extern int qio_recvmsgs(int fd, struct iovec *msgs, int msgcnt, int timeoutms);
 extern off_t qio_send(int outfd, int infd, off_t nbytes, int timeoutms);
 extern ssize_t qio_gets(int fd, char *buf, size_t bufsize, int timeoutms);
 extern ssize_t qio_puts(int fd, const char *str, int timeoutms);
 extern ssize_t qio_printf(int fd, int timeoutms, const char *format, ...);
 
+extern qio_reader_t *qio_reader(int fd, size_t bufsize);
+extern void qio_reader_setsource(qio_reader_t *reader,
+                                 ssize_t (*readfn)(void *arg, void *buf,
+                                                   size_t nbytes,
+                                                   int timeoutms),
+                                 void *arg);
+extern ssize_t qio_reader_readline(qio_reader_t *reader, char *buf,
+                                   size_t bufsize, int timeoutms);
+extern ssize_t qio_reader_read(qio_reader_t *reader, void *buf, size_t nbytes,
+                               int timeoutms);
+extern ssize_t qio_reader_read_exact(qio_reader_t *reader, void *buf,
+                                     size_t nbytes, int timeoutms);
+extern ssize_t qio_reader_peek(qio_reader_t *reader, const void **data,
+                               size_t nbytes, int timeoutms);
+extern size_t qio_reader_buffered(qio_reader_t *reader);
+extern bool qio_reader_reserve(qio_reader_t *reader, size_t nbytes);
+extern void qio_reader_reset(qio_reader_t *reader, int fd);
+extern void qio_reader_free(qio_reader_t *reader);
+
+/**
+ * qio_reader object structure
+ */
+struct qio_reader_s {
+    /* private variables - do not access directly */
+    int fd;          /*!< file descriptor */
+    ssize_t (*readfn)(void *arg, void *buf, size_t nbytes, int timeoutms);
+    void *arg;       /*!< argument of readfn */
+
+    char *buf;       /*!< read buffer */
+    size_t bufsize;  /*!< size of read buffer */
+    size_t start;    /*!< offset of unread data */
+    size_t end;      /*!< offset next to unread data */
+};
+
 #ifdef __cplusplus
 }
 #endif
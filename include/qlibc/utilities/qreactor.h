@@ -0,0 +1,84 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * qreactor header file.
+ *
+ * @file qreactor.h
+ */
+
+#ifndef QREACTOR_H
+#define QREACTOR_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qreactor_s qreactor_t;
+typedef struct qreactor_timer_s qreactor_timer_t;
+
+typedef void (*qreactor_cb_t)(qreactor_t *reactor, int fd, int events,
+                              void *userdata);
+typedef void (*qreactor_task_t)(qreactor_t *reactor, void *userdata);
+
+/* public functions */
+enum {
+    QREACTOR_READ = (0x01),     /*!< readable or peer closed */
+    QREACTOR_WRITE = (0x02),    /*!< writable */
+    QREACTOR_ERROR = (0x04),    /*!< error or hang up */
+    QREACTOR_TIMEOUT = (0x08)   /*!< no events within the idle timeout */
+};
+
+extern qreactor_t *qreactor(void);
+
+extern bool qreactor_add(qreactor_t *reactor, int fd, int events,
+                         int timeoutms, qreactor_cb_t cb, void *userdata);
+extern bool qreactor_mod(qreactor_t *reactor, int fd, int events,
+                         int timeoutms);
+extern bool qreactor_del(qreactor_t *reactor, int fd);
+
+extern qreactor_timer_t *qreactor_timer(qreactor_t *reactor, int timeoutms,
+                                        qreactor_task_t cb, void *userdata);
+extern bool qreactor_cancel(qreactor_t *reactor, qreactor_timer_t *timer);
+extern bool qreactor_defer(qreactor_t *reactor, qreactor_task_t cb,
+                           void *userdata);
+
+extern int qreactor_run_once(qreactor_t *reactor, int timeoutms);
+extern bool qreactor_run(qreactor_t *reactor);
+extern void qreactor_stop(qreactor_t *reactor);
+extern void qreactor_free(qreactor_t *reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QREACTOR_H */
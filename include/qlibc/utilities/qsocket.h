@@ -37,18 +37,45 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qsocket_addr_s qsocket_addr_t;
+typedef struct qsocket_resolver_s qsocket_resolver_t;
+
+/* public functions */
 extern int qsocket_open(const char *hostname, int port, int timeoutms);
+extern int qsocket_connect(const qsocket_addr_t *addrs, int naddrs,
+                           int timeoutms);
 extern bool qsocket_close(int sockfd, int timeoutms);
 extern bool qsocket_get_addr(struct sockaddr_in *addr, const char *hostname,
                              int port);
 extern char *qsocket_get_localaddr(char *buf, size_t bufsize);
 
+extern int qsocket_resolve(qsocket_addr_t *addrs, int maxaddrs,
+                           const char *hostname, int port);
+extern qsocket_resolver_t *qsocket_resolve_async(const char *hostname,
+                                                 int port);
+extern int qsocket_resolver_fd(qsocket_resolver_t *resolver);
+extern int qsocket_resolver_result(qsocket_resolver_t *resolver,
+                                   qsocket_addr_t *addrs, int maxaddrs);
+extern void qsocket_resolver_free(qsocket_resolver_t *resolver);
+extern void qsocket_resolve_setttl(int ttlsec, int negttlsec);
+extern void qsocket_resolve_flush(void);
+
+/**
+ * qsocket resolved address
+ */
+struct qsocket_addr_s {
+    struct sockaddr_storage addr;  /*!< sockaddr_in or sockaddr_in6 */
+    socklen_t addrlen;             /*!< length of the address */
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,18 +37,24 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "../containers/qlist.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qstrtok_s qstrtok_t;
+
 extern char *qstrtrim(char *str);
 extern char *qstrtrim_head(char *str);
 extern char *qstrtrim_tail(char *str);
 extern char *qstrunchar(char *str, char head, char tail);
 extern char *qstrreplace(const char *mode, char *srcstr, const char *tokstr,
                          const char *word);
+extern char *qstrreplace_multi(const char *srcstr, const char *tokstrs[],
+                               const char *words[], size_t num);
 extern char *qstrcpy(char *dst, size_t size, const char *src);
 extern char *qstrncpy(char *dst, size_t size, const char *src, size_t nbytes);
 extern char *qstrdupf(const char *format, ...);
@@ -63,6 +69,10 @@ extern char *qstrlower(char *str);
 extern char *qstrtok(char *str, const char *delimiters, char *retstop,
                      int *offset);
 extern qlist_t *qstrtokenizer(const char *str, const char *delimiters);
+extern bool qstrtok_init(qstrtok_t *tok, const char *str, size_t len,
+                         const char *delimiters);
+extern bool qstrtok_next(qstrtok_t *tok, const char **token, size_t *toklen,
+                         char *retstop);
 extern char *qstrunique(const char *seed);
 extern char *qstr_comma_number(int number);
 extern bool qstrtest(int (*testfunc)(int), const char *str);
@@ -71,6 +81,19 @@ extern bool qstr_is_ip4addr(const char *str);
 extern char *qstr_conv_encoding(const char *fromstr, const char *fromcode,
                                 const char *tocode, float mag);
 
+/**
+ * String tokenizer used by qstrtok_init() and qstrtok_next().
+ */
+struct qstrtok_s {
+    /* private variables - do not access directly */
+    const char *str;        /*!< source string */
+    size_t len;             /*!< length of source string */
+    size_t offset;          /*!< scan position */
+    uint64_t delimap[4];    /*!< 256-bit delimiter bitmap */
+    int numdel;             /*!< number of delimiters */
+    char firstdel;          /*!< the delimiter when numdel is 1 */
+};
+
 #ifdef __cplusplus
 }
 #endif
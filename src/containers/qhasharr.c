@@ -37,14 +37,23 @@
  *
  * The value part of an element will be stored across several slots if it's size
  * exceeds the slot size. But the key part of an element will be truncated if
- * the size exceeds and it's length and more complex MD5 hash value will be
+ * the size exceeds and it's length and a fingerprint of the whole key will be
  * stored with the key. So to look up a particular key, first we find an element
  * which has same hash value. If the key was not truncated, we just do key
  * comparison. But if the key was truncated because it's length exceeds, we do
- * both md5 and key comparison(only stored size) to verify that the key is same.
- * So please be aware of that, theoretically there is a possibility we pick
- * wrong element in case a key exceeds the limit, has same length and MD5 hash
- * with lookup key. But this possibility is very low and almost zero in practice.
+ * both fingerprint and key comparison(only stored size) to verify that the key
+ * is same. So please be aware of that, theoretically there is a possibility we
+ * pick wrong element in case a key exceeds the limit, has same length and
+ * fingerprint with lookup key. But this possibility is very low and almost zero
+ * in practice.
+ *
+ * The fingerprint type is chosen when the table is created with
+ * qhasharr_keyfp() and recorded in the table header. The default is 64-bit
+ * xxHash64. QHASHARR_KEYFP_FULLKEY stores the rest of a long key in the
+ * linked slots ahead of the value and compares the whole key instead, so there
+ * is no false match at the cost of extra slots. A table can only be attached
+ * by the same table layout, so tables made by different versions can't be
+ * confused.
  *
  * qhasharr hash-table does not provide thread-safe handling intentionally and
  * let users determine whether to provide locking mechanism or not, depending on
@@ -149,6 +158,7 @@
 
 #define COLLISION_MARK    (-1)
 #define EXTBLOCK_MARK     (-2)
+#define QHASHARR_MAGIC    (0x51484132)  /* "QHA2" */
 
 #ifndef _DOXYGEN_SKIP
 
@@ -163,6 +173,11 @@ static bool put_data(qhasharr_t *tbl, int idx, uint32_t hash, const void *name,
 static bool copy_slot(qhasharr_t *tbl, int idx1, int idx2);
 static bool remove_slot(qhasharr_t *tbl, int idx);
 static bool remove_data(qhasharr_t *tbl, int idx);
+static size_t get_keytail(qhasharr_t *tbl, size_t namesize);
+static void get_keyfp(qhasharr_t *tbl, const void *name, size_t namesize,
+                      void *retbuf);
+static bool read_payload(qhasharr_t *tbl, int idx, size_t offset, void *buf,
+                         size_t size, bool compare);
 
 #endif
 
@@ -191,7 +206,8 @@ size_t qhasharr_calculate_memsize(int max) {
  * @return qhasharr_t container pointer, otherwise returns NULL.
  * @retval errno  will be set in error condition.
  *  - EINVAL : Assigned memory is too small. It must bigger enough to allocate
- *  at least 1 slot.
+ *  at least 1 slot. Or existing data is not a table of this layout.
+ *  - ENOMEM : Memory allocation failure.
  *
  * @code
  *  // initialize hash-table with 100 slots.
@@ -204,11 +220,53 @@ size_t qhasharr_calculate_memsize(int max) {
  *  // Use existing table.
  *  qhasharr_t *tbl2 = qhasharr(memory, 0);
  * @endcode
+ *
+ * @note
+ *  New table uses QHASHARR_KEYFP_XXH64 for verifying truncated keys. Existing
+ *  table keeps the fingerprint type recorded when it was created.
  */
 qhasharr_t *qhasharr(void *memory, size_t memsize) {
+    return qhasharr_keyfp(memory, memsize, 0);
+}
+
+/**
+ * Initialize static hash table with a key fingerprint type.
+ *
+ * @param memory    a pointer of data memory.
+ * @param memsize   a size of data memory, 0 for using existing data.
+ * @param keyfp     how keys longer than Q_HASHARR_NAMESIZE are verified.
+ *                  0 uses the default for a new table and accepts any type
+ *                  for an existing table.
+ *
+ * @return qhasharr_t container pointer, otherwise returns NULL.
+ * @retval errno  will be set in error condition.
+ *  - EINVAL : Assigned memory is too small, existing data is not a table of
+ *  this layout, or the recorded fingerprint type differs from keyfp.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  // exact comparison of long keys, no fingerprint at all.
+ *  qhasharr_t *tbl = qhasharr_keyfp(memory, memsize, QHASHARR_KEYFP_FULLKEY);
+ * @endcode
+ *
+ * @note
+ *   Available fingerprint types:
+ *   - QHASHARR_KEYFP_XXH64   - 64-bit xxHash64. (default)
+ *   - QHASHARR_KEYFP_MURMUR3 - 128-bit Murmur3.
+ *   - QHASHARR_KEYFP_MD5     - 128-bit MD5. Slowest.
+ *   - QHASHARR_KEYFP_FULLKEY - stores the remaining part of long keys in the
+ *                              linked slots. Takes more slots but never
+ *                              mismatches.
+ */
+qhasharr_t *qhasharr_keyfp(void *memory, size_t memsize, int keyfp) {
     // Structure memory.
     qhasharr_data_t *tbldata = (qhasharr_data_t *) memory;
 
+    if (keyfp < 0 || keyfp > QHASHARR_KEYFP_FULLKEY) {
+        errno = EINVAL;
+        return NULL;
+    }
+
     // Initialize data if memsize is set or use existing data.
     if (memsize > 0) {
         // calculate max
@@ -221,9 +279,17 @@ qhasharr_t *qhasharr(void *memory, size_t memsize) {
 
         // Set memory.
         memset((void *) tbldata, 0, memsize);
+        tbldata->magic = QHASHARR_MAGIC;
+        tbldata->keyfp = (keyfp > 0) ? keyfp : QHASHARR_KEYFP_XXH64;
         tbldata->maxslots = maxslots;
         tbldata->usedslots = 0;
         tbldata->num = 0;
+    } else if (tbldata->magic != QHASHARR_MAGIC
+            || tbldata->keyfp < QHASHARR_KEYFP_XXH64
+            || tbldata->keyfp > QHASHARR_KEYFP_FULLKEY
+            || (keyfp > 0 && tbldata->keyfp != keyfp)) {
+        errno = EINVAL;
+        return NULL;
     }
 
     // Create the table object.
@@ -688,7 +754,8 @@ bool qhasharr_getnext(qhasharr_t *tbl, qhasharr_obj_t *obj, int *idx) {
         }
 
         size_t namesize = tblslots[*idx].data.pair.namesize;
-        if (namesize > Q_HASHARR_NAMESIZE)
+        size_t keytail = get_keytail(tbl, namesize);
+        if (namesize > Q_HASHARR_NAMESIZE && keytail == 0)
             namesize = Q_HASHARR_NAMESIZE;
 
         obj->name = malloc(namesize + 1);
@@ -696,7 +763,12 @@ bool qhasharr_getnext(qhasharr_t *tbl, qhasharr_obj_t *obj, int *idx) {
             errno = ENOMEM;
             return false;
         }
-        memcpy(obj->name, tblslots[*idx].data.pair.name, namesize);
+        memcpy(obj->name, tblslots[*idx].data.pair.name,
+               namesize - keytail);
+        if (keytail > 0) {
+            read_payload(tbl, *idx, 0, obj->name + Q_HASHARR_NAMESIZE, keytail,
+                         false);
+        }
         memcpy(obj->name + namesize, "", 1); // for truncated case
         obj->namesize = namesize;
 
@@ -795,7 +867,7 @@ bool qhasharr_debug(qhasharr_t *tbl, FILE *out) {
     while (tbl->getnext(tbl, &obj, &idx) == true) {
         uint16_t namesize = tblslots[idx - 1].data.pair.namesize;
         _q_textout(out, obj.name, obj.namesize, MAX_HUMANOUT);
-        fprintf(out, "%s(%d)=", (namesize > Q_HASHARR_NAMESIZE) ? "..." : "",
+        fprintf(out, "%s(%d)=", (namesize > obj.namesize) ? "..." : "",
                 namesize);
         _q_textout(out, obj.data, obj.datasize, MAX_HUMANOUT);
         fprintf(out, " (%zu)\n", obj.datasize);
@@ -898,6 +970,10 @@ static int get_idx(qhasharr_t *tbl, const void *name, size_t namesize,
     qhasharr_slot_t *tblslots = get_slots(tbl);
 
     if (tblslots[hash].count > 0) {
+        // fingerprint is calculated only once when needed.
+        bool fpready = false;
+        uint64_t namefp[2];
+
         int count, idx;
         for (count = 0, idx = hash; count < tblslots[hash].count;) {
             if (tblslots[idx].hash == hash
@@ -914,16 +990,25 @@ static int get_idx(qhasharr_t *tbl, const void *name, size_t namesize,
                                     namesize)) {
                             return idx;
                         }
-                    } else {
-                        // key is truncated, compare MD5 also.
-                        unsigned char namemd5[16];
-                        qhashmd5(name, namesize, namemd5);
-                        if (!memcmp(name, tblslots[idx].data.pair.name,
-                        Q_HASHARR_NAMESIZE)
-                                && !memcmp(namemd5,
-                                           tblslots[idx].data.pair.namemd5,
-                                           16)) {
-                            return idx;
+                    } else if (!memcmp(name, tblslots[idx].data.pair.name,
+                                       Q_HASHARR_NAMESIZE)) {
+                        // key is truncated, verify the rest of it.
+                        if (tbldata->keyfp == QHASHARR_KEYFP_FULLKEY) {
+                            if (read_payload(tbl, idx, 0,
+                                             (void *) name + Q_HASHARR_NAMESIZE,
+                                             namesize - Q_HASHARR_NAMESIZE,
+                                             true)) {
+                                return idx;
+                            }
+                        } else {
+                            if (fpready == false) {
+                                get_keyfp(tbl, name, namesize, namefp);
+                                fpready = true;
+                            }
+                            if (!memcmp(namefp,
+                                        tblslots[idx].data.pair.namefp, 16)) {
+                                return idx;
+                            }
                         }
                     }
                 }
@@ -961,27 +1046,16 @@ static void *get_data(qhasharr_t *tbl, int idx, size_t *size) {
             break;
     }
 
-    void *data, *dp;
+    // skip the rest of the key stored ahead of the value
+    size_t keytail = get_keytail(tbl, tblslots[idx].data.pair.namesize);
+    datasize -= keytail;
+
+    void *data;
     if ((data = malloc(datasize)) == NULL) {
         errno = ENOMEM;
         return NULL;
     }
-
-    for (newidx = idx, dp = data;; newidx = tblslots[newidx].link) {
-        if (tblslots[newidx].count == EXTBLOCK_MARK) {
-            // extended data block
-            memcpy(dp, (void *) tblslots[newidx].data.ext.data,
-                   tblslots[newidx].datasize);
-        } else {
-            // key/value pair data block
-            memcpy(dp, (void *) tblslots[newidx].data.pair.data,
-                   tblslots[newidx].datasize);
-        }
-
-        dp += tblslots[newidx].datasize;
-        if (tblslots[newidx].link == -1)
-            break;
-    }
+    read_payload(tbl, idx, keytail, data, datasize, false);
 
     if (size != NULL)
         *size = datasize;
@@ -996,22 +1070,28 @@ static bool put_data(qhasharr_t *tbl, int idx, uint32_t hash, const void *name,
 
     assert(tblslots[idx].count == 0);
 
-    unsigned char namemd5[16];
-    qhashmd5(name, namesize, namemd5);
+    // fingerprint is needed only for truncated keys
+    uint64_t namefp[2] = {0, 0};
+    size_t keytail = get_keytail(tbl, namesize);
+    if (namesize > Q_HASHARR_NAMESIZE && keytail == 0) {
+        get_keyfp(tbl, name, namesize, namefp);
+    }
 
     // store name
     tblslots[idx].count = count;
     tblslots[idx].hash = hash;
     memcpy(tblslots[idx].data.pair.name, name,
            (namesize < Q_HASHARR_NAMESIZE) ? namesize : Q_HASHARR_NAMESIZE);
-    memcpy((char *) tblslots[idx].data.pair.namemd5, (char *) namemd5, 16);
+    memcpy((char *) tblslots[idx].data.pair.namefp, (char *) namefp, 16);
     tblslots[idx].data.pair.namesize = namesize;
     tblslots[idx].link = -1;
 
-    // store data
+    // store the rest of the key if any, then data
+    const void *keyrest = name + Q_HASHARR_NAMESIZE;
+    size_t totalsize = keytail + datasize;
     int newidx;
     size_t savesize;
-    for (newidx = idx, savesize = 0; savesize < datasize;) {
+    for (newidx = idx, savesize = 0; savesize < totalsize;) {
         if (savesize > 0) {  // find next empty slot
             int tmpidx = find_avail(tbl, newidx + 1);
             if (tmpidx < 0) {
@@ -1033,23 +1113,34 @@ static bool put_data(qhasharr_t *tbl, int idx, uint32_t hash, const void *name,
         }
 
         // copy data
-        size_t copysize = datasize - savesize;
+        size_t copysize = totalsize - savesize;
+        void *dp;
         if (tblslots[newidx].count == EXTBLOCK_MARK) {
             // extended value
             if (copysize > sizeof(struct Q_HASHARR_SLOT_EXT)) {
                 copysize = sizeof(struct Q_HASHARR_SLOT_EXT);
             }
-            memcpy(tblslots[newidx].data.ext.data, data + savesize, copysize);
+            dp = tblslots[newidx].data.ext.data;
         } else {
             // first slot
             if (copysize > Q_HASHARR_DATASIZE) {
                 copysize = Q_HASHARR_DATASIZE;
             }
-            memcpy(tblslots[newidx].data.pair.data, data + savesize, copysize);
+            dp = tblslots[newidx].data.pair.data;
 
             // increase stored key counter
             tbldata->num++;
         }
+        size_t n = 0;
+        if (savesize < keytail) {
+            n = keytail - savesize;
+            if (n > copysize)
+                n = copysize;
+            memcpy(dp, keyrest + savesize, n);
+        }
+        if (n < copysize) {
+            memcpy(dp + n, data + (savesize + n - keytail), copysize - n);
+        }
         tblslots[newidx].datasize = copysize;
         savesize += copysize;
 
@@ -1104,4 +1195,71 @@ static bool remove_data(qhasharr_t *tbl, int idx) {
     return true;
 }
 
+// returns the size of the key part stored in the linked slots.
+static size_t get_keytail(qhasharr_t *tbl, size_t namesize) {
+    if (tbl->data->keyfp != QHASHARR_KEYFP_FULLKEY
+            || namesize <= Q_HASHARR_NAMESIZE) {
+        return 0;
+    }
+    return namesize - Q_HASHARR_NAMESIZE;
+}
+
+// retbuf must be at least 16 bytes long.
+static void get_keyfp(qhasharr_t *tbl, const void *name, size_t namesize,
+                      void *retbuf) {
+    memset(retbuf, 0, 16);
+    switch (tbl->data->keyfp) {
+        case QHASHARR_KEYFP_XXH64: {
+            uint64_t h = qhashxxh64(name, namesize, 0);
+            memcpy(retbuf, &h, sizeof(h));
+            break;
+        }
+        case QHASHARR_KEYFP_MURMUR3:
+            qhashmurmur3_128(name, namesize, retbuf);
+            break;
+        case QHASHARR_KEYFP_MD5:
+            qhashmd5(name, namesize, retbuf);
+            break;
+    }
+}
+
+// copies or compares the bytes stored in the slot chain starting at idx.
+static bool read_payload(qhasharr_t *tbl, int idx, size_t offset, void *buf,
+                         size_t size, bool compare) {
+    qhasharr_slot_t *tblslots = get_slots(tbl);
+
+    int newidx;
+    for (newidx = idx; size > 0; newidx = tblslots[newidx].link) {
+        if (newidx == -1) {
+            return false;
+        }
+
+        size_t slotsize = tblslots[newidx].datasize;
+        if (offset >= slotsize) {
+            offset -= slotsize;
+            continue;
+        }
+
+        void *sp = (tblslots[newidx].count == EXTBLOCK_MARK) ?
+                (void *) tblslots[newidx].data.ext.data :
+                (void *) tblslots[newidx].data.pair.data;
+        size_t n = slotsize - offset;
+        if (n > size)
+            n = size;
+        if (compare == true) {
+            if (memcmp(buf, sp + offset, n)) {
+                return false;
+            }
+        } else {
+            memcpy(buf, sp + offset, n);
+        }
+
+        buf += n;
+        size -= n;
+        offset = 0;
+    }
+
+    return true;
+}
+
 #endif /* _DOXYGEN_SKIP */
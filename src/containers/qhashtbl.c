@@ -123,6 +123,8 @@
  *   In practice, pick a value between (total keys / 3) ~ (total keys * 2).
  *   Available options:
  *   - QHASHTBL_THREADSAFE - make it thread-safe.
+ *   - QHASHTBL_HASH_XXH64 - hash keys with xxHash64 instead of Murmur3.
+ *                           Faster on long keys.
  */
 qhashtbl_t *qhashtbl(size_t range, int options) {
     if (range == 0) {
@@ -168,6 +170,10 @@ qhashtbl_t *qhashtbl(size_t range, int options) {
 
     tbl->free = qhashtbl_free;
 
+    // assign private methods.
+    tbl->hashfunc = (options & QHASHTBL_HASH_XXH64) ?
+            _q_hashxxh64_32 : qhashmurmur3_32;
+
     // set table range.
     tbl->range = range;
 
@@ -203,7 +209,7 @@ bool qhashtbl_put(qhashtbl_t *tbl, const char *name, const void *data,
     }
 
     // get hash integer
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
+    uint32_t hash = tbl->hashfunc(name, strlen(name));
     int idx = hash % tbl->range;
 
     qhashtbl_lock(tbl);
@@ -366,7 +372,7 @@ void *qhashtbl_get(qhashtbl_t *tbl, const char *name, size_t *size, bool newmem)
         return NULL;
     }
 
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
+    uint32_t hash = tbl->hashfunc(name, strlen(name));
     int idx = hash % tbl->range;
 
     qhashtbl_lock(tbl);
@@ -466,7 +472,7 @@ bool qhashtbl_remove(qhashtbl_t *tbl, const char *name) {
 
     qhashtbl_lock(tbl);
 
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
+    uint32_t hash = tbl->hashfunc(name, strlen(name));
     int idx = hash % tbl->range;
 
     // find key
@@ -146,6 +146,7 @@ static bool namecasematch(qlisttbl_obj_t *obj, const char *name, uint32_t hash);
  *   - QLISTTBL_CASEINSENSITIVE  - key is case insensitive
  *   - QLISTTBL_INSERTTOP        - insert new key at the top
  *   - QLISTTBL_LOOKUPFORWARD    - find key from the top
+ *   - QLISTTBL_HASH_XXH64       - hash keys with xxHash64 instead of Murmur3
  */
 qlisttbl_t *qlisttbl(int options)
 {
@@ -189,6 +190,7 @@ qlisttbl_t *qlisttbl(int options)
     // assign private methods.
     tbl->namematch  = namematch;
     tbl->namecmp    = strcmp;
+    tbl->hashfunc   = qhashmurmur3_32;
 
     // handle options.
     if (options & QLISTTBL_THREADSAFE) {
@@ -212,6 +214,9 @@ qlisttbl_t *qlisttbl(int options)
     if (options & QLISTTBL_LOOKUPFORWARD) {
       tbl->lookupforward = true;
     }
+    if (options & QLISTTBL_HASH_XXH64) {
+        tbl->hashfunc = _q_hashxxh64_32;
+    }
 
     return tbl;
 }
@@ -748,7 +753,7 @@ bool qlisttbl_getnext(qlisttbl_t *tbl, qlisttbl_obj_t *obj, const char *name,
         return false;
     }
 
-    uint32_t hash = (name != NULL) ? qhashmurmur3_32(name, strlen(name)) : 0;
+    uint32_t hash = (name != NULL) ? tbl->hashfunc(name, strlen(name)) : 0;
 
     bool ret = false;
     while (cont != NULL) {
@@ -1081,7 +1086,7 @@ static qlisttbl_obj_t *newobj(const char *name, const void *data, size_t size)
 static bool insertobj(qlisttbl_t *tbl, qlisttbl_obj_t *obj)
 {
     // update hash
-    obj->hash = qhashmurmur3_32(obj->name, strlen(obj->name));
+    obj->hash = tbl->hashfunc(obj->name, strlen(obj->name));
 
     qlisttbl_obj_t *prev = obj->prev;
     qlisttbl_obj_t *next = obj->next;
@@ -1110,7 +1115,7 @@ static qlisttbl_obj_t *findobj(qlisttbl_t *tbl, const char *name, qlisttbl_obj_t
         return NULL;
     }
 
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
+    uint32_t hash = tbl->hashfunc(name, strlen(name));
     qlisttbl_obj_t *obj = (tbl->lookupforward) ? tbl->first : tbl->last;
     while (obj != NULL) {
         // name string will be compared only if the hash matches.
@@ -99,6 +99,23 @@
  *  pop(): B object
  *  pop(): A object
  * @endcode
+ *
+ * qstack_array() creates a stack which keeps its elements in one contiguous
+ * buffer instead of a linked-list. The buffer grows geometrically and is
+ * reused after pops, so pushing and popping don't hit the memory allocator
+ * once the stack has reached its working size. pushint(), popint() and
+ * getint() never allocate memory in this mode. An optional inline storage
+ * is allocated together with the stack object so small stacks don't need an
+ * extra allocation at all.
+ *
+ * @code
+ *  // inline storage for the first 64 integers
+ *  qstack_t *stack = qstack_array(64 * QSTACK_ARRAY_SLOTSIZE(sizeof(int64_t)),
+ *                                 0);
+ *  stack->pushint(stack, 1);
+ *  printf("popint(): %d\n", (int)stack->popint(stack));
+ *  stack->free(stack);
+ * @endcode
  */
 
 #include <stdio.h>
@@ -109,6 +126,23 @@
 #include "qinternal.h"
 #include "containers/qstack.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define ARR_ALIGN(s)        (((s) + 7) & ~((size_t)7))
+#define ARR_TRAILER         ARR_ALIGN(sizeof(size_t))
+#define ARR_MINSIZE         (256)
+#define IS_ARRAY(s)         ((s)->list == NULL)
+
+static void qstack_setmethods(qstack_t *stack);
+static void arr_lock(qstack_t *stack);
+static void arr_unlock(qstack_t *stack);
+static bool arr_push(qstack_t *stack, const void *data, size_t size);
+static void *arr_get_at(qstack_t *stack, int index, size_t *size, bool newmem,
+                        bool remove);
+static bool arr_getint(qstack_t *stack, int64_t *num, bool remove);
+
+#endif
+
 /**
  * Create a new stack container
  *
@@ -141,6 +175,67 @@ qstack_t *qstack(int options) {
     }
 
     // methods
+    qstack_setmethods(stack);
+
+    return stack;
+}
+
+/**
+ * Create a new stack container which keeps elements in a contiguous array.
+ *
+ * @param inlinesize    bytes of storage to allocate together with the stack
+ *                      object. 0 means the storage is allocated on the first
+ *                      push.
+ * @param options       combination of initialization options.
+ *
+ * @return a pointer of malloced qstack_t container, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *   // room for the first 32 elements of up to 16 bytes without reallocation
+ *   qstack_t *stack = qstack_array(32 * QSTACK_ARRAY_SLOTSIZE(16), 0);
+ * @endcode
+ *
+ * @note
+ *   Available options:
+ *   - QSTACK_THREADSAFE - make it thread-safe.
+ *
+ *   A pointer returned by get() or getat() with newmem false points into
+ *   the array and is valid only until the next push.
+ */
+qstack_t *qstack_array(size_t inlinesize, int options) {
+    inlinesize = ARR_ALIGN(inlinesize);
+    qstack_t *stack = (qstack_t *) calloc(1, sizeof(qstack_t) + inlinesize);
+    if (stack == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (options & QSTACK_THREADSAFE) {
+        Q_MUTEX_NEW(stack->qmutex, true);
+        if (stack->qmutex == NULL) {
+            errno = ENOMEM;
+            free(stack);
+            return NULL;
+        }
+    }
+
+    if (inlinesize > 0) {
+        stack->arr = (unsigned char *) (stack + 1);
+        stack->arrsize = inlinesize;
+    }
+    stack->inlinesize = inlinesize;
+
+    // methods
+    qstack_setmethods(stack);
+
+    return stack;
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static void qstack_setmethods(qstack_t *stack) {
     stack->setsize = qstack_setsize;
 
     stack->push = qstack_push;
@@ -161,10 +256,10 @@ qstack_t *qstack(int options) {
     stack->clear = qstack_clear;
     stack->debug = qstack_debug;
     stack->free = qstack_free;
-
-    return stack;
 }
 
+#endif
+
 /**
  * qstack->setsize(): Sets maximum number of elements allowed in this
  * stack.
@@ -175,6 +270,13 @@ qstack_t *qstack(int options) {
  * @return previous maximum number.
  */
 size_t qstack_setsize(qstack_t *stack, size_t max) {
+    if (IS_ARRAY(stack)) {
+        arr_lock(stack);
+        size_t old = stack->max;
+        stack->max = max;
+        arr_unlock(stack);
+        return old;
+    }
     return stack->list->setsize(stack->list, max);
 }
 
@@ -193,6 +295,9 @@ size_t qstack_setsize(qstack_t *stack, size_t max) {
  *  - ENOMEM    : Memory allocation failure.
  */
 bool qstack_push(qstack_t *stack, const void *data, size_t size) {
+    if (IS_ARRAY(stack)) {
+        return arr_push(stack, data, size);
+    }
     return stack->list->addfirst(stack->list, data, size);
 }
 
@@ -215,6 +320,9 @@ bool qstack_pushstr(qstack_t *stack, const char *str) {
         errno = EINVAL;
         return false;
     }
+    if (IS_ARRAY(stack)) {
+        return arr_push(stack, str, strlen(str) + 1);
+    }
     return stack->list->addfirst(stack->list, str, strlen(str) + 1);
 }
 
@@ -231,6 +339,9 @@ bool qstack_pushstr(qstack_t *stack, const char *str) {
  *  - ENOMEM    : Memory allocation failure.
  */
 bool qstack_pushint(qstack_t *stack, int64_t num) {
+    if (IS_ARRAY(stack)) {
+        return arr_push(stack, &num, sizeof(num));
+    }
     return stack->list->addfirst(stack->list, &num, sizeof(num));
 }
 
@@ -247,6 +358,9 @@ bool qstack_pushint(qstack_t *stack, int64_t num) {
  *  - ENOMEM    : Memory allocation failure.
  */
 void *qstack_pop(qstack_t *stack, size_t *size) {
+    if (IS_ARRAY(stack)) {
+        return arr_get_at(stack, 0, size, true, true);
+    }
     return stack->list->popfirst(stack->list, size);
 }
 
@@ -266,7 +380,9 @@ void *qstack_pop(qstack_t *stack, size_t *size) {
  */
 char *qstack_popstr(qstack_t *stack) {
     size_t strsize;
-    char *str = stack->list->popfirst(stack->list, &strsize);
+    char *str = (IS_ARRAY(stack)) ?
+            arr_get_at(stack, 0, &strsize, true, true) :
+            stack->list->popfirst(stack->list, &strsize);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -290,6 +406,11 @@ char *qstack_popstr(qstack_t *stack) {
  */
 int64_t qstack_popint(qstack_t *stack) {
     int64_t num = 0;
+    if (IS_ARRAY(stack)) {
+        arr_getint(stack, &num, true);
+        return num;
+    }
+
     int64_t *pnum = stack->list->popfirst(stack->list, NULL);
     if (pnum != NULL) {
         num = *pnum;
@@ -318,6 +439,9 @@ int64_t qstack_popint(qstack_t *stack) {
  *  at very first time.
  */
 void *qstack_popat(qstack_t *stack, int index, size_t *size) {
+    if (IS_ARRAY(stack)) {
+        return arr_get_at(stack, index, size, true, true);
+    }
     return stack->list->popat(stack->list, index, size);
 }
 
@@ -335,6 +459,9 @@ void *qstack_popat(qstack_t *stack, int index, size_t *size) {
  * @return a pointer of malloced element, otherwise returns NULL.
  */
 void *qstack_get(qstack_t *stack, size_t *size, bool newmem) {
+    if (IS_ARRAY(stack)) {
+        return arr_get_at(stack, 0, size, newmem, false);
+    }
     return stack->list->getfirst(stack->list, size, newmem);
 }
 
@@ -354,7 +481,9 @@ void *qstack_get(qstack_t *stack, size_t *size, bool newmem) {
  */
 char *qstack_getstr(qstack_t *stack) {
     size_t strsize;
-    char *str = stack->list->getfirst(stack->list, &strsize, true);
+    char *str = (IS_ARRAY(stack)) ?
+            arr_get_at(stack, 0, &strsize, true, false) :
+            stack->list->getfirst(stack->list, &strsize, true);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -378,6 +507,11 @@ char *qstack_getstr(qstack_t *stack) {
  */
 int64_t qstack_getint(qstack_t *stack) {
     int64_t num = 0;
+    if (IS_ARRAY(stack)) {
+        arr_getint(stack, &num, false);
+        return num;
+    }
+
     int64_t *pnum = stack->list->getfirst(stack->list, NULL, true);
     if (pnum != NULL) {
         num = *pnum;
@@ -407,6 +541,9 @@ int64_t qstack_getint(qstack_t *stack) {
  * very first time.
  */
 void *qstack_getat(qstack_t *stack, int index, size_t *size, bool newmem) {
+    if (IS_ARRAY(stack)) {
+        return arr_get_at(stack, index, size, newmem, false);
+    }
     return stack->list->getat(stack->list, index, size, newmem);
 }
 
@@ -418,6 +555,9 @@ void *qstack_getat(qstack_t *stack, int index, size_t *size, bool newmem) {
  * @return the number of elements in this stack.
  */
 size_t qstack_size(qstack_t *stack) {
+    if (IS_ARRAY(stack)) {
+        return stack->num;
+    }
     return stack->list->size(stack->list);
 }
 
@@ -427,6 +567,13 @@ size_t qstack_size(qstack_t *stack) {
  * @param stack qstack container pointer.
  */
 void qstack_clear(qstack_t *stack) {
+    if (IS_ARRAY(stack)) {
+        arr_lock(stack);
+        stack->arrused = 0;
+        stack->num = 0;
+        arr_unlock(stack);
+        return;
+    }
     stack->list->clear(stack->list);
 }
 
@@ -439,6 +586,26 @@ void qstack_clear(qstack_t *stack) {
  * @return true if successful, otherwise returns false.
  */
 bool qstack_debug(qstack_t *stack, FILE *out) {
+    if (IS_ARRAY(stack)) {
+        if (out == NULL) {
+            errno = EIO;
+            return false;
+        }
+
+        arr_lock(stack);
+        size_t end = stack->arrused;
+        int i;
+        for (i = 0; end > 0; i++) {
+            size_t size;
+            memcpy(&size, stack->arr + end - ARR_TRAILER, sizeof(size_t));
+            end -= ARR_TRAILER + ARR_ALIGN(size);
+            fprintf(out, "%d=", i);
+            _q_textout(out, stack->arr + end, size, MAX_HUMANOUT);
+            fprintf(out, " (%zu)\n", size);
+        }
+        arr_unlock(stack);
+        return true;
+    }
     return stack->list->debug(stack->list, out);
 }
 
@@ -450,6 +617,169 @@ bool qstack_debug(qstack_t *stack, FILE *out) {
  * @return always returns true.
  */
 void qstack_free(qstack_t *stack) {
-    stack->list->free(stack->list);
+    if (IS_ARRAY(stack)) {
+        if (stack->arr != (unsigned char *) (stack + 1)) {
+            free(stack->arr);
+        }
+        Q_MUTEX_DESTROY(stack->qmutex);
+    } else {
+        stack->list->free(stack->list);
+    }
     free(stack);
 }
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Array storage layout. Each element is stored as its data padded to 8 bytes
+ * followed by a trailer which holds the data size, so the top element can be
+ * located from the end of the used area.
+ *
+ *   bottom                                          top
+ *   [ data A | size A ][ data B | size B ][ data C | size C ]
+ *                                                         ^ arrused
+ */
+static void arr_lock(qstack_t *stack) {
+    Q_MUTEX_ENTER(stack->qmutex);
+}
+
+static void arr_unlock(qstack_t *stack) {
+    Q_MUTEX_LEAVE(stack->qmutex);
+}
+
+static bool arr_push(qstack_t *stack, const void *data, size_t size) {
+    if (data == NULL || size <= 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    arr_lock(stack);
+
+    // check maximum number of allowed elements if set
+    if (stack->max > 0 && stack->num >= stack->max) {
+        errno = ENOBUFS;
+        arr_unlock(stack);
+        return false;
+    }
+
+    // grow geometrically
+    size_t need = stack->arrused + ARR_ALIGN(size) + ARR_TRAILER;
+    if (need > stack->arrsize) {
+        size_t newsize = (stack->arrsize < ARR_MINSIZE) ?
+                ARR_MINSIZE : stack->arrsize * 2;
+        while (newsize < need) {
+            newsize *= 2;
+        }
+
+        unsigned char *newarr;
+        if (stack->arr == NULL || stack->arr == (unsigned char *) (stack + 1)) {
+            newarr = (unsigned char *) malloc(newsize);
+            if (newarr != NULL && stack->arrused > 0) {
+                memcpy(newarr, stack->arr, stack->arrused);
+            }
+        } else {
+            newarr = (unsigned char *) realloc(stack->arr, newsize);
+        }
+        if (newarr == NULL) {
+            errno = ENOMEM;
+            arr_unlock(stack);
+            return false;
+        }
+        stack->arr = newarr;
+        stack->arrsize = newsize;
+    }
+
+    unsigned char *p = stack->arr + stack->arrused;
+    memcpy(p, data, size);
+    memcpy(p + ARR_ALIGN(size), &size, sizeof(size_t));
+    stack->arrused = need;
+    stack->num++;
+
+    arr_unlock(stack);
+    return true;
+}
+
+static void *arr_get_at(qstack_t *stack, int index, size_t *size, bool newmem,
+                        bool remove) {
+    arr_lock(stack);
+
+    // index adjustment
+    if (index < 0) {
+        index = stack->num + index;
+    }
+    if (stack->num == 0) {
+        errno = ENOENT;
+        arr_unlock(stack);
+        return NULL;
+    }
+    if (index < 0 || index >= stack->num) {
+        errno = ERANGE;
+        arr_unlock(stack);
+        return NULL;
+    }
+
+    // walk down from the top
+    size_t end = stack->arrused, start, objsize;
+    int i;
+    for (i = 0;; i++) {
+        memcpy(&objsize, stack->arr + end - ARR_TRAILER, sizeof(size_t));
+        start = end - ARR_TRAILER - ARR_ALIGN(objsize);
+        if (i == index) {
+            break;
+        }
+        end = start;
+    }
+
+    void *data;
+    if (newmem == true) {
+        data = malloc(objsize);
+        if (data == NULL) {
+            errno = ENOMEM;
+            arr_unlock(stack);
+            return NULL;
+        }
+        memcpy(data, stack->arr + start, objsize);
+    } else {
+        data = stack->arr + start;
+    }
+    if (size != NULL) {
+        *size = objsize;
+    }
+
+    if (remove == true) {
+        if (end < stack->arrused) {
+            memmove(stack->arr + start, stack->arr + end,
+                    stack->arrused - end);
+        }
+        stack->arrused -= end - start;
+        stack->num--;
+    }
+
+    arr_unlock(stack);
+    return data;
+}
+
+static bool arr_getint(qstack_t *stack, int64_t *num, bool remove) {
+    arr_lock(stack);
+
+    if (stack->num == 0) {
+        errno = ENOENT;
+        arr_unlock(stack);
+        return false;
+    }
+
+    size_t size;
+    memcpy(&size, stack->arr + stack->arrused - ARR_TRAILER, sizeof(size_t));
+    size_t start = stack->arrused - ARR_TRAILER - ARR_ALIGN(size);
+    memcpy(num, stack->arr + start,
+           (size < sizeof(int64_t)) ? size : sizeof(int64_t));
+    if (remove == true) {
+        stack->arrused = start;
+        stack->num--;
+    }
+
+    arr_unlock(stack);
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
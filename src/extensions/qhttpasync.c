@@ -0,0 +1,1028 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qhttpasync.c Asynchronous HTTP client.
+ *
+ * qhttpasync runs HTTP requests on a qreactor event loop with non-blocking
+ * sockets, so a single thread can keep thousands of requests in flight.
+ * Each request has its own timeout and gets its response body streamed to
+ * a callback as it arrives. Keep-alive connections are reused per host and
+ * the number of connections to a host can be capped, in which case extra
+ * requests wait in order.
+ *
+ * @code
+ *   bool onbody(qhttpasync_req_t *req, const void *data, size_t size) {
+ *     fwrite(data, 1, size, (FILE *) req->userdata);
+ *     return true;
+ *   }
+ *
+ *   void ondone(qhttpasync_req_t *req, int rescode, int error) {
+ *     printf("%s: %d (%s)\n", req->uri, rescode, strerror(error));
+ *   }
+ *
+ *   qreactor_t *reactor = qreactor();
+ *   qhttpasync_t *async = qhttpasync(reactor, 8);
+ *
+ *   qhttpasync_req_t reqs[1000];
+ *   memset(reqs, 0, sizeof(reqs));
+ *   for (i = 0; i < 1000; i++) {
+ *     reqs[i].uri = uris[i];
+ *     reqs[i].timeoutms = 5000;
+ *     reqs[i].onbody = onbody;
+ *     reqs[i].ondone = ondone;
+ *     reqs[i].userdata = stdout;
+ *     qhttpasync_submit(async, "http://www.qdecoder.org", 0, &reqs[i]);
+ *   }
+ *   while (qhttpasync_inflight(async) > 0) {
+ *     qreactor_run_once(reactor, -1);
+ *   }
+ *
+ *   qhttpasync_free(async);
+ *   qreactor_free(reactor);
+ * @endcode
+ *
+ * @note
+ *  Only plain HTTP is supported. qhttpasync must be used by the thread
+ *  running the reactor and freed before the reactor. Idle keep-alive
+ *  connections stay registered on the reactor for up to 30 seconds, so
+ *  qreactor_run() returns only after they're closed.
+ */
+
+#ifndef DISABLE_QHTTPCLIENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "qinternal.h"
+#include "utilities/qstring.h"
+#include "utilities/qsocket.h"
+#include "utilities/qreactor.h"
+#include "containers/qlisttbl.h"
+#include "containers/qgrow.h"
+#include "extensions/qhttpparser.h"
+#include "extensions/qhttpclient.h"
+#include "extensions/qhttpasync.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define DEF_IDLE_TIMEOUT    (30 * 1000)  /*< idle connection lifetime */
+#define DEF_READ_SIZE       (16 * 1024)  /*< receive buffer growth */
+#define MAX_HEAD_SIZE       (64 * 1024)  /*< maximum response head size */
+#define MAX_HOST_ADDRS      (8)          /*< addresses kept per host */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL        (0)
+#endif
+
+/* connection states */
+enum {
+    CONN_CONNECTING = 0,
+    CONN_WRITING,
+    CONN_READING,
+    CONN_IDLE
+};
+
+typedef struct ahost_s ahost_t;
+typedef struct aconn_s aconn_t;
+typedef struct areq_s areq_t;
+
+struct areq_s {
+    qhttpasync_t *async;
+    qhttpasync_req_t *req;
+    ahost_t *host;
+    aconn_t *conn;              /* NULL while waiting for a connection */
+    qreactor_timer_t *timer;
+    bool retried;
+    areq_t *next;
+};
+
+struct aconn_s {
+    qhttpasync_t *async;
+    ahost_t *host;
+    int fd;
+    int state;
+    int addrindex;              /* address of the host connected to */
+    bool reused;                /* served a request before */
+    areq_t *areq;
+
+    char *out;                  /* serialized request */
+    size_t outlen, outoff;
+    char *in;                   /* received, not yet parsed */
+    size_t insize, inlen;
+    bool received;              /* got any response bytes */
+
+    qhttpparser_t parser;       /* response parser */
+    qhttpdecoder_t *decoder;    /* content decoder, NULL if not encoded */
+    bool gothead;
+    int rescode;
+    bool connclose;
+
+    aconn_t *prev, *next;       /* all connections */
+    aconn_t *idlenext;          /* idle connections of the host */
+};
+
+struct ahost_s {
+    qhttpasync_t *async;
+    char *hostname;
+    int port;
+    qsocket_addr_t addrs[MAX_HOST_ADDRS];
+    int naddrs;                 /* 0 until resolved */
+    int addrindex;              /* address new connections go to */
+    qsocket_resolver_t *resolver;   /* resolving, NULL otherwise */
+    qreactor_timer_t *failtimer;    /* failing the waiting requests */
+    int error;                  /* reason of the failure */
+    int nconns;
+    aconn_t *idle;
+    areq_t *pending, *pendingtail;
+    ahost_t *next;
+};
+
+struct qhttpasync_s {
+    qreactor_t *reactor;
+    int maxperhost;
+    int inflight;
+    ahost_t *hosts;
+    aconn_t *conns;
+};
+
+static ahost_t *host_get(qhttpasync_t *async, const char *hostname,
+                         int port);
+static void host_dispatch(qhttpasync_t *async, ahost_t *host);
+static int host_resolve(qhttpasync_t *async, ahost_t *host);
+static void host_resolved(qreactor_t *reactor, int fd, int events,
+                          void *userdata);
+static bool host_next(ahost_t *host, int addrindex);
+static void host_requeue(ahost_t *host, areq_t *areq);
+static void host_fail_later(qhttpasync_t *async, ahost_t *host, int error);
+static void host_fail(qreactor_t *reactor, void *userdata);
+static aconn_t *conn_open(qhttpasync_t *async, ahost_t *host);
+static bool conn_alive(aconn_t *conn);
+static void conn_start(aconn_t *conn, areq_t *areq);
+static void conn_event(qreactor_t *reactor, int fd, int events,
+                       void *userdata);
+static void conn_write(aconn_t *conn);
+static void conn_read(aconn_t *conn);
+static int conn_parse(aconn_t *conn);
+static bool conn_output(void *userdata, const void *data, size_t size);
+static void conn_reset_decoder(aconn_t *conn);
+static void conn_consume(aconn_t *conn, size_t nbytes);
+static void conn_done(aconn_t *conn);
+static void conn_fail(aconn_t *conn, int error);
+static void conn_close(aconn_t *conn);
+static void req_finish(qhttpasync_t *async, areq_t *areq, int rescode,
+                       int error);
+static void req_timeout(qreactor_t *reactor, void *userdata);
+static const char *req_method(qhttpasync_req_t *req);
+
+#endif /* _DOXYGEN_SKIP */
+
+/**
+ * Create an asynchronous HTTP client on a reactor.
+ *
+ * @param reactor       qreactor_t object pointer
+ * @param maxperhost    maximum connections per host. 0 for no limit.
+ *
+ * @return a pointer of qhttpasync_t object if successful, otherwise returns
+ *         NULL.
+ */
+qhttpasync_t *qhttpasync(qreactor_t *reactor, int maxperhost) {
+    if (reactor == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qhttpasync_t *async = (qhttpasync_t *) calloc(1, sizeof(qhttpasync_t));
+    if (async == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    async->reactor = reactor;
+    async->maxperhost = (maxperhost > 0) ? maxperhost : 0;
+
+    return async;
+}
+
+/**
+ * Submit a request. It's started right away if a connection is available,
+ * otherwise it waits for one. The outcome is reported through the callbacks
+ * of the request while the reactor runs.
+ *
+ * @param async     qhttpasync_t object pointer
+ * @param destname  remote address, one of IP address, FQDN domain name and
+ *                  "http://" URI.
+ * @param port      remote port number. (can be 0 when destname is URI)
+ * @param req       request. must stay valid until ondone() is called.
+ *
+ * @return true if submitted, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EPROTONOSUPPORT : Not a "http://" URI.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Host names are resolved in the background with qsocket_resolve_async()
+ *  and failures are reported to ondone() from the reactor, never before this
+ *  returns, even when the failure is known right away. New connections go
+ *  to the address which worked last. When connecting fails, the request
+ *  moves on to the next address, and once all of them failed the host is
+ *  resolved again, so address changes are followed. The callbacks may
+ *  submit new requests. A request on a reused connection which fails before
+ *  any response is retried once on a new connection if its method is
+ *  idempotent.
+ */
+bool qhttpasync_submit(qhttpasync_t *async, const char *destname, int port,
+                       qhttpasync_req_t *req) {
+    if (async == NULL || destname == NULL || req == NULL || req->uri == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // parse destination
+    char hostname[256];
+    if (port == 0 || strstr(destname, "://") != NULL) {
+        if (strncasecmp(destname, "http://", CONST_STRLEN("http://"))) {
+            errno = EPROTONOSUPPORT;
+            return false;
+        }
+        const char *t1 = destname + CONST_STRLEN("http://");
+        size_t len = strcspn(t1, "/");
+        if (len + 1 > sizeof(hostname)) {
+            errno = EINVAL;
+            return false;
+        }
+        qstrncpy(hostname, sizeof(hostname), t1, len);
+        port = 80;
+        char *t2 = strchr(hostname, ':');
+        if (t2 != NULL) {
+            *t2 = '\0';
+            port = atoi(t2 + 1);
+        }
+    } else {
+        qstrcpy(hostname, sizeof(hostname), destname);
+    }
+
+    ahost_t *host = host_get(async, hostname, port);
+    if (host == NULL)
+        return false;
+
+    areq_t *areq = (areq_t *) calloc(1, sizeof(areq_t));
+    if (areq == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    areq->async = async;
+    areq->req = req;
+    areq->host = host;
+    if (req->timeoutms >= 0) {
+        areq->timer = qreactor_timer(async->reactor, req->timeoutms,
+                                     req_timeout, areq);
+        if (areq->timer == NULL) {
+            free(areq);
+            return false;
+        }
+    }
+
+    if (host->pendingtail != NULL)
+        host->pendingtail->next = areq;
+    else
+        host->pending = areq;
+    host->pendingtail = areq;
+    async->inflight++;
+
+    host_dispatch(async, host);
+    return true;
+}
+
+/**
+ * Get the number of requests which haven't completed yet.
+ *
+ * @param async     qhttpasync_t object pointer
+ *
+ * @return the number of requests in flight or waiting for a connection.
+ */
+int qhttpasync_inflight(qhttpasync_t *async) {
+    return async->inflight;
+}
+
+/**
+ * De-allocate the client and close its connections. Requests which haven't
+ * completed are dropped without their callbacks.
+ *
+ * @param async     qhttpasync_t object pointer
+ */
+void qhttpasync_free(qhttpasync_t *async) {
+    if (async == NULL)
+        return;
+
+    while (async->conns != NULL) {
+        aconn_t *conn = async->conns;
+        if (conn->areq != NULL) {
+            areq_t *areq = conn->areq;
+            conn->areq = NULL;
+            if (areq->timer != NULL)
+                qreactor_cancel(async->reactor, areq->timer);
+            free(areq);
+        }
+        conn_close(conn);
+    }
+
+    ahost_t *host, *next;
+    for (host = async->hosts; host != NULL; host = next) {
+        next = host->next;
+        while (host->pending != NULL) {
+            areq_t *areq = host->pending;
+            host->pending = areq->next;
+            if (areq->timer != NULL)
+                qreactor_cancel(async->reactor, areq->timer);
+            free(areq);
+        }
+        if (host->resolver != NULL) {
+            qreactor_del(async->reactor, qsocket_resolver_fd(host->resolver));
+            qsocket_resolver_free(host->resolver);
+        }
+        if (host->failtimer != NULL)
+            qreactor_cancel(async->reactor, host->failtimer);
+        free(host->hostname);
+        free(host);
+    }
+
+    free(async);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static ahost_t *host_get(qhttpasync_t *async, const char *hostname,
+                         int port) {
+    ahost_t *host;
+    for (host = async->hosts; host != NULL; host = host->next) {
+        if (host->port == port && !strcmp(host->hostname, hostname))
+            return host;
+    }
+
+    host = (ahost_t *) calloc(1, sizeof(ahost_t));
+    if (host == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    host->hostname = strdup(hostname);
+    if (host->hostname == NULL) {
+        free(host);
+        errno = ENOMEM;
+        return NULL;
+    }
+    host->async = async;
+    host->port = port;
+    host->next = async->hosts;
+    async->hosts = host;
+
+    return host;
+}
+
+// Hand waiting requests to idle or new connections.
+static void host_dispatch(qhttpasync_t *async, ahost_t *host) {
+    if (host->pending == NULL || host->resolver != NULL
+            || host->failtimer != NULL) {
+        return;
+    }
+    if (host->naddrs == 0) {
+        int ret = host_resolve(async, host);
+        if (ret < 0)
+            host_fail_later(async, host, errno);
+        if (ret <= 0)
+            return;
+    }
+
+    while (host->pending != NULL) {
+        aconn_t *conn = host->idle;
+        if (conn != NULL) {
+            host->idle = conn->idlenext;
+            conn->idlenext = NULL;
+            if (conn_alive(conn) == false) {
+                conn_close(conn);
+                continue;
+            }
+        } else if (async->maxperhost == 0
+                || host->nconns < async->maxperhost) {
+            conn = conn_open(async, host);
+            if (conn == NULL) {
+                int error = errno;
+                if (host_next(host, host->addrindex) == true)
+                    continue;
+                host_fail_later(async, host, error);
+                return;
+            }
+        } else {
+            break;
+        }
+
+        areq_t *areq = host->pending;
+        host->pending = areq->next;
+        if (host->pending == NULL)
+            host->pendingtail = NULL;
+        areq->next = NULL;
+        conn_start(conn, areq);
+    }
+}
+
+// Start resolving the host. Returns 1 if resolved right away, 0 if it's in
+// progress or -1 on failure.
+static int host_resolve(qhttpasync_t *async, ahost_t *host) {
+    host->resolver = qsocket_resolve_async(host->hostname, host->port);
+    if (host->resolver == NULL)
+        return -1;
+
+    int fd = qsocket_resolver_fd(host->resolver);
+    int naddrs = qsocket_resolver_result(host->resolver, host->addrs,
+                                         MAX_HOST_ADDRS);
+    if (naddrs < 0 && errno == EINPROGRESS) {
+        if (qreactor_add(async->reactor, fd, QREACTOR_READ, -1,
+                         host_resolved, host) == true) {
+            return 0;
+        }
+        naddrs = -1;
+    }
+
+    int error = errno;
+    qsocket_resolver_free(host->resolver);
+    host->resolver = NULL;
+    if (naddrs < 0) {
+        errno = error;
+        return -1;
+    }
+    host->naddrs = naddrs;
+    host->addrindex = 0;
+    return 1;
+}
+
+static void host_resolved(qreactor_t *reactor, int fd, int events,
+                          void *userdata) {
+    ahost_t *host = (ahost_t *) userdata;
+    int naddrs = qsocket_resolver_result(host->resolver, host->addrs,
+                                         MAX_HOST_ADDRS);
+    if (naddrs < 0 && errno == EINPROGRESS)
+        return;
+    int error = errno;
+
+    qreactor_del(reactor, fd);
+    qsocket_resolver_free(host->resolver);
+    host->resolver = NULL;
+
+    if (naddrs < 0) {
+        host_fail_later(host->async, host, error);
+        return;
+    }
+    host->naddrs = naddrs;
+    host->addrindex = 0;
+    host_dispatch(host->async, host);
+}
+
+// Move on from an address which couldn't be connected to, unless it's been
+// done already. Returns false once all of them failed, then the host will be
+// resolved again.
+static bool host_next(ahost_t *host, int addrindex) {
+    if (host->naddrs == 0)
+        return false;
+    if (addrindex == host->addrindex)
+        host->addrindex++;
+    if (host->addrindex < host->naddrs)
+        return true;
+    host->naddrs = 0;
+    host->addrindex = 0;
+    return false;
+}
+
+// Put a request back at the head of the queue.
+static void host_requeue(ahost_t *host, areq_t *areq) {
+    areq->next = host->pending;
+    host->pending = areq;
+    if (host->pendingtail == NULL)
+        host->pendingtail = areq;
+}
+
+// Fail the waiting requests of a host from the reactor, so ondone() isn't
+// called from within qhttpasync_submit().
+static void host_fail_later(qhttpasync_t *async, ahost_t *host, int error) {
+    if (host->failtimer != NULL)
+        return;
+    host->error = error;
+    host->failtimer = qreactor_timer(async->reactor, 0, host_fail, host);
+    if (host->failtimer == NULL)
+        host_fail(async->reactor, host);
+}
+
+static void host_fail(qreactor_t *reactor, void *userdata) {
+    ahost_t *host = (ahost_t *) userdata;
+    host->failtimer = NULL;  // released by the reactor
+
+    // callbacks may submit to the host again, detach the list first.
+    areq_t *areq = host->pending;
+    host->pending = host->pendingtail = NULL;
+    while (areq != NULL) {
+        areq_t *next = areq->next;
+        req_finish(host->async, areq, 0, host->error);
+        areq = next;
+    }
+}
+
+static aconn_t *conn_open(qhttpasync_t *async, ahost_t *host) {
+    qsocket_addr_t *addr = &host->addrs[host->addrindex];
+    int fd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return NULL;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (connect(fd, (struct sockaddr *) &addr->addr, addr->addrlen) < 0
+            && errno != EINPROGRESS) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    aconn_t *conn = (aconn_t *) calloc(1, sizeof(aconn_t));
+    if (conn == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    conn->async = async;
+    conn->host = host;
+    conn->fd = fd;
+    conn->state = CONN_CONNECTING;
+    conn->addrindex = host->addrindex;
+
+    if (qreactor_add(async->reactor, fd, QREACTOR_READ | QREACTOR_WRITE, -1,
+                     conn_event, conn) == false) {
+        int error = errno;
+        close(fd);
+        free(conn);
+        errno = error;
+        return NULL;
+    }
+
+    conn->next = async->conns;
+    if (async->conns != NULL)
+        async->conns->prev = conn;
+    async->conns = conn;
+    host->nconns++;
+
+    return conn;
+}
+
+// An idle connection closed or half-closed by the peer is readable.
+static bool conn_alive(aconn_t *conn) {
+    char c;
+    ssize_t n = recv(conn->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+static void conn_start(aconn_t *conn, areq_t *areq) {
+    qhttpasync_req_t *req = areq->req;
+    conn->areq = areq;
+    areq->conn = conn;
+
+    // reset response state
+    conn->received = false;
+    conn->gothead = false;
+    conn->rescode = 0;
+    conn->connclose = false;
+    conn->inlen = 0;
+    qhttpparser_init(&conn->parser, !strcasecmp(req_method(req), "HEAD"));
+    conn_reset_decoder(conn);
+
+    // serialize request
+    qgrow_t *outBuf = qgrow(0);
+    if (outBuf == NULL) {
+        conn_fail(conn, ENOMEM);
+        return;
+    }
+    outBuf->addstrf(outBuf, "%s %s HTTP/1.1\r\n", req_method(req), req->uri);
+    qlisttbl_t *headers = req->reqheaders;
+    if (headers == NULL || headers->get(headers, "Host", NULL, false) == NULL)
+        outBuf->addstrf(outBuf, "Host: %s:%d\r\n", conn->host->hostname,
+                        conn->host->port);
+    if (headers == NULL
+            || headers->get(headers, "User-Agent", NULL, false) == NULL)
+        outBuf->addstrf(outBuf, "User-Agent: %s\r\n", QHTTPCLIENT_NAME);
+    if (headers == NULL
+            || headers->get(headers, "Connection", NULL, false) == NULL)
+        outBuf->addstr(outBuf, "Connection: Keep-Alive\r\n");
+    if (req->compression == true && (headers == NULL
+            || headers->get(headers, "Accept-Encoding", NULL, false) == NULL))
+        outBuf->addstr(outBuf, "Accept-Encoding: gzip, deflate\r\n");
+    if (req->data != NULL && (headers == NULL
+            || headers->get(headers, "Content-Length", NULL, false) == NULL))
+        outBuf->addstrf(outBuf, "Content-Length: %zu\r\n", req->size);
+    if (headers != NULL) {
+        qlisttbl_obj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+        headers->lock(headers);
+        while (headers->getnext(headers, &obj, NULL, false) == true) {
+            outBuf->addstrf(outBuf, "%s: %s\r\n", obj.name,
+                            (char *) obj.data);
+        }
+        headers->unlock(headers);
+    }
+    outBuf->addstr(outBuf, "\r\n");
+    if (req->data != NULL && req->size > 0)
+        outBuf->add(outBuf, req->data, req->size);
+
+    free(conn->out);
+    conn->out = outBuf->toarray(outBuf, &conn->outlen);
+    conn->outoff = 0;
+    outBuf->free(outBuf);
+    if (conn->out == NULL) {
+        conn_fail(conn, ENOMEM);
+        return;
+    }
+
+    if (conn->state == CONN_IDLE) {
+        conn->reused = true;
+        conn->state = CONN_WRITING;
+        qreactor_mod(conn->async->reactor, conn->fd,
+                     QREACTOR_READ | QREACTOR_WRITE, -1);
+        conn_write(conn);
+    }
+    // otherwise the request goes out once connected.
+}
+
+static void conn_event(qreactor_t *reactor, int fd, int events,
+                       void *userdata) {
+    aconn_t *conn = (aconn_t *) userdata;
+
+    if (conn->state == CONN_IDLE) {
+        // closed by the peer or timed out
+        conn_close(conn);
+        return;
+    }
+
+    if (conn->state == CONN_CONNECTING) {
+        if ((events & (QREACTOR_WRITE | QREACTOR_ERROR)) == 0)
+            return;
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+            error = errno;
+        if (error != 0) {
+            qhttpasync_t *async = conn->async;
+            ahost_t *host = conn->host;
+            areq_t *areq = conn->areq;
+            if (host_next(host, conn->addrindex) == false || areq == NULL) {
+                conn_fail(conn, error);
+                return;
+            }
+            // nothing was sent yet, try the next address
+            conn->areq = NULL;
+            areq->conn = NULL;
+            conn_close(conn);
+            host_requeue(host, areq);
+            host_dispatch(async, host);
+            return;
+        }
+        conn->state = CONN_WRITING;
+    }
+
+    if (conn->state == CONN_WRITING) {
+        conn_write(conn);
+    } else if (conn->state == CONN_READING) {
+        conn_read(conn);
+    }
+}
+
+static void conn_write(aconn_t *conn) {
+    while (conn->outoff < conn->outlen) {
+        ssize_t n = send(conn->fd, conn->out + conn->outoff,
+                         conn->outlen - conn->outoff, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;  // wait for the next write event
+            conn_fail(conn, errno);
+            return;
+        }
+        conn->outoff += n;
+    }
+
+    free(conn->out);
+    conn->out = NULL;
+    conn->state = CONN_READING;
+    qreactor_mod(conn->async->reactor, conn->fd, QREACTOR_READ, -1);
+
+    // the response may have arrived already and its edge is gone.
+    conn_read(conn);
+}
+
+static void conn_read(aconn_t *conn) {
+    while (true) {
+        if (conn->insize - conn->inlen < DEF_READ_SIZE / 4) {
+            size_t newsize = conn->insize + DEF_READ_SIZE;
+            char *in = (char *) realloc(conn->in, newsize);
+            if (in == NULL) {
+                conn_fail(conn, ENOMEM);
+                return;
+            }
+            conn->in = in;
+            conn->insize = newsize;
+        }
+
+        ssize_t n = recv(conn->fd, conn->in + conn->inlen,
+                         conn->insize - conn->inlen, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;  // wait for the next read event
+            conn_fail(conn, errno);
+            return;
+        }
+        if (n == 0) {
+            if (conn->gothead == true
+                    && qhttpparser_eof(&conn->parser) == QHTTPPARSER_DONE) {
+                conn->connclose = true;
+                conn_done(conn);
+            } else {
+                conn_fail(conn, ECONNRESET);
+            }
+            return;
+        }
+
+        conn->inlen += n;
+        conn->received = true;
+        int ret = conn_parse(conn);
+        if (ret < 0) {
+            conn_fail(conn, errno);
+            return;
+        }
+        if (ret > 0) {
+            conn_done(conn);
+            return;
+        }
+    }
+}
+
+// Returns 1 when the response is complete, 0 for more data, -1 for error.
+static int conn_parse(aconn_t *conn) {
+    qhttpasync_req_t *req = conn->areq->req;
+    qhttpparser_t *parser = &conn->parser;
+
+    while (true) {
+        size_t consumed;
+        const char *data;
+        size_t size;
+        int event = qhttpparser_parse(parser, conn->in, conn->inlen,
+                                      &consumed, &data, &size);
+        switch (event) {
+            case QHTTPPARSER_HEAD: {
+                if (parser->status / 100 == 1) {
+                    // interim response, the real one follows
+                    conn_consume(conn, consumed);
+                    qhttpparser_init(parser,
+                                     !strcasecmp(req_method(req), "HEAD"));
+                    continue;
+                }
+                conn->gothead = true;
+                conn->rescode = parser->status;
+                conn->connclose = !parser->keepalive;
+                if (req->resheaders != NULL)
+                    qhttpparser_copyheaders(parser, req->resheaders);
+                if (req->compression == true) {
+                    conn->decoder = qhttpdecoder(parser);
+                    if (conn->decoder == NULL && errno == ENOMEM)
+                        return -1;
+                }
+                conn_consume(conn, consumed);
+
+                if (req->onresponse != NULL
+                        && req->onresponse(req, conn->rescode) == false) {
+                    errno = ECANCELED;
+                    return -1;
+                }
+                continue;
+            }
+            case QHTTPPARSER_BODY: {
+                bool ok;
+                errno = ECANCELED;
+                if (conn->decoder != NULL) {
+                    ok = qhttpdecoder_decode(conn->decoder, data, size,
+                                             conn_output, req);
+                } else {
+                    ok = conn_output(req, data, size);
+                }
+                if (ok == false)
+                    return -1;
+                conn_consume(conn, consumed);
+                continue;
+            }
+            case QHTTPPARSER_DONE: {
+                conn_consume(conn, consumed);
+                if (conn->decoder != NULL
+                        && qhttpdecoder_finish(conn->decoder) == false) {
+                    return -1;
+                }
+                return 1;
+            }
+            case QHTTPPARSER_MORE: {
+                conn_consume(conn, consumed);
+                if (conn->gothead == false && conn->inlen > MAX_HEAD_SIZE) {
+                    errno = EMSGSIZE;
+                    return -1;
+                }
+                return 0;
+            }
+            default: {
+                return -1;
+            }
+        }
+    }
+}
+
+// Deliver a piece of the (decoded) body to the request.
+static bool conn_output(void *userdata, const void *data, size_t size) {
+    qhttpasync_req_t *req = (qhttpasync_req_t *) userdata;
+    if (req->onbody != NULL && req->onbody(req, data, size) == false) {
+        errno = ECANCELED;
+        return false;
+    }
+    return true;
+}
+
+static void conn_reset_decoder(aconn_t *conn) {
+    if (conn->decoder != NULL) {
+        qhttpdecoder_free(conn->decoder);
+        conn->decoder = NULL;
+    }
+}
+
+static void conn_consume(aconn_t *conn, size_t nbytes) {
+    conn->inlen -= nbytes;
+    if (conn->inlen > 0)
+        memmove(conn->in, conn->in + nbytes, conn->inlen);
+}
+
+static void conn_done(aconn_t *conn) {
+    qhttpasync_t *async = conn->async;
+    ahost_t *host = conn->host;
+    areq_t *areq = conn->areq;
+    int rescode = conn->rescode;
+
+    conn->areq = NULL;
+    areq->conn = NULL;
+    if (conn->connclose == false && conn->inlen == 0) {
+        // keep for the next request
+        conn->state = CONN_IDLE;
+        conn->idlenext = host->idle;
+        host->idle = conn;
+        qreactor_mod(async->reactor, conn->fd, QREACTOR_READ,
+                     DEF_IDLE_TIMEOUT);
+    } else {
+        conn_close(conn);
+    }
+
+    req_finish(async, areq, rescode, 0);
+    host_dispatch(async, host);
+}
+
+static void conn_fail(aconn_t *conn, int error) {
+    qhttpasync_t *async = conn->async;
+    ahost_t *host = conn->host;
+    areq_t *areq = conn->areq;
+    bool retry = (conn->reused == true && conn->received == false);
+
+    conn->areq = NULL;
+    conn_close(conn);
+
+    if (areq != NULL) {
+        areq->conn = NULL;
+        const char *method = req_method(areq->req);
+        if (retry == true && areq->retried == false
+                && (!strcasecmp(method, "GET") || !strcasecmp(method, "HEAD")
+                        || !strcasecmp(method, "PUT")
+                        || !strcasecmp(method, "DELETE")
+                        || !strcasecmp(method, "OPTIONS"))) {
+            // the keep-alive connection went stale, try a fresh one.
+            areq->retried = true;
+            host_requeue(host, areq);
+        } else {
+            req_finish(async, areq, 0, error);
+        }
+    }
+
+    host_dispatch(async, host);
+}
+
+static void conn_close(aconn_t *conn) {
+    qhttpasync_t *async = conn->async;
+    ahost_t *host = conn->host;
+
+    if (conn->state == CONN_IDLE) {
+        aconn_t **link = &host->idle;
+        while (*link != NULL && *link != conn)
+            link = &(*link)->idlenext;
+        if (*link != NULL)
+            *link = conn->idlenext;
+    }
+
+    qreactor_del(async->reactor, conn->fd);
+    close(conn->fd);
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        async->conns = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    host->nconns--;
+
+    conn_reset_decoder(conn);
+    free(conn->out);
+    free(conn->in);
+    free(conn);
+}
+
+static void req_finish(qhttpasync_t *async, areq_t *areq, int rescode,
+                       int error) {
+    qhttpasync_req_t *req = areq->req;
+
+    if (areq->timer != NULL)
+        qreactor_cancel(async->reactor, areq->timer);
+    free(areq);
+    async->inflight--;
+
+    if (req->ondone != NULL)
+        req->ondone(req, rescode, error);
+}
+
+static void req_timeout(qreactor_t *reactor, void *userdata) {
+    areq_t *areq = (areq_t *) userdata;
+    qhttpasync_t *async = areq->async;
+    ahost_t *host = areq->host;
+    areq->timer = NULL;  // released by the reactor
+
+    if (areq->conn != NULL) {
+        aconn_t *conn = areq->conn;
+        conn->areq = NULL;
+        conn_close(conn);
+    } else {
+        // still waiting for a connection
+        areq_t **link = &host->pending;
+        areq_t *prev = NULL;
+        while (*link != areq) {
+            prev = *link;
+            link = &(*link)->next;
+        }
+        *link = areq->next;
+        if (host->pendingtail == areq)
+            host->pendingtail = prev;
+    }
+
+    req_finish(async, areq, 0, ETIMEDOUT);
+    host_dispatch(async, host);
+}
+
+static const char *req_method(qhttpasync_req_t *req) {
+    return (req->method != NULL) ? req->method : "GET";
+}
+
+#endif /* _DOXYGEN_SKIP */
+
+#endif /* DISABLE_QHTTPCLIENT */
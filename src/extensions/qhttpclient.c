@@ -116,12 +116,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -135,8 +138,9 @@
 #include "utilities/qio.h"
 #include "utilities/qstring.h"
 #include "utilities/qsocket.h"
+#include "utilities/qtime.h"
 #include "containers/qlisttbl.h"
-#include "containers/qgrow.h"
+#include "extensions/qhttpparser.h"
 #include "extensions/qhttpclient.h"
 
 #ifndef _DOXYGEN_SKIP
@@ -146,6 +150,7 @@ static bool setssl(qhttpclient_t *client);
 static void settimeout(qhttpclient_t *client, int timeoutms);
 static void setkeepalive(qhttpclient_t *client, bool keepalive);
 static void setuseragent(qhttpclient_t *client, const char *agentname);
+static bool setcompression(qhttpclient_t *client, bool compression);
 
 static bool head(qhttpclient_t *client, const char *uri, int *rescode,
                  qlisttbl_t *reqheaders, qlisttbl_t *resheaders);
@@ -153,6 +158,11 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
                 int *rescode, qlisttbl_t *reqheaders, qlisttbl_t *resheaders,
                 bool (*callback)(void *userdata, off_t recvbytes),
                 void *userdata);
+static bool download(qhttpclient_t *client, const char *uri, int fd,
+                     int nconns, off_t *savesize, int *rescode,
+                     qlisttbl_t *reqheaders,
+                     bool (*callback)(void *userdata, off_t recvbytes),
+                     void *userdata);
 static bool put(qhttpclient_t *client, const char *uri, int fd, off_t length,
                 int *rescode, qlisttbl_t *reqheaders, qlisttbl_t *resheaders,
                 bool (*callback)(void *userdata, off_t sentbytes),
@@ -165,6 +175,8 @@ static bool sendrequest(qhttpclient_t *client, const char *method,
                         const char *uri, qlisttbl_t *reqheaders);
 static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
                         off_t *contentlength);
+static int pipeline(qhttpclient_t *client, qhttpclient_req_t *reqs,
+                    int nreqs);
 
 static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize);
 static ssize_t read_(qhttpclient_t *client, void *buf, size_t nbytes);
@@ -177,6 +189,46 @@ static void _free(qhttpclient_t *client);
 
 // internal usages
 static bool _set_socket_option(int socket);
+static bool _is_alive(qhttpclient_t *client);
+static bool _send_request(qhttpclient_t *client, const char *method,
+                          const char *uri, qlisttbl_t *reqheaders,
+                          const void *body, size_t bodysize);
+static int _read_response(qhttpclient_t *client, qlisttbl_t *resheaders,
+                          off_t *contentlength, bool nobody);
+static bool _build_request(qhttpclient_t *client, size_t *offset,
+                           const char *method, const char *uri,
+                           qlisttbl_t *reqheaders, size_t bodysize);
+static bool _has_header(qlisttbl_t *headers, const char *name);
+static bool _reqbuf_reserve(qhttpclient_t *client, size_t offset,
+                            size_t nbytes);
+static bool _reqbuf_printf(qhttpclient_t *client, size_t *offset,
+                           const char *format, ...);
+static bool _read_content(qhttpclient_t *client, off_t clength, void **data,
+                          size_t *size);
+static ssize_t _read_body(qhttpclient_t *client, const char **data,
+                          size_t *held);
+static bool _write_fd(void *userdata, const void *data, size_t size);
+static bool _append_mem(void *userdata, const void *data, size_t size);
+static bool _is_idempotent(const char *method);
+struct Range;
+struct RangeJob;
+static void *_range_worker(void *arg);
+static int _range_fetch(qhttpclient_t *client, struct RangeJob *job,
+                        qlisttbl_t *headers, struct Range *range, char *buf,
+                        size_t bufsize);
+static bool _range_push(struct RangeJob *job, off_t start, off_t end);
+static void _pool_key(char *key, size_t size, const char *hostname, int port,
+                      bool ssl);
+static struct PoolHost *_pool_host(qhttppool_t *pool, const char *key,
+                                   bool create);
+static struct PoolConn *_pool_expire(qhttppool_t *pool, long now);
+static void _pool_release(struct PoolConn *conns);
+#ifdef ENABLE_OPENSSL
+static ssize_t _ssl_read(void *arg, void *buf, size_t nbytes, int timeoutms);
+static SSL_CTX *_ssl_context(void);
+static int _ssl_newsession(SSL *ssl, SSL_SESSION *session);
+static void _ssl_setsession(qhttpclient_t *client, SSL *ssl);
+#endif
 static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
                        size_t namesize, int *port);
 
@@ -190,6 +242,7 @@ static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
 #define HTTP_CODE_OK                    (200)
 #define HTTP_CODE_CREATED               (201)
 #define HTTP_CODE_NO_CONTENT            (204)
+#define HTTP_CODE_PARTIAL_CONTENT       (206)
 #define HTTP_CODE_MULTI_STATUS          (207)
 #define HTTP_CODE_MOVED_TEMPORARILY     (302)
 #define HTTP_CODE_NOT_MODIFIED          (304)
@@ -212,14 +265,115 @@ static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
 #define SET_TCP_NODELAY         (1)    /*< 0 for disable */
 #define MAX_SHUTDOWN_WAIT       (100)  /*< maximum shutdown wait, unit is ms */
 #define MAX_ATOMIC_DATA_SIZE    (32 * 1024)  /*< maximum sending bytes */
+#define MAX_PIPELINE_DEPTH      (32)   /*< maximum requests in flight */
+#define MAX_CONNECT_ADDRS       (16)   /*< addresses tried per connection */
+#define DEF_REQBUF_SIZE         (1024) /*< initial request buffer size */
+#define MAX_HEAD_SIZE           (64 * 1024)  /*< maximum response head size */
+
+struct FdSink {
+    int fd;
+    off_t saved;            /*< bytes written to fd */
+};
+
+struct MemSink {
+    char *data;             /*< NUL terminated content */
+    size_t size;
+};
+
+//
+// RANGED DOWNLOAD DEFINITION
+//
+#define MAX_RANGE_SIZE          (4 * 1024 * 1024)  /*< largest range */
+#define MIN_RANGE_SIZE          (256 * 1024)       /*< smallest range */
+#define MAX_RANGE_CONNS         (16)   /*< maximum concurrent connections */
+#define MAX_RANGE_RETRIES       (3)    /*< failures allowed per connection */
+
+struct Range {
+    off_t start;
+    off_t end;              /*< inclusive */
+};
+
+struct RangeJob {
+    void *qmutex;
+    qhttpclient_t *client;  /*< template of the worker connections */
+    const char *uri;
+    int fd;
+    qlisttbl_t *reqheaders;
+
+    struct Range *ranges;   /*< ranges to fetch, popped from the end */
+    int nranges;
+    int maxranges;
+
+    off_t received;         /*< bytes written to fd */
+    int failures;
+    int maxfailures;
+    int rescode;            /*< unexpected response code */
+    bool stop;              /*< canceled or failed for good */
+
+    bool (*callback)(void *userdata, off_t recvbytes);
+    void *userdata;
+};
+
+//
+// CONNECTION POOL DEFINITION
+//
+#define DEF_POOL_IDLETIMEOUT    (30 * 1000)  /*< idle connection lifetime */
+#define MAX_POOL_KEY            (256 + 16)   /*< host:port:tls */
 
 #ifdef  ENABLE_OPENSSL
+#define MAX_SSL_SESSIONS        (256)  /*< hosts to keep sessions for */
+#define MAX_SSL_TICKETS         (4)    /*< sessions kept per host */
+
+// SSL_SESSION_is_resumable() came with OpenSSL 1.1.1, so did TLS 1.3
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define SSL_SESSION_RESUMABLE(s)    SSL_SESSION_is_resumable(s)
+#define SSL_SESSION_SINGLE_USE(s)   \
+    (SSL_SESSION_get_protocol_version(s) >= TLS1_3_VERSION)
+#else
+#define SSL_SESSION_RESUMABLE(s)    (1)
+#define SSL_SESSION_SINGLE_USE(s)   (0)
+#endif
+
 struct SslConn {
     SSL *ssl;
-    SSL_CTX *ctx;
 };
+
+struct SslSession {
+    char key[MAX_POOL_KEY];         /*< host:port */
+    SSL_SESSION *sessions[MAX_SSL_TICKETS];  /*< oldest first */
+    int nsessions;
+    struct SslSession *next;        /*< most recently stored first */
+};
+
+// process-wide TLS state shared by all clients
+static qmutex_t _ssl_qmutex = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+static void *_ssl_mutex = &_ssl_qmutex;
+static SSL_CTX *_ssl_ctx = NULL;
+static struct SslSession *_ssl_sessions = NULL;
+static int _ssl_nsessions = 0;
+static int _ssl_exindex = -1;       /*< ex_data slot for the client */
 #endif
 
+struct PoolConn {
+    qhttpclient_t *client;
+    long idlesince;         /*< time returned to the pool in milliseconds */
+    struct PoolConn *next;
+};
+
+struct PoolHost {
+    char *key;
+    int nconns;             /*< idle and leased connections */
+    struct PoolConn *idle;  /*< most recently used first */
+    struct PoolHost *next;
+};
+
+struct qhttppool_s {
+    void *qmutex;
+    int maxperhost;
+    int idletimeoutms;
+    struct PoolHost *hosts;
+};
+
 /**
  * Initialize & create new HTTP client.
  *
@@ -245,7 +399,7 @@ struct SslConn {
 qhttpclient_t *qhttpclient(const char *destname, int port) {
     bool ishttps = false;
     char hostname[256];
-    if (port == 0 || strstr(hostname, "://") != NULL) {
+    if (port == 0 || strstr(destname, "://") != NULL) {
         if (_parse_uri(destname, &ishttps, hostname, sizeof(hostname), &port)
                 == false) {
             DEBUG("Can't parse URI %s", destname);
@@ -258,8 +412,8 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     }
 
     // get remote address
-    struct sockaddr_in addr;
-    if (qsocket_get_addr(&addr, hostname, port) == false) {
+    qsocket_addr_t addr;
+    if (qsocket_resolve(&addr, 1, hostname, port) <= 0) {
         return NULL;
     }
 
@@ -271,8 +425,18 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
 
     // initialize object
     client->socket = -1;
+    client->reader = qio_reader(-1, 0);
+    client->parser = (qhttpparser_t *) malloc(sizeof(qhttpparser_t));
+    if (client->reader == NULL || client->parser == NULL) {
+        if (client->reader != NULL) qio_reader_free(client->reader);
+        if (client->parser != NULL) free(client->parser);
+        free(client);
+        return NULL;
+    }
+    qhttpparser_init(client->parser, false);
 
-    memcpy((void *) &client->addr, (void *) &addr, sizeof(client->addr));
+    memcpy((void *) &client->addr, (void *) &addr.addr, sizeof(client->addr));
+    client->addrlen = addr.addrlen;
     client->hostname = strdup(hostname);
     client->port = port;
 
@@ -281,16 +445,19 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     client->settimeout = settimeout;
     client->setkeepalive = setkeepalive;
     client->setuseragent = setuseragent;
+    client->setcompression = setcompression;
 
     client->open = open_;
 
     client->head = head;
     client->get = get;
+    client->download = download;
     client->put = put;
     client->cmd = cmd;
 
     client->sendrequest = sendrequest;
     client->readresponse = readresponse;
+    client->pipeline = pipeline;
 
     client->gets = gets_;
     client->read = read_;
@@ -319,21 +486,24 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
  * @code
  *   httpclient->setssl(httpclient);
  * @endcode
+ *
+ * @note
+ *  All clients share one SSL context. The last few TLS sessions issued by
+ *  each host:port are kept process-wide and offered to the next connections
+ *  to it, so reconnects resume a session instead of doing a full handshake.
+ *  TLS 1.3 tickets are single use (RFC 8446 C.4), so each one is offered to
+ *  one connection only.
  */
 static bool setssl(qhttpclient_t *client) {
 #ifdef  ENABLE_OPENSSL
-    static bool initialized = false;
-
     if (client->socket >= 0) {
         // must be set before making a connection.
         return false;
     }
-    
-    // init openssl
-    if (initialized == false) {
-      initialized = true;
-      SSL_load_error_strings();
-      SSL_library_init();
+
+    // init openssl and the shared context once
+    if (_ssl_context() == NULL) {
+        return false;
     }
 
     // allocate ssl structure
@@ -397,6 +567,38 @@ static void setuseragent(qhttpclient_t *client, const char *useragent) {
     client->useragent = strdup(useragent);
 }
 
+/**
+ * qhttpclient->setcompression(): Sets compressed transfer on/off.
+ *
+ * @param client        qhttpclient object pointer
+ * @param compression   true to ask for gzip or deflate content and
+ *                      decompress it on the fly, false to turn it off
+ *
+ * @return true if successful, otherwise returns false if qLibc is built
+ *         without zlib.
+ *
+ * @code
+ *   httpclient->setcompression(httpclient, true);
+ * @endcode
+ *
+ * @note
+ *  get(), cmd() and pipeline() deliver the decompressed content and report
+ *  its size, while the Content-Length response header keeps the size on
+ *  the wire. A read of the body through readresponse() and read() is not
+ *  decompressed.
+ */
+static bool setcompression(qhttpclient_t *client, bool compression) {
+#ifdef ENABLE_ZLIB
+    client->compression = compression;
+    return true;
+#else
+    if (compression == true)
+        return false;
+    client->compression = false;
+    return true;
+#endif
+}
+
 /**
  * qhttpclient->open(): Opens a connection to the remote host.
  *
@@ -408,7 +610,8 @@ static void setuseragent(qhttpclient_t *client, const char *useragent) {
  *  Don't need to open a connection unless you definitely need to do this,
  *  because qhttpclient open a connection automatically when it's needed.
  *  This function also can be used to veryfy a connection failure with remote
- *  host.
+ *  host. All the IPv4 and IPv6 addresses of the host are tried, a new one
+ *  every 250 milliseconds, and the first to answer is used.
  *
  * @code
  *   if(httpclient->open(httpclient) == false) return;
@@ -417,43 +620,34 @@ static void setuseragent(qhttpclient_t *client, const char *useragent) {
 static bool open_(qhttpclient_t *client) {
     if (client->socket >= 0) {
         // check if connection is still alive
-        if (qio_wait_writable(client->socket, 0) > 0)
+        if (_is_alive(client) == true)
             return true;
         _close(client);
     }
 
-    // create new socket
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        DEBUG("sockfd creation failed.");
-        return false;
-    }
-
-    // set to non-block socket if timeout is set
-    int sockflag = 0;
-    if (client->timeoutms > 0) {
-        sockflag = fcntl(sockfd, F_GETFL, 0);
-        fcntl(sockfd, F_SETFL, sockflag | O_NONBLOCK);
+    // resolve again, the cache keeps it cheap and follows address changes.
+    qsocket_addr_t addrs[MAX_CONNECT_ADDRS];
+    int naddrs = qsocket_resolve(addrs, MAX_CONNECT_ADDRS, client->hostname,
+                                 client->port);
+    if (naddrs <= 0) {
+        // fall back to the address found at construction
+        memcpy((void *) &addrs[0].addr, (void *) &client->addr,
+               sizeof(client->addr));
+        addrs[0].addrlen = client->addrlen;
+        naddrs = 1;
     }
 
-    // try to connect
-    int status = connect(sockfd, (struct sockaddr *) &client->addr,
-                         sizeof(client->addr));
-    if (status < 0
-            && (errno != EINPROGRESS
-                    || qio_wait_writable(sockfd, client->timeoutms) <= 0)) {
+    // connect to the first address which answers
+    int sockfd = qsocket_connect(addrs, naddrs,
+            (client->timeoutms > 0) ? client->timeoutms : -1);
+    if (sockfd < 0) {
         DEBUG("connection failed. (%d)", errno);
-        close(sockfd);
         return false;
     }
 
-    // restore to block socket
-    if (client->timeoutms > 0) {
-        fcntl(sockfd, F_SETFL, sockflag);
-    }
-
     // store socket descriptor
     client->socket = sockfd;
+    qio_reader_reset(client->reader, sockfd);
 
     // set socket option
     _set_socket_option(sockfd);
@@ -461,17 +655,10 @@ static bool open_(qhttpclient_t *client) {
 #ifdef ENABLE_OPENSSL
     // set SSL option
     if (client->ssl != NULL) {
-        // get ssl context using SSL 2 or 3
+        // get ssl handle from the shared context
         struct SslConn *ssl = client->ssl;
-        ssl->ctx = SSL_CTX_new(SSLv23_client_method());
-        if (ssl->ctx == NULL) {
-            DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
-            _close(client);
-            return false;
-        }
-
-        // get ssl handle
-        ssl->ssl = SSL_new(ssl->ctx);
+        SSL_CTX *ctx = _ssl_context();
+        ssl->ssl = (ctx != NULL) ? SSL_new(ctx) : NULL;
         if (ssl->ssl == NULL) {
             DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
             _close(client);
@@ -487,6 +674,11 @@ static bool open_(qhttpclient_t *client) {
 
         // set options
         SSL_set_connect_state(ssl->ssl);
+        SSL_set_tlsext_host_name(ssl->ssl, client->hostname);
+        SSL_set_ex_data(ssl->ssl, _ssl_exindex, client);
+
+        // resume the last session with the host if there's one
+        _ssl_setsession(client, ssl->ssl);
 
         // handshake
         if (SSL_connect(ssl->ssl) != 1) {
@@ -494,6 +686,11 @@ static bool open_(qhttpclient_t *client) {
             _close(client);
             return false;
         }
+        DEBUG("ssl session %s", (SSL_session_reused(ssl->ssl)) ?
+              "resumed" : "established");
+
+        // responses are read through the reader
+        qio_reader_setsource(client->reader, _ssl_read, client);
 
         DEBUG("ssl initialized");
     }
@@ -557,22 +754,8 @@ static bool head(qhttpclient_t *client, const char *uri, int *rescode,
     if (rescode != NULL)
         *rescode = 0;
 
-    // generate request headers if necessary
-    bool freeReqHeaders = false;
-    if (reqheaders == NULL) {
-        reqheaders = qlisttbl(
-                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
-        freeReqHeaders = true;
-    }
-
-    // add additional headers
-    reqheaders->putstr(reqheaders, "Accept", "*/*");
-
     // send request
-    bool sendret = sendrequest(client, "HEAD", uri, reqheaders);
-    if (freeReqHeaders == true)
-        reqheaders->free(reqheaders);
-    if (sendret == false) {
+    if (sendrequest(client, "HEAD", uri, reqheaders) == false) {
         _close(client);
         return false;
     }
@@ -583,12 +766,7 @@ static bool head(qhttpclient_t *client, const char *uri, int *rescode,
     if (rescode != NULL)
         *rescode = resno;
 
-    // throw out content
-    if (clength > 0) {
-        if (read_(client, NULL, clength) != clength) {
-            _close(client);
-        }
-    }
+    // responses to HEAD never have a body even with Content-Length.
 
     // close connection if required
     if (client->keepalive == false || client->connclose == true) {
@@ -697,22 +875,8 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
     if (savesize != NULL)
         *savesize = 0;
 
-    // generate request headers if necessary
-    bool freeReqHeaders = false;
-    if (reqheaders == NULL) {
-        reqheaders = qlisttbl(
-                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
-        freeReqHeaders = true;
-    }
-
-    // add additional headers
-    reqheaders->putstr(reqheaders, "Accept", "*/*");
-
     // send request
-    bool sendret = sendrequest(client, "GET", uri, reqheaders);
-    if (freeReqHeaders == true)
-        reqheaders->free(reqheaders);
-    if (sendret == false) {
+    if (sendrequest(client, "GET", uri, reqheaders) == false) {
         _close(client);
         return false;
     }
@@ -726,10 +890,8 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
     // check response code
     if (resno != HTTP_CODE_OK) {
         // throw out content
-        if (clength > 0) {
-            if (read_(client, NULL, clength) != clength) {
-                _close(client);
-            }
+        if (_read_content(client, clength, NULL, NULL) == false) {
+            _close(client);
         }
 
         // close connection if required
@@ -746,7 +908,43 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
         return false;
     }
 
-    if (clength > 0) {
+    // decompress content on the fly if requested
+    qhttpdecoder_t *decoder = NULL;
+    if (client->compression == true && clength != 0)
+        decoder = qhttpdecoder(client->parser);
+
+    if (decoder != NULL) {
+        struct FdSink sink = { fd, 0 };
+        const char *piece;
+        size_t held = 0;
+        ssize_t ret;
+        while ((ret = _read_body(client, &piece, &held)) > 0) {
+            if (qhttpdecoder_decode(decoder, piece, ret, _write_fd, &sink)
+                    == false) {
+                ret = -1;
+                break;
+            }
+            recv = sink.saved;
+            if (savesize != NULL)
+                *savesize = recv;
+
+            // call back
+            if (callback != NULL && callback(userdata, recv) == false) {
+                qhttpdecoder_free(decoder);
+                _close(client);
+                return false;
+            }
+        }
+        if (ret == 0 && qhttpdecoder_finish(decoder) == false)
+            ret = -1;
+        qhttpdecoder_free(decoder);
+
+        if (ret < 0) {
+            DEBUG("Broken content. %jd/encoded, errno=%d", recv, errno);
+            _close(client);
+            return false;
+        }
+    } else if (clength > 0) {
         while (recv < clength) {
             unsigned int recvsize;  // this time receive size
             if (clength - recv < MAX_ATOMIC_DATA_SIZE) {
@@ -776,45 +974,26 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
         }
 
     } else if (clength == -1) {  // chunked
-        bool completed = false;
-        do {
-            // read chunk size
-            char buf[64];
-            if (gets_(client, buf, sizeof(buf)) <= 0)
+        const char *piece;
+        size_t held = 0;
+        ssize_t ret;
+        while ((ret = _read_body(client, &piece, &held)) > 0) {
+            if (qio_write(fd, piece, ret, -1) != ret) {
+                ret = -1;
                 break;
-
-            // parse chunk size
-            unsigned int recvsize;  // this time chunk size
-            sscanf(buf, "%x", &recvsize);
-            if (recvsize == 0) {
-                // end of transfer
-                completed = true;
             }
-
-            // save chunk
-            if (recvsize > 0) {
-                ssize_t ret = recvfile(client, fd, recvsize);
-                if (ret != recvsize)
-                    break;
-                recv += ret;
-                DEBUG("%zd %zd", recv, ret);
-                if (savesize != NULL)
-                    *savesize = recv;
-            }
-
-            // read tailing CRLF
-            if (gets_(client, buf, sizeof(buf)) <= 0)
-                break;
+            recv += ret;
+            if (savesize != NULL)
+                *savesize = recv;
 
             // call back
-            if (recvsize > 0 && callback != NULL
-                    && callback(userdata, recv) == false) {
+            if (callback != NULL && callback(userdata, recv) == false) {
                 _close(client);
                 return false;
             }
-        } while (completed == false);
+        }
 
-        if (completed == false) {
+        if (ret < 0) {
             DEBUG("Broken pipe. %jd/chunked, errno=%d", recv, errno);
             _close(client);
             return false;
@@ -829,6 +1008,145 @@ static bool get(qhttpclient_t *client, const char *uri, int fd, off_t *savesize,
     return true;
 }
 
+/**
+ * qhttpclient->download(): Downloads a file over several connections at
+ * once using byte ranges.
+ *
+ * @param client    qhttpclient object pointer.
+ * @param uri       URL encoded remote URI for downloading file.
+ * @param fd        opened file descriptor for writing. It must support
+ *                  pwrite(), so it can't be a pipe or a socket.
+ * @param nconns    number of connections to use. (up to 16)
+ * @param savesize  if not NULL, the length of stored bytes will be stored.
+ *                  (can be NULL)
+ * @param rescode   if not NULL, remote response code will be stored.
+ *                  (can be NULL)
+ * @param reqheaders    qlisttbl_t pointer which contains additional user
+ *                      request headers. (can be NULL)
+ * @param callback  set user call-back function. (can be NULL)
+ * @param userdata  set user data for call-back. (can be NULL)
+ *
+ * @return true if successful(200 OK), otherwise returns false
+ *
+ * @code
+ *   int fd = open("/tmp/big.iso", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+ *   off_t savesize = 0;
+ *   int rescode = 0;
+ *   bool ret = httpclient->download(httpclient, "/big.iso", fd, 8,
+ *                                   &savesize, &rescode, NULL, NULL, NULL);
+ *   close(fd);
+ * @endcode
+ *
+ * @note
+ *  The size and range support are found out with HEAD first. The content is
+ *  split into ranges of up to 4MB which the connections take one after
+ *  another, writing each range at its offset. A range which fails halfway
+ *  is fetched again from where it stopped, until failures exceed 3 per
+ *  connection. If the server doesn't advertise "Accept-Ranges: bytes", the
+ *  length is unknown or the content is small, it falls back to get() on
+ *  this client. The call-back function is called from the connection
+ *  threads, one at a time, with the total bytes written so far.
+ */
+static bool download(qhttpclient_t *client, const char *uri, int fd,
+                     int nconns, off_t *savesize, int *rescode,
+                     qlisttbl_t *reqheaders,
+                     bool (*callback)(void *userdata, off_t recvbytes),
+                     void *userdata) {
+    if (savesize != NULL)
+        *savesize = 0;
+    if (rescode != NULL)
+        *rescode = 0;
+
+    // find out the length. ranges are over the identity encoding.
+    qlisttbl_t *resheaders = qlisttbl(QLISTTBL_CASEINSENSITIVE);
+    if (resheaders == NULL)
+        return false;
+    bool compression = client->compression;
+    client->compression = false;
+    int resno = 0;
+    bool ret = head(client, uri, &resno, reqheaders, resheaders);
+    client->compression = compression;
+
+    off_t length = resheaders->getint(resheaders, "Content-Length");
+    const char *ranges = resheaders->getstr(resheaders, "Accept-Ranges",
+                                            false);
+    bool rangeable = (ret == true && ranges != NULL
+            && !strcasecmp(ranges, "bytes")
+            && resheaders->getstr(resheaders, "Content-Encoding", false)
+                    == NULL);
+    resheaders->free(resheaders);
+
+    if (ret == false && resno != HTTP_NO_RESPONSE
+            && resno != HTTP_CODE_METHOD_NOT_ALLOWED) {
+        if (rescode != NULL)
+            *rescode = resno;
+        return false;
+    }
+    if (nconns > MAX_RANGE_CONNS)
+        nconns = MAX_RANGE_CONNS;
+    if (rangeable == false || nconns < 2 || length < 2 * MIN_RANGE_SIZE) {
+        return get(client, uri, fd, savesize, rescode, reqheaders, NULL,
+                   callback, userdata);
+    }
+
+    // split into ranges
+    off_t rangesize = length / nconns;
+    if (rangesize > MAX_RANGE_SIZE)
+        rangesize = MAX_RANGE_SIZE;
+    if (rangesize < MIN_RANGE_SIZE)
+        rangesize = MIN_RANGE_SIZE;
+
+    struct RangeJob job;
+    memset((void *) &job, 0, sizeof(job));
+    job.client = client;
+    job.uri = uri;
+    job.fd = fd;
+    job.reqheaders = reqheaders;
+    job.maxfailures = nconns * MAX_RANGE_RETRIES;
+    job.callback = callback;
+    job.userdata = userdata;
+
+    off_t end;
+    ret = true;
+    for (end = length - 1; end >= 0 && ret == true; end -= rangesize) {
+        off_t start = end - rangesize + 1;
+        ret = _range_push(&job, (start > 0) ? start : 0, end);
+    }
+    Q_MUTEX_NEW(job.qmutex, true);
+    if (ret == false || job.qmutex == NULL
+            || ftruncate(fd, length) != 0) {
+        free(job.ranges);
+        Q_MUTEX_DESTROY(job.qmutex);
+        return false;
+    }
+    if (nconns > job.nranges)
+        nconns = job.nranges;
+
+    // run connections
+    pthread_t threads[MAX_RANGE_CONNS];
+    int i, nthreads = 0;
+    for (i = 0; i < nconns; i++) {
+        if (pthread_create(&threads[nthreads], NULL, _range_worker, &job)
+                == 0) {
+            nthreads++;
+        }
+    }
+    if (nthreads == 0)
+        _range_worker(&job);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    ret = (job.stop == false && job.received == length);
+    if (savesize != NULL)
+        *savesize = job.received;
+    if (rescode != NULL)
+        *rescode = (ret == true) ? HTTP_CODE_OK : job.rescode;
+
+    free(job.ranges);
+    Q_MUTEX_DESTROY(job.qmutex);
+    return ret;
+}
+
 /**
  * qhttpclient->put(): Uploads a file to the remote host using PUT method.
  *
@@ -948,7 +1266,8 @@ static bool put(qhttpclient_t *client, const char *uri, int fd, off_t length,
     }
 
     // wait 100-continue
-    if (qio_wait_readable(client->socket, client->timeoutms) <= 0) {
+    if (qio_reader_buffered(client->reader) == 0
+            && qio_wait_readable(client->socket, client->timeoutms) <= 0) {
         DEBUG("timed out %d", client->timeoutms);
         _close(client);
         return false;
@@ -1098,59 +1417,31 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
     if (contentslength != NULL)
         *contentslength = 0;
 
-    // send request
-    bool freeReqHeaders = false;
-    if (reqheaders == NULL && data != NULL && size > 0) {
-        reqheaders = qlisttbl(
-                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
-        reqheaders->putstrf(reqheaders, "Content-Length", "%jd", size);
-        freeReqHeaders = true;
-    }
-
-    bool sendret = sendrequest(client, method, uri, reqheaders);
-    if (freeReqHeaders == true) {
-        reqheaders->free(reqheaders);
-        reqheaders = NULL;
-    }
-    if (sendret == false) {
+    // send request with data
+    if (_send_request(client, method, uri, reqheaders, data, size) == false) {
         _close(client);
         return NULL;
     }
 
-    // send data
-    if (data != NULL && size > 0) {
-        ssize_t written = write_(client, data, size);
-        if (written != size) {
-            _close(client);
-            return NULL;
-        }
-    }
-
     // read response
     off_t clength = 0;
     int resno = readresponse(client, resheaders, &clength);
     if (rescode != NULL)
         *rescode = resno;
-    if (contentslength != NULL)
-        *contentslength = clength;
 
-    // malloc data
+    // read content of Content-Length or chunked encoding
     void *content = NULL;
-    if (clength > 0) {
-        content = malloc(clength + 1);
-        if (content != NULL) {
-            if (read_(client, content, clength) == clength) {
-                *(char *) (content + clength) = '\0';
-            } else {
-                free(content);
-                content = NULL;
-                _close(client);
-            }
-        }
-    } else {
+    size_t contentsize = 0;
+    if (_read_content(client, clength, &content, &contentsize) == false) {
+        _close(client);
+        return NULL;
+    }
+    if (content == NULL) {
         // succeed. to distinguish between ok and error
         content = strdup("");
     }
+    if (contentslength != NULL)
+        *contentslength = contentsize;
 
     // close connection
     if (client->keepalive == false || client->connclose == true) {
@@ -1172,8 +1463,8 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
  * @return true if successful, otherwise returns false
  *
  * @note
- *  Default headers(Host, User-Agent, Connection) will be used if reqheaders
- *  does not have those headers in it.
+ *  Default headers(Host, User-Agent, Accept, Connection) will be used if
+ *  reqheaders does not have those headers in it. reqheaders is not modified.
  *
  * @code
  *   qlisttbl_t *reqheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
@@ -1185,71 +1476,7 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
  */
 static bool sendrequest(qhttpclient_t *client, const char *method,
                         const char *uri, qlisttbl_t *reqheaders) {
-    if (open_(client) == false) {
-        return false;
-    }
-
-    // generate request headers if necessary
-    bool freeReqHeaders = false;
-    if (reqheaders == NULL) {
-        reqheaders = qlisttbl(
-                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
-        if (reqheaders == NULL)
-            return false;
-        freeReqHeaders = true;
-    }
-
-    // append default headers
-    if (reqheaders->get(reqheaders, "Host", NULL, false) == NULL) {
-        reqheaders->putstrf(reqheaders, "Host", "%s:%d", client->hostname,
-                            client->port);
-    }
-    if (reqheaders->get(reqheaders, "User-Agent", NULL, false) == NULL) {
-        reqheaders->putstr(reqheaders, "User-Agent", client->useragent);
-    }
-    if (reqheaders->get(reqheaders, "Connection", NULL, false) == NULL) {
-        reqheaders->putstr(
-                reqheaders, "Connection",
-                (client->keepalive == true) ? "Keep-Alive" : "close");
-    }
-
-    // create stream buffer
-    qgrow_t *outBuf = qgrow(0);
-    if (outBuf == NULL)
-        return false;
-
-    // buffer out command
-    outBuf->addstrf(outBuf, "%s %s %s\r\n", method, uri,
-    HTTP_PROTOCOL_11);
-
-    // buffer out headers
-    qlisttbl_obj_t obj;
-    memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
-    reqheaders->lock(reqheaders);
-    while (reqheaders->getnext(reqheaders, &obj, NULL, false) == true) {
-        outBuf->addstrf(outBuf, "%s: %s\r\n", obj.name, (char *) obj.data);
-    }
-    reqheaders->unlock(reqheaders);
-
-    outBuf->addstrf(outBuf, "\r\n");
-
-    // stream out
-    size_t towrite = 0;
-    char *final = outBuf->toarray(outBuf, &towrite);
-    ssize_t written = 0;
-    if (final != NULL) {
-        written = write_(client, final, towrite);
-        free(final);
-    }
-
-    // de-allocate
-    outBuf->free(outBuf);
-    if (freeReqHeaders == true)
-        reqheaders->free(reqheaders);
-
-    if (written > 0 && written == towrite)
-        return true;
-    return false;
+    return _send_request(client, method, uri, reqheaders, NULL, 0);
 }
 
 /**
@@ -1281,69 +1508,163 @@ static bool sendrequest(qhttpclient_t *client, const char *method,
  * @note
  *  Data of content body must be read by a application side, if you want to use
  *  Keep-Alive session. Please refer qhttpclient->read().
+ *  The response head is parsed in place with qhttpparser. The read buffer
+ *  of the connection grows to hold a long head, and a head longer than
+ *  MAX_HEAD_SIZE(64KB) is refused as no response. A response to a HEAD
+ *  request sent with sendrequest() is read as having no body.
  */
 static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
                         off_t *contentlength) {
-    if (contentlength != NULL) {
-        *contentlength = 0;
-    }
+    return _read_response(client, resheaders, contentlength,
+                          client->headreq);
+}
 
-    // read response
-    char buf[1024];
-    if (gets_(client, buf, sizeof(buf)) <= 0)
-        return HTTP_NO_RESPONSE;
+/**
+ * qhttpclient->pipeline(): Sends a batch of requests back-to-back on one
+ * keep-alive connection and reads the responses in order.
+ *
+ * @param client    qhttpclient object pointer
+ * @param reqs      array of requests
+ * @param nreqs     number of requests
+ *
+ * @return the number of requests answered. Responses are delivered in
+ *         order, so reqs[0] to reqs[return - 1] got their callbacks.
+ *
+ * @code
+ *   bool on_response(qhttpclient_req_t *req, int rescode, void *data,
+ *                    size_t size) {
+ *     printf("%s %d %zu bytes\n", req->uri, rescode, size);
+ *     return true;  // false to stop the batch
+ *   }
+ *
+ *   qhttpclient_req_t reqs[100];
+ *   memset(reqs, 0, sizeof(reqs));
+ *   for (i = 0; i < 100; i++) {
+ *     reqs[i].uri = uris[i];
+ *     reqs[i].callback = on_response;
+ *   }
+ *   int answered = httpclient->pipeline(httpclient, reqs, 100);
+ * @endcode
+ *
+ * @note
+ *  Requests are sent without a body, and up to MAX_PIPELINE_DEPTH of them
+ *  are in flight at a time. When the connection breaks or the server closes
+ *  it, requests which were sent but not answered are replayed on a new
+ *  connection as long as all of them are idempotent. The batch stops if a
+ *  new connection fails again before any progress is made. Keep-alive is
+ *  turned on for the batch and the connection is kept open afterwards only
+ *  if keep-alive was on. Servers may close the connection while requests
+ *  are still being written, so SIGPIPE should be ignored.
+ */
+static int pipeline(qhttpclient_t *client, qhttpclient_req_t *reqs,
+                    int nreqs) {
+    if (reqs == NULL || nreqs <= 0)
+        return 0;
 
-    // parse response code
-    if (strncmp(buf, "HTTP/", CONST_STRLEN("HTTP/")))
-        return HTTP_NO_RESPONSE;
-    char *tmp = strstr(buf, " ");
-    if (tmp == NULL)
-        return HTTP_NO_RESPONSE;
-    int rescode = atoi(tmp + 1);
-    if (rescode == 0)
-        return HTTP_NO_RESPONSE;
+    bool keepalive = client->keepalive;
+    client->keepalive = true;
 
-    // read headers
-    while (gets_(client, buf, sizeof(buf)) > 0) {
-        if (buf[0] == '\0')
+    int done = 0;  // answered requests
+    int sent = 0;  // sent requests
+    bool retried = false;
+    while (done < nreqs) {
+        if (open_(client) == false)
             break;
 
-        // parse header
-        char *name = buf;
-        char *value = strstr(buf, ":");
-        if (value != NULL) {
-            *value = '\0';
-            value += 1;
-            qstrtrim(value);
-        } else {
-            // missing colon
-            value = "";
-        }
-
-        if (resheaders != NULL) {
-            resheaders->putstr(resheaders, name, value);
-        }
+        bool broken = false, stopped = false;
+        sent = done;
+        while (done < nreqs) {
+            // keep the pipe filled, batching the requests into one write
+            if (sent < nreqs && sent - done < MAX_PIPELINE_DEPTH) {
+                size_t towrite = 0;
+                int n;
+                for (n = sent; n < nreqs && n - done < MAX_PIPELINE_DEPTH;
+                        n++) {
+                    const char *method = (reqs[n].method != NULL) ?
+                            reqs[n].method : "GET";
+                    // a head which failed halfway must not be sent
+                    size_t mark = towrite;
+                    if (_build_request(client, &towrite, method, reqs[n].uri,
+                                       reqs[n].reqheaders, 0) == false) {
+                        towrite = mark;
+                        break;
+                    }
+                }
+                if (n == sent) {
+                    stopped = true;
+                    break;
+                }
+                if (write_(client, client->reqbuf, towrite) != towrite) {
+                    broken = true;
+                    break;
+                }
+                sent = n;
+            }
 
-        // check Connection header
-        if (!strcasecmp(name, "Connection")) {
-            if (!strcasecmp(value, "close")) {
-                client->connclose = true;
+            // read the oldest response
+            qhttpclient_req_t *req = &reqs[done];
+            const char *method = (req->method != NULL) ? req->method : "GET";
+            off_t clength = 0;
+            int resno = _read_response(client, req->resheaders, &clength,
+                                       !strcasecmp(method, "HEAD"));
+            if (resno == HTTP_NO_RESPONSE) {
+                broken = true;
+                break;
             }
-        }
-        // check Content-Length & Transfer-Encoding header
-        else if (contentlength != NULL && *contentlength == 0) {
-            if (!strcasecmp(name, "Content-Length")) {
-                *contentlength = atoll(value);
+            if (!strcasecmp(method, "HEAD") || resno == HTTP_CODE_NO_CONTENT
+                    || resno == HTTP_CODE_NOT_MODIFIED) {
+                clength = 0;  // never has a body
+            }
+
+            void *data = NULL;
+            size_t size = 0;
+            if (_read_content(client, clength, &data, &size) == false) {
+                broken = true;
+                break;
             }
-            // check transfer-encoding header
-            else if (!strcasecmp(name, "Transfer-Encoding")
-                    && !strcasecmp(value, "chunked")) {
-                *contentlength = -1;
+            bool cont = true;
+            if (req->callback != NULL)
+                cont = req->callback(req, resno, data, size);
+            free(data);
+            done++;
+            retried = false;
+
+            if (cont == false) {
+                stopped = true;
+                break;
             }
+            if (client->connclose == true)
+                break;  // the rest must go on a new connection
+        }
+
+        if (done == nreqs || stopped == true)
+            break;
+
+        // replay unanswered requests on a new connection
+        _close(client);
+        if (broken == true) {
+            if (retried == true)
+                break;  // no progress on a fresh connection
+            retried = true;
+        }
+        int i;
+        for (i = done; i < sent; i++) {
+            if (_is_idempotent((reqs[i].method != NULL) ?
+                               reqs[i].method : "GET") == false)
+                break;
         }
+        if (i < sent)
+            break;
+        sent = done;
+    }
+
+    // responses still in flight can't be left on the connection
+    client->keepalive = keepalive;
+    if (sent > done || keepalive == false || client->connclose == true) {
+        _close(client);
     }
 
-    return rescode;
+    return done;
 }
 
 /**
@@ -1362,48 +1683,8 @@ static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
  *  characters will be counted, but not stored.
  */
 static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize) {
-#ifdef ENABLE_OPENSSL
-    if (client->ssl == NULL) {
-        return qio_gets(client->socket, buf, bufsize, client->timeoutms);
-    } else {
-        if (bufsize <= 1) return -1;
-
-        struct SslConn *ssl = client->ssl;
-        ssize_t readcnt = 0;
-        char *ptr;
-
-        for (ptr = buf; readcnt < (bufsize - 1); ptr++) {
-            // wait readable
-            //if (qio_wait_readable(client->socket, client->timeoutms) <= 0) {
-            //    break;
-            //}
-
-            int rsize = SSL_read(ssl->ssl, ptr, 1);
-            if (rsize != 1) {
-                unsigned long sslerr = ERR_get_error();
-                if (sslerr == SSL_ERROR_WANT_READ) {
-                    continue;
-                }
-
-                DEBUG("OpenSSL: %s (%d)",
-                        ERR_reason_error_string(sslerr), rsize);
-                break;
-            }
-
-            readcnt++;
-            if (*ptr == '\r') ptr--;
-            else if (*ptr == '\n') break;
-        }
-
-        *ptr = '\0';
-        DEBUG("SSL_read: %s (%zd)", buf, readcnt);
-
-        if (readcnt > 0) return readcnt;
-        return -1;
-    }
-#else
-    return qio_gets(client->socket, buf, bufsize, client->timeoutms);
-#endif
+    return qio_reader_readline(client->reader, buf, bufsize,
+                               client->timeoutms);
 }
 
 /**
@@ -1426,48 +1707,8 @@ static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize) {
  * @endcode
  */
 static ssize_t read_(qhttpclient_t *client, void *buf, size_t nbytes) {
-#ifdef ENABLE_OPENSSL
-    if (client->ssl == NULL) {
-        return qio_read(client->socket, buf, nbytes, client->timeoutms);
-    } else {
-        if (nbytes == 0) return 0;
-
-        struct SslConn *ssl = client->ssl;
-        ssize_t total = 0;
-        while (total < nbytes) {
-            //if (qio_wait_readable(client->socket, client->timeoutms) <= 0) {
-            //    break;
-            //}
-
-            int rsize = 0;
-            if (buf != NULL) {
-                rsize = SSL_read(ssl->ssl, buf + total, nbytes - total);
-            } else {
-                char trash[1024];
-                int toread = nbytes - total;
-                if (toread > sizeof(trash)) toread = sizeof(trash);
-                rsize = SSL_read(ssl->ssl, trash, toread);
-            }
-            if (rsize <= 0) {
-                DEBUG("OpenSSL: %s (%d)",
-                        ERR_reason_error_string(ERR_get_error()), rsize);
-                unsigned long sslerr = ERR_get_error();
-                if (sslerr == SSL_ERROR_WANT_READ) {
-                    usleep(1);
-                    continue;
-                }
-                break;
-            }
-            total += rsize;
-        }
-
-        DEBUG("SSL_read: %zd", total);
-        if (total > 0) return total;
-        return -1;
-    }
-#else
-    return qio_read(client->socket, buf, nbytes, client->timeoutms);
-#endif
+    return qio_reader_read_exact(client->reader, buf, nbytes,
+                                 client->timeoutms);
 }
 
 /**
@@ -1531,6 +1772,16 @@ static off_t recvfile(qhttpclient_t *client, int fd, off_t nbytes) {
 
     off_t total = 0;  // total size sent
     while (total < nbytes) {
+        if (client->ssl == NULL
+                && qio_reader_buffered(client->reader) == 0) {
+            // plain socket with nothing buffered, let the kernel move the rest.
+            off_t sent = qio_send(fd, client->socket, nbytes - total,
+                                  client->timeoutms);
+            if (sent > 0)
+                total += sent;
+            break;
+        }
+
         size_t chunksize;  // this time sending size
         if (nbytes - total <= sizeof(buf))
             chunksize = nbytes - total;
@@ -1538,7 +1789,8 @@ static off_t recvfile(qhttpclient_t *client, int fd, off_t nbytes) {
             chunksize = sizeof(buf);
 
         // read
-        ssize_t rsize = read_(client, buf, chunksize);
+        ssize_t rsize = qio_reader_read(client->reader, buf, chunksize,
+                                        client->timeoutms);
         if (rsize <= 0)
             break;
 
@@ -1573,6 +1825,12 @@ static off_t sendfile_(qhttpclient_t *client, int fd, off_t nbytes) {
     if (nbytes == 0)
         return 0;
 
+    if (client->ssl == NULL) {
+        // plain socket, let the kernel move the data.
+        off_t total = qio_send(client->socket, fd, nbytes, -1);
+        return (total > 0) ? total : -1;
+    }
+
     unsigned char buf[MAX_ATOMIC_DATA_SIZE];
 
     off_t total = 0;  // total size sent
@@ -1631,11 +1889,6 @@ static bool _close(qhttpclient_t *client) {
             SSL_free(ssl->ssl);
             ssl->ssl = NULL;
         }
-
-        if (ssl->ctx != NULL) {
-            SSL_CTX_free(ssl->ctx);
-            ssl->ctx = NULL;
-        }
     }
 #endif
 
@@ -1649,6 +1902,7 @@ static bool _close(qhttpclient_t *client) {
     // close connection
     close(client->socket);
     client->socket = -1;
+    qio_reader_reset(client->reader, -1);
     client->connclose = false;
 
     return true;
@@ -1678,11 +1932,392 @@ static void _free(qhttpclient_t *client) {
         free(client->hostname);
     if (client->useragent != NULL)
         free(client->useragent);
+    if (client->reqbuf != NULL)
+        free(client->reqbuf);
+    qio_reader_free(client->reader);
+    free(client->parser);
 
     free(client);
 }
 
+/**
+ * Create a connection pool which keeps idle keep-alive connections for reuse.
+ *
+ * @param maxperhost    maximum connections per host:port:tls, including the
+ *                      ones in use. 0 for no limit.
+ * @param idletimeoutms lifetime of idle connections. 0 for default (30
+ *                      seconds), -1 for no limit.
+ *
+ * @return a pointer of qhttppool_t object if successful, otherwise returns
+ *         NULL.
+ *
+ * @code
+ *   qhttppool_t *pool = qhttppool(8, 0);
+ *
+ *   // any thread
+ *   qhttpclient_t *client = qhttppool_get(pool, "http://www.qdecoder.org", 0);
+ *   client->get(client, "/robots.txt", ...);
+ *   qhttppool_put(pool, client);
+ *
+ *   qhttppool_free(pool);
+ * @endcode
+ *
+ * @note
+ *  The pool is thread-safe. Clients are not, so a client must be used by one
+ *  thread at a time between qhttppool_get() and qhttppool_put().
+ */
+qhttppool_t *qhttppool(int maxperhost, int idletimeoutms) {
+    qhttppool_t *pool = (qhttppool_t *) calloc(1, sizeof(qhttppool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    Q_MUTEX_NEW(pool->qmutex, true);
+    if (pool->qmutex == NULL) {
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pool->maxperhost = (maxperhost > 0) ? maxperhost : 0;
+    pool->idletimeoutms =
+            (idletimeoutms == 0) ? DEF_POOL_IDLETIMEOUT : idletimeoutms;
+
+    return pool;
+}
+
+/**
+ * Get a client from the pool.
+ *
+ * The most recently returned idle connection of the host is reused first.
+ * Idle connections which timed out or were closed by the peer are discarded.
+ * A new client is created if nothing can be reused.
+ *
+ * @param pool      qhttppool_t object pointer
+ * @param destname  remote address, same as qhttpclient()
+ * @param port      remote port number, same as qhttpclient()
+ *
+ * @return HTTP client object with keep-alive turned on if successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EBUSY  : The host has maxperhost connections already.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The client must be given back with qhttppool_put() instead of being
+ *  freed.
+ */
+qhttpclient_t *qhttppool_get(qhttppool_t *pool, const char *destname,
+                             int port) {
+    if (pool == NULL || destname == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // same parsing as qhttpclient()
+    bool ishttps = false;
+    char hostname[256];
+    if (port == 0 || strstr(destname, "://") != NULL) {
+        if (_parse_uri(destname, &ishttps, hostname, sizeof(hostname), &port)
+                == false) {
+            errno = EINVAL;
+            return NULL;
+        }
+    } else {
+        qstrcpy(hostname, sizeof(hostname), destname);
+    }
+#ifndef ENABLE_OPENSSL
+    ishttps = false;
+#endif
+
+    char key[MAX_POOL_KEY];
+    _pool_key(key, sizeof(key), hostname, port, ishttps);
+
+    qhttpclient_t *client = NULL;
+    struct PoolConn *stale = NULL;
+    bool busy = false;
+
+    Q_MUTEX_ENTER(pool->qmutex);
+    struct PoolHost *host = _pool_host(pool, key, true);
+    if (host == NULL) {
+        Q_MUTEX_LEAVE(pool->qmutex);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    long now = qtime_current_milli();
+    while (host->idle != NULL) {
+        struct PoolConn *conn = host->idle;
+        host->idle = conn->next;
+        if ((pool->idletimeoutms < 0
+                || now - conn->idlesince < pool->idletimeoutms)
+                && _is_alive(conn->client) == true) {
+            client = conn->client;
+            free(conn);
+            break;
+        }
+        conn->next = stale;
+        stale = conn;
+        host->nconns--;
+    }
+
+    if (client == NULL) {
+        if (pool->maxperhost > 0 && host->nconns >= pool->maxperhost) {
+            busy = true;
+        } else {
+            host->nconns++;  // reserve a slot for the new one
+        }
+    }
+    Q_MUTEX_LEAVE(pool->qmutex);
+
+    // closing may wait for the peer, so it's done outside of the lock.
+    _pool_release(stale);
+
+    if (busy == true) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    if (client == NULL) {
+        client = qhttpclient(destname, port);
+        if (client == NULL) {
+            Q_MUTEX_ENTER(pool->qmutex);
+            host->nconns--;
+            Q_MUTEX_LEAVE(pool->qmutex);
+            return NULL;
+        }
+        setkeepalive(client, true);
+    }
+    client->poolhost = host;  // hosts live as long as the pool
+
+    return client;
+}
+
+/**
+ * Give a client back to the pool.
+ *
+ * The connection is kept for reuse if it's still open and the last response
+ * allows keep-alive, otherwise the client is freed. Either way, the slot is
+ * given back to the host the client was leased for.
+ *
+ * @param pool      qhttppool_t object pointer
+ * @param client    HTTP client object from qhttppool_get()
+ */
+void qhttppool_put(qhttppool_t *pool, qhttpclient_t *client) {
+    if (client == NULL)
+        return;
+    struct PoolHost *host = (struct PoolHost *) client->poolhost;
+    client->poolhost = NULL;
+    if (pool == NULL || host == NULL) {
+        client->free(client);
+        return;
+    }
+
+    // setssl() may have been called after the lease, then it's not the
+    // kind of connection the host keeps.
+    char key[MAX_POOL_KEY];
+    _pool_key(key, sizeof(key), client->hostname, client->port,
+              (client->ssl != NULL));
+
+    struct PoolConn *conn = NULL;
+    if (client->socket >= 0 && client->keepalive == true
+            && client->connclose == false
+            && qio_reader_buffered(client->reader) == 0
+            && !strcmp(key, host->key)) {
+        conn = (struct PoolConn *) malloc(sizeof(struct PoolConn));
+    }
+
+    long now = qtime_current_milli();
+    Q_MUTEX_ENTER(pool->qmutex);
+    if (conn != NULL) {
+        conn->client = client;
+        conn->idlesince = now;
+        conn->next = host->idle;
+        host->idle = conn;
+        client = NULL;
+        conn = NULL;
+    } else {
+        host->nconns--;
+    }
+    struct PoolConn *stale = _pool_expire(pool, now);
+    Q_MUTEX_LEAVE(pool->qmutex);
+
+    if (client != NULL)
+        client->free(client);
+    _pool_release(stale);
+}
+
+/**
+ * De-allocate the pool and close the idle connections.
+ *
+ * @param pool      qhttppool_t object pointer
+ *
+ * @note
+ *  Clients which haven't been given back are not affected and must be freed
+ *  by the caller.
+ */
+void qhttppool_free(qhttppool_t *pool) {
+    if (pool == NULL)
+        return;
+
+    struct PoolHost *host, *next;
+    for (host = pool->hosts; host != NULL; host = next) {
+        next = host->next;
+        _pool_release(host->idle);
+        free(host->key);
+        free(host);
+    }
+
+    Q_MUTEX_DESTROY(pool->qmutex);
+    free(pool);
+}
+
 #ifndef _DOXYGEN_SKIP
+#ifdef ENABLE_OPENSSL
+// read source of the reader for SSL connections.
+static ssize_t _ssl_read(void *arg, void *buf, size_t nbytes, int timeoutms) {
+    qhttpclient_t *client = (qhttpclient_t *) arg;
+    struct SslConn *ssl = client->ssl;
+
+    if (nbytes > INT_MAX)
+        nbytes = INT_MAX;
+
+    while (true) {
+        // decrypted data may be pending without the socket being readable.
+        if (SSL_pending(ssl->ssl) == 0 && timeoutms >= 0) {
+            int ret = qio_wait_readable(client->socket, timeoutms);
+            if (ret <= 0)
+                return ret;
+        }
+
+        int rsize = SSL_read(ssl->ssl, buf, nbytes);
+        if (rsize > 0) {
+            DEBUG("SSL_read: %d", rsize);
+            return rsize;
+        }
+
+        int sslerr = SSL_get_error(ssl->ssl, rsize);
+        if (sslerr == SSL_ERROR_WANT_READ || sslerr == SSL_ERROR_WANT_WRITE)
+            continue;
+
+        DEBUG("OpenSSL: %s (%d)",
+              ERR_reason_error_string(ERR_get_error()), rsize);
+        return -1;
+    }
+}
+
+// Get the SSL context shared by all clients, creating it on first use.
+static SSL_CTX *_ssl_context(void) {
+    Q_MUTEX_ENTER(_ssl_mutex);
+    if (_ssl_ctx == NULL) {
+        SSL_load_error_strings();
+        SSL_library_init();
+
+        SSL_CTX *ctx = SSL_CTX_new(SSLv23_client_method());
+        if (ctx != NULL) {
+            // keep sessions out of OpenSSL's internal cache, we index them
+            // by host ourselves.
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT
+                                           | SSL_SESS_CACHE_NO_INTERNAL);
+            SSL_CTX_sess_set_new_cb(ctx, _ssl_newsession);
+            _ssl_exindex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+            _ssl_ctx = ctx;
+        } else {
+            DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
+        }
+    }
+    Q_MUTEX_LEAVE(_ssl_mutex);
+    return _ssl_ctx;
+}
+
+// Called by OpenSSL when the server issues a session, which is during the
+// handshake for TLS 1.2 and after it, as session tickets, for TLS 1.3.
+static int _ssl_newsession(SSL *ssl, SSL_SESSION *session) {
+    qhttpclient_t *client = SSL_get_ex_data(ssl, _ssl_exindex);
+    if (client == NULL)
+        return 0;
+
+    char key[MAX_POOL_KEY];
+    snprintf(key, sizeof(key), "%s:%d", client->hostname, client->port);
+
+    Q_MUTEX_ENTER(_ssl_mutex);
+    struct SslSession *entry, **link;
+    for (link = &_ssl_sessions; *link != NULL; link = &(*link)->next) {
+        if (!strcmp((*link)->key, key))
+            break;
+    }
+    entry = *link;
+    if (entry != NULL) {
+        *link = entry->next;
+    } else {
+        entry = (struct SslSession *) calloc(1, sizeof(struct SslSession));
+        if (entry == NULL) {
+            Q_MUTEX_LEAVE(_ssl_mutex);
+            return 0;
+        }
+        qstrcpy(entry->key, sizeof(entry->key), key);
+        _ssl_nsessions++;
+    }
+
+    // queue the session behind the others of the host
+    if (entry->nsessions == MAX_SSL_TICKETS) {
+        SSL_SESSION_free(entry->sessions[0]);
+        entry->nsessions--;
+        memmove(entry->sessions, entry->sessions + 1,
+                sizeof(SSL_SESSION *) * entry->nsessions);
+    }
+    entry->sessions[entry->nsessions++] = session;
+    entry->next = _ssl_sessions;
+    _ssl_sessions = entry;
+
+    // drop the host least recently given a session
+    if (_ssl_nsessions > MAX_SSL_SESSIONS) {
+        for (link = &_ssl_sessions; (*link)->next != NULL;
+                link = &(*link)->next);
+        int i;
+        for (i = 0; i < (*link)->nsessions; i++) {
+            SSL_SESSION_free((*link)->sessions[i]);
+        }
+        free(*link);
+        *link = NULL;
+        _ssl_nsessions--;
+    }
+    Q_MUTEX_LEAVE(_ssl_mutex);
+
+    return 1;  // we hold the reference now
+}
+
+// Offer the newest resumable session of the host to the server. A single
+// use session is taken out of the queue, so no other connection offers it.
+static void _ssl_setsession(qhttpclient_t *client, SSL *ssl) {
+    char key[MAX_POOL_KEY];
+    snprintf(key, sizeof(key), "%s:%d", client->hostname, client->port);
+
+    Q_MUTEX_ENTER(_ssl_mutex);
+    struct SslSession *entry;
+    for (entry = _ssl_sessions; entry != NULL; entry = entry->next) {
+        if (!strcmp(entry->key, key))
+            break;
+    }
+    while (entry != NULL && entry->nsessions > 0) {
+        SSL_SESSION *session = entry->sessions[entry->nsessions - 1];
+        bool resumable = SSL_SESSION_RESUMABLE(session);
+        if (resumable == true) {
+            SSL_set_session(ssl, session);  // takes its own reference
+            if (!SSL_SESSION_SINGLE_USE(session))
+                break;
+        }
+        SSL_SESSION_free(session);
+        entry->nsessions--;
+        if (resumable == true)
+            break;
+    }
+    Q_MUTEX_LEAVE(_ssl_mutex);
+}
+#endif
+
 static bool _set_socket_option(int socket) {
     bool ret = true;
 
@@ -1709,6 +2344,604 @@ static bool _set_socket_option(int socket) {
     return ret;
 }
 
+// Tell whether an idle connection can be reused. A peer which has closed
+// or half-closed the connection makes the socket readable, so does any
+// unsolicited data, and neither can be followed by a new request.
+static bool _is_alive(qhttpclient_t *client) {
+    if (qio_reader_buffered(client->reader) > 0)
+        return false;
+#ifdef ENABLE_OPENSSL
+    if (client->ssl != NULL) {
+        struct SslConn *ssl = client->ssl;
+        if (ssl->ssl == NULL || SSL_pending(ssl->ssl) > 0)
+            return false;
+    }
+#endif
+
+    int ret = qio_wait_readable(client->socket, 0);
+    if (ret == 0)
+        return true;
+    if (ret < 0)
+        return false;
+
+    char c;
+    ssize_t n = recv(client->socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+// Send a request head and an optional body, in one write when possible.
+static bool _send_request(qhttpclient_t *client, const char *method,
+                          const char *uri, qlisttbl_t *reqheaders,
+                          const void *body, size_t bodysize) {
+    if (open_(client) == false) {
+        return false;
+    }
+    client->headreq = (strcasecmp(method, "HEAD") == 0);
+
+    size_t len = 0;
+    if (_build_request(client, &len, method, uri, reqheaders,
+                       (body != NULL) ? bodysize : 0) == false) {
+        return false;
+    }
+    if (body == NULL || bodysize == 0) {
+        return (write_(client, client->reqbuf, len) == len);
+    }
+
+#ifdef ENABLE_OPENSSL
+    if (client->ssl != NULL) {
+        // copy a small body behind the head to send a single record.
+        if (bodysize <= MAX_ATOMIC_DATA_SIZE
+                && _reqbuf_reserve(client, len, bodysize) == true) {
+            memcpy(client->reqbuf + len, body, bodysize);
+            return (write_(client, client->reqbuf, len + bodysize)
+                    == len + bodysize);
+        }
+        return (write_(client, client->reqbuf, len) == len
+                && write_(client, body, bodysize) == bodysize);
+    }
+#endif
+
+    struct iovec iov[2];
+    iov[0].iov_base = client->reqbuf;
+    iov[0].iov_len = len;
+    iov[1].iov_base = (void *) body;
+    iov[1].iov_len = bodysize;
+    return (qio_writev(client->socket, iov, 2, -1) == len + bodysize);
+}
+
+// Read a response head. nobody is true for a response to HEAD, which
+// never has a body whatever its headers say.
+static int _read_response(qhttpclient_t *client, qlisttbl_t *resheaders,
+                          off_t *contentlength, bool nobody) {
+    if (contentlength != NULL) {
+        *contentlength = 0;
+    }
+
+    // parse the head in place once it's all in the read buffer
+    qhttpparser_t *parser = client->parser;
+    qhttpparser_init(parser, nobody);
+
+    const void *buf = NULL;
+    size_t consumed = 0;
+    size_t want = 1;
+    int event = QHTTPPARSER_MORE;
+    while (event == QHTTPPARSER_MORE) {
+        // the read buffer grows for a long head, up to MAX_HEAD_SIZE
+        if (want > MAX_HEAD_SIZE
+                || qio_reader_reserve(client->reader, want) == false) {
+            break;
+        }
+        ssize_t avail = qio_reader_peek(client->reader, &buf, want,
+                                        client->timeoutms);
+        if (avail <= 0 || (size_t) avail < want)
+            break;  // closed or timed out
+
+        event = qhttpparser_parse(parser, (const char *) buf, avail,
+                                  &consumed, NULL, NULL);
+        want = avail + 1;
+    }
+    if (event != QHTTPPARSER_HEAD) {
+        // the rest of this response can't be told from the next one
+        client->connclose = true;
+        return HTTP_NO_RESPONSE;
+    }
+
+    if (resheaders != NULL) {
+        qhttpparser_copyheaders(parser, resheaders);
+    }
+    if (parser->keepalive == false) {
+        client->connclose = true;
+    }
+    if (contentlength != NULL) {
+        if (parser->chunked == true) {
+            *contentlength = -1;
+        } else if (parser->contentlength > 0) {
+            *contentlength = parser->contentlength;
+        }
+    }
+
+    // the headers are copied, drop the head from the read buffer
+    qio_reader_read(client->reader, NULL, consumed, 0);
+
+    return parser->status;
+}
+
+// Serialize a request head into the request buffer of the client at offset,
+// without touching reqheaders.
+static bool _build_request(qhttpclient_t *client, size_t *offset,
+                           const char *method, const char *uri,
+                           qlisttbl_t *reqheaders, size_t bodysize) {
+    // request line
+    if (_reqbuf_printf(client, offset, "%s %s %s\r\n", method, uri,
+                       HTTP_PROTOCOL_11) == false) {
+        return false;
+    }
+
+    // default headers
+    bool ret = true;
+    if (_has_header(reqheaders, "Host") == false) {
+        ret &= _reqbuf_printf(client, offset, "Host: %s:%d\r\n",
+                              client->hostname, client->port);
+    }
+    if (_has_header(reqheaders, "User-Agent") == false) {
+        ret &= _reqbuf_printf(client, offset, "User-Agent: %s\r\n",
+                              client->useragent);
+    }
+    if (_has_header(reqheaders, "Accept") == false) {
+        ret &= _reqbuf_printf(client, offset, "Accept: */*\r\n");
+    }
+    if (client->compression == true
+            && _has_header(reqheaders, "Accept-Encoding") == false) {
+        ret &= _reqbuf_printf(client, offset,
+                              "Accept-Encoding: gzip, deflate\r\n");
+    }
+    if (_has_header(reqheaders, "Connection") == false) {
+        ret &= _reqbuf_printf(client, offset, "Connection: %s\r\n",
+                              (client->keepalive == true) ?
+                                      "Keep-Alive" : "close");
+    }
+    if (bodysize > 0 && _has_header(reqheaders, "Content-Length") == false) {
+        ret &= _reqbuf_printf(client, offset, "Content-Length: %zu\r\n",
+                              bodysize);
+    }
+
+    // user headers
+    if (reqheaders != NULL) {
+        qlisttbl_obj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+        reqheaders->lock(reqheaders);
+        while (ret == true
+                && reqheaders->getnext(reqheaders, &obj, NULL, false) == true) {
+            ret &= _reqbuf_printf(client, offset, "%s: %s\r\n", obj.name,
+                                  (char *) obj.data);
+        }
+        reqheaders->unlock(reqheaders);
+    }
+
+    ret &= _reqbuf_printf(client, offset, "\r\n");
+    return ret;
+}
+
+static bool _has_header(qlisttbl_t *headers, const char *name) {
+    return (headers != NULL && headers->get(headers, name, NULL, false) != NULL);
+}
+
+// Make room for nbytes more at offset in the request buffer.
+static bool _reqbuf_reserve(qhttpclient_t *client, size_t offset,
+                            size_t nbytes) {
+    if (offset + nbytes <= client->reqbufsize)
+        return true;
+
+    size_t newsize = (client->reqbufsize > 0) ?
+            client->reqbufsize * 2 : DEF_REQBUF_SIZE;
+    while (newsize < offset + nbytes)
+        newsize *= 2;
+    char *reqbuf = (char *) realloc(client->reqbuf, newsize);
+    if (reqbuf == NULL)
+        return false;
+    client->reqbuf = reqbuf;
+    client->reqbufsize = newsize;
+
+    return true;
+}
+
+static bool _reqbuf_printf(qhttpclient_t *client, size_t *offset,
+                           const char *format, ...) {
+    if (_reqbuf_reserve(client, *offset, 1) == false)
+        return false;
+
+    while (true) {
+        va_list arglist;
+        va_start(arglist, format);
+        int n = vsnprintf(client->reqbuf + *offset,
+                          client->reqbufsize - *offset, format, arglist);
+        va_end(arglist);
+        if (n < 0)
+            return false;
+        if (*offset + n < client->reqbufsize) {
+            *offset += n;
+            return true;
+        }
+        if (_reqbuf_reserve(client, *offset, n + 1) == false)
+            return false;
+    }
+}
+
+// Read a whole response body of Content-Length or chunked encoding into a
+// NUL terminated buffer. The body is thrown away if data is NULL.
+static bool _read_content(qhttpclient_t *client, off_t clength, void **data,
+                          size_t *size) {
+    if (data != NULL) {
+        *data = NULL;
+        *size = 0;
+    }
+
+    qhttpdecoder_t *decoder = NULL;
+    if (data != NULL && client->compression == true && clength != 0)
+        decoder = qhttpdecoder(client->parser);
+
+    if (decoder != NULL) {
+        struct MemSink sink = { NULL, 0 };
+        const char *piece;
+        size_t held = 0;
+        ssize_t ret;
+        while ((ret = _read_body(client, &piece, &held)) > 0) {
+            if (qhttpdecoder_decode(decoder, piece, ret, _append_mem, &sink)
+                    == false) {
+                ret = -1;
+                break;
+            }
+        }
+        if (ret == 0 && qhttpdecoder_finish(decoder) == false)
+            ret = -1;
+        qhttpdecoder_free(decoder);
+
+        if (ret == 0 && sink.data == NULL)
+            sink.data = strdup("");
+        if (ret < 0 || sink.data == NULL) {
+            free(sink.data);
+            return false;
+        }
+        *data = sink.data;
+        *size = sink.size;
+    } else if (clength > 0) {
+        if (data == NULL)
+            return (read_(client, NULL, clength) == clength);
+
+        char *content = (char *) malloc(clength + 1);
+        if (content == NULL)
+            return false;
+        if (read_(client, content, clength) != clength) {
+            free(content);
+            return false;
+        }
+        content[clength] = '\0';
+        *data = content;
+        *size = clength;
+    } else if (clength == -1) {  // chunked
+        char *content = NULL;
+        size_t len = 0;
+        const char *piece;
+        size_t held = 0;
+        ssize_t ret;
+        while ((ret = _read_body(client, &piece, &held)) > 0) {
+            if (data == NULL)
+                continue;
+            struct MemSink sink = { content, len };
+            if (_append_mem(&sink, piece, ret) == false) {
+                ret = -1;
+                break;
+            }
+            content = sink.data;
+            len = sink.size;
+        }
+        if (ret < 0) {
+            free(content);
+            return false;
+        }
+        if (data != NULL) {
+            if (content == NULL)
+                content = strdup("");
+            *data = content;
+            *size = len;
+            return (content != NULL);
+        }
+    }
+
+    return true;
+}
+
+// Get the next piece of a Content-Length or chunked body through the
+// response parser. The piece stays in the reader's buffer until the next
+// call, which discards the held bytes first. Returns 0 at the end of the
+// body.
+static ssize_t _read_body(qhttpclient_t *client, const char **data,
+                          size_t *held) {
+    if (*held > 0) {
+        qio_reader_read(client->reader, NULL, *held, 0);
+        *held = 0;
+    }
+
+    // what's buffered is parsed first, the body may be complete already.
+    size_t want = 0;
+    while (true) {
+        const void *buf = NULL;
+        ssize_t avail = qio_reader_peek(client->reader, &buf, want,
+                                        client->timeoutms);
+        if (avail < 0)
+            return -1;
+
+        size_t consumed;
+        size_t size;
+        int event = qhttpparser_parse(client->parser, (const char *) buf,
+                                      avail, &consumed, data, &size);
+        if (event == QHTTPPARSER_BODY) {
+            *held = consumed;
+            return size;
+        }
+        if (consumed > 0)
+            qio_reader_read(client->reader, NULL, consumed, 0);
+        if (event == QHTTPPARSER_DONE)
+            return 0;
+
+        // end of stream, timed out or a framing line is too long
+        if (event != QHTTPPARSER_MORE || (size_t) avail < want)
+            return -1;
+        want = avail - consumed + 1;
+    }
+}
+
+// Output of the content decoder writing to a file descriptor.
+static bool _write_fd(void *userdata, const void *data, size_t size) {
+    struct FdSink *sink = (struct FdSink *) userdata;
+    if (qio_write(sink->fd, data, size, -1) != (ssize_t) size)
+        return false;
+    sink->saved += size;
+    return true;
+}
+
+// Append data to a growing NUL terminated buffer.
+static bool _append_mem(void *userdata, const void *data, size_t size) {
+    struct MemSink *sink = (struct MemSink *) userdata;
+    char *newdata = (char *) realloc(sink->data, sink->size + size + 1);
+    if (newdata == NULL)
+        return false;
+    memcpy(newdata + sink->size, data, size);
+    sink->data = newdata;
+    sink->size += size;
+    sink->data[sink->size] = '\0';
+    return true;
+}
+
+// Fetch ranges of a download one after another on a connection of its own.
+static void *_range_worker(void *arg) {
+    struct RangeJob *job = (struct RangeJob *) arg;
+    qhttpclient_t *tmpl = job->client;
+
+    char *buf = (char *) malloc(MAX_ATOMIC_DATA_SIZE);
+    qhttpclient_t *client = qhttpclient(tmpl->hostname, tmpl->port);
+    qlisttbl_t *headers = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+    if (buf == NULL || client == NULL || headers == NULL) {
+        Q_MUTEX_ENTER(job->qmutex);
+        job->failures++;
+        if (job->failures > job->maxfailures)
+            job->stop = true;
+        Q_MUTEX_LEAVE(job->qmutex);
+        goto done;
+    }
+    if (tmpl->ssl != NULL)
+        setssl(client);
+    settimeout(client, tmpl->timeoutms);
+    setkeepalive(client, true);
+    setuseragent(client, tmpl->useragent);
+
+    // copy user headers, the table may not be thread-safe
+    Q_MUTEX_ENTER(job->qmutex);
+    if (job->reqheaders != NULL) {
+        qlisttbl_obj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+        job->reqheaders->lock(job->reqheaders);
+        while (job->reqheaders->getnext(job->reqheaders, &obj, NULL, false)) {
+            headers->putstr(headers, obj.name, (char *) obj.data);
+        }
+        job->reqheaders->unlock(job->reqheaders);
+    }
+    Q_MUTEX_LEAVE(job->qmutex);
+
+    while (true) {
+        struct Range range;
+        Q_MUTEX_ENTER(job->qmutex);
+        bool more = (job->stop == false && job->nranges > 0);
+        if (more == true)
+            range = job->ranges[--job->nranges];
+        Q_MUTEX_LEAVE(job->qmutex);
+        if (more == false)
+            break;
+
+        int resno = _range_fetch(client, job, headers, &range, buf,
+                                 MAX_ATOMIC_DATA_SIZE);
+        if (range.start > range.end)
+            continue;  // done
+
+        // fetch the rest again later unless it's hopeless
+        _close(client);
+        Q_MUTEX_ENTER(job->qmutex);
+        job->failures++;
+        if (resno != HTTP_NO_RESPONSE)
+            job->rescode = resno;
+        if (job->stop == false) {
+            if ((resno != HTTP_NO_RESPONSE && resno != HTTP_CODE_PARTIAL_CONTENT
+                    && resno / 100 != 5)
+                    || job->failures > job->maxfailures
+                    || _range_push(job, range.start, range.end) == false) {
+                job->stop = true;
+            }
+        }
+        Q_MUTEX_LEAVE(job->qmutex);
+    }
+
+done:
+    if (headers != NULL)
+        headers->free(headers);
+    if (client != NULL)
+        _free(client);
+    free(buf);
+    return NULL;
+}
+
+// Fetch a range into the file. range->start advances as data is written,
+// so a failed range can be resumed. Returns the response code.
+static int _range_fetch(qhttpclient_t *client, struct RangeJob *job,
+                        qlisttbl_t *headers, struct Range *range, char *buf,
+                        size_t bufsize) {
+    headers->putstrf(headers, "Range", "bytes=%jd-%jd",
+                     (intmax_t) range->start, (intmax_t) range->end);
+    if (sendrequest(client, "GET", job->uri, headers) == false)
+        return HTTP_NO_RESPONSE;
+
+    off_t clength = 0;
+    int resno = readresponse(client, NULL, &clength);
+    if (resno != HTTP_CODE_PARTIAL_CONTENT)
+        return resno;
+
+    // the server must send exactly what was asked for
+    const qhttpparser_header_t *h;
+    h = qhttpparser_header(client->parser, QHTTP_HDR_CONTENT_RANGE);
+    char expect[64];
+    int len = snprintf(expect, sizeof(expect), "bytes %jd-%jd/",
+                       (intmax_t) range->start, (intmax_t) range->end);
+    if (h == NULL || h->valuelen < (size_t) len
+            || strncasecmp(h->value, expect, len)
+            || clength != range->end - range->start + 1) {
+        return HTTP_NO_RESPONSE;
+    }
+
+    while (range->start <= range->end) {
+        size_t want = bufsize;
+        if ((off_t) want > range->end - range->start + 1)
+            want = range->end - range->start + 1;
+        ssize_t rsize = qio_reader_read(client->reader, buf, want,
+                                        client->timeoutms);
+        if (rsize <= 0)
+            return resno;
+
+        ssize_t wsize = pwrite(job->fd, buf, rsize, range->start);
+        if (wsize != rsize) {
+            Q_MUTEX_ENTER(job->qmutex);
+            job->stop = true;  // local error, retrying won't help
+            Q_MUTEX_LEAVE(job->qmutex);
+            return resno;
+        }
+        range->start += rsize;
+
+        Q_MUTEX_ENTER(job->qmutex);
+        job->received += rsize;
+        if (job->stop == false && job->callback != NULL
+                && job->callback(job->userdata, job->received) == false) {
+            job->stop = true;
+        }
+        bool stop = job->stop;
+        Q_MUTEX_LEAVE(job->qmutex);
+        if (stop == true)
+            return resno;
+    }
+
+    if (client->connclose == true)
+        _close(client);
+    return resno;
+}
+
+static bool _range_push(struct RangeJob *job, off_t start, off_t end) {
+    if (job->nranges == job->maxranges) {
+        int maxranges = (job->maxranges > 0) ? job->maxranges * 2 : 16;
+        struct Range *ranges = (struct Range *) realloc(job->ranges,
+                maxranges * sizeof(struct Range));
+        if (ranges == NULL)
+            return false;
+        job->ranges = ranges;
+        job->maxranges = maxranges;
+    }
+    job->ranges[job->nranges].start = start;
+    job->ranges[job->nranges].end = end;
+    job->nranges++;
+    return true;
+}
+
+// RFC 7231, 4.2.2
+static bool _is_idempotent(const char *method) {
+    const char *methods[] = { "GET", "HEAD", "PUT", "DELETE", "OPTIONS",
+                              "TRACE", NULL };
+    int i;
+    for (i = 0; methods[i] != NULL; i++) {
+        if (!strcasecmp(method, methods[i]))
+            return true;
+    }
+    return false;
+}
+
+static void _pool_key(char *key, size_t size, const char *hostname, int port,
+                      bool ssl) {
+    snprintf(key, size, "%s:%d:%d", hostname, port, (ssl == true) ? 1 : 0);
+}
+
+static struct PoolHost *_pool_host(qhttppool_t *pool, const char *key,
+                                   bool create) {
+    struct PoolHost *host;
+    for (host = pool->hosts; host != NULL; host = host->next) {
+        if (!strcmp(host->key, key))
+            return host;
+    }
+    if (create == false)
+        return NULL;
+
+    host = (struct PoolHost *) calloc(1, sizeof(struct PoolHost));
+    if (host == NULL)
+        return NULL;
+    host->key = strdup(key);
+    if (host->key == NULL) {
+        free(host);
+        return NULL;
+    }
+    host->next = pool->hosts;
+    pool->hosts = host;
+
+    return host;
+}
+
+// Detach idle connections which timed out. Must be called with the lock.
+static struct PoolConn *_pool_expire(qhttppool_t *pool, long now) {
+    if (pool->idletimeoutms < 0)
+        return NULL;
+
+    struct PoolConn *stale = NULL;
+    struct PoolHost *host;
+    for (host = pool->hosts; host != NULL; host = host->next) {
+        struct PoolConn **link = &host->idle;
+        while (*link != NULL) {
+            struct PoolConn *conn = *link;
+            if (now - conn->idlesince < pool->idletimeoutms) {
+                link = &conn->next;
+                continue;
+            }
+            *link = conn->next;
+            conn->next = stale;
+            stale = conn;
+            host->nconns--;
+        }
+    }
+
+    return stale;
+}
+
+static void _pool_release(struct PoolConn *conns) {
+    while (conns != NULL) {
+        struct PoolConn *next = conns->next;
+        conns->client->free(conns->client);
+        free(conns);
+        conns = next;
+    }
+}
+
 static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
                        size_t namesize, int *port) {
 
@@ -0,0 +1,882 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qhttpparser.c Incremental HTTP response parser.
+ *
+ * qhttpparser is a state machine parsing an HTTP/1.x response as it
+ * arrives: the status line, headers, Content-Length or chunked framing and
+ * trailers. It never copies. Headers are returned as views into the
+ * caller's buffer and the well-known ones are classified by token while
+ * parsing, so looking them up doesn't compare strings. The parser keeps
+ * no reference to the buffer between calls, which lets it be fed from
+ * partial reads of a blocking stream or of a non-blocking socket alike.
+ *
+ * The caller owns the buffer. Each call reports how many bytes it
+ * consumed; those may be discarded once the returned views are no longer
+ * needed, and the rest must be passed again, followed by new data. The
+ * whole response head has to be in the buffer at once.
+ *
+ * @code
+ *   qhttpparser_t parser;
+ *   qhttpparser_init(&parser, false);
+ *
+ *   while (true) {
+ *     size_t consumed;
+ *     const char *data;
+ *     size_t size;
+ *     int event = qhttpparser_parse(&parser, buf, buflen, &consumed,
+ *                                   &data, &size);
+ *     if (event == QHTTPPARSER_HEAD) {
+ *       const qhttpparser_header_t *h;
+ *       h = qhttpparser_header(&parser, QHTTP_HDR_CONTENT_TYPE);
+ *       if (h != NULL) printf("%.*s\n", (int) h->valuelen, h->value);
+ *     } else if (event == QHTTPPARSER_BODY) {
+ *       fwrite(data, 1, size, stdout);
+ *     }
+ *
+ *     // drop the consumed bytes from buf
+ *     memmove(buf, buf + consumed, buflen - consumed);
+ *     buflen -= consumed;
+ *
+ *     if (event == QHTTPPARSER_DONE || event == QHTTPPARSER_ERROR) break;
+ *     if (event == QHTTPPARSER_MORE) {
+ *       // append more data to buf, or call qhttpparser_eof() at the end
+ *     }
+ *   }
+ * @endcode
+ *
+ * A body sent with Content-Encoding gzip or deflate can be decompressed
+ * piece by piece with qhttpdecoder, which needs qLibc to be built with
+ * zlib (--with-zlib). It uses a fixed output buffer, so memory stays
+ * bounded regardless of the body size.
+ *
+ * @code
+ *   // after QHTTPPARSER_HEAD
+ *   qhttpdecoder_t *decoder = qhttpdecoder(&parser);
+ *
+ *   // on each QHTTPPARSER_BODY
+ *   if (decoder != NULL) {
+ *     qhttpdecoder_decode(decoder, data, size, write_cb, stdout);
+ *   }
+ *
+ *   // on QHTTPPARSER_DONE
+ *   if (decoder != NULL) {
+ *     bool complete = qhttpdecoder_finish(decoder);
+ *     qhttpdecoder_free(decoder);
+ *   }
+ * @endcode
+ *
+ * @note
+ *  An interim 1xx response is reported as QHTTPPARSER_HEAD followed by
+ *  QHTTPPARSER_DONE. Call qhttpparser_init() again to parse the final
+ *  response that follows it.
+ */
+
+#ifndef DISABLE_QHTTPCLIENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "qinternal.h"
+#include "containers/qlisttbl.h"
+#include "extensions/qhttpparser.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define MAX_LINE_SIZE   (1024)  /*< maximum chunk size or trailer line */
+#define DECODE_BUFSIZE  (16 * 1024)  /*< decoder output buffer size */
+
+struct qhttpdecoder_s {
+#ifdef ENABLE_ZLIB
+    z_stream zs;
+#endif
+    bool gzip;      /*< labeled gzip, otherwise deflate */
+    bool gzipdata;  /*< the data is gzip, which may have several members */
+    bool started;   /*< inflate is set up for the data */
+    bool ended;     /*< reached the end of the stream or a gzip member */
+    bool trailing;  /*< ignoring what follows the end */
+    unsigned char head[2];  /*< first bytes of the stream or a member */
+    size_t headlen;
+    unsigned char out[DECODE_BUFSIZE];
+};
+
+/* parsing states */
+enum {
+    P_HEAD = 0,
+    P_LENGTH,
+    P_CLOSE,
+    P_CHUNK_SIZE,
+    P_CHUNK_DATA,
+    P_CHUNK_CRLF,
+    P_TRAILER,
+    P_DONE,
+    P_ERROR
+};
+
+static bool parse_head(qhttpparser_t *parser, const char *buf, size_t size);
+static bool parse_header(qhttpparser_t *parser, const char *line,
+                         const char *end);
+static int classify(const char *name, size_t namelen);
+static bool hastoken(const char *value, size_t valuelen, const char *token);
+static const char *findcrlf(const char *buf, size_t size);
+#ifdef ENABLE_ZLIB
+static int decoder_start(qhttpdecoder_t *decoder);
+static bool decoder_inflate(qhttpdecoder_t *decoder, const void *data,
+                            size_t size,
+                            bool (*output)(void *userdata, const void *data,
+                                           size_t size),
+                            void *userdata);
+#endif
+
+#endif
+
+/**
+ * Initialize a parser for a new response.
+ *
+ * @param parser    qhttpparser_t structure to initialize.
+ * @param nobody    true if the response is for a HEAD request and has no
+ *                  body regardless of its headers.
+ *
+ * @code
+ *   qhttpparser_t parser;
+ *   qhttpparser_init(&parser, false);
+ * @endcode
+ */
+void qhttpparser_init(qhttpparser_t *parser, bool nobody) {
+    memset((void *) parser, 0, sizeof(qhttpparser_t));
+    parser->contentlength = -1;
+    parser->state = P_HEAD;
+    parser->nobody = nobody;
+    memset((void *) parser->index, -1, sizeof(parser->index));
+}
+
+/**
+ * Parse the next piece of a response.
+ *
+ * @param parser    qhttpparser_t structure.
+ * @param buf       unconsumed response data.
+ * @param size      size of buf.
+ * @param consumed  number of bytes consumed from buf is stored.
+ * @param data      a piece of body is stored on QHTTPPARSER_BODY (can be
+ *                  NULL if the body is not wanted).
+ * @param datasize  size of the piece is stored (can be NULL).
+ *
+ * @return QHTTPPARSER_HEAD when the status line and headers are parsed,
+ *         QHTTPPARSER_BODY when data points to a piece of the body,
+ *         QHTTPPARSER_DONE at the end of the response, QHTTPPARSER_MORE if
+ *         buf doesn't have enough data to go on, or QHTTPPARSER_ERROR
+ *         with errno EPROTO if the response is malformed.
+ *
+ * @note
+ *  Views returned on QHTTPPARSER_HEAD and QHTTPPARSER_BODY point into buf
+ *  and are valid as long as the consumed bytes stay in place. After
+ *  QHTTPPARSER_HEAD or QHTTPPARSER_BODY, call again even if buf has no
+ *  more data since the end of the body may be known already.
+ */
+int qhttpparser_parse(qhttpparser_t *parser, const char *buf, size_t size,
+                      size_t *consumed, const char **data, size_t *datasize) {
+    const char *dummydata;
+    size_t dummysize;
+    if (data == NULL) {
+        data = &dummydata;
+    }
+    if (datasize == NULL) {
+        datasize = &dummysize;
+    }
+    *data = NULL;
+    *datasize = 0;
+    *consumed = 0;
+
+    size_t off = 0;
+    while (true) {
+        const char *p = buf + off;
+        size_t avail = size - off;
+
+        switch (parser->state) {
+            case P_HEAD: {
+                // resume the search where the previous call left it
+                size_t from = (parser->scanned > 3) ? parser->scanned - 3 : 0;
+                const char *end = NULL;
+                size_t i;
+                for (i = from; i + 3 < avail; i++) {
+                    if (p[i] == '\r' && p[i + 1] == '\n' && p[i + 2] == '\r'
+                            && p[i + 3] == '\n') {
+                        end = p + i + 4;
+                        break;
+                    }
+                }
+                if (end == NULL) {
+                    parser->scanned = avail;
+                    *consumed = off;
+                    return QHTTPPARSER_MORE;
+                }
+                if (parse_head(parser, p, end - p) == false) {
+                    parser->state = P_ERROR;
+                    errno = EPROTO;
+                    return QHTTPPARSER_ERROR;
+                }
+                *consumed = off + (end - p);
+                return QHTTPPARSER_HEAD;
+            }
+            case P_LENGTH:
+            case P_CHUNK_DATA: {
+                if (avail == 0) {
+                    *consumed = off;
+                    return QHTTPPARSER_MORE;
+                }
+                size_t n = avail;
+                if ((off_t) n > parser->remain) {
+                    n = (size_t) parser->remain;
+                }
+                parser->remain -= n;
+                if (parser->remain == 0) {
+                    parser->state = (parser->state == P_LENGTH) ?
+                                    P_DONE : P_CHUNK_CRLF;
+                }
+                *data = p;
+                *datasize = n;
+                *consumed = off + n;
+                return QHTTPPARSER_BODY;
+            }
+            case P_CLOSE: {
+                *consumed = off + avail;
+                if (avail == 0) {
+                    return QHTTPPARSER_MORE;
+                }
+                *data = p;
+                *datasize = avail;
+                return QHTTPPARSER_BODY;
+            }
+            case P_CHUNK_SIZE: {
+                const char *eol = findcrlf(p, avail);
+                if (eol == NULL) {
+                    if (avail >= MAX_LINE_SIZE) {
+                        break;
+                    }
+                    *consumed = off;
+                    return QHTTPPARSER_MORE;
+                }
+                off_t chunksize = 0;
+                const char *c;
+                for (c = p; c < eol; c++) {
+                    int v;
+                    if (*c >= '0' && *c <= '9') {
+                        v = *c - '0';
+                    } else if (*c >= 'a' && *c <= 'f') {
+                        v = *c - 'a' + 10;
+                    } else if (*c >= 'A' && *c <= 'F') {
+                        v = *c - 'A' + 10;
+                    } else {
+                        break;
+                    }
+                    if (chunksize > (((off_t) 1 << 59) - 1)) {
+                        break;
+                    }
+                    chunksize = (chunksize << 4) | v;
+                }
+                // digits followed by optional extensions
+                if (c == p || (c < eol && *c != ';' && *c != ' '
+                        && *c != '\t')) {
+                    break;
+                }
+                parser->remain = chunksize;
+                parser->state = (chunksize > 0) ? P_CHUNK_DATA : P_TRAILER;
+                off += (eol - p) + 2;
+                continue;
+            }
+            case P_CHUNK_CRLF: {
+                if (avail < 2) {
+                    *consumed = off;
+                    return QHTTPPARSER_MORE;
+                }
+                if (p[0] != '\r' || p[1] != '\n') {
+                    break;
+                }
+                parser->state = P_CHUNK_SIZE;
+                off += 2;
+                continue;
+            }
+            case P_TRAILER: {
+                // trailer fields are skipped
+                const char *eol = findcrlf(p, avail);
+                if (eol == NULL) {
+                    if (avail >= MAX_LINE_SIZE) {
+                        break;
+                    }
+                    *consumed = off;
+                    return QHTTPPARSER_MORE;
+                }
+                off += (eol - p) + 2;
+                if (eol == p) {
+                    parser->state = P_DONE;
+                }
+                continue;
+            }
+            case P_DONE: {
+                *consumed = off;
+                return QHTTPPARSER_DONE;
+            }
+            default: {
+                break;
+            }
+        }
+
+        // malformed framing
+        parser->state = P_ERROR;
+        errno = EPROTO;
+        return QHTTPPARSER_ERROR;
+    }
+}
+
+/**
+ * Tell the parser that the connection has been closed.
+ *
+ * @param parser    qhttpparser_t structure.
+ *
+ * @return QHTTPPARSER_DONE if the response is complete, since its body is
+ *         delimited by the connection close, otherwise QHTTPPARSER_ERROR
+ *         with errno ECONNRESET.
+ */
+int qhttpparser_eof(qhttpparser_t *parser) {
+    if (parser->state == P_CLOSE || parser->state == P_DONE) {
+        parser->state = P_DONE;
+        return QHTTPPARSER_DONE;
+    }
+    parser->state = P_ERROR;
+    errno = ECONNRESET;
+    return QHTTPPARSER_ERROR;
+}
+
+/**
+ * Look up a well-known header.
+ *
+ * @param parser    qhttpparser_t structure.
+ * @param token     QHTTP_HDR_* token.
+ *
+ * @return the first header of the token, or NULL if not found.
+ *
+ * @code
+ *   const qhttpparser_header_t *h;
+ *   h = qhttpparser_header(&parser, QHTTP_HDR_LOCATION);
+ * @endcode
+ */
+const qhttpparser_header_t *qhttpparser_header(qhttpparser_t *parser,
+                                               int token) {
+    if (token <= QHTTP_HDR_UNKNOWN || token >= QHTTP_HDR_MAX
+            || parser->index[token] < 0) {
+        return NULL;
+    }
+    return &parser->headers[(int) parser->index[token]];
+}
+
+/**
+ * Look up a header by name.
+ *
+ * @param parser    qhttpparser_t structure.
+ * @param name      header name, case-insensitive.
+ *
+ * @return the first header of the name, or NULL if not found.
+ */
+const qhttpparser_header_t *qhttpparser_find(qhttpparser_t *parser,
+                                             const char *name) {
+    size_t namelen = strlen(name);
+    int i;
+    for (i = 0; i < parser->nheaders; i++) {
+        qhttpparser_header_t *h = &parser->headers[i];
+        if (h->namelen == namelen && !strncasecmp(h->name, name, namelen)) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Copy the parsed headers into a table.
+ *
+ * @param parser    qhttpparser_t structure.
+ * @param tbl       qlisttbl_t table to add the headers to.
+ *
+ * @return true if successful, otherwise returns false.
+ */
+bool qhttpparser_copyheaders(qhttpparser_t *parser, qlisttbl_t *tbl) {
+    int i;
+    for (i = 0; i < parser->nheaders; i++) {
+        qhttpparser_header_t *h = &parser->headers[i];
+        char name[256];
+        if (h->namelen >= sizeof(name)) {
+            continue;
+        }
+        memcpy(name, h->name, h->namelen);
+        name[h->namelen] = '\0';
+        if (tbl->putstrf(tbl, name, "%.*s", (int) h->valuelen,
+                         h->value) == false) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Create a decoder for the Content-Encoding of a parsed response.
+ *
+ * @param parser    qhttpparser_t structure holding the response head.
+ *
+ * @return a pointer of qhttpdecoder_t if the body is encoded with gzip or
+ *         deflate. NULL with errno 0 if the body is not encoded, otherwise
+ *         NULL with errno EPROTONOSUPPORT if the encoding is not supported
+ *         or qLibc is built without zlib, or ENOMEM.
+ */
+qhttpdecoder_t *qhttpdecoder(qhttpparser_t *parser) {
+    const qhttpparser_header_t *h;
+    h = qhttpparser_header(parser, QHTTP_HDR_CONTENT_ENCODING);
+    errno = 0;
+    if (h == NULL || h->valuelen == 0
+            || (h->valuelen == 8 && !strncasecmp(h->value, "identity", 8))) {
+        return NULL;
+    }
+
+    bool gzip = ((h->valuelen == 4 && !strncasecmp(h->value, "gzip", 4))
+            || (h->valuelen == 6 && !strncasecmp(h->value, "x-gzip", 6)));
+    if (gzip == false
+            && !(h->valuelen == 7 && !strncasecmp(h->value, "deflate", 7))) {
+        errno = EPROTONOSUPPORT;
+        return NULL;
+    }
+
+#ifdef ENABLE_ZLIB
+    qhttpdecoder_t *decoder;
+    decoder = (qhttpdecoder_t *) calloc(1, sizeof(qhttpdecoder_t));
+    if (decoder == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    decoder->gzip = gzip;
+    // the wrapper is chosen once the first bytes arrive
+    if (inflateInit2(&decoder->zs, MAX_WBITS) != Z_OK) {
+        free(decoder);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return decoder;
+#else
+    errno = EPROTONOSUPPORT;
+    return NULL;
+#endif
+}
+
+/**
+ * Decompress a piece of the body.
+ *
+ * @param decoder   qhttpdecoder_t object pointer.
+ * @param data      piece of the encoded body.
+ * @param size      size of data.
+ * @param output    function called with each piece of decoded data. return
+ *                  false to stop.
+ * @param userdata  user data passed to output.
+ *
+ * @return true if successful, otherwise returns false with errno EPROTO if
+ *         the data is corrupted, or when output returned false.
+ *
+ * @note
+ *  The first two bytes tell gzip, zlib wrapped and raw deflate data apart,
+ *  so they're held until both have arrived. gzip data may have several
+ *  members, and anything else after the end, like zero padding, is
+ *  ignored.
+ */
+bool qhttpdecoder_decode(qhttpdecoder_t *decoder, const void *data,
+                         size_t size,
+                         bool (*output)(void *userdata, const void *data,
+                                        size_t size),
+                         void *userdata) {
+#ifdef ENABLE_ZLIB
+    const unsigned char *in = (const unsigned char *) data;
+    while (size > 0 && decoder->trailing == false) {
+        if (decoder->started == false || decoder->ended == true) {
+            // collect the first two bytes of the stream or the next member
+            size_t n = sizeof(decoder->head) - decoder->headlen;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(decoder->head + decoder->headlen, in, n);
+            decoder->headlen += n;
+            in += n;
+            size -= n;
+            if (decoder->headlen < sizeof(decoder->head)) {
+                break;
+            }
+            decoder->headlen = 0;
+
+            int ret = decoder_start(decoder);
+            if (ret < 0) {
+                return false;
+            }
+            if (ret == 0) {
+                decoder->trailing = true;
+                break;
+            }
+            if (decoder_inflate(decoder, decoder->head, sizeof(decoder->head),
+                                output, userdata) == false) {
+                return false;
+            }
+            continue;
+        }
+
+        if (decoder_inflate(decoder, in, size, output, userdata) == false) {
+            return false;
+        }
+        in += size - decoder->zs.avail_in;
+        size = decoder->zs.avail_in;
+        if (decoder->ended == false) {
+            break;  // needs more input
+        }
+    }
+    return true;
+#else
+    errno = EPROTONOSUPPORT;
+    return false;
+#endif
+}
+
+/**
+ * Check if the decoder has seen the end of the encoded stream.
+ *
+ * @param decoder   qhttpdecoder_t object pointer.
+ *
+ * @return true if the stream is complete, otherwise returns false with
+ *         errno EPROTO, which means the body is truncated.
+ */
+bool qhttpdecoder_finish(qhttpdecoder_t *decoder) {
+    if (decoder->ended == false) {
+        errno = EPROTO;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Free a decoder.
+ *
+ * @param decoder   qhttpdecoder_t object pointer.
+ */
+void qhttpdecoder_free(qhttpdecoder_t *decoder) {
+#ifdef ENABLE_ZLIB
+    inflateEnd(&decoder->zs);
+#endif
+    free(decoder);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static bool parse_head(qhttpparser_t *parser, const char *buf, size_t size) {
+    const char *end = buf + size;
+
+    // status line: HTTP/1.x SP 3DIGIT SP reason CRLF
+    const char *eol = findcrlf(buf, size);
+    if (eol - buf < 12 || strncmp(buf, "HTTP/1.", 7) || buf[7] < '0'
+            || buf[7] > '9' || buf[8] != ' ') {
+        return false;
+    }
+    const char *c = buf + 9;
+    if (c[0] < '1' || c[0] > '9' || c[1] < '0' || c[1] > '9'
+            || c[2] < '0' || c[2] > '9' || (c + 3 < eol && c[3] != ' ')) {
+        return false;
+    }
+    parser->version = 10 + (buf[7] - '0');
+    parser->status = (c[0] - '0') * 100 + (c[1] - '0') * 10 + (c[2] - '0');
+    parser->reason = (c + 3 < eol) ? c + 4 : eol;
+    parser->reasonlen = eol - parser->reason;
+    parser->keepalive = (parser->version >= 11);
+
+    // header lines
+    const char *line;
+    for (line = eol + 2; line < end; line = eol + 2) {
+        eol = findcrlf(line, end - line);
+        if (eol == line) {
+            break;
+        }
+        if (parse_header(parser, line, eol) == false) {
+            return false;
+        }
+    }
+
+    // body framing
+    if (parser->nobody || parser->status / 100 == 1 || parser->status == 204
+            || parser->status == 304) {
+        parser->state = P_DONE;
+    } else if (parser->chunked) {
+        parser->state = P_CHUNK_SIZE;
+    } else if (parser->contentlength >= 0
+            && parser->index[QHTTP_HDR_TRANSFER_ENCODING] < 0) {
+        parser->remain = parser->contentlength;
+        parser->state = (parser->remain > 0) ? P_LENGTH : P_DONE;
+    } else {
+        parser->state = P_CLOSE;
+        parser->keepalive = false;
+    }
+    return true;
+}
+
+static bool parse_header(qhttpparser_t *parser, const char *line,
+                         const char *end) {
+    const char *colon = memchr(line, ':', end - line);
+    // obsolete line folding is not supported
+    if (colon == NULL || colon == line || line[0] == ' ' || line[0] == '\t'
+            || colon[-1] == ' ' || colon[-1] == '\t') {
+        return false;
+    }
+
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    const char *vend = end;
+    while (vend > value && (vend[-1] == ' ' || vend[-1] == '\t')) {
+        vend--;
+    }
+
+    size_t namelen = colon - line;
+    size_t valuelen = vend - value;
+    int token = classify(line, namelen);
+
+    switch (token) {
+        case QHTTP_HDR_CONTENT_LENGTH: {
+            off_t length = 0;
+            const char *c;
+            for (c = value; c < vend; c++) {
+                if (*c < '0' || *c > '9' || length > (((off_t) 1 << 58))) {
+                    return false;
+                }
+                length = length * 10 + (*c - '0');
+            }
+            if (c == value || (parser->contentlength >= 0
+                    && parser->contentlength != length)) {
+                return false;
+            }
+            parser->contentlength = length;
+            break;
+        }
+        case QHTTP_HDR_TRANSFER_ENCODING: {
+            // chunked must be the final coding
+            parser->chunked = (valuelen >= 7
+                    && !strncasecmp(vend - 7, "chunked", 7)
+                    && (valuelen == 7 || vend[-8] == ' ' || vend[-8] == ','
+                            || vend[-8] == '\t'));
+            if (parser->chunked == false) {
+                parser->keepalive = false;
+            }
+            break;
+        }
+        case QHTTP_HDR_CONNECTION: {
+            if (hastoken(value, valuelen, "close")) {
+                parser->keepalive = false;
+            } else if (hastoken(value, valuelen, "keep-alive")) {
+                parser->keepalive = true;
+            }
+            break;
+        }
+    }
+
+    if (parser->nheaders < QHTTPPARSER_MAX_HEADERS) {
+        qhttpparser_header_t *h = &parser->headers[parser->nheaders];
+        h->name = line;
+        h->namelen = namelen;
+        h->value = value;
+        h->valuelen = valuelen;
+        h->token = token;
+        if (token != QHTTP_HDR_UNKNOWN && parser->index[token] < 0) {
+            parser->index[token] = (signed char) parser->nheaders;
+        }
+        parser->nheaders++;
+    }
+    return true;
+}
+
+// Map a header name to its token, switching on the length first.
+static int classify(const char *name, size_t namelen) {
+#define MATCH(s, t) do {                                                    \
+        if (!strncasecmp(name, s, namelen)) {                               \
+            return t;                                                       \
+        }                                                                   \
+    } while (0)
+    switch (namelen) {
+        case 4:
+            MATCH("ETag", QHTTP_HDR_ETAG);
+            break;
+        case 8:
+            MATCH("Location", QHTTP_HDR_LOCATION);
+            break;
+        case 10:
+            MATCH("Connection", QHTTP_HDR_CONNECTION);
+            MATCH("Keep-Alive", QHTTP_HDR_KEEP_ALIVE);
+            break;
+        case 12:
+            MATCH("Content-Type", QHTTP_HDR_CONTENT_TYPE);
+            break;
+        case 13:
+            MATCH("Accept-Ranges", QHTTP_HDR_ACCEPT_RANGES);
+            MATCH("Content-Range", QHTTP_HDR_CONTENT_RANGE);
+            MATCH("Last-Modified", QHTTP_HDR_LAST_MODIFIED);
+            break;
+        case 14:
+            MATCH("Content-Length", QHTTP_HDR_CONTENT_LENGTH);
+            break;
+        case 16:
+            MATCH("Content-Encoding", QHTTP_HDR_CONTENT_ENCODING);
+            break;
+        case 17:
+            MATCH("Transfer-Encoding", QHTTP_HDR_TRANSFER_ENCODING);
+            break;
+    }
+#undef MATCH
+    return QHTTP_HDR_UNKNOWN;
+}
+
+// Check if a comma separated value has the token, case-insensitively.
+static bool hastoken(const char *value, size_t valuelen, const char *token) {
+    size_t tokenlen = strlen(token);
+    const char *end = value + valuelen;
+    const char *c = value;
+    while (c < end) {
+        while (c < end && (*c == ' ' || *c == '\t' || *c == ',')) {
+            c++;
+        }
+        const char *e = c;
+        while (e < end && *e != ',') {
+            e++;
+        }
+        const char *t = e;
+        while (t > c && (t[-1] == ' ' || t[-1] == '\t')) {
+            t--;
+        }
+        if ((size_t) (t - c) == tokenlen && !strncasecmp(c, token, tokenlen)) {
+            return true;
+        }
+        c = e;
+    }
+    return false;
+}
+
+#ifdef ENABLE_ZLIB
+// Set up inflate by the first two bytes of the stream or of what follows
+// its end. Returns 1 if set up, 0 if no gzip member follows the end, or -1
+// with errno EPROTO if the data doesn't match the encoding.
+static int decoder_start(qhttpdecoder_t *decoder) {
+    const unsigned char *h = decoder->head;
+    int wbits;
+    if (decoder->ended == true && decoder->gzipdata == false) {
+        return 0;
+    } else if (h[0] == 0x1f && h[1] == 0x8b) {
+        wbits = MAX_WBITS + 16;  // gzip wrapper
+        decoder->gzipdata = true;
+    } else if (decoder->ended == true) {
+        return 0;
+    } else if (decoder->gzip == true) {
+        errno = EPROTO;
+        return -1;
+    } else if ((h[0] & 0x0f) == Z_DEFLATED && (h[0] >> 4) + 8 <= MAX_WBITS
+            && ((h[0] << 8) | h[1]) % 31 == 0) {
+        wbits = MAX_WBITS;  // zlib wrapper
+    } else {
+        wbits = -MAX_WBITS;  // some servers send deflate without a wrapper
+    }
+
+    if (inflateReset2(&decoder->zs, wbits) != Z_OK) {
+        errno = EPROTO;
+        return -1;
+    }
+    decoder->started = true;
+    decoder->ended = false;
+    return 1;
+}
+
+// Inflate data until it's all taken or the stream ends. What's left after
+// the end stays in zs.avail_in.
+static bool decoder_inflate(qhttpdecoder_t *decoder, const void *data,
+                            size_t size,
+                            bool (*output)(void *userdata, const void *data,
+                                           size_t size),
+                            void *userdata) {
+    z_stream *zs = &decoder->zs;
+    zs->next_in = (Bytef *) data;
+    zs->avail_in = size;
+
+    while (true) {
+        zs->next_out = decoder->out;
+        zs->avail_out = sizeof(decoder->out);
+        int ret = inflate(zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            errno = EPROTO;
+            return false;
+        }
+
+        size_t nbytes = sizeof(decoder->out) - zs->avail_out;
+        if (nbytes > 0 && output(userdata, decoder->out, nbytes) == false) {
+            return false;
+        }
+
+        if (ret == Z_STREAM_END) {
+            decoder->ended = true;
+            break;
+        }
+        if (ret == Z_BUF_ERROR || (zs->avail_in == 0 && zs->avail_out > 0)) {
+            break;  // needs more input
+        }
+    }
+    return true;
+}
+#endif
+
+static const char *findcrlf(const char *buf, size_t size) {
+    const char *c = buf;
+    const char *end = buf + size;
+    while (c + 1 < end) {
+        c = memchr(c, '\r', end - c - 1);
+        if (c == NULL) {
+            return NULL;
+        }
+        if (c[1] == '\n') {
+            return c;
+        }
+        c++;
+    }
+    return NULL;
+}
+
+#endif /* _DOXYGEN_SKIP */
+
+#endif /* DISABLE_QHTTPCLIENT */
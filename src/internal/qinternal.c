@@ -33,9 +33,11 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <errno.h>
 #include <sys/types.h>
 #include "qinternal.h"
+#include "utilities/qhash.h"
 
 // Change two hex character to one hex value.
 char _q_x2c(char hex_up, char hex_low) {
@@ -82,3 +84,9 @@ void _q_textout(FILE *fp, void *data, size_t size, size_t max) {
     if (size > max)
         fputs("...", fp);
 }
+
+// Fold 64-bit xxHash64 into 32 bits for the containers using 32-bit hashes.
+uint32_t _q_hashxxh64_32(const void *data, size_t nbytes) {
+    uint64_t h = qhashxxh64(data, nbytes, 0);
+    return (uint32_t) (h ^ (h >> 32));
+}
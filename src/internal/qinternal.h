@@ -61,6 +61,7 @@
 #define _MULTI_THREADED
 #endif
 
+#include <stdint.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -160,5 +161,6 @@ struct qmutex_s {
 extern char _q_x2c(char hex_up, char hex_low);
 extern char *_q_makeword(char *str, char stop);
 extern void _q_textout(FILE *fp, void *data, size_t size, size_t max);
+extern uint32_t _q_hashxxh64_32(const void *data, size_t nbytes);
 
 #endif /* QINTERNAL_H */
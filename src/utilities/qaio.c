@@ -0,0 +1,1098 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qaio.c Completion-based asynchronous I/O engine.
+ *
+ * Operations are submitted without blocking and their completions are
+ * reaped in batches, so a few threads can drive a large number of
+ * descriptors. On Linux the engine runs on io_uring, talking to the kernel
+ * through the raw system calls, and falls back to epoll when io_uring is
+ * not available or not permitted.
+ *
+ * @code
+ *   qaio_t *aio = qaio(256, 0);
+ *   char buf[4096];
+ *   qaio_read(aio, sockfd, buf, sizeof(buf), 1000, NULL);
+ *
+ *   qaio_event_t events[64];
+ *   int n = qaio_reap(aio, events, 64, -1);
+ *   for (int i = 0; i < n; i++) {
+ *     if (events[i].result < 0) {
+ *       printf("failed: %s\n", strerror(-events[i].result));
+ *     }
+ *   }
+ *   qaio_free(aio);
+ * @endcode
+ *
+ * @note
+ *  Timeouts follow the qio API: timeoutms bounds each wait for the
+ *  descriptor to become ready, 0 for no wait and -1 for infinite wait.
+ *  Buffers must stay valid until the operation is reaped. An engine is not
+ *  thread-safe, use one engine per thread. Descriptors must be in
+ *  non-blocking mode: the epoll backend performs the I/O itself once a
+ *  descriptor is ready, and a blocking call there stalls every other
+ *  operation of the engine.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#include "qinternal.h"
+#include "utilities/qaio.h"
+
+#if defined(__linux__) && !defined(DISABLE_IOURING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_FAST_POLL) && defined(__NR_io_uring_setup)
+#define QAIO_IOURING
+#endif
+#endif
+#endif
+
+#ifndef _DOXYGEN_SKIP
+
+#define DEF_DEPTH           (256)
+#define MAX_EPOLL_EVENTS    (64)
+
+typedef struct aioop_s aioop_t;
+struct aioop_s {
+    int op;
+    int fd;
+    int infd;           /* QAIO_SENDFILE */
+    char *buf;          /* QAIO_READ, QAIO_WRITE */
+    size_t nbytes;
+    size_t done;        /* bytes transferred so far */
+    off_t offset;       /* QAIO_SENDFILE */
+    struct sockaddr_storage addr;  /* QAIO_CONNECT */
+    socklen_t addrlen;
+    int timeoutms;
+    int64_t deadline;   /* epoll: monotonic ms, -1 for none */
+    void *userdata;
+
+    bool completed;
+    ssize_t result;
+
+#ifdef QAIO_IOURING
+    struct __kernel_timespec ts;  /* must live until submitted */
+#endif
+
+    aioop_t *prev, *next;   /* outstanding operations */
+    aioop_t *rnext;         /* completion queue */
+};
+
+#ifdef __linux__
+struct aiofd_s {
+    aioop_t *rd;        /* QAIO_READ, QAIO_ACCEPT */
+    aioop_t *wr;        /* QAIO_WRITE, QAIO_CONNECT, QAIO_SENDFILE */
+    uint32_t events;    /* registered epoll events */
+};
+#endif
+
+struct qaio_s {
+    int depth;
+    int inflight;
+    aioop_t *ops;       /* outstanding operations */
+    aioop_t *ready;     /* completed, not reaped yet */
+    aioop_t *readytail;
+    bool uring;
+
+#ifdef QAIO_IOURING
+    int ringfd;
+    void *sqmap, *cqmap;
+    size_t sqmapsize, cqmapsize;
+    struct io_uring_sqe *sqes;
+    size_t sqessize;
+    unsigned *sqhead, *sqtail, *sqmask, *sqarray, sqentries;
+    unsigned *cqhead, *cqtail, *cqmask;
+    struct io_uring_cqe *cqes;
+    unsigned sqlocal;   /* tail including unpublished entries */
+#endif
+
+#ifdef __linux__
+    int epfd;
+    struct aiofd_s *fds;
+    int fdsize;
+#endif
+};
+
+static aioop_t *op_new(qaio_t *aio, int op, int fd, int timeoutms,
+                       void *userdata);
+static bool op_start(qaio_t *aio, aioop_t *op);
+static void op_complete(qaio_t *aio, aioop_t *op, ssize_t result);
+static int64_t now_ms(void);
+
+#ifdef QAIO_IOURING
+static bool uring_init(qaio_t *aio, unsigned entries);
+static void uring_free(qaio_t *aio);
+static bool uring_start(qaio_t *aio, aioop_t *op);
+static int uring_flush(qaio_t *aio);
+static bool uring_wait(qaio_t *aio, int timeoutms);
+static void uring_complete(qaio_t *aio, aioop_t *op, int res);
+#endif
+
+#ifdef __linux__
+static bool epoll_start(qaio_t *aio, aioop_t *op);
+static bool epoll_wait_(qaio_t *aio, int timeoutms);
+static bool epoll_run(qaio_t *aio, aioop_t *op);
+static void epoll_detach(qaio_t *aio, aioop_t *op);
+static bool epoll_update(qaio_t *aio, int fd);
+#endif
+
+#endif /* _DOXYGEN_SKIP */
+
+/**
+ * Create an asynchronous I/O engine.
+ *
+ * @param depth     the maximum number of operations in flight. 0 for
+ *                  default.
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of qaio_t object if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *  - ENOSYS : Not supported on this platform.
+ *  - Other errors from epoll_create1().
+ *
+ * @note
+ *   Available options:
+ *   - QAIO_USE_EPOLL  - use epoll even if io_uring is available.
+ */
+qaio_t *qaio(int depth, int options) {
+#ifdef __linux__
+    if (depth <= 0)
+        depth = DEF_DEPTH;
+
+    qaio_t *aio = (qaio_t *) calloc(1, sizeof(qaio_t));
+    if (aio == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    aio->depth = depth;
+    aio->epfd = -1;
+
+#ifdef QAIO_IOURING
+    aio->ringfd = -1;
+    if (!(options & QAIO_USE_EPOLL) && uring_init(aio, depth) == true) {
+        aio->uring = true;
+        return aio;
+    }
+#endif
+
+    aio->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (aio->epfd < 0) {
+        free(aio);
+        return NULL;
+    }
+    return aio;
+#else
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+/**
+ * Submit a read. It completes as soon as any data is read, with the number
+ * of bytes read or 0 at end of file.
+ *
+ * @param aio       qaio_t object pointer
+ * @param fd        file descriptor
+ * @param buf       buffer to read into
+ * @param nbytes    buffer size
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ * @param userdata  user data handed back with the completion
+ *
+ * @return true if queued, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EBUSY  : Too many operations in flight, or another read-side operation
+ *             is pending on fd with the epoll backend.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  fd must be in non-blocking mode, or a read woken up spuriously blocks
+ *  the engine with the epoll backend.
+ */
+bool qaio_read(qaio_t *aio, int fd, void *buf, size_t nbytes, int timeoutms,
+               void *userdata) {
+    if (buf == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    aioop_t *op = op_new(aio, QAIO_READ, fd, timeoutms, userdata);
+    if (op == NULL)
+        return false;
+    op->buf = (char *) buf;
+    op->nbytes = nbytes;
+    return op_start(aio, op);
+}
+
+/**
+ * Submit a write. Partial writes are resumed internally and it completes
+ * when all the bytes are written, with nbytes. On timeout or failure after
+ * a partial write, the number of bytes written so far is returned.
+ *
+ * @param aio       qaio_t object pointer
+ * @param fd        file descriptor
+ * @param buf       data to write
+ * @param nbytes    the number of bytes to write
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ * @param userdata  user data handed back with the completion
+ *
+ * @return true if queued, otherwise returns false.
+ *
+ * @note
+ *  fd must be in non-blocking mode, or resuming a partial write blocks
+ *  until the peer drains it.
+ */
+bool qaio_write(qaio_t *aio, int fd, const void *buf, size_t nbytes,
+                int timeoutms, void *userdata) {
+    if (buf == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    aioop_t *op = op_new(aio, QAIO_WRITE, fd, timeoutms, userdata);
+    if (op == NULL)
+        return false;
+    op->buf = (char *) buf;
+    op->nbytes = nbytes;
+    return op_start(aio, op);
+}
+
+/**
+ * Submit an accept on a listening socket. It completes with the accepted
+ * socket descriptor.
+ *
+ * @param aio       qaio_t object pointer
+ * @param fd        listening socket
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ * @param userdata  user data handed back with the completion
+ *
+ * @return true if queued, otherwise returns false.
+ *
+ * @note
+ *  fd must be in non-blocking mode, or accept() blocks when another
+ *  process takes the pending connection first.
+ */
+bool qaio_accept(qaio_t *aio, int fd, int timeoutms, void *userdata) {
+    aioop_t *op = op_new(aio, QAIO_ACCEPT, fd, timeoutms, userdata);
+    if (op == NULL)
+        return false;
+    return op_start(aio, op);
+}
+
+/**
+ * Submit a connect. It completes with 0 once connected.
+ *
+ * @param aio       qaio_t object pointer
+ * @param fd        socket descriptor
+ * @param addr      remote address, copied internally
+ * @param addrlen   length of addr
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ * @param userdata  user data handed back with the completion
+ *
+ * @return true if queued, otherwise returns false.
+ *
+ * @note
+ *  fd must be in non-blocking mode, or connect() blocks on submission with
+ *  the epoll backend.
+ */
+bool qaio_connect(qaio_t *aio, int fd, const struct sockaddr *addr,
+                  socklen_t addrlen, int timeoutms, void *userdata) {
+    if (addr == NULL || addrlen > sizeof(struct sockaddr_storage)) {
+        errno = EINVAL;
+        return false;
+    }
+    aioop_t *op = op_new(aio, QAIO_CONNECT, fd, timeoutms, userdata);
+    if (op == NULL)
+        return false;
+    memcpy(&op->addr, addr, addrlen);
+    op->addrlen = addrlen;
+    return op_start(aio, op);
+}
+
+/**
+ * Submit a transfer from a file to a descriptor such as a socket. The data
+ * is moved with sendfile() whenever outfd is writable, and it completes when
+ * nbytes are sent or at end of file.
+ *
+ * @param aio       qaio_t object pointer
+ * @param outfd     output descriptor
+ * @param infd      input file, the file position is not changed
+ * @param offset    file offset to start from
+ * @param nbytes    the number of bytes to transfer
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ * @param userdata  user data handed back with the completion
+ *
+ * @return true if queued, otherwise returns false.
+ *
+ * @note
+ *  outfd must be in non-blocking mode. Each sendfile() call moves as much
+ *  as outfd takes, so on a blocking socket it waits for the peer with both
+ *  backends.
+ */
+bool qaio_sendfile(qaio_t *aio, int outfd, int infd, off_t offset,
+                   size_t nbytes, int timeoutms, void *userdata) {
+    if (infd < 0 || offset < 0) {
+        errno = EINVAL;
+        return false;
+    }
+    aioop_t *op = op_new(aio, QAIO_SENDFILE, outfd, timeoutms, userdata);
+    if (op == NULL)
+        return false;
+    op->infd = infd;
+    op->offset = offset;
+    op->nbytes = nbytes;
+    return op_start(aio, op);
+}
+
+/**
+ * Hand the queued operations to the kernel.
+ *
+ * This is done by qaio_reap() as well, so calling it is only needed to get
+ * the operations started earlier.
+ *
+ * @param aio       qaio_t object pointer
+ *
+ * @return the number of operations submitted, -1 for error.
+ */
+int qaio_submit(qaio_t *aio) {
+#ifdef QAIO_IOURING
+    if (aio->uring == true)
+        return uring_flush(aio);
+#endif
+    return 0;
+}
+
+/**
+ * Wait for completions and collect them.
+ *
+ * @param aio       qaio_t object pointer
+ * @param events    array to store the completions
+ * @param maxevents size of events array
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of completions stored, 0 on timeout or when nothing is
+ *         in flight, -1 for error.
+ */
+int qaio_reap(qaio_t *aio, qaio_event_t *events, int maxevents,
+              int timeoutms) {
+    if (aio == NULL || events == NULL || maxevents <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#ifdef __linux__
+    int64_t deadline = (timeoutms > 0) ? now_ms() + timeoutms : 0;
+    while (aio->ready == NULL && aio->inflight > 0) {
+        int waitms = timeoutms;
+        if (timeoutms > 0) {
+            waitms = (int) (deadline - now_ms());
+            if (waitms < 0)
+                waitms = 0;
+        }
+
+        bool ret;
+#ifdef QAIO_IOURING
+        if (aio->uring == true)
+            ret = uring_wait(aio, waitms);
+        else
+#endif
+            ret = epoll_wait_(aio, waitms);
+        if (ret == false)
+            return -1;
+
+        if (waitms == 0)
+            break;
+    }
+#endif
+
+    int num = 0;
+    while (num < maxevents && aio->ready != NULL) {
+        aioop_t *op = aio->ready;
+        aio->ready = op->rnext;
+        if (aio->ready == NULL)
+            aio->readytail = NULL;
+
+        events[num].op = op->op;
+        events[num].fd = op->fd;
+        events[num].result = op->result;
+        events[num].userdata = op->userdata;
+        num++;
+
+        if (op->prev != NULL)
+            op->prev->next = op->next;
+        else
+            aio->ops = op->next;
+        if (op->next != NULL)
+            op->next->prev = op->prev;
+        aio->inflight--;
+        free(op);
+    }
+
+    if (num == 0)
+        errno = ETIMEDOUT;
+    return num;
+}
+
+/**
+ * Get the number of operations submitted but not reaped yet.
+ *
+ * @param aio       qaio_t object pointer
+ *
+ * @return the number of operations in flight.
+ */
+int qaio_inflight(qaio_t *aio) {
+    return aio->inflight;
+}
+
+/**
+ * Get the name of the backend in use.
+ *
+ * @param aio       qaio_t object pointer
+ *
+ * @return "io_uring" or "epoll".
+ */
+const char *qaio_backend(qaio_t *aio) {
+    return (aio->uring == true) ? "io_uring" : "epoll";
+}
+
+/**
+ * De-allocate the engine. Operations in flight are abandoned.
+ *
+ * @param aio       qaio_t object pointer
+ */
+void qaio_free(qaio_t *aio) {
+    if (aio == NULL)
+        return;
+
+#ifdef QAIO_IOURING
+    if (aio->uring == true)
+        uring_free(aio);
+#endif
+#ifdef __linux__
+    if (aio->epfd >= 0)
+        close(aio->epfd);
+    free(aio->fds);
+#endif
+
+    aioop_t *op, *next;
+    for (op = aio->ops; op != NULL; op = next) {
+        next = op->next;
+        free(op);
+    }
+    free(aio);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static aioop_t *op_new(qaio_t *aio, int op, int fd, int timeoutms,
+                       void *userdata) {
+    if (aio == NULL || fd < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (aio->inflight >= aio->depth) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    aioop_t *aioop = (aioop_t *) calloc(1, sizeof(aioop_t));
+    if (aioop == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    aioop->op = op;
+    aioop->fd = fd;
+    aioop->infd = -1;
+    aioop->timeoutms = timeoutms;
+    aioop->deadline = -1;
+    aioop->userdata = userdata;
+    return aioop;
+}
+
+static bool op_start(qaio_t *aio, aioop_t *op) {
+    bool ret = false;
+#ifdef QAIO_IOURING
+    if (aio->uring == true)
+        ret = uring_start(aio, op);
+    else
+#endif
+#ifdef __linux__
+        ret = epoll_start(aio, op);
+#endif
+
+    if (ret == false) {
+        free(op);
+        return false;
+    }
+
+    op->next = aio->ops;
+    if (aio->ops != NULL)
+        aio->ops->prev = op;
+    aio->ops = op;
+    aio->inflight++;
+    return true;
+}
+
+static void op_complete(qaio_t *aio, aioop_t *op, ssize_t result) {
+    // a partial transfer is reported as what has been done.
+    if (result < 0 && op->done > 0)
+        result = op->done;
+
+    op->completed = true;
+    op->result = result;
+    op->rnext = NULL;
+    if (aio->readytail != NULL)
+        aio->readytail->rnext = op;
+    else
+        aio->ready = op;
+    aio->readytail = op;
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#ifdef QAIO_IOURING
+
+#define URING_LINK_TIMEOUT  (0)     /* user_data of linked timeouts */
+
+static bool uring_init(qaio_t *aio, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return false;
+
+    // FAST_POLL comes with READ/WRITE/ACCEPT/CONNECT and linked timeouts.
+    if (!(p.features & IORING_FEAT_FAST_POLL)
+            || !(p.features & IORING_FEAT_NODROP)) {
+        close(fd);
+        return false;
+    }
+
+    aio->ringfd = fd;
+    aio->sqmapsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    aio->cqmapsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (aio->cqmapsize > aio->sqmapsize)
+            aio->sqmapsize = aio->cqmapsize;
+        aio->cqmapsize = 0;
+    }
+
+    aio->sqmap = mmap(NULL, aio->sqmapsize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (aio->sqmap == MAP_FAILED) {
+        aio->sqmap = NULL;
+        uring_free(aio);
+        return false;
+    }
+    aio->cqmap = aio->sqmap;
+    if (aio->cqmapsize > 0) {
+        aio->cqmap = mmap(NULL, aio->cqmapsize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (aio->cqmap == MAP_FAILED) {
+            aio->cqmap = NULL;
+            uring_free(aio);
+            return false;
+        }
+    }
+    aio->sqessize = p.sq_entries * sizeof(struct io_uring_sqe);
+    aio->sqes = mmap(NULL, aio->sqessize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (aio->sqes == MAP_FAILED) {
+        aio->sqes = NULL;
+        uring_free(aio);
+        return false;
+    }
+
+    char *sq = (char *) aio->sqmap, *cq = (char *) aio->cqmap;
+    aio->sqhead = (unsigned *) (sq + p.sq_off.head);
+    aio->sqtail = (unsigned *) (sq + p.sq_off.tail);
+    aio->sqmask = (unsigned *) (sq + p.sq_off.ring_mask);
+    aio->sqarray = (unsigned *) (sq + p.sq_off.array);
+    aio->sqentries = p.sq_entries;
+    aio->cqhead = (unsigned *) (cq + p.cq_off.head);
+    aio->cqtail = (unsigned *) (cq + p.cq_off.tail);
+    aio->cqmask = (unsigned *) (cq + p.cq_off.ring_mask);
+    aio->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    aio->sqlocal = *aio->sqtail;
+
+    return true;
+}
+
+static void uring_free(qaio_t *aio) {
+    if (aio->sqes != NULL)
+        munmap(aio->sqes, aio->sqessize);
+    if (aio->cqmap != NULL && aio->cqmap != aio->sqmap)
+        munmap(aio->cqmap, aio->cqmapsize);
+    if (aio->sqmap != NULL)
+        munmap(aio->sqmap, aio->sqmapsize);
+    close(aio->ringfd);
+    aio->ringfd = -1;
+}
+
+// Get n free submission entries, submitting queued ones to make room.
+static struct io_uring_sqe *uring_get_sqes(qaio_t *aio, unsigned n) {
+    unsigned head = __atomic_load_n(aio->sqhead, __ATOMIC_ACQUIRE);
+    if (aio->sqlocal - head + n > aio->sqentries) {
+        if (uring_flush(aio) < 0)
+            return NULL;
+        head = __atomic_load_n(aio->sqhead, __ATOMIC_ACQUIRE);
+        if (aio->sqlocal - head + n > aio->sqentries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+
+    unsigned i;
+    for (i = 0; i < n; i++) {
+        unsigned idx = (aio->sqlocal + i) & *aio->sqmask;
+        aio->sqarray[idx] = idx;
+        memset(&aio->sqes[idx], 0, sizeof(struct io_uring_sqe));
+    }
+    return &aio->sqes[aio->sqlocal & *aio->sqmask];
+}
+
+static bool uring_start(qaio_t *aio, aioop_t *op) {
+    unsigned n = (op->timeoutms >= 0) ? 2 : 1;
+    if (uring_get_sqes(aio, n) == NULL)
+        return false;
+
+    struct io_uring_sqe *sqe = &aio->sqes[aio->sqlocal & *aio->sqmask];
+    sqe->fd = op->fd;
+    sqe->user_data = (uint64_t) (uintptr_t) op;
+    switch (op->op) {
+        case QAIO_READ:
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr = (uint64_t) (uintptr_t) op->buf;
+            sqe->len = op->nbytes;
+            sqe->off = (uint64_t) -1;  // current file position
+            break;
+        case QAIO_WRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = (uint64_t) (uintptr_t) (op->buf + op->done);
+            sqe->len = op->nbytes - op->done;
+            sqe->off = (uint64_t) -1;
+            break;
+        case QAIO_ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            break;
+        case QAIO_CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr = (uint64_t) (uintptr_t) &op->addr;
+            sqe->off = op->addrlen;
+            break;
+        case QAIO_SENDFILE: {
+            // no sendfile opcode, wait for writability and sendfile() then.
+            uint32_t mask = POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            mask = (mask << 16) | (mask >> 16);
+#endif
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = mask;
+            break;
+        }
+    }
+
+    if (op->timeoutms >= 0) {
+        sqe->flags |= IOSQE_IO_LINK;
+        op->ts.tv_sec = op->timeoutms / 1000;
+        op->ts.tv_nsec = (long long) (op->timeoutms % 1000) * 1000000;
+
+        struct io_uring_sqe *tsqe = &aio->sqes[(aio->sqlocal + 1)
+                & *aio->sqmask];
+        tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+        tsqe->fd = -1;
+        tsqe->addr = (uint64_t) (uintptr_t) &op->ts;
+        tsqe->len = 1;
+        tsqe->user_data = URING_LINK_TIMEOUT;
+    }
+    aio->sqlocal += n;
+
+    return true;
+}
+
+static int uring_flush(qaio_t *aio) {
+    __atomic_store_n(aio->sqtail, aio->sqlocal, __ATOMIC_RELEASE);
+    unsigned tosubmit = aio->sqlocal
+            - __atomic_load_n(aio->sqhead, __ATOMIC_ACQUIRE);
+    if (tosubmit == 0)
+        return 0;
+
+    int ret;
+    do {
+        ret = (int) syscall(__NR_io_uring_enter, aio->ringfd, tosubmit, 0, 0,
+                            NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+// Collect completions. Returns the number of completion entries seen.
+static int uring_harvest(qaio_t *aio) {
+    unsigned head = *aio->cqhead;
+    unsigned tail = __atomic_load_n(aio->cqtail, __ATOMIC_ACQUIRE);
+    int seen = 0;
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cqmask];
+        uint64_t userdata = cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(aio->cqhead, head, __ATOMIC_RELEASE);
+        seen++;
+
+        if (userdata != URING_LINK_TIMEOUT)
+            uring_complete(aio, (aioop_t *) (uintptr_t) userdata, res);
+        tail = __atomic_load_n(aio->cqtail, __ATOMIC_ACQUIRE);
+    }
+    return seen;
+}
+
+static void uring_complete(qaio_t *aio, aioop_t *op, int res) {
+    if (res == -ECANCELED && op->timeoutms >= 0) {
+        // cancelled by the linked timeout.
+        op_complete(aio, op, -ETIMEDOUT);
+        return;
+    }
+    if (res < 0) {
+        op_complete(aio, op, res);
+        return;
+    }
+
+    switch (op->op) {
+        case QAIO_WRITE: {
+            op->done += res;
+            if (res > 0 && op->done < op->nbytes) {
+                if (uring_start(aio, op) == true)
+                    return;
+                op_complete(aio, op, -errno);
+                return;
+            }
+            op_complete(aio, op, op->done);
+            return;
+        }
+        case QAIO_SENDFILE: {
+            bool again = false;
+            while (op->done < op->nbytes) {
+                ssize_t n = sendfile(op->fd, op->infd, &op->offset,
+                                     op->nbytes - op->done);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN) {
+                        again = true;
+                        break;
+                    }
+                    op_complete(aio, op, -errno);
+                    return;
+                }
+                if (n == 0)
+                    break;  // EOF
+                op->done += n;
+            }
+            if (again == true) {
+                if (uring_start(aio, op) == true)
+                    return;
+                op_complete(aio, op, -errno);
+                return;
+            }
+            op_complete(aio, op, op->done);
+            return;
+        }
+        default:
+            op_complete(aio, op, res);
+            return;
+    }
+}
+
+static bool uring_wait(qaio_t *aio, int timeoutms) {
+    if (uring_flush(aio) < 0)
+        return false;
+    if (uring_harvest(aio) > 0)
+        return true;
+    if (timeoutms == 0)
+        return true;
+
+    if (timeoutms < 0) {
+        int ret = (int) syscall(__NR_io_uring_enter, aio->ringfd, 0, 1,
+                                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR)
+            return false;
+    } else {
+        // the ring descriptor polls readable when completions are posted.
+        struct pollfd pfd;
+        pfd.fd = aio->ringfd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeoutms) < 0 && errno != EINTR)
+            return false;
+    }
+
+    uring_harvest(aio);
+    return uring_flush(aio) >= 0;
+}
+
+#endif /* QAIO_IOURING */
+
+#ifdef __linux__
+
+static bool epoll_start(qaio_t *aio, aioop_t *op) {
+    if (op->fd >= aio->fdsize) {
+        int newsize = (aio->fdsize > 0) ? aio->fdsize : 64;
+        while (newsize <= op->fd)
+            newsize *= 2;
+        struct aiofd_s *fds = (struct aiofd_s *) realloc(
+                aio->fds, sizeof(struct aiofd_s) * newsize);
+        if (fds == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        memset(fds + aio->fdsize, 0,
+               sizeof(struct aiofd_s) * (newsize - aio->fdsize));
+        aio->fds = fds;
+        aio->fdsize = newsize;
+    }
+
+    struct aiofd_s *rec = &aio->fds[op->fd];
+    bool rdside = (op->op == QAIO_READ || op->op == QAIO_ACCEPT);
+    if ((rdside && rec->rd != NULL) || (!rdside && rec->wr != NULL)) {
+        errno = EBUSY;
+        return false;
+    }
+
+    if (op->op == QAIO_CONNECT) {
+        if (connect(op->fd, (struct sockaddr *) &op->addr, op->addrlen) == 0) {
+            op_complete(aio, op, 0);
+            return true;
+        } else if (errno != EINPROGRESS) {
+            op_complete(aio, op, -errno);
+            return true;
+        }
+    }
+
+    if (rdside)
+        rec->rd = op;
+    else
+        rec->wr = op;
+    if (epoll_update(aio, op->fd) == false) {
+        if (rdside)
+            rec->rd = NULL;
+        else
+            rec->wr = NULL;
+
+        // regular files can't be polled, they are always ready.
+        if (errno == EPERM && op->op != QAIO_CONNECT) {
+            if (epoll_run(aio, op) == false)
+                op_complete(aio, op, -EAGAIN);
+            return true;
+        }
+        return false;
+    }
+
+    if (op->timeoutms >= 0)
+        op->deadline = now_ms() + op->timeoutms;
+    return true;
+}
+
+static bool epoll_wait_(qaio_t *aio, int timeoutms) {
+    // the nearest deadline bounds the wait.
+    int64_t now = now_ms();
+    aioop_t *op;
+    for (op = aio->ops; op != NULL; op = op->next) {
+        if (op->completed == true || op->deadline < 0)
+            continue;
+        int64_t left = op->deadline - now;
+        if (left < 0)
+            left = 0;
+        if (timeoutms < 0 || left < timeoutms)
+            timeoutms = (int) left;
+    }
+
+    struct epoll_event evs[MAX_EPOLL_EVENTS];
+    int n = epoll_wait(aio->epfd, evs, MAX_EPOLL_EVENTS, timeoutms);
+    if (n < 0) {
+        if (errno == EINTR)
+            return true;
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < n; i++) {
+        int fd = evs[i].data.fd;
+        struct aiofd_s *rec = &aio->fds[fd];
+        uint32_t events = evs[i].events;
+        if (rec->rd != NULL && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            op = rec->rd;
+            if (epoll_run(aio, op) == true)
+                epoll_detach(aio, op);
+            else if (op->timeoutms >= 0)
+                op->deadline = now_ms() + op->timeoutms;
+        }
+        if (rec->wr != NULL && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            op = rec->wr;
+            if (epoll_run(aio, op) == true)
+                epoll_detach(aio, op);
+            else if (op->timeoutms >= 0)
+                op->deadline = now_ms() + op->timeoutms;
+        }
+    }
+
+    // expire
+    now = now_ms();
+    for (op = aio->ops; op != NULL; op = op->next) {
+        if (op->completed == false && op->deadline >= 0
+                && op->deadline <= now) {
+            epoll_detach(aio, op);
+            op_complete(aio, op, -ETIMEDOUT);
+        }
+    }
+
+    return true;
+}
+
+// Try the operation. Returns true if it has completed.
+static bool epoll_run(qaio_t *aio, aioop_t *op) {
+    while (true) {
+        ssize_t n = 0;
+        switch (op->op) {
+            case QAIO_READ:
+                n = read(op->fd, op->buf, op->nbytes);
+                break;
+            case QAIO_ACCEPT:
+                n = accept(op->fd, NULL, NULL);
+                break;
+            case QAIO_WRITE:
+                n = write(op->fd, op->buf + op->done, op->nbytes - op->done);
+                break;
+            case QAIO_SENDFILE:
+                n = sendfile(op->fd, op->infd, &op->offset,
+                             op->nbytes - op->done);
+                break;
+            case QAIO_CONNECT: {
+                int err = 0;
+                socklen_t errlen = sizeof(err);
+                if (getsockopt(op->fd, SOL_SOCKET, SO_ERROR, &err, &errlen)
+                        != 0) {
+                    err = errno;
+                }
+                op_complete(aio, op, -err);
+                return true;
+            }
+        }
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            op_complete(aio, op, -errno);
+            return true;
+        }
+
+        if (op->op == QAIO_WRITE || op->op == QAIO_SENDFILE) {
+            op->done += n;
+            if (n > 0 && op->done < op->nbytes)
+                continue;
+            op_complete(aio, op, op->done);
+            return true;
+        }
+
+        op_complete(aio, op, n);
+        return true;
+    }
+}
+
+static void epoll_detach(qaio_t *aio, aioop_t *op) {
+    if (op->fd >= aio->fdsize)
+        return;
+    struct aiofd_s *rec = &aio->fds[op->fd];
+    if (rec->rd == op)
+        rec->rd = NULL;
+    else if (rec->wr == op)
+        rec->wr = NULL;
+    else
+        return;
+    epoll_update(aio, op->fd);
+}
+
+static bool epoll_update(qaio_t *aio, int fd) {
+    struct aiofd_s *rec = &aio->fds[fd];
+    uint32_t events = ((rec->rd != NULL) ? EPOLLIN : 0)
+            | ((rec->wr != NULL) ? EPOLLOUT : 0);
+    if (events == rec->events)
+        return true;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    int ctl;
+    if (rec->events == 0)
+        ctl = EPOLL_CTL_ADD;
+    else if (events == 0)
+        ctl = EPOLL_CTL_DEL;
+    else
+        ctl = EPOLL_CTL_MOD;
+
+    if (epoll_ctl(aio->epfd, ctl, fd, &ev) != 0 && ctl != EPOLL_CTL_DEL)
+        return false;
+    rec->events = events;
+    return true;
+}
+
+#endif /* __linux__ */
+
+#endif /* _DOXYGEN_SKIP */
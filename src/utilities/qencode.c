@@ -33,11 +33,130 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include "qinternal.h"
 #include "utilities/qstring.h"
 #include "utilities/qencode.h"
 
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * SSSE3/AVX2 codecs are compiled with per-function target attributes and
+ * selected at run time, so the library itself keeps the baseline ISA.
+ * Define DISABLE_SIMD to build the scalar code only.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(DISABLE_SIMD)
+#define QENCODE_SIMD_X86
+#include <immintrin.h>
+#define CPU_SSSE3   (0x01)
+#define CPU_AVX2    (0x02)
+#endif
+
+static const char URLCHARTBL[16*16] = {
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 00-0F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 10-1F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 ,'-','.','/', // 20-2F
+    '0','1','2','3','4','5','6','7','8','9',':', 0 , 0 , 0 , 0 , 0 , // 30-3F
+    '@','A','B','C','D','E','F','G','H','I','J','K','L','M','N','O', // 40-4F
+    'P','Q','R','S','T','U','V','W','X','Y','Z', 0 ,'\\',0 , 0 ,'_', // 50-5F
+    00 ,'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o', // 60-6f
+    'p','q','r','s','t','u','v','w','x','y','z', 0 , 0 , 0 , 0 , 0 , // 70-7F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 80-8F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 90-9F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // A0-AF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // B0-BF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // C0-CF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // D0-DF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // E0-EF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0   // F0-FF
+}; // 0 means must be encoded.
+
+static const char B64CHARTBL[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P', // 00-0F
+    'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f', // 10-1F
+    'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v', // 20-2F
+    'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'  // 30-3F
+};
+
+static const unsigned char B64MAPTBL[16 * 16] = {
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 00-0F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 10-1F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,  // 20-2F
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,  // 30-3F
+    64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  // 40-4F
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,  // 50-5F
+    64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,  // 60-6F
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,  // 70-7F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 80-8F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 90-9F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // A0-AF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // B0-BF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // C0-CF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // D0-DF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // E0-EF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64   // F0-FF
+};
+
+static const char HEXCHARTBL[16] = {
+    '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
+};
+
+static const unsigned char HEXMAPTBL[16 * 16] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 00-0F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10-1F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 20-2F
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0, // 30-3F
+    0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 40-4F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 50-5F
+    0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 60-6f
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 70-7F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80-8F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90-9F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // A0-AF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // B0-BF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // C0-CF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // D0-DF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // E0-EF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0  // F0-FF
+};
+
+static bool next_query(char **pos, char *end, char equalchar, char sepchar,
+                       qquery_t *entry);
+static size_t url_safe_span(const unsigned char *src, size_t len);
+static size_t url_special_span(const char *src, size_t len);
+static size_t url_decode(char *str, size_t len);
+static size_t b64enc_scalar(char *out, const unsigned char *src, size_t size);
+static size_t b64dec(unsigned char *out, size_t outsize,
+                     const unsigned char *src, size_t len);
+static size_t hexdec(unsigned char *out, const unsigned char *src,
+                     size_t len);
+
+#ifdef QENCODE_SIMD_X86
+static int cpu_features(void);
+static size_t urlsafe_ssse3(const unsigned char *src, size_t len);
+static size_t urlsafe_avx2(const unsigned char *src, size_t len);
+static size_t urlspecial_ssse3(const char *src, size_t len);
+static size_t urlspecial_avx2(const char *src, size_t len);
+static size_t b64enc_ssse3(char *out, const unsigned char *src, size_t size);
+static size_t b64enc_avx2(char *out, const unsigned char *src, size_t size);
+static size_t b64dec_ssse3(unsigned char *out, size_t outsize,
+                           const unsigned char *src, size_t len);
+static size_t b64dec_avx2(unsigned char *out, size_t outsize,
+                          const unsigned char *src, size_t len);
+static size_t hexenc_ssse3(char *out, const unsigned char *src, size_t size);
+static size_t hexenc_avx2(char *out, const unsigned char *src, size_t size);
+static size_t hexdec_ssse3(unsigned char *out, const unsigned char *src,
+                           size_t len);
+static size_t hexdec_avx2(unsigned char *out, const unsigned char *src,
+                          size_t len);
+#endif
+
+#endif
+
 /**
  * Parse URL encoded query string
  *
@@ -71,18 +190,17 @@ qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
 
     int cnt = 0;
     char *newquery = strdup(query);
-    while (newquery && *newquery) {
-        char *value = _q_makeword(newquery, sepchar);
-        char *name = qstrtrim(_q_makeword(value, equalchar));
-        qurl_decode(name);
-        qurl_decode(value);
-
-        if (tbl->putstr(tbl, name, value) == true) {
-            cnt++;
+    if (newquery != NULL) {
+        char *pos = newquery, *end = newquery + strlen(newquery);
+        qquery_t entry;
+        while (next_query(&pos, end, equalchar, sepchar, &entry) == true) {
+            // decoding only shrinks, so both ends lie within the buffer.
+            entry.name[entry.namelen] = '\0';
+            entry.value[entry.valuelen] = '\0';
+            if (tbl->putstr(tbl, entry.name, entry.value) == true) {
+                cnt++;
+            }
         }
-
-        free(name);
-        free(value);
     }
 
     if (count != NULL) {
@@ -93,6 +211,65 @@ qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
     return tbl;
 }
 
+/**
+ * Parse URL encoded query string without copying.
+ *
+ * Each entry points into the query buffer. Only names and values that
+ * contain '%' or '+' are decoded, in place, and the others are not touched.
+ * The name is trimmed of surrounding white spaces like qparse_queries() does.
+ *
+ * @param query         URL encoded string. It is modified by decoding.
+ * @param len           the length of query.
+ * @param equalchar     separater of key, value pair.
+ * @param sepchar       separater of line.
+ * @param entries       array to store the parsed entries, or NULL to count
+ *                      entries without modifying the query.
+ * @param maxentries    the number of elements in entries.
+ *
+ * @return the number of entries parsed. When entries is NULL, the number of
+ *         entries in the query.
+ *
+ * @note
+ *  Names and values are not terminated by NULL character. Use namelen and
+ *  valuelen. Parsing stops when the entries array is full, and the rest of
+ *  the query is left untouched.
+ *
+ * @code
+ *  char query[] = "category=love&str=hello%20world&sort=asc";
+ *  qquery_t entries[8];
+ *  int i, n = qparse_queries_view(query, strlen(query), '=', '&',
+ *                                 entries, 8);
+ *  for (i = 0; i < n; i++) {
+ *    printf("%.*s = %.*s\n", (int)entries[i].namelen, entries[i].name,
+ *           (int)entries[i].valuelen, entries[i].value);
+ *  }
+ * @endcode
+ */
+int qparse_queries_view(char *query, size_t len, char equalchar, char sepchar,
+                        qquery_t *entries, int maxentries) {
+    if (query == NULL) {
+        return 0;
+    }
+
+    int cnt = 0;
+    char *pos = query, *end = query + len;
+    if (entries == NULL) {
+        while (pos < end) {
+            char *sep = memchr(pos, sepchar, end - pos);
+            pos = (sep != NULL) ? sep + 1 : end;
+            cnt++;
+        }
+        return cnt;
+    }
+
+    while (cnt < maxentries
+            && next_query(&pos, end, equalchar, sepchar, &entries[cnt])) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
 /**
  * Encode data using URL encoding(Percent encoding) algorithm.
  *
@@ -123,25 +300,6 @@ qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
  * @endcode
  */
 char *qurl_encode(const void *bin, size_t size) {
-    const char URLCHARTBL[16*16] = {
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 00-0F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 10-1F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 ,'-','.','/', // 20-2F
-        '0','1','2','3','4','5','6','7','8','9',':', 0 , 0 , 0 , 0 , 0 , // 30-3F
-        '@','A','B','C','D','E','F','G','H','I','J','K','L','M','N','O', // 40-4F
-        'P','Q','R','S','T','U','V','W','X','Y','Z', 0 ,'\\',0 , 0 ,'_', // 50-5F
-        00 ,'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o', // 60-6f
-        'p','q','r','s','t','u','v','w','x','y','z', 0 , 0 , 0 , 0 , 0 , // 70-7F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 80-8F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 90-9F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // A0-AF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // B0-BF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // C0-CF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // D0-DF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // E0-EF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0   // F0-FF
-    }; // 0 means must be encoded.
-
     if (bin == NULL)
         return NULL;
     if (size == 0)
@@ -153,24 +311,21 @@ char *qurl_encode(const void *bin, size_t size) {
         return NULL;
 
     char *pszEncPt = pszEncStr;
-    char *pBinPt = (char *) bin;
-    const char *pBinEnd = (bin + size - 1);
-    for (; pBinPt <= pBinEnd; pBinPt++) {
-        unsigned char c = *pBinPt;
-        if (URLCHARTBL[c] != 0) {
-            *pszEncPt++ = *pBinPt;
-        } else {
-            unsigned char cUpper4 = (c >> 4);
-            unsigned char cLower4 = (c & 0x0F);
-
-            *pszEncPt++ = '%';
-            *pszEncPt++ =
-                    (cUpper4 < 0x0A) ?
-                            (cUpper4 + '0') : ((cUpper4 - 0x0A) + 'a');
-            *pszEncPt++ =
-                    (cLower4 < 0x0A) ?
-                            (cLower4 + '0') : ((cLower4 - 0x0A) + 'a');
-        }
+    const unsigned char *pBinPt = (const unsigned char *) bin;
+    const unsigned char *pBinEnd = pBinPt + size;
+    while (pBinPt < pBinEnd) {
+        // copy a run of characters which need no encoding at once.
+        size_t run = url_safe_span(pBinPt, pBinEnd - pBinPt);
+        memcpy(pszEncPt, pBinPt, run);
+        pszEncPt += run;
+        pBinPt += run;
+        if (pBinPt >= pBinEnd)
+            break;
+
+        unsigned char c = *pBinPt++;
+        *pszEncPt++ = '%';
+        *pszEncPt++ = HEXCHARTBL[c >> 4];
+        *pszEncPt++ = HEXCHARTBL[c & 0x0F];
     }
     *pszEncPt = '\0';
 
@@ -194,29 +349,13 @@ size_t qurl_decode(char *str) {
         return 0;
     }
 
-    char *pEncPt, *pBinPt = str;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt++) {
-        switch (*pEncPt) {
-            case '+': {
-                *pBinPt++ = ' ';
-                break;
-            }
-            case '%': {
-                *pBinPt++ = _q_x2c(*(pEncPt + 1), *(pEncPt + 2));
-                pEncPt += 2;
-                break;
-            }
-            default: {
-                *pBinPt++ = *pEncPt;
-                break;
-            }
-        }
-    }
-    *pBinPt = '\0';
+    size_t len = url_decode(str, strlen(str));
+    str[len] = '\0';
 
-    return (pBinPt - str);
+    return len;
 }
 
+
 /**
  * Encode data using BASE64 algorithm.
  *
@@ -247,48 +386,20 @@ size_t qurl_decode(char *str) {
  * @endcode
  */
 char *qbase64_encode(const void *bin, size_t size) {
-    const char B64CHARTBL[64] = {
-        'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P', // 00-0F
-        'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f', // 10-1F
-        'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v', // 20-2F
-        'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'  // 30-3F
-    };
-
     if (size == 0) {
         return strdup("");
     }
 
-    // malloc for encoded string
-    char *pszB64 = (char *) malloc(
-            4 * ((size / 3) + ((size % 3 == 0) ? 0 : 1)) + 1);
+    size_t buflen = qbase64_encode_len(size);
+    char *pszB64 = (buflen > 0) ? (char *) malloc(buflen) : NULL;
     if (pszB64 == NULL) {
         return NULL;
     }
 
-    char *pszB64Pt = pszB64;
-    unsigned char *pBinPt, *pBinEnd = (unsigned char *) (bin + size - 1);
-    unsigned char szIn[3] = { 0, 0, 0 };
-    int nOffset;
-    for (pBinPt = (unsigned char *) bin, nOffset = 0; pBinPt <= pBinEnd;
-            pBinPt++, nOffset++) {
-        int nIdxOfThree = nOffset % 3;
-        szIn[nIdxOfThree] = *pBinPt;
-        if (nIdxOfThree < 2 && pBinPt < pBinEnd)
-            continue;
-
-        *pszB64Pt++ = B64CHARTBL[((szIn[0] & 0xFC) >> 2)];
-        *pszB64Pt++ = B64CHARTBL[(((szIn[0] & 0x03) << 4)
-                | ((szIn[1] & 0xF0) >> 4))];
-        *pszB64Pt++ =
-                (nIdxOfThree >= 1) ?
-                        B64CHARTBL[(((szIn[1] & 0x0F) << 2)
-                                | ((szIn[2] & 0xC0) >> 6))] :
-                        '=';
-        *pszB64Pt++ = (nIdxOfThree >= 2) ? B64CHARTBL[(szIn[2] & 0x3F)] : '=';
-
-        memset((void *) szIn, 0, sizeof(szIn));
+    if (qbase64_encode_buf(pszB64, buflen, bin, size) < 0) {
+        free(pszB64);
+        return NULL;
     }
-    *pszB64Pt = '\0';
 
     return pszB64;
 }
@@ -306,57 +417,128 @@ char *qbase64_encode(const void *bin, size_t size) {
  *  character.
  */
 size_t qbase64_decode(char *str) {
-    const char B64MAPTBL[16 * 16] = {
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 00-0F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 10-1F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,  // 20-2F
-        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,  // 30-3F
-        64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  // 40-4F
-        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,  // 50-5F
-        64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,  // 60-6F
-        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,  // 70-7F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 80-8F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 90-9F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // A0-AF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // B0-BF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // C0-CF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // D0-DF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // E0-EF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64   // F0-FF
-    };
-
-    char *pEncPt, *pBinPt = str;
-    int nIdxOfFour = 0;
-    char cLastByte = 0;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt++) {
-        char cByte = B64MAPTBL[(unsigned char) (*pEncPt)];
-        if (cByte == 64)
-            continue;
+    size_t len = strlen(str);
+    size_t decsize = b64dec((unsigned char *) str, len + 1,
+                            (const unsigned char *) str, len);
+    str[decsize] = '\0';
 
-        if (nIdxOfFour == 0) {
-            nIdxOfFour++;
-        } else if (nIdxOfFour == 1) {
-            // 00876543 0021????
-            //*pBinPt++ = ( ((cLastByte << 2) & 0xFC) | ((cByte >> 4) & 0x03) );
-            *pBinPt++ = ((cLastByte << 2) | (cByte >> 4));
-            nIdxOfFour++;
-        } else if (nIdxOfFour == 2) {
-            // 00??8765 004321??
-            //*pBinPt++ = ( ((cLastByte << 4) & 0xF0) | ((cByte >> 2) & 0x0F) );
-            *pBinPt++ = ((cLastByte << 4) | (cByte >> 2));
-            nIdxOfFour++;
-        } else {
-            // 00????87 00654321
-            //*pBinPt++ = ( ((cLastByte << 6) & 0xC0) | (cByte & 0x3F) );
-            *pBinPt++ = ((cLastByte << 6) | cByte);
-            nIdxOfFour = 0;
-        }
+    return decsize;
+}
 
-        cLastByte = cByte;
+/**
+ * Get the buffer size needed by qbase64_encode_buf().
+ *
+ * @param size  the length of input data.
+ *
+ * @return the number of bytes including the terminating NULL character,
+ *         or 0 if the result does not fit in size_t.
+ */
+size_t qbase64_encode_len(size_t size) {
+    if (size / 3 >= (SIZE_MAX - 5) / 4) {
+        return 0;
     }
-    *pBinPt = '\0';
+    return 4 * ((size + 2) / 3) + 1;
+}
 
-    return (pBinPt - str);
+/**
+ * Get the maximum number of bytes qbase64_decode_buf() can produce.
+ *
+ * @param len   the length of BASE64 encoded string.
+ *
+ * @return the maximum decoded length in bytes.
+ */
+size_t qbase64_decode_len(size_t len) {
+    return (len / 4) * 3 + ((len % 4) * 3) / 4;
+}
+
+/**
+ * Encode data using BASE64 algorithm into a caller-provided buffer.
+ *
+ * SSSE3 or AVX2 is used when the running CPU supports it.
+ *
+ * @param buf       output buffer.
+ * @param bufsize   size of output buffer. It must be at least
+ *                  qbase64_encode_len(size) bytes.
+ * @param bin       a pointer of input data.
+ * @param size      the length of input data.
+ *
+ * @return the length of encoded string not including the terminating NULL
+ *         character in case of successful, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOBUFS : Output buffer is too small.
+ *
+ * @code
+ *   char buf[qbase64_encode_len(sizeof(data))];
+ *   ssize_t enclen = qbase64_encode_buf(buf, sizeof(buf), data, sizeof(data));
+ * @endcode
+ */
+ssize_t qbase64_encode_buf(char *buf, size_t bufsize, const void *bin,
+                           size_t size) {
+    if (buf == NULL || (bin == NULL && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t enclen = qbase64_encode_len(size);
+    if (enclen == 0 || bufsize < enclen) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    const unsigned char *src = (const unsigned char *) bin;
+    char *pszB64Pt = buf;
+    size_t done = 0;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+    if (cpu & CPU_AVX2) {
+        done = b64enc_avx2(pszB64Pt, src, size);
+    }
+    if (cpu & CPU_SSSE3) {
+        done += b64enc_ssse3(pszB64Pt + (done / 3) * 4, src + done,
+                             size - done);
+    }
+    pszB64Pt += (done / 3) * 4;
+#endif
+    pszB64Pt += b64enc_scalar(pszB64Pt, src + done, size - done);
+    *pszB64Pt = '\0';
+
+    return (pszB64Pt - buf);
+}
+
+/**
+ * Decode BASE64 encoded string into a caller-provided buffer.
+ *
+ * Characters outside of the BASE64 alphabet such as line breaks and padding
+ * are skipped like qbase64_decode() does.
+ *
+ * @param buf       output buffer. It can be same as str for in-place decoding.
+ * @param bufsize   size of output buffer. It must be at least
+ *                  qbase64_decode_len(len) bytes.
+ * @param str       a pointer of BASE64 encoded string.
+ * @param len       the length of encoded string.
+ *
+ * @return the number of bytes stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOBUFS : Output buffer is too small.
+ *
+ * @note
+ *  The output is binary and not terminated by NULL character.
+ */
+ssize_t qbase64_decode_buf(void *buf, size_t bufsize, const char *str,
+                           size_t len) {
+    if (buf == NULL || (str == NULL && len > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < qbase64_decode_len(len)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    return b64dec((unsigned char *) buf, bufsize, (const unsigned char *) str,
+                  len);
 }
 
 /**
@@ -391,22 +573,15 @@ size_t qbase64_decode(char *str) {
  * @endcode
  */
 char *qhex_encode(const void *bin, size_t size) {
-    const char HEXCHARTBL[16] = {
-        '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
-    };
-
-    char *pHexStr = (char *) malloc(sizeof(char) * ((size * 2) + 1));
+    size_t buflen = qhex_encode_len(size);
+    char *pHexStr = (buflen > 0) ? (char *) malloc(buflen) : NULL;
     if (pHexStr == NULL)
         return NULL;
 
-    unsigned char *pSrc = (unsigned char *) bin;
-    char *pHexPt = pHexStr;
-    int i;
-    for (i = 0; i < size; i++) {
-        *pHexPt++ = HEXCHARTBL[(pSrc[i] >> 4)];
-        *pHexPt++ = HEXCHARTBL[(pSrc[i] & 0x0F)];
+    if (qhex_encode_buf(pHexStr, buflen, bin, size) < 0) {
+        free(pHexStr);
+        return NULL;
     }
-    *pHexPt = '\0';
 
     return pHexStr;
 }
@@ -424,31 +599,708 @@ char *qhex_encode(const void *bin, size_t size) {
  *  character.
  */
 size_t qhex_decode(char *str) {
-    const char HEXMAPTBL[16*16] = {
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 00-0F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10-1F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 20-2F
-        0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0, // 30-3F
-        0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 40-4F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 50-5F
-        0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 60-6f
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 70-7F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80-8F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90-9F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // A0-AF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // B0-BF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // C0-CF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // D0-DF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // E0-EF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0  // F0-FF
-    };
-
-    char *pEncPt, *pBinPt = str;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt += 2) {
-        *pBinPt++ = (HEXMAPTBL[(unsigned char) (*pEncPt)] << 4)
-                + HEXMAPTBL[(unsigned char) (*(pEncPt + 1))];
-    }
-    *pBinPt = '\0';
+    size_t len = strlen(str);
+    size_t decsize = hexdec((unsigned char *) str,
+                            (const unsigned char *) str, len);
+    str[decsize] = '\0';
+
+    return decsize;
+}
+
+/**
+ * Get the buffer size needed by qhex_encode_buf().
+ *
+ * @param size  the length of input data.
+ *
+ * @return the number of bytes including the terminating NULL character,
+ *         or 0 if the result does not fit in size_t.
+ */
+size_t qhex_encode_len(size_t size) {
+    if (size >= (SIZE_MAX - 1) / 2) {
+        return 0;
+    }
+    return (size * 2) + 1;
+}
+
+/**
+ * Get the number of bytes qhex_decode_buf() produces.
+ *
+ * @param len   the length of Hexadecimal encoded string.
+ *
+ * @return the decoded length in bytes.
+ */
+size_t qhex_decode_len(size_t len) {
+    return (len / 2) + (len % 2);
+}
+
+/**
+ * Encode data to Hexadecimal digit format into a caller-provided buffer.
+ *
+ * SSSE3 or AVX2 is used when the running CPU supports it.
+ *
+ * @param buf       output buffer.
+ * @param bufsize   size of output buffer. It must be at least
+ *                  qhex_encode_len(size) bytes.
+ * @param bin       a pointer of input data.
+ * @param size      the length of input data.
+ *
+ * @return the length of encoded string not including the terminating NULL
+ *         character in case of successful, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOBUFS : Output buffer is too small.
+ */
+ssize_t qhex_encode_buf(char *buf, size_t bufsize, const void *bin,
+                        size_t size) {
+    if (buf == NULL || (bin == NULL && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t enclen = qhex_encode_len(size);
+    if (enclen == 0 || bufsize < enclen) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    const unsigned char *pSrc = (const unsigned char *) bin;
+    size_t i = 0;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+    if (cpu & CPU_AVX2) {
+        i = hexenc_avx2(buf, pSrc, size);
+    }
+    if (cpu & CPU_SSSE3) {
+        i += hexenc_ssse3(buf + (i * 2), pSrc + i, size - i);
+    }
+#endif
+    char *pHexPt = buf + (i * 2);
+    for (; i < size; i++) {
+        *pHexPt++ = HEXCHARTBL[(pSrc[i] >> 4)];
+        *pHexPt++ = HEXCHARTBL[(pSrc[i] & 0x0F)];
+    }
+    *pHexPt = '\0';
+
+    return (pHexPt - buf);
+}
+
+/**
+ * Decode Hexadecimal encoded data into a caller-provided buffer.
+ *
+ * @param buf       output buffer. It can be same as str for in-place decoding.
+ * @param bufsize   size of output buffer. It must be at least
+ *                  qhex_decode_len(len) bytes.
+ * @param str       a pointer of Hexadecimal encoded string.
+ * @param len       the length of encoded string.
+ *
+ * @return the number of bytes stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOBUFS : Output buffer is too small.
+ *
+ * @note
+ *  Non-hexadecimal characters are decoded as 0 like qhex_decode() does.
+ *  The output is binary and not terminated by NULL character.
+ */
+ssize_t qhex_decode_buf(void *buf, size_t bufsize, const char *str,
+                        size_t len) {
+    if (buf == NULL || (str == NULL && len > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < qhex_decode_len(len)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    return hexdec((unsigned char *) buf, (const unsigned char *) str, len);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Cut the next "name=value" pair out of [*pos, end) and decode the parts
+ * which contain '%' or '+'.
+ */
+static bool next_query(char **pos, char *end, char equalchar, char sepchar,
+                       qquery_t *entry) {
+    if (*pos >= end) {
+        return false;
+    }
+
+    char *seg = *pos;
+    char *segend = memchr(seg, sepchar, end - seg);
+    if (segend == NULL) {
+        segend = end;
+    }
+    *pos = (segend < end) ? segend + 1 : end;
+
+    char *eq = memchr(seg, equalchar, segend - seg);
+    char *name = seg, *nameend = (eq != NULL) ? eq : segend;
+    while (name < nameend && isspace((unsigned char) *name)) {
+        name++;
+    }
+    while (nameend > name && isspace((unsigned char) *(nameend - 1))) {
+        nameend--;
+    }
+
+    entry->name = name;
+    entry->namelen = url_decode(name, nameend - name);
+    entry->value = (eq != NULL) ? eq + 1 : segend;
+    entry->valuelen = url_decode(entry->value, segend - entry->value);
+
+    return true;
+}
+
+// Returns the number of leading bytes which need no URL encoding.
+static size_t url_safe_span(const unsigned char *src, size_t len) {
+    size_t i = 0;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+    if (cpu & CPU_AVX2) {
+        i = urlsafe_avx2(src, len);
+    }
+    if (cpu & CPU_SSSE3) {
+        i += urlsafe_ssse3(src + i, len - i);
+    }
+#endif
+    while (i < len && URLCHARTBL[src[i]] != 0) {
+        i++;
+    }
+    return i;
+}
+
+// Returns the number of leading bytes before the first '%' or '+'.
+static size_t url_special_span(const char *src, size_t len) {
+    size_t i = 0;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+    if (cpu & CPU_AVX2) {
+        i = urlspecial_avx2(src, len);
+    }
+    if (cpu & CPU_SSSE3) {
+        i += urlspecial_ssse3(src + i, len - i);
+    }
+#endif
+    while (i < len && src[i] != '%' && src[i] != '+') {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Decode len bytes of str in place and return the decoded length. Nothing
+ * is written when there is no '%' or '+'. A '%' without two following
+ * characters is kept as it is.
+ */
+static size_t url_decode(char *str, size_t len) {
+    size_t i = url_special_span(str, len);
+    char *pBinPt = str + i;
+    while (i < len) {
+        if (str[i] == '+') {
+            *pBinPt++ = ' ';
+            i++;
+        } else if (str[i] == '%' && i + 2 < len) {
+            *pBinPt++ = _q_x2c(str[i + 1], str[i + 2]);
+            i += 3;
+        } else {
+            *pBinPt++ = str[i++];
+        }
+
+        size_t run = url_special_span(str + i, len - i);
+        memmove(pBinPt, str + i, run);
+        pBinPt += run;
+        i += run;
+    }
 
     return (pBinPt - str);
 }
+
+static size_t b64enc_scalar(char *out, const unsigned char *src, size_t size) {
+    char *pszB64Pt = out;
+    size_t i;
+    for (i = 0; i + 3 <= size; i += 3) {
+        uint32_t v = ((uint32_t) src[i] << 16) | ((uint32_t) src[i + 1] << 8)
+                | src[i + 2];
+        *pszB64Pt++ = B64CHARTBL[(v >> 18) & 0x3F];
+        *pszB64Pt++ = B64CHARTBL[(v >> 12) & 0x3F];
+        *pszB64Pt++ = B64CHARTBL[(v >> 6) & 0x3F];
+        *pszB64Pt++ = B64CHARTBL[v & 0x3F];
+    }
+
+    if (i < size) {
+        uint32_t v = (uint32_t) src[i] << 16;
+        if (i + 1 < size) {
+            v |= (uint32_t) src[i + 1] << 8;
+        }
+        *pszB64Pt++ = B64CHARTBL[(v >> 18) & 0x3F];
+        *pszB64Pt++ = B64CHARTBL[(v >> 12) & 0x3F];
+        *pszB64Pt++ = (i + 1 < size) ? B64CHARTBL[(v >> 6) & 0x3F] : '=';
+        *pszB64Pt++ = '=';
+    }
+
+    return (pszB64Pt - out);
+}
+
+/*
+ * Decode in blocks with SIMD whenever the decoder sits on a quad boundary,
+ * and byte by byte otherwise. Blocks containing characters outside of the
+ * alphabet are left to the scalar loop which skips them. The output never
+ * runs ahead of the input, so src and out may overlap for in-place decoding.
+ */
+static size_t b64dec(unsigned char *out, size_t outsize,
+                     const unsigned char *src, size_t len) {
+    unsigned char *pBinPt = out;
+    const unsigned char *pEncPt = src, *pEncEnd = src + len;
+    int nIdxOfFour = 0;
+    unsigned char cLastByte = 0;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+#endif
+
+    while (pEncPt < pEncEnd) {
+#ifdef QENCODE_SIMD_X86
+        if (nIdxOfFour == 0 && (cpu & CPU_SSSE3)) {
+            size_t done = 0;
+            if (cpu & CPU_AVX2) {
+                done = b64dec_avx2(pBinPt, outsize - (pBinPt - out), pEncPt,
+                                   pEncEnd - pEncPt);
+            }
+            unsigned char *pNext = pBinPt + (done / 4) * 3;
+            done += b64dec_ssse3(pNext, outsize - (pNext - out),
+                                 pEncPt + done, pEncEnd - pEncPt - done);
+            pBinPt += (done / 4) * 3;
+            pEncPt += done;
+            if (pEncPt >= pEncEnd) {
+                break;
+            }
+        }
+#endif
+        unsigned char cByte = B64MAPTBL[*pEncPt++];
+        if (cByte == 64)
+            continue;
+
+        if (nIdxOfFour == 0) {
+            nIdxOfFour++;
+        } else if (nIdxOfFour == 1) {
+            // 00876543 0021????
+            *pBinPt++ = ((cLastByte << 2) | (cByte >> 4));
+            nIdxOfFour++;
+        } else if (nIdxOfFour == 2) {
+            // 00??8765 004321??
+            *pBinPt++ = ((cLastByte << 4) | (cByte >> 2));
+            nIdxOfFour++;
+        } else {
+            // 00????87 00654321
+            *pBinPt++ = ((cLastByte << 6) | cByte);
+            nIdxOfFour = 0;
+        }
+
+        cLastByte = cByte;
+    }
+
+    return (pBinPt - out);
+}
+
+static size_t hexdec(unsigned char *out, const unsigned char *src,
+                     size_t len) {
+    size_t i = 0;
+    unsigned char *pBinPt = out;
+#ifdef QENCODE_SIMD_X86
+    int cpu = cpu_features();
+#endif
+
+    while (i < len) {
+#ifdef QENCODE_SIMD_X86
+        if (cpu & CPU_SSSE3) {
+            size_t done = 0;
+            if (cpu & CPU_AVX2) {
+                done = hexdec_avx2(pBinPt, src + i, len - i);
+            }
+            done += hexdec_ssse3(pBinPt + (done / 2), src + i + done,
+                                 len - i - done);
+            pBinPt += done / 2;
+            i += done;
+            if (i >= len) {
+                break;
+            }
+        }
+#endif
+        // A block with non-hex characters is done one pair at a time.
+        unsigned char cLow = (i + 1 < len) ? HEXMAPTBL[src[i + 1]] : 0;
+        *pBinPt++ = (HEXMAPTBL[src[i]] << 4) | cLow;
+        i += 2;
+    }
+
+    return (pBinPt - out);
+}
+
+#ifdef QENCODE_SIMD_X86
+
+static int cpu_features(void) {
+    static volatile int features = -1;
+    if (features < 0) {
+        int f = 0;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+            f |= CPU_SSSE3;
+        if (__builtin_cpu_supports("avx2"))
+            f |= (CPU_SSSE3 | CPU_AVX2);
+        features = f;
+    }
+    return features;
+}
+
+/*
+ * URL-safe characters are classified with a nibble bitmap: the low nibble
+ * selects the set of allowed high nibbles. Bytes of 0x80 and above have no
+ * bit in the high-nibble table and always need encoding.
+ */
+#define URLSAFE_LUT_LO  0xB8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, \
+                        0xF8, 0xF8, 0xF8, 0x50, 0x70, 0x54, 0x54, 0x74
+#define URLSAFE_LUT_HI  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, \
+                        0, 0, 0, 0, 0, 0, 0, 0
+
+__attribute__((target("ssse3")))
+static size_t urlsafe_ssse3(const unsigned char *src, size_t len) {
+    const __m128i lut_lo = _mm_setr_epi8(URLSAFE_LUT_LO);
+    const __m128i lut_hi = _mm_setr_epi8(URLSAFE_LUT_HI);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i;
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble));
+        __m128i hi = _mm_shuffle_epi8(lut_hi,
+                                      _mm_and_si128(_mm_srli_epi16(in, 4),
+                                                    nibble));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                                    _mm_setzero_si128()));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t urlsafe_avx2(const unsigned char *src, size_t len) {
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(URLSAFE_LUT_LO));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(URLSAFE_LUT_HI));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i;
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, nibble));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi,
+                                         _mm256_and_si256(
+                                                 _mm256_srli_epi16(in, 4),
+                                                 nibble));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+                                  _mm256_setzero_si256()));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t urlspecial_ssse3(const char *src, size_t len) {
+    const __m128i percent = _mm_set1_epi8('%'), plus = _mm_set1_epi8('+');
+    size_t i;
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(in, percent),
+                                                  _mm_cmpeq_epi8(in, plus)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t urlspecial_avx2(const char *src, size_t len) {
+    const __m256i percent = _mm256_set1_epi8('%');
+    const __m256i plus = _mm256_set1_epi8('+');
+    size_t i;
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (src + i));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(in, percent),
+                                _mm256_cmpeq_epi8(in, plus)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i;
+}
+
+/*
+ * Base64 codecs follow the multiply-shift approach by Wojciech Mula and
+ * Daniel Lemire: 12 input bytes are spread over 16 lanes, the 6-bit indices
+ * are isolated with two multiplies and translated to ASCII with a single
+ * nibble-indexed shuffle.
+ */
+__attribute__((target("ssse3")))
+static size_t b64enc_ssse3(char *out, const unsigned char *src, size_t size) {
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4,
+                                      1, 2, 0, 1);
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    size_t i;
+    for (i = 0; i + 16 <= size; i += 12, out += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        in = _mm_shuffle_epi8(in, shuf);
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(t1, t3);
+
+        __m128i res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+        res = _mm_or_si128(res, _mm_and_si128(less, _mm_set1_epi8(13)));
+        res = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, res), idx);
+        _mm_storeu_si128((__m128i *) out, res);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b64enc_avx2(char *out, const unsigned char *src, size_t size) {
+    const __m256i shuf = _mm256_broadcastsi128_si256(
+            _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m256i shift_lut = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                          '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    size_t i;
+    for (i = 0; i + 28 <= size; i += 24, out += 32) {
+        __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                        _mm_loadu_si128((const __m128i *) (src + i))),
+                _mm_loadu_si128((const __m128i *) (src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t1, t3);
+
+        __m256i res = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        res = _mm256_or_si256(res, _mm256_and_si256(less,
+                                                    _mm256_set1_epi8(13)));
+        res = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, res), idx);
+        _mm256_storeu_si256((__m256i *) out, res);
+    }
+    return i;
+}
+
+/*
+ * Decoders stop at the first block holding a character outside of the
+ * alphabet. Each block stores a full vector of which only 3/4 is output,
+ * so the caller's buffer is checked for the whole store width.
+ */
+__attribute__((target("ssse3")))
+static size_t b64dec_ssse3(unsigned char *out, size_t outsize,
+                           const unsigned char *src, size_t len) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                         0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                         0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13,
+                                       12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i, o;
+    for (i = 0, o = 0; i + 16 <= len && o + 16 <= outsize; i += 16, o += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i hi_nibble = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibble);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                             _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+
+        __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+        __m128i roll = _mm_shuffle_epi8(lut_roll,
+                                        _mm_add_epi8(eq_2f, hi_nibble));
+        __m128i val = _mm_add_epi8(in, roll);
+
+        val = _mm_maddubs_epi16(val, _mm_set1_epi32(0x01400140));
+        val = _mm_madd_epi16(val, _mm_set1_epi32(0x00011000));
+        val = _mm_shuffle_epi8(val, pack);
+        _mm_storeu_si128((__m128i *) (out + o), val);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b64dec_avx2(unsigned char *out, size_t outsize,
+                          const unsigned char *src, size_t len) {
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                          0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i lut_roll = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+                          0, 0));
+    const __m256i pack = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1,
+                          -1));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i, o;
+    for (i = 0, o = 0; i + 32 <= len && o + 32 <= outsize; i += 32, o += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i hi_nibble = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, nibble));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibble);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+                                           _mm256_add_epi8(eq_2f, hi_nibble));
+        __m256i val = _mm256_add_epi8(in, roll);
+
+        val = _mm256_maddubs_epi16(val, _mm256_set1_epi32(0x01400140));
+        val = _mm256_madd_epi16(val, _mm256_set1_epi32(0x00011000));
+        val = _mm256_shuffle_epi8(val, pack);
+        val = _mm256_permutevar8x32_epi32(val,
+                                          _mm256_setr_epi32(0, 1, 2, 4, 5, 6,
+                                                            3, 7));
+        _mm256_storeu_si256((__m256i *) (out + o), val);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t hexenc_ssse3(char *out, const unsigned char *src, size_t size) {
+    const __m128i lut = _mm_loadu_si128((const __m128i *) HEXCHARTBL);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i;
+    for (i = 0; i + 16 <= size; i += 16, out += 32) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i hi = _mm_shuffle_epi8(lut,
+                                      _mm_and_si128(_mm_srli_epi16(in, 4),
+                                                    nibble));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, nibble));
+        _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t hexenc_avx2(char *out, const unsigned char *src, size_t size) {
+    const __m256i lut = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *) HEXCHARTBL));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i;
+    for (i = 0; i + 32 <= size; i += 32, out += 64) {
+        // unpack works within 128-bit lanes, so order the quadwords 0,2,1,3
+        __m256i in = _mm256_permute4x64_epi64(
+                _mm256_loadu_si256((const __m256i *) (src + i)), 0xD8);
+        __m256i hi = _mm256_shuffle_epi8(lut,
+                                         _mm256_and_si256(
+                                                 _mm256_srli_epi16(in, 4),
+                                                 nibble));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, nibble));
+        _mm256_storeu_si256((__m256i *) out, _mm256_unpacklo_epi8(hi, lo));
+        _mm256_storeu_si256((__m256i *) (out + 32),
+                            _mm256_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+/*
+ * Hex digits are converted with range compares on c - '0' and
+ * (c | 0x20) - 'a', then each pair is merged by a multiply-add with
+ * weights 16 and 1. Blocks with any other character are rejected.
+ */
+__attribute__((target("ssse3")))
+static size_t hexdec_ssse3(unsigned char *out, const unsigned char *src,
+                           size_t len) {
+    const __m128i minus1 = _mm_set1_epi8(-1);
+    const __m128i ten = _mm_set1_epi8(10), six = _mm_set1_epi8(6);
+    size_t i;
+    for (i = 0; i + 32 <= len; i += 32, out += 16) {
+        __m128i val[2];
+        int k, valid = 0xFFFF;
+        for (k = 0; k < 2; k++) {
+            __m128i in = _mm_loadu_si128((const __m128i *) (src + i + k * 16));
+            __m128i d = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+            __m128i dm = _mm_and_si128(_mm_cmpgt_epi8(d, minus1),
+                                       _mm_cmplt_epi8(d, ten));
+            __m128i a = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)),
+                                     _mm_set1_epi8('a'));
+            __m128i am = _mm_and_si128(_mm_cmpgt_epi8(a, minus1),
+                                       _mm_cmplt_epi8(a, six));
+            valid &= _mm_movemask_epi8(_mm_or_si128(dm, am));
+            val[k] = _mm_or_si128(_mm_and_si128(dm, d),
+                                  _mm_and_si128(am, _mm_add_epi8(a, ten)));
+            val[k] = _mm_maddubs_epi16(val[k], _mm_set1_epi16(0x0110));
+        }
+        if (valid != 0xFFFF) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(val[0], val[1]));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t hexdec_avx2(unsigned char *out, const unsigned char *src,
+                          size_t len) {
+    const __m256i minus1 = _mm256_set1_epi8(-1);
+    const __m256i ten = _mm256_set1_epi8(10), six = _mm256_set1_epi8(6);
+    size_t i;
+    for (i = 0; i + 64 <= len; i += 64, out += 32) {
+        __m256i val[2];
+        int k, valid = -1;
+        for (k = 0; k < 2; k++) {
+            __m256i in = _mm256_loadu_si256(
+                    (const __m256i *) (src + i + k * 32));
+            __m256i d = _mm256_sub_epi8(in, _mm256_set1_epi8('0'));
+            __m256i dm = _mm256_and_si256(_mm256_cmpgt_epi8(d, minus1),
+                                          _mm256_cmpgt_epi8(ten, d));
+            __m256i a = _mm256_sub_epi8(
+                    _mm256_or_si256(in, _mm256_set1_epi8(0x20)),
+                    _mm256_set1_epi8('a'));
+            __m256i am = _mm256_and_si256(_mm256_cmpgt_epi8(a, minus1),
+                                          _mm256_cmpgt_epi8(six, a));
+            valid &= _mm256_movemask_epi8(_mm256_or_si256(dm, am));
+            val[k] = _mm256_or_si256(
+                    _mm256_and_si256(dm, d),
+                    _mm256_and_si256(am, _mm256_add_epi8(a, ten)));
+            val[k] = _mm256_maddubs_epi16(val[k], _mm256_set1_epi16(0x0110));
+        }
+        if (valid != -1) {
+            break;
+        }
+        // packus works within 128-bit lanes, so restore the quadword order
+        __m256i res = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(val[0], val[1]), 0xD8);
+        _mm256_storeu_si256((__m256i *) out, res);
+    }
+    return i;
+}
+
+#endif /* QENCODE_SIMD_X86 */
+
+#endif /* _DOXYGEN_SKIP */
@@ -40,13 +40,30 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include "qinternal.h"
 #include "utilities/qstring.h"
 #include "utilities/qfile.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define READ_CHUNKSIZE  (64 * 1024)   /* initial buffer for unknown size */
+#define WRITEV_BATCH    (64)          /* iovecs passed per writev() call */
+
+static void *read_fd(int fd, size_t sizehint, size_t limit, size_t *nbytes);
+static void *read_fp(FILE *fp, size_t limit, size_t *nbytes);
+static bool skip_fd(int fd, off_t nbytes);
+static ssize_t write_iov(int fd, const struct iovec *iov, int iovcnt);
+static void sync_dir(const char *filepath);
+static int open_tmp(const char *filepath, mode_t mode, char **tmppath);
+
+#endif
+
 /**
  * Lock file
  *
@@ -149,6 +166,7 @@ bool qfile_exist(const char *filepath) {
  * @endcode
  *
  * @note
+ *  Pipes and pseudo files which report no size are read in chunks until EOF.
  *  This method actually allocates memory more than 1 bytes than filesize then
  *  append NULL character at the end. For example, when the file size is 10
  *  bytes long, 10+1 bytes will allocated and the last byte is always NULL
@@ -167,25 +185,21 @@ void *qfile_load(const char *filepath, size_t *nbytes) {
         return NULL;
     }
 
-    size_t size = fs.st_size;
-    if (nbytes != NULL && *nbytes > 0 && *nbytes < fs.st_size)
-        size = *nbytes;
-
-    void *buf = malloc(size + 1);
-    if (buf == NULL) {
-        close(fd);
-        return NULL;
+    size_t limit = (nbytes != NULL) ? *nbytes : 0;
+    size_t sizehint = 0;
+    if (S_ISREG(fs.st_mode)) {
+        // empty, or a pseudo file like /proc that reports no size, is read
+        // until EOF or the limit.
+        sizehint = fs.st_size;
+        if (sizehint > 0 && (limit == 0 || limit > sizehint))
+            limit = sizehint;
     }
 
-    ssize_t count = read(fd, buf, size);
+    size_t count = 0;
+    void *buf = read_fd(fd, sizehint, limit, &count);
     close(fd);
-
-    if (count != size) {
-        free(buf);
+    if (buf == NULL)
         return NULL;
-    }
-
-    ((char *) buf)[count] = '\0';
 
     if (nbytes != NULL)
         *nbytes = count;
@@ -212,52 +226,157 @@ void *qfile_load(const char *filepath, size_t *nbytes) {
  *  counts actual readed bytes.
  */
 void *qfile_read(FILE *fp, size_t *nbytes) {
-    size_t memsize = 1024;
-    size_t size = 0;
+    size_t limit = (nbytes != NULL) ? *nbytes : 0;
+    size_t count = 0;
+    void *data = read_fp(fp, limit, &count);
+    if (data == NULL)
+        return NULL;
 
-    if (nbytes != NULL && *nbytes > 0) {
-        memsize = *nbytes;
-        size = *nbytes;
+    if (count == 0) {
+        free(data);
+        return NULL;
     }
 
-    int c;
-    size_t c_count;
-    char *data = NULL;
-    for (c_count = 0; (c = fgetc(fp)) != EOF;) {
-        if (size > 0 && c_count == size)
-            break;
+    if (nbytes != NULL)
+        *nbytes = count;
 
-        if (c_count == 0) {
-            data = (char *) malloc(sizeof(char) * memsize);
-            if (data == NULL) {
-                DEBUG("Memory allocation failed.");
-                return NULL;
-            }
-        } else if (c_count == memsize - 1) {
-            memsize *= 2;
-
-            /* Here, we don't use realloc(). Sometimes it is unstable. */
-            char *datatmp = (char *) malloc(sizeof(char) * (memsize + 1));
-            if (datatmp == NULL) {
-                DEBUG("Memory allocation failed.");
-                free(data);
-                return NULL;
+    return data;
+}
+
+/**
+ * Map a file into memory for reading.
+ *
+ * The file is mapped read-only and shared with the page cache, so large
+ * files are neither copied nor counted twice in memory. Pipes, character
+ * devices and files which cannot be mapped are read into memory instead,
+ * which is transparent to the caller.
+ *
+ * @param view      a pointer of qfile_view_t to be filled.
+ * @param filepath  file path
+ * @param offset    starting offset in the file.
+ * @param nbytes    number of bytes to map. 0 to map until the end of file.
+ * @param options   combination of access hints.
+ *                  - QFILE_MAP_SEQUENTIAL : data will be read in order.
+ *                  - QFILE_MAP_RANDOM : data will be accessed randomly.
+ *                  - QFILE_MAP_WILLNEED : start reading ahead now.
+ *                  - QFILE_MAP_HUGEPAGE : use transparent huge pages if
+ *                                         available.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - Other errno values set by open(), fstat() or mmap().
+ *
+ * @code
+ *   qfile_view_t view;
+ *   if (qfile_map(&view, "/data/dict.bin", 0, 0, QFILE_MAP_SEQUENTIAL)) {
+ *     process(view.data, view.size);
+ *     qfile_unmap(&view);
+ *   }
+ * @endcode
+ *
+ * @note
+ *  The data is not terminated by NULL character. Mapped files should not
+ *  be truncated by others while mapped.
+ */
+bool qfile_map(qfile_view_t *view, const char *filepath, off_t offset,
+               size_t nbytes, int options) {
+    if (view == NULL || filepath == NULL || offset < 0) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) view, 0, sizeof(qfile_view_t));
+    view->data = "";
+
+    int fd = open(filepath, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat fs;
+    if (fstat(fd, &fs) < 0) {
+        close(fd);
+        return false;
+    }
+
+    if (!S_ISREG(fs.st_mode) || fs.st_size == 0) {
+        // fall back to reading, skipping offset bytes on streams.
+        bool ret = false;
+        if (offset == 0 || lseek(fd, offset, SEEK_SET) == offset
+                || skip_fd(fd, offset) == true) {
+            size_t count = 0;
+            void *buf = read_fd(fd, 0, nbytes, &count);
+            if (buf != NULL) {
+                view->data = buf;
+                view->size = count;
+                view->mapaddr = buf;
+                ret = true;
             }
-            memcpy(datatmp, data, c_count);
-            free(data);
-            data = datatmp;
         }
-        data[c_count++] = (char) c;
+        close(fd);
+        return ret;
     }
 
-    if (c_count == 0 && c == EOF)
-        return NULL;
-    data[c_count] = '\0';
+    if (offset >= fs.st_size) {
+        close(fd);
+        return true;
+    }
 
-    if (nbytes != NULL)
-        *nbytes = c_count;
+    size_t size = fs.st_size - offset;
+    if (nbytes > 0 && nbytes < size)
+        size = nbytes;
+
+    // mmap() needs the offset aligned to the page size.
+    off_t pagesize = sysconf(_SC_PAGESIZE);
+    off_t mapoffset = offset - (offset % pagesize);
+    size_t mapsize = size + (offset - mapoffset);
 
-    return (void *) data;
+    void *addr = mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, mapoffset);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+#ifdef MADV_SEQUENTIAL
+    if (options & QFILE_MAP_SEQUENTIAL)
+        madvise(addr, mapsize, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_RANDOM
+    if (options & QFILE_MAP_RANDOM)
+        madvise(addr, mapsize, MADV_RANDOM);
+#endif
+#ifdef MADV_WILLNEED
+    if (options & QFILE_MAP_WILLNEED)
+        madvise(addr, mapsize, MADV_WILLNEED);
+#endif
+#ifdef MADV_HUGEPAGE
+    if (options & QFILE_MAP_HUGEPAGE)
+        madvise(addr, mapsize, MADV_HUGEPAGE);
+#endif
+
+    view->data = (char *) addr + (offset - mapoffset);
+    view->size = size;
+    view->mapaddr = addr;
+    view->mapsize = mapsize;
+    view->mapped = true;
+
+    return true;
+}
+
+/**
+ * Release a file view created by qfile_map().
+ *
+ * @param view      a pointer of qfile_view_t.
+ */
+void qfile_unmap(qfile_view_t *view) {
+    if (view == NULL)
+        return;
+
+    if (view->mapped == true) {
+        munmap(view->mapaddr, view->mapsize);
+    } else {
+        free(view->mapaddr);
+    }
+    memset((void *) view, 0, sizeof(qfile_view_t));
+    view->data = "";
 }
 
 /**
@@ -282,20 +401,108 @@ void *qfile_read(FILE *fp, size_t *nbytes) {
  */
 ssize_t qfile_save(const char *filepath, const void *buf, size_t size,
                    bool append) {
-    int fd;
+    struct iovec iov;
+    iov.iov_base = (void *) buf;
+    iov.iov_len = size;
+    return qfile_savev(filepath, &iov, 1, (append) ? QFILE_SAVE_APPEND : 0);
+}
+
+/**
+ * Save multiple buffers into file with optional atomic replacement and
+ * durability.
+ *
+ * Buffers are written with writev() in batches, and partial writes are
+ * resumed until everything is written.
+ *
+ * @param filepath  file path
+ * @param iov       array of buffers to write in order.
+ * @param iovcnt    the number of elements in iov.
+ * @param options   combination of options.
+ *                  - QFILE_SAVE_APPEND : append to the file instead of
+ *                                        truncating it.
+ *                  - QFILE_SAVE_ATOMIC : write into a temporary file in the
+ *                    same directory and rename it over filepath, so readers
+ *                    see either the old or the new contents, never a torn
+ *                    file. The permission of the existing file is kept.
+ *                  - QFILE_SAVE_SYNC : flush data to disk with fdatasync()
+ *                    before returning. With QFILE_SAVE_ATOMIC the directory
+ *                    is also synced so the rename survives a crash.
+ *
+ * @return the number of bytes written if successful, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument, such as QFILE_SAVE_APPEND with
+ *             QFILE_SAVE_ATOMIC.
+ *  - Other errno values set by open(), writev(), fdatasync() or rename().
+ *
+ * @code
+ *   struct iovec iov[2];
+ *   iov[0].iov_base = header;
+ *   iov[0].iov_len = headersize;
+ *   iov[1].iov_base = body;
+ *   iov[1].iov_len = bodysize;
+ *   qfile_savev("/data/snapshot.bin", iov, 2,
+ *               QFILE_SAVE_ATOMIC | QFILE_SAVE_SYNC);
+ * @endcode
+ */
+ssize_t qfile_savev(const char *filepath, const struct iovec *iov, int iovcnt,
+                    int options) {
+    if (filepath == NULL || iovcnt < 0 || (iov == NULL && iovcnt > 0)
+            || ((options & QFILE_SAVE_APPEND)
+                    && (options & QFILE_SAVE_ATOMIC))) {
+        errno = EINVAL;
+        return -1;
+    }
 
-    if (append == false) {
-        fd = open(filepath, O_CREAT | O_WRONLY | O_TRUNC,
-                  (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    mode_t mode = (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    char *tmppath = NULL;
+    int fd;
+    if (options & QFILE_SAVE_ATOMIC) {
+        // created with the umask applied like the non-atomic path, and
+        // the permission of an existing file is kept as is.
+        if ((fd = open_tmp(filepath, mode, &tmppath)) < 0)
+            return -1;
+        struct stat fs;
+        if (stat(filepath, &fs) == 0 && fchmod(fd, fs.st_mode & 07777) != 0) {
+            int errsave = errno;
+            close(fd);
+            unlink(tmppath);
+            free(tmppath);
+            errno = errsave;
+            return -1;
+        }
+    } else if (options & QFILE_SAVE_APPEND) {
+        fd = open(filepath, O_CREAT | O_WRONLY | O_APPEND, mode);
     } else {
-        fd = open(filepath, O_CREAT | O_WRONLY | O_APPEND,
-                  (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+        fd = open(filepath, O_CREAT | O_WRONLY | O_TRUNC, mode);
     }
     if (fd < 0)
         return -1;
 
-    ssize_t count = write(fd, buf, size);
-    close(fd);
+    ssize_t count = write_iov(fd, iov, iovcnt);
+    if (count >= 0 && (options & QFILE_SAVE_SYNC)) {
+#if defined(__linux__)
+        if (fdatasync(fd) != 0)
+            count = -1;
+#else
+        if (fsync(fd) != 0)
+            count = -1;
+#endif
+    }
+    if (close(fd) != 0)
+        count = -1;
+
+    if (tmppath != NULL) {
+        if (count >= 0 && rename(tmppath, filepath) != 0)
+            count = -1;
+        if (count < 0) {
+            int errsave = errno;
+            unlink(tmppath);
+            errno = errsave;
+        } else if (options & QFILE_SAVE_SYNC) {
+            sync_dir(filepath);
+        }
+        free(tmppath);
+    }
 
     return count;
 }
@@ -543,3 +750,184 @@ char *qfile_abspath(char *buf, size_t bufsize, const char *path) {
 
     return buf;
 }
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Read from fd until EOF or limit bytes, whichever comes first. When
+ * sizehint is known the buffer is allocated once and no probing read is
+ * made after it is filled. Otherwise the buffer grows geometrically.
+ * The data is always terminated by NULL character.
+ */
+static void *read_fd(int fd, size_t sizehint, size_t limit, size_t *nbytes) {
+    size_t bufsize = (sizehint > 0) ? sizehint : READ_CHUNKSIZE;
+    if (limit > 0 && limit < bufsize)
+        bufsize = limit;
+
+    char *buf = (char *) malloc(bufsize + 1);
+    if (buf == NULL)
+        return NULL;
+
+    size_t count = 0;
+    while (limit == 0 || count < limit) {
+        if (count == bufsize) {
+            if (sizehint > 0 && count == sizehint)
+                break;
+            size_t newsize = bufsize * 2;
+            if (limit > 0 && newsize > limit)
+                newsize = limit;
+            char *newbuf = (char *) realloc(buf, newsize + 1);
+            if (newbuf == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = newbuf;
+            bufsize = newsize;
+        }
+
+        ssize_t n = read(fd, buf + count, bufsize - count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            return NULL;
+        }
+        if (n == 0)
+            break;
+        count += n;
+    }
+
+    buf[count] = '\0';
+    *nbytes = count;
+    return buf;
+}
+
+// Discard bytes from a stream which cannot seek.
+static bool skip_fd(int fd, off_t nbytes) {
+    char buf[4096];
+    while (nbytes > 0) {
+        ssize_t n = read(fd, buf, (nbytes < sizeof(buf)) ? nbytes : sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        nbytes -= n;
+    }
+    return true;
+}
+
+/*
+ * Write all buffers, resuming after partial writes. The caller's iov array
+ * is not modified; batches are copied to a small local array instead.
+ */
+static ssize_t write_iov(int fd, const struct iovec *iov, int iovcnt) {
+    struct iovec batch[WRITEV_BATCH];
+    size_t total = 0, skip = 0;
+    int idx = 0;
+
+    while (idx < iovcnt) {
+        int n;
+        for (n = 0; n < WRITEV_BATCH && idx + n < iovcnt; n++) {
+            batch[n] = iov[idx + n];
+        }
+        batch[0].iov_base = (char *) batch[0].iov_base + skip;
+        batch[0].iov_len -= skip;
+
+        ssize_t written = writev(fd, batch, n);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        total += written;
+
+        // advance past fully written buffers.
+        int previdx = idx;
+        size_t left = written + skip;
+        while (idx < iovcnt && left >= iov[idx].iov_len) {
+            left -= iov[idx].iov_len;
+            idx++;
+        }
+        if (written == 0 && idx == previdx) {
+            errno = EIO;
+            return -1;
+        }
+        skip = left;
+    }
+
+    return total;
+}
+
+// Sync the directory holding filepath so a rename in it is durable.
+static void sync_dir(const char *filepath) {
+    char *dirpath = qfile_get_dir(filepath);
+    if (dirpath == NULL)
+        return;
+
+    int fd = open(dirpath, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dirpath);
+}
+
+// Create a new temporary file next to filepath. Unlike mkstemp(), the
+// permission goes through the umask.
+static int open_tmp(const char *filepath, mode_t mode, char **tmppath) {
+    static unsigned int seq = 0;
+    int i;
+    for (i = 0; i < 100; i++) {
+        *tmppath = qstrdupf("%s.%d.%u", filepath, (int) getpid(),
+                            (unsigned int) (seq++ ^ (time(NULL) << 8)));
+        if (*tmppath == NULL)
+            return -1;
+        int fd = open(*tmppath, O_CREAT | O_EXCL | O_WRONLY, mode);
+        if (fd >= 0)
+            return fd;
+        int errsave = errno;
+        free(*tmppath);
+        *tmppath = NULL;
+        if (errsave != EEXIST) {
+            errno = errsave;
+            return -1;
+        }
+    }
+    errno = EEXIST;
+    return -1;
+}
+
+static void *read_fp(FILE *fp, size_t limit, size_t *nbytes) {
+    size_t bufsize = (limit > 0 && limit < READ_CHUNKSIZE) ?
+            limit : READ_CHUNKSIZE;
+    char *buf = (char *) malloc(bufsize + 1);
+    if (buf == NULL)
+        return NULL;
+
+    size_t count = 0;
+    while (limit == 0 || count < limit) {
+        if (count == bufsize) {
+            size_t newsize = bufsize * 2;
+            if (limit > 0 && newsize > limit)
+                newsize = limit;
+            char *newbuf = (char *) realloc(buf, newsize + 1);
+            if (newbuf == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = newbuf;
+            bufsize = newsize;
+        }
+
+        size_t n = fread(buf + count, 1, bufsize - count, fp);
+        count += n;
+        if (n == 0)
+            break;
+    }
+
+    buf[count] = '\0';
+    *nbytes = count;
+    return buf;
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -40,10 +40,48 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "md5/md5.h"
 #include "qinternal.h"
 #include "utilities/qhash.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define HASHFILE_MAPSIZE    (64 * 1024 * 1024)  /* mmap window size */
+#define HASHFILE_READSIZE   (1024 * 1024)       /* read() buffer size */
+
+#define XXH_PRIME64_1   (0x9E3779B185EBCA87ULL)
+#define XXH_PRIME64_2   (0xC2B2AE3D27D4EB4FULL)
+#define XXH_PRIME64_3   (0x165667B19E3779F9ULL)
+#define XXH_PRIME64_4   (0x85EBCA77C2B2AE63ULL)
+#define XXH_PRIME64_5   (0x27D4EB2F165667C5ULL)
+#define XXH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t xxh64_read64(const unsigned char *p);
+static uint32_t xxh64_read32(const unsigned char *p);
+static uint64_t xxh64_round(uint64_t acc, uint64_t input);
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val);
+static const unsigned char *xxh64_stripes(uint64_t *v, const unsigned char *p,
+                                          const unsigned char *end);
+static uint64_t xxh64_finish(uint64_t h, const unsigned char *p, size_t len);
+
+static uint32_t murmur3_32_block(uint32_t h, uint32_t k);
+static uint32_t murmur3_32_finish(uint32_t h, const uint8_t *tail,
+                                  size_t nbytes);
+static void murmur3_128_block(uint64_t *h1, uint64_t *h2, uint64_t k1,
+                              uint64_t k2);
+static void murmur3_128_finish(uint64_t h1, uint64_t h2, const uint8_t *tail,
+                               size_t nbytes, void *retbuf);
+
+static bool hash_file(const char *filepath, off_t offset, ssize_t nbytes,
+                      bool (*update)(void *ctx, const void *data,
+                                     size_t nbytes),
+                      void *ctx);
+static bool md5_update_cb(void *ctx, const void *data, size_t nbytes);
+static bool xxh64_update_cb(void *ctx, const void *data, size_t nbytes);
+
+#endif
+
 /**
  * Calculate 128-bit(16-bytes) MD5 hash.
  *
@@ -93,54 +131,94 @@ bool qhashmd5(const void *data, size_t nbytes, void *retbuf) {
  *   unsigned char md5hash[16];
  *   qhashmd5_file("/tmp/test.dat", 0, 0, md5hash);
  * @endcode
+ *
+ * @note
+ *  Regular files are read through mmap() with sequential access advice.
+ *  Other files such as pipes are read with large read() calls.
  */
 bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
                    void *retbuf) {
-    if (filepath == NULL || offset < 0 || nbytes < 0 || retbuf == NULL) {
+    if (retbuf == NULL) {
         errno = EINVAL;
         return false;
     }
 
-    int fd = open(filepath, O_RDONLY, 0);
-    if (fd < 0)
+    qhashmd5_t ctx;
+    qhashmd5_init(&ctx);
+    if (hash_file(filepath, offset, nbytes, md5_update_cb, &ctx) == false) {
         return false;
+    }
 
-    struct stat st;
-    if (fstat(fd, &st) < 0)
-        return false;
-    size_t size = st.st_size;
+    return qhashmd5_final(&ctx, retbuf);
+}
 
-    // check filesize
-    if (size < offset + nbytes) {
+/**
+ * Initialize MD5 streaming context.
+ *
+ * @param ctx       context to initialize
+ *
+ * @code
+ *   qhashmd5_t ctx;
+ *   qhashmd5_init(&ctx);
+ *   while ((n = read(fd, buf, sizeof(buf))) > 0) {
+ *     qhashmd5_update(&ctx, buf, n);
+ *   }
+ *   unsigned char md5hash[16];
+ *   qhashmd5_final(&ctx, md5hash);
+ * @endcode
+ */
+void qhashmd5_init(qhashmd5_t *ctx) {
+    MD5Init((MD5_CTX *) ctx);
+}
+
+/**
+ * Feed data into MD5 streaming context.
+ *
+ * @param ctx       context initialized by qhashmd5_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashmd5_update(qhashmd5_t *ctx, const void *data, size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
         errno = EINVAL;
-        close(fd);
         return false;
     }
 
-    // seek
-    if (offset > 0) {
-        if (lseek(fd, offset, SEEK_SET) != offset) {
-            close(fd);
-            return false;
-        }
+    // MD5Update() takes unsigned int length.
+    const unsigned char *p = (const unsigned char *) data;
+    while (nbytes > 0) {
+        unsigned int n = (nbytes > (1U << 30)) ? (1U << 30) : nbytes;
+        MD5Update((MD5_CTX *) ctx, p, n);
+        p += n;
+        nbytes -= n;
     }
 
-    MD5_CTX context;
-    MD5Init(&context);
-    ssize_t toread, nread;
-    unsigned char buf[32 * 1024];
-    for (toread = nbytes; toread > 0; toread -= nread) {
-        if (toread > sizeof(buf))
-            nread = read(fd, buf, sizeof(buf));
-        else
-            nread = read(fd, buf, toread);
-        if (nread < 0)
-            break;
-        MD5Update(&context, buf, nread);
-    }
-    close(fd);
-    if (toread != 0)
+    return true;
+}
+
+/**
+ * Get the MD5 hash of the data fed so far.
+ *
+ * @param ctx       context
+ * @param retbuf    user buffer. It must be at leat 16-bytes long.
+ *
+ * @return true if successful, otherwise false.
+ *
+ * @note
+ *  The context is not modified, so more data can be fed after this call.
+ */
+bool qhashmd5_final(qhashmd5_t *ctx, void *retbuf) {
+    if (ctx == NULL || retbuf == NULL) {
+        errno = EINVAL;
         return false;
+    }
+
+    MD5_CTX context;
+    memcpy((void *) &context, (void *) ctx, sizeof(MD5_CTX));
     MD5Final(retbuf, &context);
 
     return true;
@@ -203,6 +281,66 @@ uint32_t qhashfnv1_32(const void *data, size_t nbytes) {
     return h;
 }
 
+/**
+ * Initialize 32-bit FNV1 streaming context.
+ *
+ * @param ctx       context to initialize
+ *
+ * @note
+ *  Same as qhashfnv1_32(), hashing stops at the first NUL byte.
+ */
+void qhashfnv1_32_init(qhashfnv1_32_t *ctx) {
+    ctx->h = 0x811C9DC5;
+    ctx->done = false;
+    ctx->empty = true;
+}
+
+/**
+ * Feed data into 32-bit FNV1 streaming context.
+ *
+ * @param ctx       context initialized by qhashfnv1_32_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashfnv1_32_update(qhashfnv1_32_t *ctx, const void *data,
+                         size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    unsigned char *dp;
+    uint32_t h = ctx->h;
+    for (dp = (unsigned char *) data; !ctx->done && nbytes > 0;
+            dp++, nbytes--) {
+        if (*dp == '\0') {
+            ctx->done = true;
+            break;
+        }
+        h *= 0x01000193;
+        h ^= *dp;
+        ctx->empty = false;
+    }
+    ctx->h = h;
+
+    return true;
+}
+
+/**
+ * Get the 32-bit FNV1 hash of the data fed so far.
+ *
+ * @param ctx       context
+ *
+ * @return 32-bit unsigned hash value.
+ */
+uint32_t qhashfnv1_32_final(qhashfnv1_32_t *ctx) {
+    return (ctx->empty) ? 0 : ctx->h;
+}
+
 /**
  * Get 64-bit FNV1 hash integer.
  *
@@ -235,6 +373,66 @@ uint64_t qhashfnv1_64(const void *data, size_t nbytes) {
     return h;
 }
 
+/**
+ * Initialize 64-bit FNV1 streaming context.
+ *
+ * @param ctx       context to initialize
+ *
+ * @note
+ *  Same as qhashfnv1_64(), hashing stops at the first NUL byte.
+ */
+void qhashfnv1_64_init(qhashfnv1_64_t *ctx) {
+    ctx->h = 0xCBF29CE484222325ULL;
+    ctx->done = false;
+    ctx->empty = true;
+}
+
+/**
+ * Feed data into 64-bit FNV1 streaming context.
+ *
+ * @param ctx       context initialized by qhashfnv1_64_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashfnv1_64_update(qhashfnv1_64_t *ctx, const void *data,
+                         size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    unsigned char *dp;
+    uint64_t h = ctx->h;
+    for (dp = (unsigned char *) data; !ctx->done && nbytes > 0;
+            dp++, nbytes--) {
+        if (*dp == '\0') {
+            ctx->done = true;
+            break;
+        }
+        h *= 0x100000001B3ULL;
+        h ^= *dp;
+        ctx->empty = false;
+    }
+    ctx->h = h;
+
+    return true;
+}
+
+/**
+ * Get the 64-bit FNV1 hash of the data fed so far.
+ *
+ * @param ctx       context
+ *
+ * @return 64-bit unsigned hash value.
+ */
+uint64_t qhashfnv1_64_final(qhashfnv1_64_t *ctx) {
+    return (ctx->empty) ? 0 : ctx->h;
+}
+
 /**
  * Get 32-bit Murmur3 hash.
  *
@@ -259,9 +457,6 @@ uint32_t qhashmurmur3_32(const void *data, size_t nbytes) {
     if (data == NULL || nbytes == 0)
         return 0;
 
-    const uint32_t c1 = 0xcc9e2d51;
-    const uint32_t c2 = 0x1b873593;
-
     const int nblocks = nbytes / 4;
     const uint32_t *blocks = (const uint32_t *) (data);
     const uint8_t *tail = (const uint8_t *) (data + (nblocks * 4));
@@ -269,42 +464,82 @@ uint32_t qhashmurmur3_32(const void *data, size_t nbytes) {
     uint32_t h = 0;
 
     int i;
-    uint32_t k;
     for (i = 0; i < nblocks; i++) {
-        k = blocks[i];
+        h = murmur3_32_block(h, blocks[i]);
+    }
 
-        k *= c1;
-        k = (k << 15) | (k >> (32 - 15));
-        k *= c2;
+    return murmur3_32_finish(h, tail, nbytes);
+}
 
-        h ^= k;
-        h = (h << 13) | (h >> (32 - 13));
-        h = (h * 5) + 0xe6546b64;
+/**
+ * Initialize 32-bit Murmur3 streaming context.
+ *
+ * @param ctx       context to initialize
+ */
+void qhashmurmur3_32_init(qhashmurmur3_32_t *ctx) {
+    memset((void *) ctx, 0, sizeof(qhashmurmur3_32_t));
+}
+
+/**
+ * Feed data into 32-bit Murmur3 streaming context.
+ *
+ * @param ctx       context initialized by qhashmurmur3_32_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashmurmur3_32_update(qhashmurmur3_32_t *ctx, const void *data,
+                            size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
+        errno = EINVAL;
+        return false;
     }
 
-    k = 0;
-    switch (nbytes & 3) {
-        case 3:
-            k ^= tail[2] << 16;
-        case 2:
-            k ^= tail[1] << 8;
-        case 1:
-            k ^= tail[0];
-            k *= c1;
-            k = (k << 15) | (k >> (32 - 15));
-            k *= c2;
-            h ^= k;
-    };
+    const unsigned char *p = (const unsigned char *) data;
+    ctx->total += nbytes;
 
-    h ^= nbytes;
+    uint32_t k;
+    if (ctx->tailsize > 0) {
+        size_t fill = 4 - ctx->tailsize;
+        if (fill > nbytes)
+            fill = nbytes;
+        memcpy(ctx->tail + ctx->tailsize, p, fill);
+        ctx->tailsize += fill;
+        p += fill;
+        nbytes -= fill;
+        if (ctx->tailsize < 4)
+            return true;
+        memcpy(&k, ctx->tail, 4);
+        ctx->h = murmur3_32_block(ctx->h, k);
+        ctx->tailsize = 0;
+    }
 
-    h ^= h >> 16;
-    h *= 0x85ebca6b;
-    h ^= h >> 13;
-    h *= 0xc2b2ae35;
-    h ^= h >> 16;
+    for (; nbytes >= 4; p += 4, nbytes -= 4) {
+        memcpy(&k, p, 4);
+        ctx->h = murmur3_32_block(ctx->h, k);
+    }
+    if (nbytes > 0) {
+        memcpy(ctx->tail, p, nbytes);
+        ctx->tailsize = nbytes;
+    }
 
-    return h;
+    return true;
+}
+
+/**
+ * Get the 32-bit Murmur3 hash of the data fed so far.
+ *
+ * @param ctx       context
+ *
+ * @return 32-bit unsigned hash value.
+ */
+uint32_t qhashmurmur3_32_final(qhashmurmur3_32_t *ctx) {
+    if (ctx->total == 0)
+        return 0;
+    return murmur3_32_finish(ctx->h, ctx->tail, ctx->total);
 }
 
 /**
@@ -331,9 +566,6 @@ bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf) {
     if (data == NULL || nbytes == 0)
         return false;
 
-    const uint64_t c1 = 0x87c37b91114253d5ULL;
-    const uint64_t c2 = 0x4cf5ad432745937fULL;
-
     const int nblocks = nbytes / 16;
     const uint64_t *blocks = (const uint64_t *) (data);
     const uint8_t *tail = (const uint8_t *) (data + (nblocks * 16));
@@ -342,31 +574,416 @@ bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf) {
     uint64_t h2 = 0;
 
     int i;
-    uint64_t k1, k2;
     for (i = 0; i < nblocks; i++) {
-        k1 = blocks[i * 2 + 0];
-        k2 = blocks[i * 2 + 1];
+        murmur3_128_block(&h1, &h2, blocks[i * 2 + 0], blocks[i * 2 + 1]);
+    }
+
+    murmur3_128_finish(h1, h2, tail, nbytes, retbuf);
 
-        k1 *= c1;
-        k1 = (k1 << 31) | (k1 >> (64 - 31));
-        k1 *= c2;
-        h1 ^= k1;
+    return true;
+}
+
+/**
+ * Initialize 128-bit Murmur3 streaming context.
+ *
+ * @param ctx       context to initialize
+ */
+void qhashmurmur3_128_init(qhashmurmur3_128_t *ctx) {
+    memset((void *) ctx, 0, sizeof(qhashmurmur3_128_t));
+}
+
+/**
+ * Feed data into 128-bit Murmur3 streaming context.
+ *
+ * @param ctx       context initialized by qhashmurmur3_128_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashmurmur3_128_update(qhashmurmur3_128_t *ctx, const void *data,
+                             size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
+        errno = EINVAL;
+        return false;
+    }
 
-        h1 = (h1 << 27) | (h1 >> (64 - 27));
-        h1 += h2;
-        h1 = h1 * 5 + 0x52dce729;
+    const unsigned char *p = (const unsigned char *) data;
+    ctx->total += nbytes;
 
-        k2 *= c2;
-        k2 = (k2 << 33) | (k2 >> (64 - 33));
-        k2 *= c1;
-        h2 ^= k2;
+    uint64_t k[2];
+    if (ctx->tailsize > 0) {
+        size_t fill = 16 - ctx->tailsize;
+        if (fill > nbytes)
+            fill = nbytes;
+        memcpy(ctx->tail + ctx->tailsize, p, fill);
+        ctx->tailsize += fill;
+        p += fill;
+        nbytes -= fill;
+        if (ctx->tailsize < 16)
+            return true;
+        memcpy(k, ctx->tail, 16);
+        murmur3_128_block(&ctx->h1, &ctx->h2, k[0], k[1]);
+        ctx->tailsize = 0;
+    }
 
-        h2 = (h2 << 31) | (h2 >> (64 - 31));
-        h2 += h1;
-        h2 = h2 * 5 + 0x38495ab5;
+    for (; nbytes >= 16; p += 16, nbytes -= 16) {
+        memcpy(k, p, 16);
+        murmur3_128_block(&ctx->h1, &ctx->h2, k[0], k[1]);
+    }
+    if (nbytes > 0) {
+        memcpy(ctx->tail, p, nbytes);
+        ctx->tailsize = nbytes;
     }
 
-    k1 = k2 = 0;
+    return true;
+}
+
+/**
+ * Get the 128-bit Murmur3 hash of the data fed so far.
+ *
+ * @param ctx       context
+ * @param retbuf    user buffer. It must be at leat 16-bytes long.
+ *
+ * @return true if successful, otherwise false.
+ */
+bool qhashmurmur3_128_final(qhashmurmur3_128_t *ctx, void *retbuf) {
+    if (ctx == NULL || retbuf == NULL || ctx->total == 0)
+        return false;
+
+    murmur3_128_finish(ctx->h1, ctx->h2, ctx->tail, ctx->total, retbuf);
+    return true;
+}
+
+/**
+ * Get 64-bit xxHash64 hash.
+ *
+ * @param data      source data
+ * @param nbytes    size of data
+ * @param seed      seed value. Use 0 unless the hash needs to be randomized.
+ *
+ * @return 64-bit unsigned hash value.
+ *
+ * @code
+ *  uint64_t hashval = qhashxxh64((void*)"hello", 5, 0);
+ * @endcode
+ *
+ * @code
+ *  xxHash was created by Yann Collet. It consumes input in 32-byte stripes
+ *  with four independent 64-bit lanes, which makes it several times faster
+ *  than Murmur3 on long keys.
+ *    https://github.com/Cyan4973/xxHash
+ * @endcode
+ */
+uint64_t qhashxxh64(const void *data, size_t nbytes, uint64_t seed) {
+    if (data == NULL)
+        nbytes = 0;
+
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + nbytes;
+    uint64_t h;
+
+    if (nbytes >= 32) {
+        uint64_t v[4];
+        v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        v[1] = seed + XXH_PRIME64_2;
+        v[2] = seed;
+        v[3] = seed - XXH_PRIME64_1;
+        p = xxh64_stripes(v, p, end);
+
+        h = XXH_ROTL64(v[0], 1) + XXH_ROTL64(v[1], 7) + XXH_ROTL64(v[2], 12)
+                + XXH_ROTL64(v[3], 18);
+        h = xxh64_merge(h, v[0]);
+        h = xxh64_merge(h, v[1]);
+        h = xxh64_merge(h, v[2]);
+        h = xxh64_merge(h, v[3]);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t) nbytes;
+
+    return xxh64_finish(h, p, end - p);
+}
+
+/**
+ * Get 64-bit xxHash64 hash of a file contents.
+ *
+ * @param filepath  file path
+ * @param offset    start offset. Set to 0 to digest from beginning of file.
+ * @param nbytes    number of bytes to digest. Set to 0 to digest until end
+ *                  of file.
+ * @param retval    hash value will be stored.
+ *
+ * @return true if successful, otherwise false.
+ *
+ * @code
+ *   uint64_t hashval;
+ *   qhashxxh64_file("/tmp/test.dat", 0, 0, &hashval);
+ * @endcode
+ *
+ * @note
+ *  Regular files are read through mmap() with sequential access advice.
+ *  Other files such as pipes are read with large read() calls.
+ */
+bool qhashxxh64_file(const char *filepath, off_t offset, ssize_t nbytes,
+                     uint64_t *retval) {
+    if (retval == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    qhashxxh64_t ctx;
+    qhashxxh64_init(&ctx, 0);
+    if (hash_file(filepath, offset, nbytes, xxh64_update_cb, &ctx) == false) {
+        return false;
+    }
+
+    *retval = qhashxxh64_final(&ctx);
+    return true;
+}
+
+/**
+ * Initialize xxHash64 streaming context.
+ *
+ * @param ctx       context to initialize
+ * @param seed      seed value
+ *
+ * @code
+ *  qhashxxh64_t ctx;
+ *  qhashxxh64_init(&ctx, 0);
+ *  qhashxxh64_update(&ctx, "hel", 3);
+ *  qhashxxh64_update(&ctx, "lo", 2);
+ *  uint64_t hashval = qhashxxh64_final(&ctx);  // same as qhashxxh64("hello")
+ * @endcode
+ */
+void qhashxxh64_init(qhashxxh64_t *ctx, uint64_t seed) {
+    memset((void *) ctx, 0, sizeof(qhashxxh64_t));
+    ctx->seed = seed;
+    ctx->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    ctx->v[1] = seed + XXH_PRIME64_2;
+    ctx->v[2] = seed;
+    ctx->v[3] = seed - XXH_PRIME64_1;
+}
+
+/**
+ * Feed data into xxHash64 streaming context.
+ *
+ * @param ctx       context initialized by qhashxxh64_init()
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ */
+bool qhashxxh64_update(qhashxxh64_t *ctx, const void *data, size_t nbytes) {
+    if (ctx == NULL || (data == NULL && nbytes > 0)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + nbytes;
+    ctx->total += nbytes;
+
+    // not enough to fill a stripe
+    if (ctx->memsize + nbytes < 32) {
+        if (nbytes > 0) {
+            memcpy(ctx->mem + ctx->memsize, p, nbytes);
+            ctx->memsize += nbytes;
+        }
+        return true;
+    }
+
+    // complete the pending stripe
+    if (ctx->memsize > 0) {
+        size_t fill = 32 - ctx->memsize;
+        memcpy(ctx->mem + ctx->memsize, p, fill);
+        xxh64_stripes(ctx->v, ctx->mem, ctx->mem + 32);
+        p += fill;
+        ctx->memsize = 0;
+    }
+
+    p = xxh64_stripes(ctx->v, p, end);
+    if (p < end) {
+        memcpy(ctx->mem, p, end - p);
+        ctx->memsize = end - p;
+    }
+
+    return true;
+}
+
+/**
+ * Get the xxHash64 hash of the data fed so far.
+ *
+ * @param ctx       context
+ *
+ * @return 64-bit unsigned hash value.
+ *
+ * @note
+ *  The context is not modified, so more data can be fed after this call.
+ */
+uint64_t qhashxxh64_final(qhashxxh64_t *ctx) {
+    uint64_t h;
+    if (ctx->total >= 32) {
+        h = XXH_ROTL64(ctx->v[0], 1) + XXH_ROTL64(ctx->v[1], 7)
+                + XXH_ROTL64(ctx->v[2], 12) + XXH_ROTL64(ctx->v[3], 18);
+        h = xxh64_merge(h, ctx->v[0]);
+        h = xxh64_merge(h, ctx->v[1]);
+        h = xxh64_merge(h, ctx->v[2]);
+        h = xxh64_merge(h, ctx->v[3]);
+    } else {
+        h = ctx->seed + XXH_PRIME64_5;
+    }
+    h += ctx->total;
+
+    return xxh64_finish(h, ctx->mem, ctx->memsize);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static uint64_t xxh64_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static uint32_t xxh64_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = XXH_ROTL64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// consumes whole 32-byte stripes and returns where it stopped.
+static const unsigned char *xxh64_stripes(uint64_t *v, const unsigned char *p,
+                                          const unsigned char *end) {
+    uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    for (; end - p >= 32; p += 32) {
+        v1 = xxh64_round(v1, xxh64_read64(p));
+        v2 = xxh64_round(v2, xxh64_read64(p + 8));
+        v3 = xxh64_round(v3, xxh64_read64(p + 16));
+        v4 = xxh64_round(v4, xxh64_read64(p + 24));
+    }
+    v[0] = v1, v[1] = v2, v[2] = v3, v[3] = v4;
+    return p;
+}
+
+// mixes the remaining tail bytes (less than 32) and avalanches.
+static uint64_t xxh64_finish(uint64_t h, const unsigned char *p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        h ^= xxh64_round(0, xxh64_read64(p));
+        h = XXH_ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t) xxh64_read32(p) * XXH_PRIME64_1;
+        h = XXH_ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4, len -= 4;
+    }
+    for (; len > 0; p++, len--) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = XXH_ROTL64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+static uint32_t murmur3_32_block(uint32_t h, uint32_t k) {
+    k *= 0xcc9e2d51;
+    k = (k << 15) | (k >> (32 - 15));
+    k *= 0x1b873593;
+
+    h ^= k;
+    h = (h << 13) | (h >> (32 - 13));
+    return (h * 5) + 0xe6546b64;
+}
+
+// tail holds the last (nbytes & 3) bytes.
+static uint32_t murmur3_32_finish(uint32_t h, const uint8_t *tail,
+                                  size_t nbytes) {
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+
+    uint32_t k = 0;
+    switch (nbytes & 3) {
+        case 3:
+            k ^= tail[2] << 16;
+        case 2:
+            k ^= tail[1] << 8;
+        case 1:
+            k ^= tail[0];
+            k *= c1;
+            k = (k << 15) | (k >> (32 - 15));
+            k *= c2;
+            h ^= k;
+    };
+
+    h ^= nbytes;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static void murmur3_128_block(uint64_t *h1, uint64_t *h2, uint64_t k1,
+                              uint64_t k2) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    k1 *= c1;
+    k1 = (k1 << 31) | (k1 >> (64 - 31));
+    k1 *= c2;
+    *h1 ^= k1;
+
+    *h1 = (*h1 << 27) | (*h1 >> (64 - 27));
+    *h1 += *h2;
+    *h1 = *h1 * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = (k2 << 33) | (k2 >> (64 - 33));
+    k2 *= c1;
+    *h2 ^= k2;
+
+    *h2 = (*h2 << 31) | (*h2 >> (64 - 31));
+    *h2 += *h1;
+    *h2 = *h2 * 5 + 0x38495ab5;
+}
+
+// tail holds the last (nbytes & 15) bytes.
+static void murmur3_128_finish(uint64_t h1, uint64_t h2, const uint8_t *tail,
+                               size_t nbytes, void *retbuf) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    uint64_t k1 = 0, k2 = 0;
     switch (nbytes & 15) {
         case 15:
             k2 ^= (uint64_t)(tail[14]) << 48;
@@ -435,6 +1052,133 @@ bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf) {
 
     ((uint64_t *) retbuf)[0] = h1;
     ((uint64_t *) retbuf)[1] = h2;
+}
 
-    return true;
+static bool hash_file(const char *filepath, off_t offset, ssize_t nbytes,
+                      bool (*update)(void *ctx, const void *data,
+                                     size_t nbytes),
+                      void *ctx) {
+    if (filepath == NULL || offset < 0 || nbytes < 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    int fd = open(filepath, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    bool regular = S_ISREG(st.st_mode);
+    if (regular) {
+        // check filesize
+        if (st.st_size < offset + nbytes) {
+            close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        if (nbytes == 0) {
+            nbytes = st.st_size - offset;
+            if (nbytes == 0) {
+                close(fd);
+                return true;
+            }
+        }
+
+        // map the file window by window, so huge files don't take
+        // address space all at once.
+        long pagesize = sysconf(_SC_PAGESIZE);
+        off_t pos = offset, end = offset + nbytes;
+        while (pos < end) {
+            off_t mapoff = pos - (pos % pagesize);
+            size_t maplen = (end - mapoff > HASHFILE_MAPSIZE) ?
+                    HASHFILE_MAPSIZE : (size_t) (end - mapoff);
+            void *map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, mapoff);
+            if (map == MAP_FAILED) {
+                if (pos == offset)
+                    break;  // fall back to read()
+                close(fd);
+                return false;
+            }
+#ifdef MADV_SEQUENTIAL
+            madvise(map, maplen, MADV_SEQUENTIAL);
+#endif
+            bool ret = update(ctx, (char *) map + (pos - mapoff),
+                              maplen - (pos - mapoff));
+            munmap(map, maplen);
+            if (ret == false) {
+                close(fd);
+                return false;
+            }
+            pos = mapoff + maplen;
+        }
+        if (pos >= end) {
+            close(fd);
+            return true;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, offset, nbytes, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    // seek
+    if (offset > 0) {
+        if (lseek(fd, offset, SEEK_SET) != offset) {
+            close(fd);
+            return false;
+        }
+    }
+
+    unsigned char *buf = (unsigned char *) malloc(HASHFILE_READSIZE);
+    if (buf == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // nbytes 0 reads until end of file here, such as for pipes.
+    bool ret = true;
+    ssize_t toread = (nbytes > 0) ? nbytes : -1;
+    while (toread != 0) {
+        size_t want = (toread > 0 && toread < HASHFILE_READSIZE) ?
+                (size_t) toread : HASHFILE_READSIZE;
+        ssize_t nread = read(fd, buf, want);
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = false;
+            break;
+        }
+        if (nread == 0) {
+            if (toread > 0) {
+                errno = EIO;  // file got truncated
+                ret = false;
+            }
+            break;
+        }
+        if (update(ctx, buf, nread) == false) {
+            ret = false;
+            break;
+        }
+        if (toread > 0)
+            toread -= nread;
+    }
+    free(buf);
+    close(fd);
+
+    return ret;
+}
+
+static bool md5_update_cb(void *ctx, const void *data, size_t nbytes) {
+    return qhashmd5_update((qhashmd5_t *) ctx, data, nbytes);
 }
+
+static bool xxh64_update_cb(void *ctx, const void *data, size_t nbytes) {
+    return qhashxxh64_update((qhashxxh64_t *) ctx, data, nbytes);
+}
+
+#endif /* _DOXYGEN_SKIP */
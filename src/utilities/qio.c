@@ -30,18 +30,58 @@
  * @file qio.c I/O handling APIs.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* splice() */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <poll.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
 #include "qinternal.h"
 #include "utilities/qio.h"
 
 #define MAX_IOSEND_SIZE     (32 * 1024)
+#define DEF_READER_BUFSIZE  (16 * 1024)
+#define MAX_IOV_BATCH       (64)    /* iovecs or messages per system call */
+
+#ifndef _DOXYGEN_SKIP
+
+static int iov_batch(struct iovec *batch, const struct iovec *iov, int iovcnt,
+                     int idx, size_t skip);
+static int iov_advance(const struct iovec *iov, int iovcnt, int idx,
+                       size_t *skip, size_t nbytes);
+
+static ssize_t reader_source(qio_reader_t *reader, void *buf, size_t nbytes,
+                             int timeoutms);
+static ssize_t reader_fill(qio_reader_t *reader, int timeoutms);
+
+#ifdef __linux__
+#define MAX_SENDFILE_SIZE   (0x7ffff000)    /* Linux caps a single call */
+#define MAX_SPLICE_SIZE     (64 * 1024)     /* default pipe capacity */
+
+static bool send_kernel(int outfd, int infd, off_t nbytes, int timeoutms,
+                        off_t *sent);
+static bool send_sendfile(int outfd, int infd, off_t nbytes, int timeoutms,
+                          off_t *sent);
+static bool send_splice(int outfd, int infd, off_t nbytes, int timeoutms,
+                        off_t *sent);
+#endif
+
+#endif
 
 /**
  * Test & wait until the file descriptor has readable data.
@@ -126,7 +166,7 @@ ssize_t qio_read(int fd, void *buf, size_t nbytes, int timeoutms) {
 
         ssize_t rsize = read(fd, buf + total, nbytes - total);
         if (rsize <= 0) {
-            if (errno == EAGAIN || errno == EINPROGRESS) {
+            if (rsize < 0 && (errno == EAGAIN || errno == EINPROGRESS)) {
                 // possible with non-block io
                 usleep(1);
                 continue;
@@ -183,9 +223,252 @@ ssize_t qio_write(int fd, const void *buf, size_t nbytes, int timeoutms) {
     return -1;
 }
 
+/**
+ * Read from a file descriptor into multiple buffers.
+ *
+ * Like qio_read(), this keeps reading until all the buffers are filled
+ * unless it times out or reaches the end.
+ *
+ * @param fd        file descriptor
+ * @param iov       array of buffers to fill in order
+ * @param iovcnt    number of buffers
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ */
+ssize_t qio_readv(int fd, const struct iovec *iov, int iovcnt, int timeoutms) {
+    struct iovec batch[MAX_IOV_BATCH];
+    ssize_t total = 0;
+    size_t skip = 0;
+    int idx = 0;
+
+    while ((idx = iov_advance(iov, iovcnt, idx, &skip, 0)) < iovcnt) {
+        if (timeoutms >= 0 && qio_wait_readable(fd, timeoutms) <= 0)
+            break;
+
+        int n = iov_batch(batch, iov, iovcnt, idx, skip);
+        ssize_t rsize = readv(fd, batch, n);
+        if (rsize <= 0) {
+            if (rsize < 0 && (errno == EINTR || errno == EAGAIN
+                    || errno == EINPROGRESS)) {
+                // possible with non-block io
+                usleep(1);
+                continue;
+            }
+            break;
+        }
+        total += rsize;
+        idx = iov_advance(iov, iovcnt, idx, &skip, rsize);
+    }
+
+    if (total > 0 || idx >= iovcnt)
+        return total;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Write multiple buffers to a file descriptor with gather writes.
+ *
+ * Partial writes are resumed from where the kernel stopped, so all the
+ * buffers are written unless it times out or fails. The iov array itself
+ * is never modified.
+ *
+ * @param fd        file descriptor
+ * @param iov       array of buffers to write in order
+ * @param iovcnt    number of buffers
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes written if successful, 0 on timeout,
+ *         -1 for error.
+ *
+ * @code
+ *   struct iovec iov[2];
+ *   iov[0].iov_base = header;
+ *   iov[0].iov_len = headerlen;
+ *   iov[1].iov_base = body;
+ *   iov[1].iov_len = bodylen;
+ *   qio_writev(sockfd, iov, 2, 1000);
+ * @endcode
+ */
+ssize_t qio_writev(int fd, const struct iovec *iov, int iovcnt,
+                   int timeoutms) {
+    struct iovec batch[MAX_IOV_BATCH];
+    ssize_t total = 0;
+    size_t skip = 0;
+    int idx = 0;
+
+    while ((idx = iov_advance(iov, iovcnt, idx, &skip, 0)) < iovcnt) {
+        if (timeoutms >= 0 && qio_wait_writable(fd, timeoutms) <= 0)
+            break;
+
+        int n = iov_batch(batch, iov, iovcnt, idx, skip);
+        ssize_t wsize = writev(fd, batch, n);
+        if (wsize <= 0) {
+            if (wsize < 0 && (errno == EINTR || errno == EAGAIN
+                    || errno == EINPROGRESS)) {
+                // possible with non-block io
+                usleep(1);
+                continue;
+            }
+            break;
+        }
+        total += wsize;
+        idx = iov_advance(iov, iovcnt, idx, &skip, wsize);
+    }
+
+    if (total > 0 || idx >= iovcnt)
+        return total;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Send multiple datagrams on a connected socket.
+ *
+ * Each element of msgs is sent as one datagram. On Linux the messages are
+ * handed to the kernel in batches with sendmmsg(), otherwise one by one.
+ *
+ * @param fd        connected datagram socket
+ * @param msgs      array of messages
+ * @param msgcnt    number of messages
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of messages sent if successful, 0 on timeout,
+ *         -1 for error.
+ */
+int qio_sendmsgs(int fd, const struct iovec *msgs, int msgcnt,
+                 int timeoutms) {
+    if (msgcnt <= 0)
+        return 0;
+
+    int sent = 0;
+    while (sent < msgcnt) {
+        if (timeoutms >= 0 && qio_wait_writable(fd, timeoutms) <= 0)
+            break;
+
+#ifdef __linux__
+        struct mmsghdr batch[MAX_IOV_BATCH];
+        int n = (msgcnt - sent < MAX_IOV_BATCH) ? msgcnt - sent : MAX_IOV_BATCH;
+        int i;
+        memset(batch, 0, sizeof(struct mmsghdr) * n);
+        for (i = 0; i < n; i++) {
+            batch[i].msg_hdr.msg_iov = (struct iovec *) &msgs[sent + i];
+            batch[i].msg_hdr.msg_iovlen = 1;
+        }
+        int ret = sendmmsg(fd, batch, n, 0);
+#else
+        int ret = (send(fd, msgs[sent].iov_base, msgs[sent].iov_len, 0) < 0) ?
+                -1 : 1;
+#endif
+        if (ret <= 0) {
+            if (ret < 0 && (errno == EINTR || errno == EAGAIN)) {
+                // possible with non-block io
+                usleep(1);
+                continue;
+            }
+            break;
+        }
+        sent += ret;
+    }
+
+    if (sent > 0)
+        return sent;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Receive multiple datagrams from a socket.
+ *
+ * Waits for the first datagram, then takes whatever else is already queued
+ * without waiting, up to msgcnt. On Linux this is done in batches with
+ * recvmmsg().
+ *
+ * @param fd        datagram socket
+ * @param msgs      array of receive buffers, one per datagram. iov_len of
+ *                  each filled element is set to the received length.
+ * @param msgcnt    number of buffers
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of messages received if successful, 0 on timeout,
+ *         -1 for error.
+ *
+ * @note
+ *  Datagrams longer than the buffer are truncated, as with recv().
+ */
+int qio_recvmsgs(int fd, struct iovec *msgs, int msgcnt, int timeoutms) {
+    if (msgcnt <= 0)
+        return 0;
+
+    int received = 0;
+    while (received < msgcnt) {
+        if (received == 0 && timeoutms >= 0
+                && qio_wait_readable(fd, timeoutms) <= 0) {
+            break;
+        }
+
+        // only the first datagram is waited for.
+        int flags = (received == 0) ? 0 : MSG_DONTWAIT;
+#ifdef __linux__
+        struct mmsghdr batch[MAX_IOV_BATCH];
+        int n = (msgcnt - received < MAX_IOV_BATCH) ?
+                msgcnt - received : MAX_IOV_BATCH;
+        int i;
+        memset(batch, 0, sizeof(struct mmsghdr) * n);
+        for (i = 0; i < n; i++) {
+            batch[i].msg_hdr.msg_iov = &msgs[received + i];
+            batch[i].msg_hdr.msg_iovlen = 1;
+        }
+        int ret = recvmmsg(fd, batch, n, flags | MSG_WAITFORONE, NULL);
+        for (i = 0; i < ret; i++) {
+            msgs[received + i].iov_len = batch[i].msg_len;
+        }
+#else
+        int n = 1;
+        ssize_t rsize = recv(fd, msgs[received].iov_base,
+                             msgs[received].iov_len, flags);
+        if (rsize >= 0)
+            msgs[received].iov_len = rsize;
+        int ret = (rsize < 0) ? -1 : 1;
+#endif
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0 && errno == EAGAIN && received == 0) {
+                // possible with non-block io
+                usleep(1);
+                continue;
+            }
+            break;
+        }
+        received += ret;
+        if (ret < n)
+            break;
+    }
+
+    if (received > 0)
+        return received;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
 /**
  * Transfer data between file descriptors
  *
+ * On Linux the data is moved inside the kernel without copying it through
+ * user space: sendfile() is used when infd is a regular file, and splice()
+ * through a pipe for sockets and pipes. Other cases and platforms use a
+ * read/write copy loop.
+ *
  * @param outfd       output file descriptor
  * @param infd        input file descriptor
  * @param nbytes      the number of bytes to copy between file descriptors.
@@ -200,10 +483,15 @@ off_t qio_send(int outfd, int infd, off_t nbytes, int timeoutms) {
     if (nbytes == 0)
         return 0;
 
-    unsigned char buf[MAX_IOSEND_SIZE];
-
     off_t total = 0;  // total size sent
-    while (total < nbytes) {
+    bool done = false;
+#ifdef __linux__
+    done = send_kernel(outfd, infd, nbytes, timeoutms, &total);
+    DEBUG("kernel send %jd, done %d", (intmax_t) total, done);
+#endif
+
+    unsigned char buf[MAX_IOSEND_SIZE];
+    while (done == false && total < nbytes) {
         size_t chunksize;  // this time sending size
         if (nbytes - total <= sizeof(buf))
             chunksize = nbytes - total;
@@ -333,3 +621,533 @@ ssize_t qio_printf(int fd, int timeoutms, const char *format, ...) {
 
     return ret;
 }
+
+/**
+ * Create a buffered reader on a file descriptor.
+ *
+ * The reader pulls data with large reads into its own buffer and serves
+ * lines and small reads from there, which is what line-oriented protocols
+ * need to stay away from one read() per byte as qio_gets() does.
+ *
+ * @param fd        file descriptor
+ * @param bufsize   size of read buffer. 0 for default size.
+ *
+ * @return a pointer of qio_reader_t object if successful, otherwise returns
+ *         NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *   qio_reader_t *reader = qio_reader(sockfd, 0);
+ *   char line[1024];
+ *   while (qio_reader_readline(reader, line, sizeof(line), 1000) > 0) {
+ *     printf("%s\n", line);
+ *   }
+ *   qio_reader_free(reader);
+ * @endcode
+ *
+ * @note
+ *  Data buffered by the reader is not visible to the file descriptor any
+ *  more, so once a reader is used all reads should go through it.
+ *  qio_reader_buffered() tells how much is left in the buffer.
+ */
+qio_reader_t *qio_reader(int fd, size_t bufsize) {
+    if (bufsize == 0)
+        bufsize = DEF_READER_BUFSIZE;
+
+    qio_reader_t *reader = (qio_reader_t *) calloc(1, sizeof(qio_reader_t));
+    if (reader == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reader->buf = (char *) malloc(bufsize);
+    if (reader->buf == NULL) {
+        free(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->bufsize = bufsize;
+    reader->fd = fd;
+
+    return reader;
+}
+
+/**
+ * Set a custom data source of the reader such as a TLS connection.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param readfn    read function, NULL to read from the file descriptor
+ * @param arg       user argument passed to readfn
+ *
+ * @note
+ *  readfn reads at most nbytes into buf and returns as soon as any data is
+ *  available. It must return the number of bytes read, 0 on timeout, -1 at
+ *  end of stream or for errors, in the same manner as qio_read().
+ */
+void qio_reader_setsource(qio_reader_t *reader,
+                          ssize_t (*readfn)(void *arg, void *buf,
+                                            size_t nbytes, int timeoutms),
+                          void *arg) {
+    reader->readfn = readfn;
+    reader->arg = arg;
+}
+
+/**
+ * Read a line through the reader.
+ *
+ * This works the same way as qio_gets() but reads the data from the reader's
+ * buffer.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param buf       data buffer pointer
+ * @param bufsize   buffer size
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ *
+ * @note
+ *  Like qio_gets(), the return value counts the new-line characters which
+ *  are consumed but not stored.
+ */
+ssize_t qio_reader_readline(qio_reader_t *reader, char *buf, size_t bufsize,
+                            int timeoutms) {
+    if (bufsize <= 1)
+        return -1;
+
+    size_t readcnt = 0;
+    ssize_t rsize = 1;
+    char *ptr = buf;
+    while (readcnt < bufsize - 1) {
+        if (reader->start == reader->end
+                && (rsize = reader_fill(reader, timeoutms)) <= 0) {
+            break;
+        }
+
+        const char *data = reader->buf + reader->start;
+        size_t avail = reader->end - reader->start;
+        if (avail > bufsize - 1 - readcnt)
+            avail = bufsize - 1 - readcnt;
+
+        const char *newline = memchr(data, '\n', avail);
+        size_t n = (newline != NULL) ? (newline - data + 1) : avail;
+        size_t i;
+        for (i = 0; i < n; i++) {
+            if (data[i] != '\r' && data[i] != '\n')
+                *ptr++ = data[i];
+        }
+        reader->start += n;
+        readcnt += n;
+
+        if (newline != NULL)
+            break;
+    }
+
+    *ptr = '\0';
+
+    if (readcnt > 0)
+        return readcnt;
+    return rsize;
+}
+
+/**
+ * Read available data through the reader.
+ *
+ * Returns as soon as some data is available rather than waiting for nbytes.
+ * Buffered data is served first, and large reads on an empty buffer go
+ * straight into the caller's buffer.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param buf       data buffer pointer. (can be NULL, then read & throw out)
+ * @param nbytes    the maximum number of bytes to read
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ */
+ssize_t qio_reader_read(qio_reader_t *reader, void *buf, size_t nbytes,
+                        int timeoutms) {
+    if (nbytes == 0)
+        return 0;
+
+    if (reader->start == reader->end) {
+        if (buf != NULL && nbytes >= reader->bufsize) {
+            return reader_source(reader, buf, nbytes, timeoutms);
+        }
+
+        ssize_t rsize = reader_fill(reader, timeoutms);
+        if (rsize <= 0)
+            return rsize;
+    }
+
+    size_t avail = reader->end - reader->start;
+    if (avail > nbytes)
+        avail = nbytes;
+    if (buf != NULL)
+        memcpy(buf, reader->buf + reader->start, avail);
+    reader->start += avail;
+
+    return avail;
+}
+
+/**
+ * Read exactly nbytes through the reader.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param buf       data buffer pointer. (can be NULL, then read & throw out)
+ * @param nbytes    the number of bytes to read
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ *         It can be less than nbytes when the stream ends or times out in
+ *         the middle.
+ */
+ssize_t qio_reader_read_exact(qio_reader_t *reader, void *buf, size_t nbytes,
+                              int timeoutms) {
+    if (nbytes == 0)
+        return 0;
+
+    size_t total = 0;
+    ssize_t rsize = 0;
+    while (total < nbytes) {
+        rsize = qio_reader_read(reader,
+                                (buf != NULL) ? (char *) buf + total : NULL,
+                                nbytes - total, timeoutms);
+        if (rsize <= 0)
+            break;
+        total += rsize;
+    }
+
+    if (total > 0)
+        return total;
+    return rsize;
+}
+
+/**
+ * Look at the buffered data without consuming it.
+ *
+ * Reads more data into the buffer until at least nbytes are buffered. nbytes
+ * is capped to the size of the reader's buffer.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param data      pointer to store the address of buffered data. Valid
+ *                  until the next call on the reader.
+ * @param nbytes    the number of bytes wanted
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of buffered bytes if any, 0 on timeout, -1 for error.
+ *         It can be more than nbytes, or less at end of stream or timeout.
+ */
+ssize_t qio_reader_peek(qio_reader_t *reader, const void **data, size_t nbytes,
+                        int timeoutms) {
+    if (nbytes > reader->bufsize)
+        nbytes = reader->bufsize;
+
+    ssize_t rsize = 0;
+    while (reader->end - reader->start < nbytes) {
+        rsize = reader_fill(reader, timeoutms);
+        if (rsize <= 0)
+            break;
+    }
+
+    if (data != NULL)
+        *data = reader->buf + reader->start;
+
+    size_t avail = reader->end - reader->start;
+    if (avail > 0 || nbytes == 0)
+        return avail;
+    return rsize;
+}
+
+/**
+ * Get the number of bytes buffered in the reader.
+ *
+ * @param reader    qio_reader_t object pointer
+ *
+ * @return the number of bytes which can be read without touching the source.
+ */
+size_t qio_reader_buffered(qio_reader_t *reader) {
+    return reader->end - reader->start;
+}
+
+/**
+ * Enlarge the reader's buffer so it can hold at least nbytes.
+ *
+ * qio_reader_peek() can't look further than the size of the buffer, this
+ * makes room for a bigger look-ahead. Buffered data is kept.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param nbytes    the number of bytes the buffer must hold
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The buffer never shrinks, so the cap on nbytes is up to the caller.
+ */
+bool qio_reader_reserve(qio_reader_t *reader, size_t nbytes) {
+    if (nbytes <= reader->bufsize)
+        return true;
+
+    size_t newsize = reader->bufsize;
+    while (newsize < nbytes)
+        newsize *= 2;
+
+    // pull the data to the front, then realloc() copies only that
+    size_t avail = reader->end - reader->start;
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start, avail);
+        reader->start = 0;
+        reader->end = avail;
+    }
+    char *buf = (char *) realloc(reader->buf, newsize);
+    if (buf == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    reader->buf = buf;
+    reader->bufsize = newsize;
+
+    return true;
+}
+
+/**
+ * Discard the buffered data and attach the reader to a file descriptor.
+ *
+ * @param reader    qio_reader_t object pointer
+ * @param fd        file descriptor
+ *
+ * @note
+ *  Custom data source set by qio_reader_setsource() is removed as well.
+ */
+void qio_reader_reset(qio_reader_t *reader, int fd) {
+    reader->fd = fd;
+    reader->readfn = NULL;
+    reader->arg = NULL;
+    reader->start = reader->end = 0;
+}
+
+/**
+ * De-allocate the reader. The file descriptor is not closed.
+ *
+ * @param reader    qio_reader_t object pointer
+ */
+void qio_reader_free(qio_reader_t *reader) {
+    if (reader == NULL)
+        return;
+    free(reader->buf);
+    free(reader);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Copy the iovecs starting at iov[idx] into batch, the first one shortened by
+ * skip bytes already transferred. Returns the number of iovecs copied.
+ */
+static int iov_batch(struct iovec *batch, const struct iovec *iov, int iovcnt,
+                     int idx, size_t skip) {
+    int n;
+    for (n = 0; n < MAX_IOV_BATCH && idx + n < iovcnt; n++) {
+        batch[n] = iov[idx + n];
+    }
+    batch[0].iov_base = (char *) batch[0].iov_base + skip;
+    batch[0].iov_len -= skip;
+    return n;
+}
+
+/*
+ * Account nbytes transferred from iov[idx] + *skip. Returns the index of the
+ * first iovec with data left, skipping empty ones, and updates *skip.
+ */
+static int iov_advance(const struct iovec *iov, int iovcnt, int idx,
+                       size_t *skip, size_t nbytes) {
+    size_t left = *skip + nbytes;
+    while (idx < iovcnt && left >= iov[idx].iov_len) {
+        left -= iov[idx].iov_len;
+        idx++;
+    }
+    *skip = left;
+    return idx;
+}
+
+/*
+ * Read once from the source. Returns the number of bytes read, 0 on
+ * timeout and -1 at end of stream or for errors.
+ */
+static ssize_t reader_source(qio_reader_t *reader, void *buf, size_t nbytes,
+                             int timeoutms) {
+    if (reader->readfn != NULL)
+        return reader->readfn(reader->arg, buf, nbytes, timeoutms);
+
+    while (true) {
+        if (timeoutms >= 0) {
+            int ret = qio_wait_readable(reader->fd, timeoutms);
+            if (ret <= 0)
+                return ret;
+        }
+
+        ssize_t rsize = read(reader->fd, buf, nbytes);
+        if (rsize > 0)
+            return rsize;
+        if (rsize < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EINPROGRESS) {
+                // possible with non-block io
+                if (timeoutms < 0)
+                    qio_wait_readable(reader->fd, -1);
+                continue;
+            }
+        }
+        return -1;
+    }
+}
+
+static ssize_t reader_fill(qio_reader_t *reader, int timeoutms) {
+    if (reader->start == reader->end) {
+        reader->start = reader->end = 0;
+    } else if (reader->end == reader->bufsize) {
+        memmove(reader->buf, reader->buf + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    ssize_t rsize = reader_source(reader, reader->buf + reader->end,
+                                  reader->bufsize - reader->end, timeoutms);
+    if (rsize > 0)
+        reader->end += rsize;
+    return rsize;
+}
+
+#ifdef __linux__
+
+/*
+ * Move data in the kernel. Returns true when the transfer is over, whether
+ * completed, at EOF, timed out or failed, and false when the descriptors
+ * are not supported so the copy loop should carry on from *sent.
+ */
+static bool send_kernel(int outfd, int infd, off_t nbytes, int timeoutms,
+                        off_t *sent) {
+    struct stat st;
+    if (fstat(infd, &st) != 0)
+        return false;
+
+    if (S_ISREG(st.st_mode))
+        return send_sendfile(outfd, infd, nbytes, timeoutms, sent);
+    return send_splice(outfd, infd, nbytes, timeoutms, sent);
+}
+
+static bool send_sendfile(int outfd, int infd, off_t nbytes, int timeoutms,
+                          off_t *sent) {
+    while (*sent < nbytes) {
+        if (timeoutms >= 0 && qio_wait_writable(outfd, timeoutms) <= 0)
+            return true;
+
+        size_t chunksize = MAX_SENDFILE_SIZE;
+        if (nbytes - *sent < chunksize)
+            chunksize = nbytes - *sent;
+
+        // NULL offset reads from and advances the file position of infd.
+        ssize_t n = sendfile(outfd, infd, NULL, chunksize);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                if (timeoutms < 0)
+                    qio_wait_writable(outfd, -1);
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS)
+                return false;
+            return true;
+        }
+        if (n == 0)
+            return true;  // EOF
+        *sent += n;
+    }
+    return true;
+}
+
+static bool send_splice(int outfd, int infd, off_t nbytes, int timeoutms,
+                        off_t *sent) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0)
+        return false;
+
+    const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+    bool done = true;
+    while (*sent < nbytes) {
+        if (timeoutms >= 0 && qio_wait_readable(infd, timeoutms) <= 0)
+            break;
+
+        size_t chunksize = MAX_SPLICE_SIZE;
+        if (nbytes - *sent < chunksize)
+            chunksize = nbytes - *sent;
+
+        ssize_t inpipe = splice(infd, NULL, pipefd[1], NULL, chunksize, flags);
+        if (inpipe < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                if (timeoutms < 0)
+                    qio_wait_readable(infd, -1);
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS)
+                done = false;
+            break;
+        }
+        if (inpipe == 0)
+            break;  // EOF
+
+        while (inpipe > 0) {
+            if (timeoutms >= 0 && qio_wait_writable(outfd, timeoutms) <= 0)
+                goto out;
+
+            ssize_t n = splice(pipefd[0], NULL, outfd, NULL, inpipe, flags);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN) {
+                    if (timeoutms < 0)
+                        qio_wait_writable(outfd, -1);
+                    continue;
+                }
+                if (errno == EINVAL) {
+                    // outfd doesn't take splice, like O_APPEND files.
+                    // flush what is in the pipe and let the copy loop go on.
+                    unsigned char buf[MAX_IOSEND_SIZE];
+                    while (inpipe > 0) {
+                        ssize_t rsize = read(pipefd[0], buf,
+                                (inpipe < sizeof(buf)) ? inpipe : sizeof(buf));
+                        if (rsize <= 0
+                                || qio_write(outfd, buf, rsize, timeoutms)
+                                        != rsize)
+                            goto out;
+                        inpipe -= rsize;
+                        *sent += rsize;
+                    }
+                    done = false;
+                }
+                goto out;
+            }
+            inpipe -= n;
+            *sent += n;
+        }
+    }
+
+out:
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return done;
+}
+
+#endif /* __linux__ */
+
+#endif /* _DOXYGEN_SKIP */
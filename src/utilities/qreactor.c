@@ -0,0 +1,696 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qreactor.c Event loop for multiplexing many descriptors.
+ *
+ * qreactor dispatches edge-triggered readiness callbacks from epoll, runs
+ * timers kept in a hashed timer wheel, and runs deferred tasks once per
+ * loop iteration. Each registered descriptor may have an idle timeout
+ * which is re-armed whenever the descriptor has events.
+ *
+ * @code
+ *   void on_event(qreactor_t *reactor, int fd, int events, void *userdata) {
+ *     if (events & (QREACTOR_ERROR | QREACTOR_TIMEOUT)) {
+ *       qreactor_del(reactor, fd);
+ *       close(fd);
+ *       return;
+ *     }
+ *     if (events & QREACTOR_READ) {
+ *       // edge-triggered, read until EAGAIN.
+ *       char buf[4096];
+ *       while (read(fd, buf, sizeof(buf)) > 0);
+ *     }
+ *   }
+ *
+ *   qreactor_t *reactor = qreactor();
+ *   qreactor_add(reactor, sockfd, QREACTOR_READ, 30000, on_event, NULL);
+ *   qreactor_run(reactor);
+ *   qreactor_free(reactor);
+ * @endcode
+ *
+ * @note
+ *  Callbacks are edge-triggered, so descriptors should be non-blocking and
+ *  drained until EAGAIN. Timeouts follow the qio convention: milliseconds,
+ *  0 for the next iteration and -1 for none. Timers have a resolution of
+ *  10 milliseconds. A reactor is not thread-safe, use one per thread.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "qinternal.h"
+#include "utilities/qreactor.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define TIMER_TICKMS        (10)    /* timer resolution */
+#define TIMER_SLOTS         (1024)  /* must be a power of 2 */
+#define MAX_EPOLL_EVENTS    (256)
+
+/* timer wheel entry, slots and pending lists are circular with a sentinel */
+typedef struct rtimer_s rtimer_t;
+struct rtimer_s {
+    rtimer_t *prev, *next;
+    int64_t expire;         /* tick */
+    int fd;                 /* idle timer of a descriptor, -1 for user timer */
+    qreactor_task_t cb;
+    void *userdata;
+};
+
+struct qreactor_timer_s {
+    rtimer_t node;
+};
+
+typedef struct rfd_s rfd_t;
+struct rfd_s {
+    int events;
+    int timeoutms;
+    uint32_t gen;           /* tells stale epoll events apart */
+    qreactor_cb_t cb;
+    void *userdata;
+    rtimer_t timer;         /* idle timeout */
+};
+
+typedef struct rtask_s rtask_t;
+struct rtask_s {
+    qreactor_task_t cb;
+    void *userdata;
+    rtask_t *next;
+};
+
+struct qreactor_s {
+    int epfd;
+    rfd_t **fds;
+    int fdsize;
+    int nfds;
+    uint32_t gen;
+
+    rtimer_t wheel[TIMER_SLOTS];
+    int ntimers;
+    int64_t tick;           /* last processed tick */
+
+    rtask_t *tasks, *taskstail;
+    bool stop;
+};
+
+static int64_t now_tick(void);
+static void timer_link(qreactor_t *reactor, rtimer_t *timer, int timeoutms);
+static void timer_unlink(qreactor_t *reactor, rtimer_t *timer);
+static int timer_wait(qreactor_t *reactor, int timeoutms);
+static int timer_expire(qreactor_t *reactor);
+static int task_run(qreactor_t *reactor);
+#ifdef __linux__
+static bool fd_ctl(qreactor_t *reactor, int op, int fd, rfd_t *rfd);
+#endif
+
+#endif /* _DOXYGEN_SKIP */
+
+/**
+ * Create a reactor.
+ *
+ * @return a pointer of qreactor_t object if successful, otherwise returns
+ *         NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *  - ENOSYS : Not supported on this platform.
+ *  - Other errors from epoll_create1().
+ */
+qreactor_t *qreactor(void) {
+#ifdef __linux__
+    qreactor_t *reactor = (qreactor_t *) calloc(1, sizeof(qreactor_t));
+    if (reactor == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epfd < 0) {
+        free(reactor);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < TIMER_SLOTS; i++) {
+        reactor->wheel[i].prev = reactor->wheel[i].next = &reactor->wheel[i];
+    }
+    reactor->tick = now_tick();
+
+    return reactor;
+#else
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+/**
+ * Register a descriptor.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param fd        file descriptor, should be in non-blocking mode
+ * @param events    QREACTOR_READ and/or QREACTOR_WRITE
+ * @param timeoutms idle timeout milliseconds. -1 for none.
+ * @param cb        callback function
+ * @param userdata  user data passed to the callback
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EEXIST : Already registered.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The callback gets a combination of QREACTOR_READ, QREACTOR_WRITE and
+ *  QREACTOR_ERROR, or QREACTOR_TIMEOUT alone when the descriptor had no
+ *  events within timeoutms. The idle timer is re-armed whenever events are
+ *  dispatched but not after it fires; use qreactor_mod() to re-arm it.
+ */
+bool qreactor_add(qreactor_t *reactor, int fd, int events, int timeoutms,
+                  qreactor_cb_t cb, void *userdata) {
+#ifdef __linux__
+    if (reactor == NULL || fd < 0 || cb == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (fd < reactor->fdsize && reactor->fds[fd] != NULL) {
+        errno = EEXIST;
+        return false;
+    }
+
+    if (fd >= reactor->fdsize) {
+        int newsize = (reactor->fdsize > 0) ? reactor->fdsize : 64;
+        while (newsize <= fd)
+            newsize *= 2;
+        rfd_t **fds = (rfd_t **) realloc(reactor->fds,
+                                         sizeof(rfd_t *) * newsize);
+        if (fds == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        memset(fds + reactor->fdsize, 0,
+               sizeof(rfd_t *) * (newsize - reactor->fdsize));
+        reactor->fds = fds;
+        reactor->fdsize = newsize;
+    }
+
+    rfd_t *rfd = (rfd_t *) calloc(1, sizeof(rfd_t));
+    if (rfd == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    rfd->events = events;
+    rfd->timeoutms = timeoutms;
+    rfd->gen = ++reactor->gen;
+    rfd->cb = cb;
+    rfd->userdata = userdata;
+    rfd->timer.prev = rfd->timer.next = &rfd->timer;
+    rfd->timer.fd = fd;
+
+    if (fd_ctl(reactor, EPOLL_CTL_ADD, fd, rfd) == false) {
+        free(rfd);
+        return false;
+    }
+    reactor->fds[fd] = rfd;
+    reactor->nfds++;
+    timer_link(reactor, &rfd->timer, timeoutms);
+
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+/**
+ * Change the events and the idle timeout of a registered descriptor.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param fd        file descriptor
+ * @param events    QREACTOR_READ and/or QREACTOR_WRITE
+ * @param timeoutms idle timeout milliseconds. -1 for none.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Not registered.
+ */
+bool qreactor_mod(qreactor_t *reactor, int fd, int events, int timeoutms) {
+#ifdef __linux__
+    if (reactor == NULL || fd < 0 || fd >= reactor->fdsize
+            || reactor->fds[fd] == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    rfd_t *rfd = reactor->fds[fd];
+    int oldevents = rfd->events;
+    rfd->events = events;
+    if (fd_ctl(reactor, EPOLL_CTL_MOD, fd, rfd) == false) {
+        rfd->events = oldevents;
+        return false;
+    }
+    rfd->timeoutms = timeoutms;
+    timer_unlink(reactor, &rfd->timer);
+    timer_link(reactor, &rfd->timer, timeoutms);
+
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+/**
+ * Unregister a descriptor. It's safe to call from any callback, including
+ * the descriptor's own.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param fd        file descriptor
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Not registered.
+ *
+ * @note
+ *  Unregister before closing the descriptor.
+ */
+bool qreactor_del(qreactor_t *reactor, int fd) {
+#ifdef __linux__
+    if (reactor == NULL || fd < 0 || fd >= reactor->fdsize
+            || reactor->fds[fd] == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    rfd_t *rfd = reactor->fds[fd];
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
+    timer_unlink(reactor, &rfd->timer);
+    reactor->fds[fd] = NULL;
+    reactor->nfds--;
+    free(rfd);
+
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+/**
+ * Add a one-shot timer.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param timeoutms milliseconds until the timer fires, 0 for the next
+ *                  iteration.
+ * @param cb        callback function
+ * @param userdata  user data passed to the callback
+ *
+ * @return timer handle if successful, otherwise returns NULL.
+ *
+ * @note
+ *  The handle is released after the callback returns, so it must not be
+ *  cancelled once the timer has fired.
+ */
+qreactor_timer_t *qreactor_timer(qreactor_t *reactor, int timeoutms,
+                                 qreactor_task_t cb, void *userdata) {
+    if (reactor == NULL || timeoutms < 0 || cb == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qreactor_timer_t *timer = (qreactor_timer_t *) calloc(
+            1, sizeof(qreactor_timer_t));
+    if (timer == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    timer->node.fd = -1;
+    timer->node.cb = cb;
+    timer->node.userdata = userdata;
+    timer_link(reactor, &timer->node, timeoutms);
+
+    return timer;
+}
+
+/**
+ * Cancel a timer which has not fired yet.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param timer     timer handle
+ *
+ * @return true if successful, otherwise returns false.
+ */
+bool qreactor_cancel(qreactor_t *reactor, qreactor_timer_t *timer) {
+    if (reactor == NULL || timer == NULL || timer->node.next == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    timer_unlink(reactor, &timer->node);
+    free(timer);
+    return true;
+}
+
+/**
+ * Run a task at the end of the current loop iteration, or of the next one
+ * when called from a deferred task.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param cb        task function
+ * @param userdata  user data passed to the task
+ *
+ * @return true if successful, otherwise returns false.
+ */
+bool qreactor_defer(qreactor_t *reactor, qreactor_task_t cb,
+                    void *userdata) {
+    if (reactor == NULL || cb == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    rtask_t *task = (rtask_t *) malloc(sizeof(rtask_t));
+    if (task == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    task->cb = cb;
+    task->userdata = userdata;
+    task->next = NULL;
+    if (reactor->taskstail != NULL)
+        reactor->taskstail->next = task;
+    else
+        reactor->tasks = task;
+    reactor->taskstail = task;
+
+    return true;
+}
+
+/**
+ * Run one iteration of the loop: wait for events, then dispatch them, the
+ * expired timers and the deferred tasks in that order.
+ *
+ * @param reactor   qreactor_t object pointer
+ * @param timeoutms maximum wait milliseconds. 0 for no wait, -1 for infinite
+ *                  wait. Pending timers and tasks shorten the wait.
+ *
+ * @return the number of callbacks run, -1 for error.
+ */
+int qreactor_run_once(qreactor_t *reactor, int timeoutms) {
+#ifdef __linux__
+    if (reactor == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (reactor->tasks != NULL)
+        timeoutms = 0;
+    else
+        timeoutms = timer_wait(reactor, timeoutms);
+
+    struct epoll_event evs[MAX_EPOLL_EVENTS];
+    int n = epoll_wait(reactor->epfd, evs, MAX_EPOLL_EVENTS, timeoutms);
+    if (n < 0) {
+        if (errno != EINTR)
+            return -1;
+        n = 0;
+    }
+
+    int called = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        int fd = (int) (evs[i].data.u64 & 0xffffffff);
+        uint32_t gen = (uint32_t) (evs[i].data.u64 >> 32);
+        rfd_t *rfd = (fd < reactor->fdsize) ? reactor->fds[fd] : NULL;
+        if (rfd == NULL || rfd->gen != gen)
+            continue;  // removed by an earlier callback
+
+        int events = 0;
+        if (evs[i].events & (EPOLLIN | EPOLLRDHUP))
+            events |= QREACTOR_READ;
+        if (evs[i].events & EPOLLOUT)
+            events |= QREACTOR_WRITE;
+        if (evs[i].events & (EPOLLERR | EPOLLHUP))
+            events |= QREACTOR_ERROR;
+
+        timer_unlink(reactor, &rfd->timer);
+        timer_link(reactor, &rfd->timer, rfd->timeoutms);
+        rfd->cb(reactor, fd, events, rfd->userdata);
+        called++;
+    }
+
+    called += timer_expire(reactor);
+    called += task_run(reactor);
+
+    return called;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Run the loop until qreactor_stop() is called or nothing is left to wait
+ * for.
+ *
+ * @param reactor   qreactor_t object pointer
+ *
+ * @return true if stopped or nothing is left, false for error.
+ */
+bool qreactor_run(qreactor_t *reactor) {
+    if (reactor == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    reactor->stop = false;
+    while (reactor->stop == false
+            && (reactor->nfds > 0 || reactor->ntimers > 0
+                    || reactor->tasks != NULL)) {
+        if (qreactor_run_once(reactor, -1) < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Make qreactor_run() return after the current iteration.
+ *
+ * @param reactor   qreactor_t object pointer
+ */
+void qreactor_stop(qreactor_t *reactor) {
+    reactor->stop = true;
+}
+
+/**
+ * De-allocate the reactor. Registered descriptors are not closed, and
+ * pending timers and tasks are dropped without being run.
+ *
+ * @param reactor   qreactor_t object pointer
+ */
+void qreactor_free(qreactor_t *reactor) {
+    if (reactor == NULL)
+        return;
+
+    int i;
+    for (i = 0; i < reactor->fdsize; i++) {
+        if (reactor->fds[i] != NULL)
+            qreactor_del(reactor, i);
+    }
+    free(reactor->fds);
+
+    for (i = 0; i < TIMER_SLOTS; i++) {
+        rtimer_t *head = &reactor->wheel[i];
+        while (head->next != head) {
+            rtimer_t *timer = head->next;
+            timer_unlink(reactor, timer);
+            free(timer);  // only user timers are left
+        }
+    }
+
+    rtask_t *task, *next;
+    for (task = reactor->tasks; task != NULL; task = next) {
+        next = task->next;
+        free(task);
+    }
+
+#ifdef __linux__
+    close(reactor->epfd);
+#endif
+    free(reactor);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static int64_t now_tick(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / TIMER_TICKMS;
+}
+
+static void timer_link(qreactor_t *reactor, rtimer_t *timer, int timeoutms) {
+    if (timeoutms < 0)
+        return;
+
+    // round up so a timer never fires early.
+    int64_t now = now_tick();
+    if (now < reactor->tick)
+        now = reactor->tick;
+    timer->expire = now + (timeoutms + TIMER_TICKMS - 1) / TIMER_TICKMS;
+    if (timer->expire <= reactor->tick)
+        timer->expire = reactor->tick + 1;
+
+    rtimer_t *head = &reactor->wheel[timer->expire & (TIMER_SLOTS - 1)];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    reactor->ntimers++;
+}
+
+static void timer_unlink(qreactor_t *reactor, rtimer_t *timer) {
+    if (timer->next == NULL || timer->next == timer)
+        return;  // not linked
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = (timer->fd >= 0) ? timer : NULL;
+    reactor->ntimers--;
+}
+
+// Shorten the wait to the next occupied slot of the wheel.
+static int timer_wait(qreactor_t *reactor, int timeoutms) {
+    if (reactor->ntimers == 0)
+        return timeoutms;
+
+    int64_t now = now_tick();
+    int64_t t;
+    for (t = reactor->tick + 1; t <= reactor->tick + TIMER_SLOTS; t++) {
+        rtimer_t *head = &reactor->wheel[t & (TIMER_SLOTS - 1)];
+        if (head->next != head)
+            break;
+    }
+
+    int64_t waitms = (t - now) * TIMER_TICKMS;
+    if (waitms < 0)
+        waitms = 0;
+    if (timeoutms < 0 || waitms < timeoutms)
+        return (int) waitms;
+    return timeoutms;
+}
+
+static int timer_expire(qreactor_t *reactor) {
+    int64_t now = now_tick();
+    if (now <= reactor->tick)
+        return 0;
+
+    // move expired timers to a pending list, then fire them one by one so
+    // callbacks can cancel or delete anything safely.
+    rtimer_t pending;
+    pending.prev = pending.next = &pending;
+
+    int64_t t = reactor->tick + 1;
+    if (now - reactor->tick > TIMER_SLOTS)
+        t = now - TIMER_SLOTS + 1;  // a full turn visits every slot
+    for (; t <= now; t++) {
+        rtimer_t *head = &reactor->wheel[t & (TIMER_SLOTS - 1)];
+        rtimer_t *timer, *next;
+        for (timer = head->next; timer != head; timer = next) {
+            next = timer->next;
+            if (timer->expire > now)
+                continue;
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            timer->prev = pending.prev;
+            timer->next = &pending;
+            pending.prev->next = timer;
+            pending.prev = timer;
+        }
+    }
+    reactor->tick = now;
+
+    int called = 0;
+    while (pending.next != &pending) {
+        rtimer_t *timer = pending.next;
+        timer_unlink(reactor, timer);
+        if (timer->fd >= 0) {
+            rfd_t *rfd = reactor->fds[timer->fd];
+            rfd->cb(reactor, timer->fd, QREACTOR_TIMEOUT, rfd->userdata);
+        } else {
+            timer->cb(reactor, timer->userdata);
+            free(timer);
+        }
+        called++;
+    }
+
+    return called;
+}
+
+static int task_run(qreactor_t *reactor) {
+    // tasks deferred from here on run in the next iteration.
+    rtask_t *task = reactor->tasks;
+    reactor->tasks = reactor->taskstail = NULL;
+
+    int called = 0;
+    while (task != NULL) {
+        rtask_t *next = task->next;
+        task->cb(reactor, task->userdata);
+        free(task);
+        task = next;
+        called++;
+    }
+
+    return called;
+}
+
+#ifdef __linux__
+static bool fd_ctl(qreactor_t *reactor, int op, int fd, rfd_t *rfd) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLET;
+    if (rfd->events & QREACTOR_READ)
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    if (rfd->events & QREACTOR_WRITE)
+        ev.events |= EPOLLOUT;
+    ev.data.u64 = ((uint64_t) rfd->gen << 32) | (uint32_t) fd;
+
+    return (epoll_ctl(reactor->epfd, op, fd, &ev) == 0);
+}
+#endif
+
+#endif /* _DOXYGEN_SKIP */
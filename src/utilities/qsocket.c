@@ -35,20 +35,84 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <time.h>
 #include "qinternal.h"
 #include "utilities/qio.h"
+#include "utilities/qhash.h"
 #include "utilities/qstring.h"
 #include "utilities/qsocket.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define MAX_RESOLVE_ADDRS       (16)    /*< addresses kept per name */
+#define MAX_RESOLVE_CACHE       (1024)  /*< names kept in the cache */
+#define RESOLVE_BUCKETS         (256)   /*< cache hash buckets */
+#define DEF_RESOLVE_TTL         (60)    /*< default ttl, unit is second */
+#define DEF_RESOLVE_NEGTTL      (5)     /*< default negative ttl */
+#define DEF_CONNECT_DELAY       (250)   /*< delay between connection attempts,
+                                            unit is ms */
+
+struct ResolveEntry {
+    char *hostname;
+    int64_t expire;             /*< monotonic clock, unit is ms */
+    int error;                  /*< errno of a failed lookup */
+    int naddrs;
+    qsocket_addr_t *addrs;      /*< port is not set */
+    struct ResolveEntry *next;
+};
+
+struct qsocket_resolver_s {
+    char *hostname;
+    int port;
+    int pipefd[2];              /*< readable when done */
+    int refs;                   /*< caller and lookup thread */
+    bool done;
+    int error;
+    int naddrs;
+    qsocket_addr_t addrs[MAX_RESOLVE_ADDRS];
+};
+
+static qmutex_t _resolve_qmutex = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+static void *_resolve_mutex = &_resolve_qmutex;
+static struct ResolveEntry *_resolve_cache[RESOLVE_BUCKETS];
+static int _resolve_ncache = 0;
+static int _resolve_ttl = DEF_RESOLVE_TTL;
+static int _resolve_negttl = DEF_RESOLVE_NEGTTL;
+
+static int _resolve(qsocket_addr_t *addrs, const char *hostname, int *error);
+static int _resolve_lookup(qsocket_addr_t *addrs, const char *hostname,
+                           int flags, int *error);
+static int _resolve_cached(qsocket_addr_t *addrs, const char *hostname,
+                           int *error);
+static void _resolve_store(const char *hostname, const qsocket_addr_t *addrs,
+                           int naddrs, int error);
+static void _resolve_purge(int64_t now, bool all);
+static int _resolve_copy(qsocket_addr_t *dst, int maxaddrs,
+                         const qsocket_addr_t *src, int naddrs, int port);
+static void _resolve_finish(qsocket_resolver_t *resolver,
+                            const qsocket_addr_t *addrs, int naddrs,
+                            int error);
+static void *_resolve_thread(void *arg);
+static void _resolver_release(qsocket_resolver_t *resolver);
+static void _connect_order(const qsocket_addr_t **order,
+                           const qsocket_addr_t *addrs, int naddrs);
+static int _connect_start(const qsocket_addr_t *addr, bool *created,
+                          int *error);
+static int64_t _now_ms(void);
+
+#endif
+
 /**
  * Create a TCP socket for the remote host and port.
  *
@@ -61,37 +125,134 @@
  *         -1 in case of invalid hostname,
  *         -2 in case of socket creation failure,
  *         -3 in case of connection failure.
+ *
+ * @note
+ *  All the IPv4 and IPv6 addresses of the host are tried with
+ *  qsocket_connect().
  */
 int qsocket_open(const char *hostname, int port, int timeoutms) {
     /* host conversion */
-    struct sockaddr_in addr;
-    if (qsocket_get_addr(&addr, hostname, port) == false) {
+    qsocket_addr_t addrs[MAX_RESOLVE_ADDRS];
+    int naddrs = qsocket_resolve(addrs, MAX_RESOLVE_ADDRS, hostname, port);
+    if (naddrs <= 0) {
         return -1; /* invalid hostname */
     }
 
-    /* create new socket */
-    int sockfd;
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        return -2; /* sockfd creation fail */
+    return qsocket_connect(addrs, naddrs, timeoutms);
+}
+
+/**
+ * Connect to the first of several addresses which answers.
+ *
+ * @param addrs     addresses in order of preference, usually from
+ *                  qsocket_resolve()
+ * @param naddrs    number of addresses
+ * @param timeoutms wait timeout milliseconds. if set to negative value,
+ *                  wait indefinitely.
+ *
+ * @return the new socket descriptor in blocking mode, or
+ *         -1 in case of invalid arguments,
+ *         -2 in case of socket creation failure,
+ *         -3 in case of connection failure.
+ *         errno is set to the reason of the last failure.
+ *
+ * @note
+ *  Attempts follow RFC 8305 (Happy Eyeballs). Addresses are tried
+ *  alternating IPv6 and IPv4, starting with the family of the first one.
+ *  A new attempt starts every 250 milliseconds, or right away when one
+ *  fails, while the earlier ones keep going. The first connection to be
+ *  established wins and the others are closed. So a dead or slow address
+ *  costs 250 milliseconds instead of the whole timeout.
+ */
+int qsocket_connect(const qsocket_addr_t *addrs, int naddrs, int timeoutms) {
+    if (addrs == NULL || naddrs <= 0) {
+        errno = EINVAL;
+        return -1;
     }
+    if (naddrs > MAX_RESOLVE_ADDRS)
+        naddrs = MAX_RESOLVE_ADDRS;
 
-    /* set to non-block socket*/
-    int flags = fcntl(sockfd, F_GETFL, 0);
-    if (timeoutms >= 0)
-        fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    const qsocket_addr_t *order[MAX_RESOLVE_ADDRS];
+    _connect_order(order, addrs, naddrs);
 
-    /* try to connect */
-    int status = connect(sockfd, (struct sockaddr *) &addr, sizeof(addr));
-    if (status < 0
-            && (errno != EINPROGRESS
-                    || qio_wait_writable(sockfd, timeoutms) <= 0)) {
-        close(sockfd);
-        return -3; /* connection failed */
+    struct pollfd pfds[MAX_RESOLVE_ADDRS];
+    int i, npfds = 0, next = 0, sockfd = -1, error = ETIMEDOUT;
+    bool created = false;
+    int64_t now = _now_ms();
+    int64_t deadline = (timeoutms >= 0) ? now + timeoutms : -1;
+    int64_t nextstart = now;
+
+    while (sockfd < 0) {
+        now = _now_ms();
+
+        /* start the next attempt when it's due or nothing is in flight */
+        if (next < naddrs && (now >= nextstart || npfds == 0)) {
+            int fd = _connect_start(order[next++], &created, &error);
+            if (fd >= 0) {
+                pfds[npfds].fd = fd;
+                pfds[npfds].events = POLLOUT;
+                pfds[npfds].revents = 0;
+                npfds++;
+                nextstart = now + DEF_CONNECT_DELAY;
+            }
+            continue;
+        }
+        if (npfds == 0)
+            break; /* all failed */
+        if (deadline >= 0 && now >= deadline) {
+            error = ETIMEDOUT;
+            break;
+        }
+
+        int64_t wait = -1;
+        if (next < naddrs)
+            wait = nextstart - now;
+        if (deadline >= 0 && (wait < 0 || deadline - now < wait))
+            wait = deadline - now;
+        int n = poll(pfds, npfds, (int) wait);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+
+        for (i = 0; n > 0 && i < npfds;) {
+            if (pfds[i].revents == 0) {
+                i++;
+                continue;
+            }
+            int soerror = 0;
+            socklen_t len = sizeof(soerror);
+            if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &soerror, &len)
+                    < 0) {
+                soerror = errno;
+            }
+            if (soerror == 0) {
+                sockfd = pfds[i].fd;
+                pfds[i] = pfds[--npfds];
+                break;
+            }
+
+            /* a failure starts the next attempt right away */
+            DEBUG("Connection attempt failed. errno=%d", soerror);
+            error = soerror;
+            close(pfds[i].fd);
+            pfds[i] = pfds[--npfds];
+            nextstart = now;
+        }
+    }
+
+    for (i = 0; i < npfds; i++) {
+        close(pfds[i].fd);
+    }
+    if (sockfd < 0) {
+        errno = error;
+        return (created == true) ? -3 : -2;
     }
 
     /* restore to block socket */
-    if (timeoutms >= 0)
-        fcntl(sockfd, F_SETFL, flags);
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) & ~O_NONBLOCK);
 
     return sockfd;
 }
@@ -130,20 +291,27 @@ bool qsocket_close(int sockfd, int timeoutms) {
  * @param port      port number
  *
  * @return true if successful, otherwise returns false.
+ *
+ * @note
+ *  The first IPv4 address qsocket_resolve() returns is used, so lookups
+ *  are cached.
  */
 bool qsocket_get_addr(struct sockaddr_in *addr, const char *hostname, int port) {
-    /* here we assume that the hostname argument contains ip address */
     memset((void *) addr, 0, sizeof(struct sockaddr_in));
-    if (!inet_aton(hostname, &addr->sin_addr)) { /* fail then try another way */
-        struct hostent *hp;
-        if ((hp = gethostbyname(hostname)) == 0)
-            return false;
-        memcpy(&addr->sin_addr, hp->h_addr, sizeof(struct in_addr));
+
+    qsocket_addr_t addrs[MAX_RESOLVE_ADDRS];
+    int i, naddrs = qsocket_resolve(addrs, MAX_RESOLVE_ADDRS, hostname, port);
+    for (i = 0; i < naddrs; i++) {
+        if (addrs[i].addr.ss_family == AF_INET) {
+            memcpy((void *) addr, (void *) &addrs[i].addr,
+                   sizeof(struct sockaddr_in));
+            return true;
+        }
     }
-    addr->sin_family = AF_INET;
-    addr->sin_port = htons(port);
+    if (naddrs > 0)
+        errno = EAFNOSUPPORT;
 
-    return true;
+    return false;
 }
 
 /**
@@ -157,16 +325,496 @@ char *qsocket_get_localaddr(char *buf, size_t bufsize) {
     if (gethostname(hostname, sizeof(hostname)) != 0)
         return NULL;
 
-    struct hostent *hostentry = gethostbyname(hostname);
-    if (hostentry == NULL)
+    struct sockaddr_in addr;
+    if (qsocket_get_addr(&addr, hostname, 0) == false)
         return NULL;
 
-    char *localip = inet_ntoa(*(struct in_addr *) *hostentry->h_addr_list);
-    if (localip == NULL)
+    if (inet_ntop(AF_INET, &addr.sin_addr, buf, bufsize) == NULL)
         return NULL;
-
-    qstrcpy(buf, bufsize, localip);
     return buf;
 }
 
+/**
+ * Resolve a hostname into IPv4 and IPv6 addresses.
+ *
+ * @param addrs     array to store the addresses
+ * @param maxaddrs  size of the array
+ * @param hostname  IP string address or hostname
+ * @param port      port number
+ *
+ * @return the number of addresses stored, or -1 on failure with errno set.
+ *  ENOENT means that the name doesn't exist, EAGAIN a temporary failure.
+ *
+ * @code
+ *   qsocket_addr_t addrs[8];
+ *   int naddrs = qsocket_resolve(addrs, 8, "www.example.com", 80);
+ *   if (naddrs > 0) {
+ *     int sockfd = socket(addrs[0].addr.ss_family, SOCK_STREAM, 0);
+ *     connect(sockfd, (struct sockaddr *) &addrs[0].addr, addrs[0].addrlen);
+ *   }
+ * @endcode
+ *
+ * @note
+ *  Lookups go through getaddrinfo() and the addresses are in its order of
+ *  preference. Results are cached for 60 seconds, and names which don't
+ *  exist for 5 seconds, see qsocket_resolve_setttl(). IP address strings
+ *  are converted without lookup. It is thread-safe.
+ */
+int qsocket_resolve(qsocket_addr_t *addrs, int maxaddrs, const char *hostname,
+                    int port) {
+    if (addrs == NULL || maxaddrs <= 0 || hostname == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    qsocket_addr_t found[MAX_RESOLVE_ADDRS];
+    int error = 0;
+    int naddrs = _resolve(found, hostname, &error);
+    if (naddrs < 0) {
+        naddrs = _resolve_lookup(found, hostname, 0, &error);
+        _resolve_store(hostname, found, naddrs, error);
+    }
+    if (naddrs == 0) {
+        errno = error;
+        return -1;
+    }
+
+    return _resolve_copy(addrs, maxaddrs, found, naddrs, port);
+}
+
+/**
+ * Start resolving a hostname in the background.
+ *
+ * @param hostname  IP string address or hostname
+ * @param port      port number
+ *
+ * @return a resolver handle if successful, otherwise returns NULL.
+ *
+ * @code
+ *   static void on_resolved(qreactor_t *reactor, int fd, int events,
+ *                           void *userdata) {
+ *     qsocket_resolver_t *resolver = (qsocket_resolver_t *) userdata;
+ *     qsocket_addr_t addrs[8];
+ *     int naddrs = qsocket_resolver_result(resolver, addrs, 8);
+ *     if (naddrs < 0 && errno == EINPROGRESS)
+ *       return;  // not yet
+ *     qreactor_del(reactor, fd);
+ *     qsocket_resolver_free(resolver);
+ *     (...connect to addrs...)
+ *   }
+ *
+ *   qsocket_resolver_t *resolver = qsocket_resolve_async("example.com", 80);
+ *   qreactor_add(reactor, qsocket_resolver_fd(resolver), QREACTOR_READ, -1,
+ *                on_resolved, resolver);
+ * @endcode
+ *
+ * @note
+ *  Cached names and IP address strings are done right away, others are
+ *  looked up on a thread of their own. The descriptor of
+ *  qsocket_resolver_fd() becomes readable once the result is available,
+ *  so it can be watched by any event loop.
+ */
+qsocket_resolver_t *qsocket_resolve_async(const char *hostname, int port) {
+    if (hostname == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qsocket_resolver_t *resolver;
+    resolver = (qsocket_resolver_t *) calloc(1, sizeof(qsocket_resolver_t));
+    if (resolver == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    resolver->pipefd[0] = resolver->pipefd[1] = -1;
+    resolver->port = port;
+    resolver->refs = 1;
+    resolver->hostname = strdup(hostname);
+    if (resolver->hostname == NULL || pipe(resolver->pipefd) != 0) {
+        _resolver_release(resolver);
+        errno = ENOMEM;
+        return NULL;
+    }
+    int i;
+    for (i = 0; i < 2; i++) {
+        fcntl(resolver->pipefd[i], F_SETFL,
+              fcntl(resolver->pipefd[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(resolver->pipefd[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    qsocket_addr_t found[MAX_RESOLVE_ADDRS];
+    int error = 0;
+    int naddrs = _resolve(found, hostname, &error);
+    if (naddrs >= 0) {
+        _resolve_finish(resolver, found, naddrs, error);
+        return resolver;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    resolver->refs++;
+    int ret = pthread_create(&thread, &attr, _resolve_thread, resolver);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        resolver->refs = 1;
+        _resolver_release(resolver);
+        errno = ret;
+        return NULL;
+    }
+
+    return resolver;
+}
+
+/**
+ * Get the descriptor which becomes readable when the result is available.
+ *
+ * @param resolver  resolver handle
+ *
+ * @return a non-blocking descriptor. It's owned by the resolver.
+ */
+int qsocket_resolver_fd(qsocket_resolver_t *resolver) {
+    return resolver->pipefd[0];
+}
+
+/**
+ * Get the result of a background resolution.
+ *
+ * @param resolver  resolver handle
+ * @param addrs     array to store the addresses
+ * @param maxaddrs  size of the array
+ *
+ * @return the number of addresses stored, or -1 on failure with errno set.
+ *  EINPROGRESS means that it is not done yet, others are the same as
+ *  qsocket_resolve().
+ */
+int qsocket_resolver_result(qsocket_resolver_t *resolver,
+                            qsocket_addr_t *addrs, int maxaddrs) {
+    if (addrs == NULL || maxaddrs <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Q_MUTEX_ENTER(_resolve_mutex);
+    bool done = resolver->done;
+    Q_MUTEX_LEAVE(_resolve_mutex);
+    if (done == false) {
+        errno = EINPROGRESS;
+        return -1;
+    }
+
+    char c;
+    while (read(resolver->pipefd[0], &c, sizeof(c)) > 0);
+    if (resolver->naddrs == 0) {
+        errno = resolver->error;
+        return -1;
+    }
+    return _resolve_copy(addrs, maxaddrs, resolver->addrs, resolver->naddrs,
+                         resolver->port);
+}
+
+/**
+ * Release a resolver handle. It can be released before it's done.
+ *
+ * @param resolver  resolver handle
+ */
+void qsocket_resolver_free(qsocket_resolver_t *resolver) {
+    _resolver_release(resolver);
+}
+
+/**
+ * Set how long resolved names are cached.
+ *
+ * @param ttlsec    seconds to keep addresses. 0 to disable caching.
+ * @param negttlsec seconds to keep names which don't exist. 0 to disable
+ *                  negative caching.
+ */
+void qsocket_resolve_setttl(int ttlsec, int negttlsec) {
+    Q_MUTEX_ENTER(_resolve_mutex);
+    _resolve_ttl = (ttlsec > 0) ? ttlsec : 0;
+    _resolve_negttl = (negttlsec > 0) ? negttlsec : 0;
+    _resolve_purge(0, true);
+    Q_MUTEX_LEAVE(_resolve_mutex);
+}
+
+/**
+ * Drop all cached names.
+ */
+void qsocket_resolve_flush(void) {
+    Q_MUTEX_ENTER(_resolve_mutex);
+    _resolve_purge(0, true);
+    Q_MUTEX_LEAVE(_resolve_mutex);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// Resolve IP address strings and cached names. Returns -1 when it needs
+// a lookup.
+static int _resolve(qsocket_addr_t *addrs, const char *hostname, int *error) {
+    int naddrs = _resolve_lookup(addrs, hostname, AI_NUMERICHOST, error);
+    if (naddrs > 0)
+        return naddrs;
+    return _resolve_cached(addrs, hostname, error);
+}
+
+static int _resolve_lookup(qsocket_addr_t *addrs, const char *hostname,
+                           int flags, int *error) {
+    struct addrinfo hints, *result, *ai;
+    memset((void *) &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = flags;
+
+    int ret = getaddrinfo(hostname, NULL, &hints, &result);
+    if (ret != 0) {
+        switch (ret) {
+            case EAI_AGAIN:
+                *error = EAGAIN;
+                break;
+            case EAI_MEMORY:
+                *error = ENOMEM;
+                break;
+            case EAI_SYSTEM:
+                *error = errno;
+                break;
+            default:
+                *error = ENOENT;
+                break;
+        }
+        return 0;
+    }
+
+    int naddrs = 0;
+    for (ai = result; ai != NULL && naddrs < MAX_RESOLVE_ADDRS;
+            ai = ai->ai_next) {
+        if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+                || ai->ai_addrlen > sizeof(addrs[naddrs].addr)) {
+            continue;
+        }
+        memset((void *) &addrs[naddrs], 0, sizeof(qsocket_addr_t));
+        memcpy((void *) &addrs[naddrs].addr, ai->ai_addr, ai->ai_addrlen);
+        addrs[naddrs].addrlen = ai->ai_addrlen;
+        naddrs++;
+    }
+    freeaddrinfo(result);
+
+    if (naddrs == 0)
+        *error = ENOENT;
+    return naddrs;
+}
+
+// Returns the number of cached addresses, 0 for a cached failure or -1 if
+// it's not cached.
+static int _resolve_cached(qsocket_addr_t *addrs, const char *hostname,
+                           int *error) {
+    uint32_t bucket = qhashmurmur3_32(hostname, strlen(hostname))
+            % RESOLVE_BUCKETS;
+    int64_t now = _now_ms();
+    int naddrs = -1;
+
+    Q_MUTEX_ENTER(_resolve_mutex);
+    struct ResolveEntry *entry;
+    for (entry = _resolve_cache[bucket]; entry != NULL; entry = entry->next) {
+        if (!strcmp(entry->hostname, hostname)) {
+            if (entry->expire > now) {
+                naddrs = entry->naddrs;
+                memcpy((void *) addrs, (void *) entry->addrs,
+                       naddrs * sizeof(qsocket_addr_t));
+                *error = entry->error;
+            }
+            break;
+        }
+    }
+    Q_MUTEX_LEAVE(_resolve_mutex);
+
+    return naddrs;
+}
+
+static void _resolve_store(const char *hostname, const qsocket_addr_t *addrs,
+                           int naddrs, int error) {
+    // temporary failures aren't cached
+    if (naddrs == 0 && error != ENOENT)
+        return;
+
+    uint32_t bucket = qhashmurmur3_32(hostname, strlen(hostname))
+            % RESOLVE_BUCKETS;
+    int64_t now = _now_ms();
+
+    Q_MUTEX_ENTER(_resolve_mutex);
+    int ttl = (naddrs > 0) ? _resolve_ttl : _resolve_negttl;
+    if (ttl <= 0) {
+        Q_MUTEX_LEAVE(_resolve_mutex);
+        return;
+    }
+
+    struct ResolveEntry *entry;
+    for (entry = _resolve_cache[bucket]; entry != NULL; entry = entry->next) {
+        if (!strcmp(entry->hostname, hostname))
+            break;
+    }
+    if (entry == NULL) {
+        if (_resolve_ncache >= MAX_RESOLVE_CACHE)
+            _resolve_purge(now, false);
+        if (_resolve_ncache >= MAX_RESOLVE_CACHE)
+            _resolve_purge(now, true);
+
+        entry = (struct ResolveEntry *) calloc(1, sizeof(struct ResolveEntry));
+        if (entry == NULL || (entry->hostname = strdup(hostname)) == NULL) {
+            free(entry);
+            Q_MUTEX_LEAVE(_resolve_mutex);
+            return;
+        }
+        entry->next = _resolve_cache[bucket];
+        _resolve_cache[bucket] = entry;
+        _resolve_ncache++;
+    }
+
+    qsocket_addr_t *copy = NULL;
+    if (naddrs > 0) {
+        copy = (qsocket_addr_t *) malloc(naddrs * sizeof(qsocket_addr_t));
+        if (copy == NULL) {
+            naddrs = 0;
+            ttl = 0;  // expire right away
+        } else {
+            memcpy((void *) copy, (void *) addrs,
+                   naddrs * sizeof(qsocket_addr_t));
+        }
+    }
+    free(entry->addrs);
+    entry->addrs = copy;
+    entry->naddrs = naddrs;
+    entry->error = error;
+    entry->expire = now + (int64_t) ttl * 1000;
+    Q_MUTEX_LEAVE(_resolve_mutex);
+}
+
+// Drop expired entries, or all of them. Called in the mutex.
+static void _resolve_purge(int64_t now, bool all) {
+    int i;
+    for (i = 0; i < RESOLVE_BUCKETS; i++) {
+        struct ResolveEntry **link = &_resolve_cache[i];
+        while (*link != NULL) {
+            struct ResolveEntry *entry = *link;
+            if (all == false && entry->expire > now) {
+                link = &entry->next;
+                continue;
+            }
+            *link = entry->next;
+            free(entry->hostname);
+            free(entry->addrs);
+            free(entry);
+            _resolve_ncache--;
+        }
+    }
+}
+
+static int _resolve_copy(qsocket_addr_t *dst, int maxaddrs,
+                         const qsocket_addr_t *src, int naddrs, int port) {
+    int i;
+    for (i = 0; i < naddrs && i < maxaddrs; i++) {
+        dst[i] = src[i];
+        if (dst[i].addr.ss_family == AF_INET6) {
+            ((struct sockaddr_in6 *) &dst[i].addr)->sin6_port = htons(port);
+        } else {
+            ((struct sockaddr_in *) &dst[i].addr)->sin_port = htons(port);
+        }
+    }
+    return i;
+}
+
+static void _resolve_finish(qsocket_resolver_t *resolver,
+                            const qsocket_addr_t *addrs, int naddrs,
+                            int error) {
+    Q_MUTEX_ENTER(_resolve_mutex);
+    memcpy((void *) resolver->addrs, (void *) addrs,
+           naddrs * sizeof(qsocket_addr_t));
+    resolver->naddrs = naddrs;
+    resolver->error = error;
+    resolver->done = true;
+    Q_MUTEX_LEAVE(_resolve_mutex);
+
+    char c = 0;
+    if (write(resolver->pipefd[1], &c, sizeof(c)) < 0) {
+        DEBUG("Can't signal the resolver. errno=%d", errno);
+    }
+}
+
+static void *_resolve_thread(void *arg) {
+    qsocket_resolver_t *resolver = (qsocket_resolver_t *) arg;
+
+    qsocket_addr_t found[MAX_RESOLVE_ADDRS];
+    int error = 0;
+    int naddrs = _resolve_lookup(found, resolver->hostname, 0, &error);
+    _resolve_store(resolver->hostname, found, naddrs, error);
+    _resolve_finish(resolver, found, naddrs, error);
+    _resolver_release(resolver);
+
+    return NULL;
+}
+
+static void _resolver_release(qsocket_resolver_t *resolver) {
+    Q_MUTEX_ENTER(_resolve_mutex);
+    int refs = --resolver->refs;
+    Q_MUTEX_LEAVE(_resolve_mutex);
+    if (refs > 0)
+        return;
+
+    if (resolver->pipefd[0] >= 0)
+        close(resolver->pipefd[0]);
+    if (resolver->pipefd[1] >= 0)
+        close(resolver->pipefd[1]);
+    free(resolver->hostname);
+    free(resolver);
+}
+
+// Interleave address families, keeping the order within each family.
+static void _connect_order(const qsocket_addr_t **order,
+                           const qsocket_addr_t *addrs, int naddrs) {
+    int i, first = 0, other = 0, n = 0;
+    sa_family_t family = addrs[0].addr.ss_family;
+    while (n < naddrs) {
+        for (i = first; i < naddrs && addrs[i].addr.ss_family != family; i++);
+        if (i < naddrs) {
+            order[n++] = &addrs[i];
+            first = i + 1;
+        }
+        for (i = other; i < naddrs && addrs[i].addr.ss_family == family; i++);
+        if (i < naddrs) {
+            order[n++] = &addrs[i];
+            other = i + 1;
+        }
+    }
+}
+
+// Start a non-blocking connection. Returns the socket, or -1 if it failed
+// right away.
+static int _connect_start(const qsocket_addr_t *addr, bool *created,
+                          int *error) {
+    int sockfd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        *error = errno;
+        return -1;
+    }
+    *created = true;
+
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(sockfd, (const struct sockaddr *) &addr->addr, addr->addrlen)
+            < 0 && errno != EINPROGRESS) {
+        *error = errno;
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+static int64_t _now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#endif /* _DOXYGEN_SKIP */
+
 #endif /* _WIN32 */
@@ -36,13 +36,53 @@
 #include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/types.h>
 #include <sys/time.h>
 #include "qinternal.h"
 #include "utilities/qencode.h"
 #include "utilities/qhash.h"
 #include "utilities/qstring.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define DELIMAP_SET(m, c)   ((m)[(unsigned char)(c) >> 6] |= \
+                             (1ULL << ((unsigned char)(c) & 63)))
+#define DELIMAP_TEST(m, c)  (((m)[(unsigned char)(c) >> 6] >> \
+                              ((unsigned char)(c) & 63)) & 1)
+
+/* Aho-Corasick trie node. Children are kept in sibling lists. */
+typedef struct acnode_s {
+    int child;      /* first child */
+    int sibling;    /* next sibling */
+    int fail;       /* failure link */
+    int dict;       /* nearest pattern node on the failure chain */
+    int pattern;    /* index of pattern ending here, or -1 */
+    int depth;
+    unsigned char c;
+} acnode_t;
+
+typedef struct actrie_s {
+    acnode_t *nodes;
+    int num;
+    int max;
+    int maxdepth;
+    int rootnext[256];  /* dense transitions of the root */
+    const char **words;
+    size_t *wordlens;
+} actrie_t;
+
+static char *find_str(const char *str, size_t len, const char *needle,
+                      size_t needlelen);
+static bool actrie_build(actrie_t *ac, const char *tokstrs[],
+                         const char *words[], size_t num);
+static ssize_t actrie_replace(actrie_t *ac, const char *str, size_t len,
+                              char *out);
+static void actrie_free(actrie_t *ac);
+
+#endif
+
 /**
  * Remove white spaces(including CR, LF) from head and tail of the string.
  *
@@ -218,11 +258,11 @@ char *qstrunchar(char *str, char head, char tail) {
  *   --[Result]--
  *   before tn : srcstr = Welcome to The qDecoder Project.
  *   after  tn : srcstr = Welcome to The qDecoder Project.
- *               retstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
+ *               retstr = W_lcom_ to ___ qD_cod_r Proj_ct.
  *
  *   before tr : srcstr = Welcome to The qDecoder Project.
- *   after  tr : srcstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
- *               retstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
+ *   after  tr : srcstr = W_lcom_ to ___ qD_cod_r Proj_ct.
+ *               retstr = W_lcom_ to ___ qD_cod_r Proj_ct.
  *
  *   before sn : srcstr = Welcome to The qDecoder Project.
  *   after  sn : srcstr = Welcome to The qDecoder Project.
@@ -241,72 +281,136 @@ char *qstrreplace(const char *mode, char *srcstr, const char *tokstr,
         return NULL;
     }
 
-    char *newstr, *newp, *srcp, *tokenp, *retp;
-    newstr = newp = srcp = tokenp = retp = NULL;
+    char *newstr, *newp, *srcp, *retp;
+    newstr = newp = srcp = retp = NULL;
 
     char method = mode[0], memuse = mode[1];
-    int maxstrlen, tokstrlen;
+    if ((method != 't' && method != 's') || (memuse != 'n' && memuse != 'r')) {
+        DEBUG("Unknown mode \"%s\".", mode);
+        return NULL;
+    }
+
+    size_t srclen = strlen(srcstr), toklen = strlen(tokstr);
+    size_t wordlen = strlen(word);
+    char *srcend = srcstr + srclen;
 
-    /* Put replaced string into malloced 'newstr' */
+    /* Count matches first, so the result is allocated in its exact size */
+    size_t nummatch = 0;
     if (method == 't') { /* Token replace */
-        maxstrlen = strlen(srcstr) * ((strlen(word) > 0) ? strlen(word) : 1);
-        newstr = (char *) malloc(maxstrlen + 1);
-
-        for (srcp = (char *) srcstr, newp = newstr; *srcp; srcp++) {
-            for (tokenp = (char *) tokstr; *tokenp; tokenp++) {
-                if (*srcp == *tokenp) {
-                    char *wordp;
-                    for (wordp = (char *) word; *wordp; wordp++) {
-                        *newp++ = *wordp;
-                    }
-                    break;
-                }
-            }
-            if (!*tokenp)
-                *newp++ = *srcp;
+        uint64_t delimap[4] = { 0, 0, 0, 0 };
+        const char *tokenp;
+        for (tokenp = tokstr; *tokenp; tokenp++) {
+            DELIMAP_SET(delimap, *tokenp);
         }
-        *newp = '\0';
-    } else if (method == 's') { /* String replace */
-        if (strlen(word) > strlen(tokstr)) {
-            maxstrlen = ((strlen(srcstr) / strlen(tokstr)) * strlen(word))
-                    + (strlen(srcstr) % strlen(tokstr));
-        } else {
-            maxstrlen = strlen(srcstr);
+        for (srcp = srcstr; *srcp; srcp++) {
+            if (DELIMAP_TEST(delimap, *srcp))
+                nummatch++;
         }
-        newstr = (char *) malloc(maxstrlen + 1);
-        tokstrlen = strlen(tokstr);
+
+        newstr = (char *) malloc(srclen - nummatch + (nummatch * wordlen) + 1);
+        if (newstr == NULL)
+            return NULL;
 
         for (srcp = srcstr, newp = newstr; *srcp; srcp++) {
-            if (!strncmp(srcp, tokstr, tokstrlen)) {
-                char *wordp;
-                for (wordp = (char *) word; *wordp; wordp++)
-                    *newp++ = *wordp;
-                srcp += tokstrlen - 1;
-            } else
+            if (DELIMAP_TEST(delimap, *srcp)) {
+                memcpy(newp, word, wordlen);
+                newp += wordlen;
+            } else {
                 *newp++ = *srcp;
+            }
         }
         *newp = '\0';
-    } else {
-        DEBUG("Unknown mode \"%s\".", mode);
-        return NULL;
+    } else { /* String replace */
+        for (srcp = srcstr;
+                (srcp = find_str(srcp, srcend - srcp, tokstr, toklen)) != NULL;
+                srcp += toklen) {
+            nummatch++;
+        }
+
+        newstr = (char *) malloc(srclen - (nummatch * toklen)
+                                 + (nummatch * wordlen) + 1);
+        if (newstr == NULL)
+            return NULL;
+
+        char *matchp;
+        for (srcp = srcstr, newp = newstr;
+                (matchp = find_str(srcp, srcend - srcp, tokstr, toklen))
+                        != NULL; srcp = matchp + toklen) {
+            memcpy(newp, srcp, matchp - srcp);
+            newp += matchp - srcp;
+            memcpy(newp, word, wordlen);
+            newp += wordlen;
+        }
+        memcpy(newp, srcp, srcend - srcp);
+        newp += srcend - srcp;
+        *newp = '\0';
     }
 
     /* decide whether newing the memory or replacing into exist one */
-    if (memuse == 'n')
+    if (memuse == 'n') {
         retp = newstr;
-    else if (memuse == 'r') {
+    } else {
         strcpy(srcstr, newstr);
         free(newstr);
         retp = srcstr;
-    } else {
-        DEBUG("Unknown mode \"%s\".", mode);
-        free(newstr);
-        return NULL;
     }
 
     return retp;
 }
 
+/**
+ * Replace many strings at once.
+ *
+ * All patterns are matched in a single pass over the source string using
+ * Aho-Corasick automaton. When matches overlap, the one starting first wins
+ * and among those starting at the same position the longest one wins.
+ * Replaced text is not scanned again.
+ *
+ * @param srcstr    source string
+ * @param tokstrs   array of strings to be replaced. empty strings are ignored.
+ * @param words     array of words to replace with. words[i] replaces
+ *                  tokstrs[i].
+ * @param num       the number of elements in tokstrs and words.
+ *
+ * @return a pointer of malloced string if successful, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *   const char *toks[] = { "{name}", "{city}" };
+ *   const char *words[] = { "qLibc", "Seoul" };
+ *   char *str = qstrreplace_multi("Hi {name} from {city}", toks, words, 2);
+ *   printf("%s\n", str); // Hi qLibc from Seoul
+ *   free(str);
+ * @endcode
+ */
+char *qstrreplace_multi(const char *srcstr, const char *tokstrs[],
+                        const char *words[], size_t num) {
+    if (srcstr == NULL || (num > 0 && (tokstrs == NULL || words == NULL))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    actrie_t ac;
+    if (actrie_build(&ac, tokstrs, words, num) == false) {
+        return NULL;
+    }
+
+    size_t srclen = strlen(srcstr);
+    char *newstr = NULL;
+    ssize_t newlen = actrie_replace(&ac, srcstr, srclen, NULL);
+    if (newlen >= 0 && (newstr = (char *) malloc(newlen + 1)) != NULL) {
+        actrie_replace(&ac, srcstr, srclen, newstr);
+        newstr[newlen] = '\0';
+    } else {
+        errno = ENOMEM;
+    }
+    actrie_free(&ac);
+
+    return newstr;
+}
+
 /**
  * Copy src string to dst. The dst string array will be always terminated by
  * NULL character. Also allows overlap between src and dst.
@@ -575,20 +679,21 @@ char *qstrlower(char *str) {
  */
 char *qstrtok(char *str, const char *delimiters, char *retstop, int *offset) {
     char *tokensp, *tokenep;
+    uint64_t delimap[4] = { 0, 0, 0, 0 };
+    const char *d;
+    for (d = delimiters; *d; d++) {
+        DELIMAP_SET(delimap, *d);
+    }
 
     tokensp = tokenep = (char *) (str + *offset);
-    int numdel = strlen(delimiters);
     for (; *tokenep; tokenep++) {
-        int j;
-        for (j = 0; j < numdel; j++) {
-            if (*tokenep == delimiters[j]) {
-                if (retstop != NULL)
-                    *retstop = delimiters[j];
-                *tokenep = '\0';
-                tokenep++;
-                *offset = tokenep - str;
-                return tokensp;
-            }
+        if (DELIMAP_TEST(delimap, *tokenep)) {
+            if (retstop != NULL)
+                *retstop = *tokenep;
+            *tokenep = '\0';
+            tokenep++;
+            *offset = tokenep - str;
+            return tokensp;
         }
     }
 
@@ -638,6 +743,107 @@ qlist_t *qstrtokenizer(const char *str, const char *delimiters) {
     return list;
 }
 
+/**
+ * Initialize a string tokenizer which returns tokens as pointer and length
+ * pairs without allocating or modifying the source string.
+ *
+ * @param tok           tokenizer to initialize.
+ * @param str           source string. it doesn't need to be NULL terminated.
+ * @param len           the length of source string.
+ * @param delimiters    string that specifies a set of delimiters that may
+ *                      surround the token being extracted
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *
+ * @code
+ *   const char *str = "Hello,world|Thank,you";
+ *   qstrtok_t tok;
+ *   const char *token;
+ *   size_t toklen;
+ *   qstrtok_init(&tok, str, strlen(str), "|,");
+ *   while (qstrtok_next(&tok, &token, &toklen, NULL)) {
+ *     printf("%.*s\n", (int)toklen, token);
+ *   }
+ * @endcode
+ *
+ * @note
+ *  The source string must stay valid while tokens are used. Empty tokens
+ *  are returned the same way as qstrtok() does.
+ */
+bool qstrtok_init(qstrtok_t *tok, const char *str, size_t len,
+                  const char *delimiters) {
+    if (tok == NULL || (str == NULL && len > 0) || delimiters == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    memset((void *) tok, 0, sizeof(qstrtok_t));
+    tok->str = str;
+    tok->len = len;
+    const char *d;
+    for (d = delimiters; *d; d++) {
+        if (!DELIMAP_TEST(tok->delimap, *d)) {
+            DELIMAP_SET(tok->delimap, *d);
+            tok->firstdel = *d;
+            tok->numdel++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Get next token from the tokenizer.
+ *
+ * @param tok       tokenizer initialized by qstrtok_init().
+ * @param token     the pointer to the first byte of the token will be stored.
+ * @param toklen    the length of the token will be stored.
+ * @param retstop   stop delimiter character will be stored. it can be NULL
+ *                  if you don't want to know.
+ *
+ * @return true if a token is found, false when there are no more tokens.
+ */
+bool qstrtok_next(qstrtok_t *tok, const char **token, size_t *toklen,
+                  char *retstop) {
+    if (tok->offset >= tok->len) {
+        if (retstop != NULL)
+            *retstop = '\0';
+        return false;
+    }
+
+    const char *tokensp = tok->str + tok->offset;
+    const char *strend = tok->str + tok->len;
+    const char *tokenep;
+    if (tok->numdel == 1) {
+        // memchr() is vectorized by libc, so single delimiter like CSV is
+        // scanned at memory speed.
+        tokenep = memchr(tokensp, tok->firstdel, strend - tokensp);
+        if (tokenep == NULL)
+            tokenep = strend;
+    } else {
+        for (tokenep = tokensp;
+                tokenep < strend && !DELIMAP_TEST(tok->delimap, *tokenep);
+                tokenep++)
+            ;
+    }
+
+    *token = tokensp;
+    *toklen = tokenep - tokensp;
+    if (tokenep < strend) {
+        if (retstop != NULL)
+            *retstop = *tokenep;
+        tok->offset = (tokenep + 1) - tok->str;
+    } else {
+        if (retstop != NULL)
+            *retstop = '\0';
+        tok->offset = tok->len;
+    }
+
+    return true;
+}
+
 /**
  * Generate unique id
  *
@@ -891,3 +1097,225 @@ char *qstr_conv_encoding(const char *str, const char *fromcode,
     return NULL;
 #endif
 }
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Find needle using memchr() on the first byte as a filter. libc vectorizes
+ * memchr(), so sparse candidates are skipped at memory speed.
+ */
+static char *find_str(const char *str, size_t len, const char *needle,
+                      size_t needlelen) {
+    if (needlelen == 0 || needlelen > len)
+        return NULL;
+
+    const char *p = str, *last = str + (len - needlelen);
+    while (p <= last) {
+        p = memchr(p, needle[0], (last - p) + 1);
+        if (p == NULL)
+            return NULL;
+        if (!memcmp(p + 1, needle + 1, needlelen - 1))
+            return (char *) p;
+        p++;
+    }
+    return NULL;
+}
+
+static int actrie_child(actrie_t *ac, int node, unsigned char c) {
+    int ch;
+    for (ch = ac->nodes[node].child; ch >= 0; ch = ac->nodes[ch].sibling) {
+        if (ac->nodes[ch].c == c)
+            return ch;
+    }
+    return -1;
+}
+
+static int actrie_newnode(actrie_t *ac, int parent, unsigned char c) {
+    if (ac->num == ac->max) {
+        int newmax = ac->max * 2;
+        acnode_t *newnodes = (acnode_t *) realloc(ac->nodes,
+                                                  sizeof(acnode_t) * newmax);
+        if (newnodes == NULL)
+            return -1;
+        ac->nodes = newnodes;
+        ac->max = newmax;
+    }
+
+    int idx = ac->num++;
+    acnode_t *node = &ac->nodes[idx];
+    node->child = node->fail = node->dict = node->pattern = -1;
+    node->sibling = -1;
+    node->c = c;
+    node->depth = (parent >= 0) ? ac->nodes[parent].depth + 1 : 0;
+    if (parent >= 0) {
+        node->sibling = ac->nodes[parent].child;
+        ac->nodes[parent].child = idx;
+    }
+    return idx;
+}
+
+static bool actrie_build(actrie_t *ac, const char *tokstrs[],
+                         const char *words[], size_t num) {
+    memset((void *) ac, 0, sizeof(actrie_t));
+    ac->max = 64;
+    ac->nodes = (acnode_t *) malloc(sizeof(acnode_t) * ac->max);
+    ac->wordlens = (size_t *) malloc(sizeof(size_t) * (num + 1));
+    if (ac->nodes == NULL || ac->wordlens == NULL) {
+        actrie_free(ac);
+        errno = ENOMEM;
+        return false;
+    }
+    ac->words = words;
+    actrie_newnode(ac, -1, 0);
+
+    size_t i;
+    for (i = 0; i < num; i++) {
+        if (tokstrs[i] == NULL || words[i] == NULL) {
+            actrie_free(ac);
+            errno = EINVAL;
+            return false;
+        }
+        ac->wordlens[i] = strlen(words[i]);
+
+        int node = 0;
+        const unsigned char *p;
+        for (p = (const unsigned char *) tokstrs[i]; *p; p++) {
+            int ch = actrie_child(ac, node, *p);
+            if (ch < 0 && (ch = actrie_newnode(ac, node, *p)) < 0) {
+                actrie_free(ac);
+                errno = ENOMEM;
+                return false;
+            }
+            node = ch;
+        }
+        if (node > 0 && ac->nodes[node].pattern < 0) {
+            ac->nodes[node].pattern = i;
+            if (ac->nodes[node].depth > ac->maxdepth)
+                ac->maxdepth = ac->nodes[node].depth;
+        }
+    }
+
+    // Breadth-first walk to set failure and dictionary links.
+    int *queue = (int *) malloc(sizeof(int) * ac->num);
+    if (queue == NULL) {
+        actrie_free(ac);
+        errno = ENOMEM;
+        return false;
+    }
+    int head = 0, tail = 0, ch;
+    for (i = 0; i < 256; i++) {
+        ac->rootnext[i] = 0;
+    }
+    for (ch = ac->nodes[0].child; ch >= 0; ch = ac->nodes[ch].sibling) {
+        ac->nodes[ch].fail = 0;
+        ac->rootnext[ac->nodes[ch].c] = ch;
+        queue[tail++] = ch;
+    }
+    while (head < tail) {
+        int node = queue[head++];
+        for (ch = ac->nodes[node].child; ch >= 0; ch = ac->nodes[ch].sibling) {
+            unsigned char c = ac->nodes[ch].c;
+            int f = ac->nodes[node].fail, next = 0;
+            while (f > 0 && (next = actrie_child(ac, f, c)) < 0) {
+                f = ac->nodes[f].fail;
+            }
+            if (f == 0) {
+                next = ac->rootnext[c];
+            }
+            ac->nodes[ch].fail = next;
+            ac->nodes[ch].dict = (ac->nodes[next].pattern >= 0) ?
+                    next : ac->nodes[next].dict;
+            queue[tail++] = ch;
+        }
+    }
+    free(queue);
+
+    return true;
+}
+
+/*
+ * Run the automaton over str and write the replaced string into out, or
+ * only compute its length when out is NULL.
+ *
+ * Every match is recorded in a ring indexed by its start position, keeping
+ * the longest one per start. A start is settled once the automaton depth
+ * shows that no future match can begin there. Settled starts are resolved
+ * from left to right, so the result is leftmost-longest and non-overlapping
+ * while the scan stays linear.
+ */
+static ssize_t actrie_replace(actrie_t *ac, const char *str, size_t len,
+                              char *out) {
+    size_t ringsize = ac->maxdepth + 1;
+    int *best = (int *) malloc(sizeof(int) * ringsize);
+    if (best == NULL)
+        return -1;
+    size_t i;
+    for (i = 0; i < ringsize; i++) {
+        best[i] = -1;
+    }
+
+    acnode_t *nodes = ac->nodes;
+    size_t outlen = 0, copied = 0, scanpos = 0, pos;
+    int state = 0;
+    for (pos = 0; pos <= len; pos++) {
+        size_t bound = len;
+        if (pos < len) {
+            unsigned char c = (unsigned char) str[pos];
+            int next = -1;
+            while (state > 0 && (next = actrie_child(ac, state, c)) < 0) {
+                state = nodes[state].fail;
+            }
+            state = (state > 0) ? next : ac->rootnext[c];
+
+            int m = (nodes[state].pattern >= 0) ? state : nodes[state].dict;
+            for (; m >= 0; m = nodes[m].dict) {
+                size_t start = pos + 1 - nodes[m].depth;
+                if (start < scanpos)
+                    continue;
+                int *slot = &best[start % ringsize];
+                if (*slot < 0 || nodes[m].depth > nodes[*slot].depth)
+                    *slot = m;
+            }
+            bound = pos + 1 - nodes[state].depth;
+        }
+
+        while (scanpos < bound) {
+            int m = best[scanpos % ringsize];
+            best[scanpos % ringsize] = -1;
+            if (m < 0) {
+                scanpos++;
+                continue;
+            }
+
+            int pattern = nodes[m].pattern;
+            size_t wordlen = ac->wordlens[pattern];
+            if (out != NULL) {
+                memcpy(out + outlen, str + copied, scanpos - copied);
+                memcpy(out + outlen + (scanpos - copied), ac->words[pattern],
+                       wordlen);
+            }
+            outlen += (scanpos - copied) + wordlen;
+            size_t newpos = scanpos + nodes[m].depth;
+            for (scanpos++; scanpos < newpos; scanpos++) {
+                best[scanpos % ringsize] = -1;
+            }
+            copied = scanpos;
+        }
+    }
+    free(best);
+
+    if (out != NULL)
+        memcpy(out + outlen, str + copied, len - copied);
+    outlen += len - copied;
+
+    return outlen;
+}
+
+static void actrie_free(actrie_t *ac) {
+    free(ac->nodes);
+    free(ac->wordlens);
+    ac->nodes = NULL;
+    ac->wordlens = NULL;
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -0,0 +1,599 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+/*
+ * Loopback HTTP/1.1 server for the client tests. Each connection is
+ * served by a thread of its own, and pipelined requests are answered in
+ * order. With ENABLE_OPENSSL it can speak TLS with a self-signed
+ * certificate made at start, and with ENABLE_ZLIB it can compress.
+ */
+
+#ifndef TEST_HTTPD_H
+#define TEST_HTTPD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ENABLE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#endif
+
+#define HTTPD_BUFSIZE   (64 * 1024)
+
+typedef struct httpd_s httpd_t;
+typedef struct httpd_conn_s httpd_conn_t;
+
+struct httpd_s {
+    int lfd;
+    int port;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int naccepted;      /* connections accepted */
+    int nrequests;      /* requests served */
+    int maxrequests;    /* requests served per connection, 0 for no limit */
+#ifdef ENABLE_OPENSSL
+    SSL_CTX *sslctx;    /* NULL for plain HTTP */
+    int nhandshakes;    /* TLS handshakes done */
+    int nresumed;       /* of which resumed a session */
+#endif
+};
+
+struct httpd_conn_s {
+    httpd_t *httpd;
+    int fd;
+    int nth;            /* requests served before on the connection */
+#ifdef ENABLE_OPENSSL
+    SSL *ssl;
+#endif
+};
+
+// Add to a counter and return it.
+static int httpd_count(httpd_t *httpd, int *counter, int add) {
+    pthread_mutex_lock(&httpd->lock);
+    int n = (*counter += add);
+    pthread_mutex_unlock(&httpd->lock);
+    return n;
+}
+
+// Find a request header. Returns the length of the value, -1 if not found.
+static int httpd_header(const char *head, const char *name, char *value,
+                        size_t size) {
+    size_t namelen = strlen(name);
+    const char *line = strstr(head, "\r\n");
+    while (line != NULL) {
+        line += 2;
+        if (!strncasecmp(line, name, namelen) && line[namelen] == ':') {
+            const char *v = line + namelen + 1;
+            while (*v == ' ')
+                v++;
+            size_t len = strcspn(v, "\r");
+            if (len >= size)
+                len = size - 1;
+            memcpy(value, v, len);
+            value[len] = '\0';
+            return (int) len;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return -1;
+}
+
+static ssize_t httpd_recv(httpd_conn_t *conn, void *buf, size_t size) {
+#ifdef ENABLE_OPENSSL
+    if (conn->ssl != NULL)
+        return SSL_read(conn->ssl, buf, (int) size);
+#endif
+    return recv(conn->fd, buf, size, 0);
+}
+
+static bool httpd_send(httpd_conn_t *conn, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size > 0) {
+        ssize_t n;
+#ifdef ENABLE_OPENSSL
+        if (conn->ssl != NULL) {
+            n = SSL_write(conn->ssl, p, (int) size);
+        } else {
+            n = send(conn->fd, p, size, MSG_NOSIGNAL);
+        }
+#else
+        n = send(conn->fd, p, size, MSG_NOSIGNAL);
+#endif
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Send a response with Content-Length. headers are extra lines ending with
+// CRLF, or NULL.
+static bool httpd_reply(httpd_conn_t *conn, int status, const char *headers,
+                        const void *body, size_t size, bool headonly) {
+    char head[256];
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\n",
+                       status, (status < 300) ? "OK" : "Error", size);
+    if (httpd_send(conn, head, len) == false
+            || (headers != NULL
+                    && httpd_send(conn, headers, strlen(headers)) == false)
+            || httpd_send(conn, "\r\n", 2) == false) {
+        return false;
+    }
+    return (headonly == true || httpd_send(conn, body, size) == true);
+}
+
+// Fill buf with the bytes of a /blob from the given offset.
+static void httpd_blob(char *buf, size_t offset, size_t size) {
+    size_t i;
+    for (i = 0; i < size; i++) {
+        size_t at = offset + i;
+        buf[i] = (char) (at * 31 + at / 4096);
+    }
+}
+
+// Answer /blob/SIZE[/norange|/break]. Ranges are served with 206 unless
+// norange, and with break a range starting on a 64KB boundary is cut off
+// after 100000 bytes, so only the resumed request gets all of it.
+static bool httpd_serve_blob(httpd_conn_t *conn, const char *path,
+                             const char *head, bool headonly) {
+    char *opt;
+    size_t size = strtoul(path, &opt, 10);
+    bool ranges = (strcmp(opt, "/norange") != 0);
+    bool broken = (strcmp(opt, "/break") == 0);
+
+    size_t start = 0, end = size - 1;
+    char value[64], headers[128] = "";
+    if (ranges == true) {
+        strcpy(headers, "Accept-Ranges: bytes\r\n");
+        unsigned long a, b;
+        if (httpd_header(head, "Range", value, sizeof(value)) > 0
+                && sscanf(value, "bytes=%lu-%lu", &a, &b) == 2) {
+            if (a > b || b >= size)
+                return httpd_reply(conn, 416, NULL, "", 0, headonly);
+            start = a;
+            end = b;
+            snprintf(headers, sizeof(headers),
+                     "Accept-Ranges: bytes\r\n"
+                     "Content-Range: bytes %zu-%zu/%zu\r\n",
+                     start, end, size);
+        }
+    }
+    int status = (end - start + 1 < size) ? 206 : 200;
+
+    size_t len = end - start + 1;
+    char *body = (char *) malloc(len);
+    if (body == NULL)
+        return false;
+    httpd_blob(body, start, len);
+    bool ok;
+    if (broken == true && status == 206 && start % (64 * 1024) == 0
+            && len > 100000) {
+        // the whole length is promised but the connection is closed early
+        if (httpd_reply(conn, status, headers, body, len, true) == true)
+            httpd_send(conn, body, 100000);
+        ok = false;
+    } else {
+        ok = httpd_reply(conn, status, headers, body, len, headonly);
+    }
+    free(body);
+    return ok;
+}
+
+// Send a response with chunked transfer coding, in chunks of up to 1000
+// bytes.
+static bool httpd_reply_chunked(httpd_conn_t *conn, int status,
+                                const char *headers, const void *body,
+                                size_t size, bool headonly) {
+    char line[256];
+    int len = snprintf(line, sizeof(line),
+                       "HTTP/1.1 %d %s\r\nTransfer-Encoding: chunked\r\n",
+                       status, (status < 300) ? "OK" : "Error");
+    if (httpd_send(conn, line, len) == false
+            || (headers != NULL
+                    && httpd_send(conn, headers, strlen(headers)) == false)
+            || httpd_send(conn, "\r\n", 2) == false) {
+        return false;
+    }
+    if (headonly == true)
+        return true;
+
+    const char *p = (const char *) body;
+    while (size > 0) {
+        size_t n = (size > 1000) ? 1000 : size;
+        len = snprintf(line, sizeof(line), "%zx\r\n", n);
+        if (httpd_send(conn, line, len) == false
+                || httpd_send(conn, p, n) == false
+                || httpd_send(conn, "\r\n", 2) == false) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return httpd_send(conn, "0\r\n\r\n", 5);
+}
+
+// Fill buf with the text of a /gzip or /deflate response.
+static void httpd_text(char *buf, size_t size) {
+    size_t i;
+    for (i = 0; i < size; i++) {
+        buf[i] = 'a' + (i / 7 + i % 5) % 26;
+    }
+}
+
+#ifdef ENABLE_ZLIB
+// Compress into a malloced buffer, gzip or zlib wrapped.
+static char *httpd_compress(const char *data, size_t size, bool gzip,
+                            size_t *outlen) {
+    z_stream zs;
+    memset((void *) &zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     (gzip == true) ? MAX_WBITS + 16 : MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t bound = deflateBound(&zs, size);
+    char *out = (char *) malloc(bound);
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef *) out;
+    zs.avail_out = bound;
+    if (out == NULL || deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        free(out);
+        out = NULL;
+    }
+    *outlen = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+#endif
+
+// Answer /gzip/SIZE[/chunked] and /deflate/SIZE[/chunked] with the text of
+// the size, compressed if the client accepts the encoding.
+static bool httpd_serve_text(httpd_conn_t *conn, const char *encoding,
+                             const char *path, const char *head,
+                             bool headonly) {
+    char *opt;
+    size_t size = strtoul(path, &opt, 10);
+    bool chunked = (strcmp(opt, "/chunked") == 0);
+
+    char *body = (char *) malloc(size + 1);
+    if (body == NULL)
+        return false;
+    httpd_text(body, size);
+
+    char headers[64] = "";
+#ifdef ENABLE_ZLIB
+    char value[256];
+    if (httpd_header(head, "Accept-Encoding", value, sizeof(value)) > 0
+            && strstr(value, encoding) != NULL) {
+        char *zbody = httpd_compress(body, size, !strcmp(encoding, "gzip"),
+                                     &size);
+        free(body);
+        if (zbody == NULL)
+            return false;
+        body = zbody;
+        snprintf(headers, sizeof(headers), "Content-Encoding: %s\r\n",
+                 encoding);
+    }
+#endif
+
+    bool ok;
+    if (chunked == true) {
+        ok = httpd_reply_chunked(conn, 200, headers, body, size, headonly);
+    } else {
+        ok = httpd_reply(conn, 200, headers, body, size, headonly);
+    }
+    free(body);
+    return ok;
+}
+
+// Answer a request. Returns false to close the connection.
+static bool httpd_serve(httpd_conn_t *conn, const char *method,
+                        const char *path, const char *head) {
+    bool headonly = (strcmp(method, "HEAD") == 0);
+
+    if (!strcmp(path, "/hello")) {
+        return httpd_reply(conn, 200, NULL, "hello", 5, headonly);
+    }
+    if (!strncmp(path, "/seq/", 5)) {
+        // echoes the number back
+        return httpd_reply(conn, 200, NULL, path + 5, strlen(path + 5),
+                           headonly);
+    }
+    if (!strcmp(path, "/echo")) {
+        // echoes the X-Echo header back
+        char value[HTTPD_BUFSIZE / 2];
+        int len = httpd_header(head, "X-Echo", value, sizeof(value));
+        if (len < 0)
+            len = 0;
+        return httpd_reply(conn, 200, NULL, value, len, headonly);
+    }
+    if (!strncmp(path, "/bighead/", 9)) {
+        // a head padded with X-Fill headers to about the given size
+        size_t size = strtoul(path + 9, NULL, 10);
+        char *headers = (char *) malloc(size + 128);
+        size_t len = 0;
+        int i;
+        for (i = 0; len < size; i++) {
+            len += sprintf(headers + len, "X-Fill-%d: %0100d\r\n", i, i);
+        }
+        bool ok = httpd_reply(conn, 200, headers, "big", 3, headonly);
+        free(headers);
+        return ok;
+    }
+    if (!strcmp(path, "/nolength")) {
+        // no Content-Length, the body goes on until the connection closes
+        const char *res = "HTTP/1.1 200 OK\r\n\r\n";
+        if (httpd_send(conn, res, strlen(res)) == false)
+            return false;
+        if (headonly == true)
+            return true;
+        httpd_send(conn, "nolength", 8);
+        return false;
+    }
+    if (!strcmp(path, "/close")) {
+        return false;  // closes without an answer
+    }
+    if (!strcmp(path, "/fresh")) {
+        // answered on new connections only, like a stale keep-alive
+        if (conn->nth > 0)
+            return false;
+        return httpd_reply(conn, 200, NULL, "fresh", 5, headonly);
+    }
+    if (!strncmp(path, "/gzip/", 6)) {
+        return httpd_serve_text(conn, "gzip", path + 6, head, headonly);
+    }
+    if (!strncmp(path, "/deflate/", 9)) {
+        return httpd_serve_text(conn, "deflate", path + 9, head, headonly);
+    }
+    if (!strncmp(path, "/blob/", 6)) {
+        return httpd_serve_blob(conn, path + 6, head, headonly);
+    }
+    if (!strncmp(path, "/sleep/", 7)) {
+        usleep(atoi(path + 7) * 1000);
+        return httpd_reply(conn, 200, NULL, "slept", 5, headonly);
+    }
+    return httpd_reply(conn, 404, NULL, "", 0, headonly);
+}
+
+static void *httpd_conn_main(void *arg) {
+    httpd_conn_t *conn = (httpd_conn_t *) arg;
+    httpd_t *httpd = conn->httpd;
+
+    char *buf = (char *) malloc(HTTPD_BUFSIZE);
+    size_t len = 0;
+
+#ifdef ENABLE_OPENSSL
+    if (httpd->sslctx != NULL) {
+        conn->ssl = SSL_new(httpd->sslctx);
+        SSL_set_fd(conn->ssl, conn->fd);
+        if (SSL_accept(conn->ssl) != 1)
+            goto done;
+        httpd_count(httpd, &httpd->nhandshakes, 1);
+        if (SSL_session_reused(conn->ssl))
+            httpd_count(httpd, &httpd->nresumed, 1);
+    }
+#endif
+
+    while (buf != NULL) {
+        // a request head
+        char *end;
+        buf[len] = '\0';
+        while ((end = strstr(buf, "\r\n\r\n")) == NULL) {
+            if (len >= HTTPD_BUFSIZE - 1)
+                goto done;
+            ssize_t n = httpd_recv(conn, buf + len, HTTPD_BUFSIZE - 1 - len);
+            if (n <= 0)
+                goto done;
+            len += n;
+            buf[len] = '\0';
+        }
+        end[2] = '\0';
+        size_t headlen = end + 4 - buf;
+
+        // and its body, which is thrown away
+        char value[32];
+        size_t bodylen = 0;
+        if (httpd_header(buf, "Content-Length", value, sizeof(value)) > 0)
+            bodylen = strtoul(value, NULL, 10);
+        if (headlen + bodylen >= HTTPD_BUFSIZE)
+            goto done;
+        while (len < headlen + bodylen) {
+            ssize_t n = httpd_recv(conn, buf + len, headlen + bodylen - len);
+            if (n <= 0)
+                goto done;
+            len += n;
+        }
+
+        char method[16], path[1024];
+        if (sscanf(buf, "%15s %1023s", method, path) != 2)
+            break;
+        httpd_count(httpd, &httpd->nrequests, 1);
+        if (httpd_serve(conn, method, path, buf) == false)
+            break;
+        conn->nth++;
+        if (httpd->maxrequests > 0 && conn->nth >= httpd->maxrequests)
+            break;
+
+        len -= headlen + bodylen;
+        memmove(buf, buf + headlen + bodylen, len);
+    }
+
+done:
+#ifdef ENABLE_OPENSSL
+    if (conn->ssl != NULL) {
+        SSL_shutdown(conn->ssl);
+        SSL_free(conn->ssl);
+    }
+#endif
+    // let the client read what was sent before the connection goes away
+    shutdown(conn->fd, SHUT_WR);
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (buf != NULL && recv(conn->fd, buf, HTTPD_BUFSIZE, 0) > 0)
+        ;
+    close(conn->fd);
+    free(buf);
+    free(conn);
+    return NULL;
+}
+
+static void *httpd_main(void *arg) {
+    httpd_t *httpd = (httpd_t *) arg;
+    while (true) {
+        int fd = accept(httpd->lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;  // stopped
+        }
+        httpd_count(httpd, &httpd->naccepted, 1);
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        httpd_conn_t *conn = (httpd_conn_t *) calloc(1, sizeof(httpd_conn_t));
+        conn->httpd = httpd;
+        conn->fd = fd;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, httpd_conn_main, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+#ifdef ENABLE_OPENSSL
+// Make a server context with a fresh self-signed certificate.
+static SSL_CTX *httpd_sslctx(void) {
+    EVP_PKEY *pkey = NULL;
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (pctx == NULL || EVP_PKEY_keygen_init(pctx) <= 0
+            || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(
+                    pctx, NID_X9_62_prime256v1) <= 0
+            || EVP_PKEY_keygen(pctx, &pkey) <= 0) {
+        EVP_PKEY_CTX_free(pctx);
+        return NULL;
+    }
+    EVP_PKEY_CTX_free(pctx);
+
+    X509 *cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, pkey);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char *) "127.0.0.1", -1, -1,
+                               0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, pkey, EVP_sha256());
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx != NULL && (SSL_CTX_use_certificate(ctx, cert) != 1
+            || SSL_CTX_use_PrivateKey(ctx, pkey) != 1)) {
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+    }
+    if (ctx != NULL) {
+        // stateful tickets, which the server takes back once used
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "httpd",
+                                       5);
+    }
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    return ctx;
+}
+#endif
+
+// Start listening on an ephemeral loopback port, speaking TLS if tls is
+// true, which needs ENABLE_OPENSSL.
+static bool httpd_start(httpd_t *httpd, bool tls) {
+    memset((void *) httpd, 0, sizeof(httpd_t));
+    pthread_mutex_init(&httpd->lock, NULL);
+
+    if (tls == true) {
+#ifdef ENABLE_OPENSSL
+        httpd->sslctx = httpd_sslctx();
+        if (httpd->sslctx == NULL)
+            return false;
+#else
+        return false;
+#endif
+    }
+
+    struct sockaddr_in addr;
+    memset((void *) &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+
+    httpd->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (httpd->lfd < 0
+            || bind(httpd->lfd, (struct sockaddr *) &addr, addrlen) != 0
+            || listen(httpd->lfd, 64) != 0
+            || getsockname(httpd->lfd, (struct sockaddr *) &addr, &addrlen)
+                    != 0) {
+        return false;
+    }
+    httpd->port = ntohs(addr.sin_port);
+
+    return (pthread_create(&httpd->thread, NULL, httpd_main, httpd) == 0);
+}
+
+// Stop accepting. Connections being served finish on their own, so the
+// TLS context is left to the process exit.
+static void httpd_stop(httpd_t *httpd) {
+    shutdown(httpd->lfd, SHUT_RDWR);
+    pthread_join(httpd->thread, NULL);
+    close(httpd->lfd);
+}
+
+#endif /* TEST_HTTPD_H */
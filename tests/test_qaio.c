@@ -0,0 +1,228 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qaio.c");
+
+int reap_one(qaio_t *aio, qaio_event_t *event, int timeoutms) {
+    return qaio_reap(aio, event, 1, timeoutms);
+}
+
+void test_readwrite(int options) {
+    qaio_t *aio = qaio(16, options);
+    ASSERT_NOT_NULL(aio);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    char buf[64];
+    ASSERT_TRUE(qaio_read(aio, sv[0], buf, sizeof(buf), -1, buf));
+    ASSERT_TRUE(qaio_write(aio, sv[1], "hello", 5, 1000, sv));
+    ASSERT_EQUAL_INT(2, qaio_inflight(aio));
+
+    int got = 0;
+    while (got < 2) {
+        qaio_event_t event;
+        ASSERT_EQUAL_INT(1, reap_one(aio, &event, 1000));
+        if (event.op == QAIO_READ) {
+            ASSERT_EQUAL_PT(buf, event.userdata);
+            ASSERT_EQUAL_INT(sv[0], event.fd);
+            ASSERT_EQUAL_INT(5, event.result);
+            ASSERT_EQUAL_MEM("hello", buf, 5);
+        } else {
+            ASSERT_EQUAL_INT(QAIO_WRITE, event.op);
+            ASSERT_EQUAL_INT(5, event.result);
+        }
+        got++;
+    }
+    ASSERT_EQUAL_INT(0, qaio_inflight(aio));
+
+    // nothing in flight
+    qaio_event_t event;
+    ASSERT_EQUAL_INT(0, qaio_reap(aio, &event, 1, 1000));
+
+    close(sv[0]);
+    close(sv[1]);
+    qaio_free(aio);
+}
+
+void test_timeout(int options) {
+    qaio_t *aio = qaio(16, options);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    char buf[64];
+    ASSERT_TRUE(qaio_read(aio, sv[0], buf, sizeof(buf), 50, NULL));
+    qaio_event_t event;
+    ASSERT_EQUAL_INT(0, reap_one(aio, &event, 0));
+    ASSERT_EQUAL_INT(1, reap_one(aio, &event, 5000));
+    ASSERT_EQUAL_INT(-ETIMEDOUT, event.result);
+
+    close(sv[0]);
+    close(sv[1]);
+    qaio_free(aio);
+}
+
+void test_large_write(int options) {
+    qaio_t *aio = qaio(16, options);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+    // larger than the socket buffer, needs partial write resumption.
+    size_t size = 4 * 1024 * 1024;
+    char *data = malloc(size);
+    char *recv = malloc(size);
+    size_t i;
+    for (i = 0; i < size; i++)
+        data[i] = i % 251;
+    ASSERT_TRUE(qaio_write(aio, sv[1], data, size, 1000, NULL));
+
+    size_t received = 0;
+    bool written = false, reading = false;
+    while (received < size || written == false) {
+        if (received < size && reading == false) {
+            ASSERT_TRUE(qaio_read(aio, sv[0], recv + received,
+                                  size - received, 1000, NULL));
+            reading = true;
+        }
+        qaio_event_t event;
+        ASSERT_EQUAL_INT(1, reap_one(aio, &event, 1000));
+        ASSERT(event.result > 0);
+        if (event.op == QAIO_WRITE) {
+            ASSERT_EQUAL_INT(size, event.result);
+            written = true;
+        } else {
+            received += event.result;
+            reading = false;
+        }
+    }
+    ASSERT_EQUAL_MEM(data, recv, size);
+
+    free(data);
+    free(recv);
+    close(sv[0]);
+    close(sv[1]);
+    qaio_free(aio);
+}
+
+void test_accept_connect(int options) {
+    qaio_t *aio = qaio(16, options);
+
+    int lsock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQUAL_INT(0, bind(lsock, (struct sockaddr *) &addr, sizeof(addr)));
+    socklen_t addrlen = sizeof(addr);
+    getsockname(lsock, (struct sockaddr *) &addr, &addrlen);
+    ASSERT_EQUAL_INT(0, listen(lsock, 8));
+
+    int csock = socket(AF_INET, SOCK_STREAM, 0);
+    fcntl(csock, F_SETFL, fcntl(csock, F_GETFL) | O_NONBLOCK);
+    ASSERT_TRUE(qaio_accept(aio, lsock, 1000, NULL));
+    ASSERT_TRUE(qaio_connect(aio, csock, (struct sockaddr *) &addr, addrlen,
+                             1000, NULL));
+
+    int accepted = -1, got = 0;
+    while (got < 2) {
+        qaio_event_t event;
+        ASSERT_EQUAL_INT(1, reap_one(aio, &event, 1000));
+        if (event.op == QAIO_ACCEPT) {
+            ASSERT(event.result >= 0);
+            accepted = event.result;
+        } else {
+            ASSERT_EQUAL_INT(QAIO_CONNECT, event.op);
+            ASSERT_EQUAL_INT(0, event.result);
+        }
+        got++;
+    }
+
+    // file transfer over the connection.
+    char path[] = "/tmp/test_qaio.XXXXXX";
+    int filefd = mkstemp(path);
+    ASSERT_EQUAL_INT(26, write(filefd, "abcdefghijklmnopqrstuvwxyz", 26));
+    ASSERT_TRUE(qaio_sendfile(aio, accepted, filefd, 10, 100, 1000, NULL));
+    qaio_event_t event;
+    ASSERT_EQUAL_INT(1, reap_one(aio, &event, 1000));
+    ASSERT_EQUAL_INT(QAIO_SENDFILE, event.op);
+    ASSERT_EQUAL_INT(16, event.result);
+    char buf[32];
+    ASSERT_EQUAL_INT(16, qio_read(csock, buf, 16, 1000));
+    ASSERT_EQUAL_MEM("klmnopqrstuvwxyz", buf, 16);
+
+    close(filefd);
+    unlink(path);
+    close(accepted);
+    close(csock);
+    close(lsock);
+    qaio_free(aio);
+}
+
+TEST("qaio: read and write") {
+    test_readwrite(0);
+    test_readwrite(QAIO_USE_EPOLL);
+}
+
+TEST("qaio: timeout") {
+    test_timeout(0);
+    test_timeout(QAIO_USE_EPOLL);
+}
+
+TEST("qaio: partial write resumption") {
+    test_large_write(0);
+    test_large_write(QAIO_USE_EPOLL);
+}
+
+TEST("qaio: accept, connect and sendfile") {
+    test_accept_connect(0);
+    test_accept_connect(QAIO_USE_EPOLL);
+}
+
+TEST("qaio: depth limit") {
+    qaio_t *aio = qaio(1, 0);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    char buf[8];
+    ASSERT_TRUE(qaio_read(aio, sv[0], buf, sizeof(buf), -1, NULL));
+    ASSERT_FALSE(qaio_read(aio, sv[1], buf, sizeof(buf), -1, NULL));
+    ASSERT_EQUAL_INT(EBUSY, errno);
+    close(sv[0]);
+    close(sv[1]);
+    qaio_free(aio);
+}
+
+QUNIT_END();
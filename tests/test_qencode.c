@@ -0,0 +1,217 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// Bit-by-bit reference encoders to check the vectorized paths against.
+static void ref_base64(char *out, const unsigned char *in, size_t size) {
+    const char *tbl =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i, bits = size * 8, n = 0;
+    for (i = 0; i < bits; i += 6) {
+        int v = 0, b;
+        for (b = 0; b < 6; b++) {
+            size_t bit = i + b;
+            v <<= 1;
+            if (bit < bits) {
+                v |= (in[bit / 8] >> (7 - (bit % 8))) & 1;
+            }
+        }
+        out[n++] = tbl[v];
+    }
+    while (n % 4) out[n++] = '=';
+    out[n] = '\0';
+}
+
+static void ref_hex(char *out, const unsigned char *in, size_t size) {
+    size_t i;
+    for (i = 0; i < size; i++) {
+        sprintf(out + i * 2, "%02x", in[i]);
+    }
+    out[size * 2] = '\0';
+}
+
+static void ref_url(char *out, const unsigned char *in, size_t size) {
+    const char *safe = "-./0123456789:@ABCDEFGHIJKLMNOPQRSTUVWXYZ\\_"
+            "abcdefghijklmnopqrstuvwxyz";
+    size_t i;
+    for (i = 0; i < size; i++) {
+        if (in[i] != '\0' && strchr(safe, in[i]) != NULL) {
+            *out++ = in[i];
+        } else {
+            out += sprintf(out, "%%%02x", in[i]);
+        }
+    }
+    *out = '\0';
+}
+
+QUNIT_START("Test qencode.c");
+
+TEST("qurl_encode()/qurl_decode()") {
+    unsigned char data[600];
+    char ref[1801];
+    size_t i, size;
+    // long safe runs broken by every byte value to cross block boundaries.
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (i % 7 == 6) ? (unsigned char) (i / 7 * 3) : 'a' + (i % 26);
+    }
+
+    for (size = 0; size <= sizeof(data); size += 37) {
+        ref_url(ref, data, size);
+        char *enc = qurl_encode(data, size);
+        ASSERT_EQUAL_STR(ref, enc);
+        ASSERT_EQUAL_INT(size, qurl_decode(enc));
+        ASSERT_EQUAL_MEM(data, enc, size);
+        free(enc);
+    }
+
+    char str[] = "hello+%27qLibc%27%20world%4";
+    ASSERT_EQUAL_INT(21, qurl_decode(str));
+    ASSERT_EQUAL_STR("hello 'qLibc' world%4", str);
+}
+
+TEST("qparse_queries()") {
+    int count = 0;
+    qlisttbl_t *tbl = qparse_queries(NULL, " a =1&b=hello+world&c&d=%41%42",
+                                     '=', '&', &count);
+    ASSERT_EQUAL_INT(4, count);
+    ASSERT_EQUAL_STR("1", tbl->getstr(tbl, "a", false));
+    ASSERT_EQUAL_STR("hello world", tbl->getstr(tbl, "b", false));
+    ASSERT_EQUAL_STR("", tbl->getstr(tbl, "c", false));
+    ASSERT_EQUAL_STR("AB", tbl->getstr(tbl, "d", false));
+    tbl->free(tbl);
+}
+
+TEST("qparse_queries_view()") {
+    char query[] = "category=love&str=hello%20world&sort=asc&q=a+b";
+    const char *orig = "category=love&str=hello%20world&sort=asc&q=a+b";
+    size_t len = strlen(query);
+    qquery_t e[4];
+
+    ASSERT_EQUAL_INT(4, qparse_queries_view(query, len, '=', '&', NULL, 0));
+    ASSERT_EQUAL_STR(orig, query);
+
+    // stops when the array is full and leaves the rest as it is.
+    ASSERT_EQUAL_INT(1, qparse_queries_view(query, len, '=', '&', e, 1));
+    ASSERT_EQUAL_STR(orig, query);
+
+    ASSERT_EQUAL_INT(4, qparse_queries_view(query, len, '=', '&', e, 4));
+    ASSERT_EQUAL_PT(query, e[0].name);
+    ASSERT_EQUAL_INT(8, e[0].namelen);
+    ASSERT_EQUAL_PT(query + 9, e[0].value);
+    ASSERT_EQUAL_INT(4, e[0].valuelen);
+    ASSERT_EQUAL_INT(11, e[1].valuelen);
+    ASSERT_EQUAL_MEM("hello world", e[1].value, 11);
+    ASSERT_EQUAL_MEM("sort", e[2].name, 4);
+    ASSERT_EQUAL_MEM("asc", e[2].value, 3);
+    ASSERT_EQUAL_MEM("a b", e[3].value, 3);
+    ASSERT_EQUAL_INT(3, e[3].valuelen);
+}
+
+TEST("qbase64_encode()/qbase64_decode()") {
+    char *enc = qbase64_encode("hello world", 11);
+    ASSERT_EQUAL_STR("aGVsbG8gd29ybGQ=", enc);
+    ASSERT_EQUAL_INT(11, qbase64_decode(enc));
+    ASSERT_EQUAL_STR("hello world", enc);
+    free(enc);
+
+    char str[] = "aGVs\r\nbG8g\nd29y bGQ=";
+    ASSERT_EQUAL_INT(11, qbase64_decode(str));
+    ASSERT_EQUAL_STR("hello world", str);
+}
+
+TEST("qbase64_encode_buf()/qbase64_decode_buf() against reference") {
+    unsigned char data[300], dec[300];
+    char enc[512], ref[512];
+    size_t i, size;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char) (i * 131 + 7);
+    }
+
+    for (size = 0; size <= sizeof(data); size++) {
+        ref_base64(ref, data, size);
+        ASSERT_EQUAL_INT(strlen(ref) + 1, qbase64_encode_len(size));
+        ASSERT_EQUAL_INT(strlen(ref),
+                         qbase64_encode_buf(enc, qbase64_encode_len(size),
+                                            data, size));
+        ASSERT_EQUAL_STR(ref, enc);
+
+        size_t enclen = strlen(enc);
+        ASSERT_TRUE(qbase64_decode_len(enclen) >= size);
+        ASSERT_EQUAL_INT(size, qbase64_decode_buf(dec, qbase64_decode_len(
+                enclen), enc, enclen));
+        ASSERT_EQUAL_MEM(data, dec, size);
+
+        // in-place
+        ASSERT_EQUAL_INT(size, qbase64_decode(enc));
+        ASSERT_EQUAL_MEM(data, enc, size);
+    }
+}
+
+TEST("qbase64_encode_buf() with small buffer") {
+    char buf[8];
+    errno = 0;
+    ASSERT_EQUAL_INT(-1, qbase64_encode_buf(buf, sizeof(buf), "hello", 6));
+    ASSERT_EQUAL_INT(ENOBUFS, errno);
+    ASSERT_EQUAL_INT(-1, qbase64_decode_buf(buf, 2, "aGVsbG8=", 8));
+    ASSERT_EQUAL_INT(ENOBUFS, errno);
+}
+
+TEST("qhex_encode_buf()/qhex_decode_buf() against reference") {
+    unsigned char data[300], dec[300];
+    char enc[601], ref[601];
+    size_t i, size;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char) (i * 131 + 7);
+    }
+
+    for (size = 0; size <= sizeof(data); size++) {
+        ref_hex(ref, data, size);
+        ASSERT_EQUAL_INT(size * 2,
+                         qhex_encode_buf(enc, sizeof(enc), data, size));
+        ASSERT_EQUAL_STR(ref, enc);
+
+        // upper case digits decode the same
+        char *upper = qstrupper(strdup(enc));
+        ASSERT_EQUAL_INT(size, qhex_decode_buf(dec, sizeof(dec), upper,
+                                               size * 2));
+        ASSERT_EQUAL_MEM(data, dec, size);
+        free(upper);
+
+        ASSERT_EQUAL_INT(size, qhex_decode(enc));
+        ASSERT_EQUAL_MEM(data, enc, size);
+    }
+
+    char *enc2 = qhex_encode("hello world", 11);
+    ASSERT_EQUAL_STR("68656c6c6f20776f726c64", enc2);
+    free(enc2);
+}
+
+QUNIT_END();
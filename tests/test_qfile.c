@@ -0,0 +1,207 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static char *make_tempfile(const void *data, size_t size) {
+    char *path = strdup("/tmp/test_qfile.XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+    ssize_t written = write(fd, data, size);
+    close(fd);
+    if (written != (ssize_t) size) {
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+QUNIT_START("Test qfile.c");
+
+TEST("qfile_load()") {
+    char data[100000];
+    size_t i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = 'a' + (i % 26);
+    }
+    char *path = make_tempfile(data, sizeof(data));
+    ASSERT_NOT_NULL(path);
+
+    size_t nbytes = 0;
+    char *buf = qfile_load(path, &nbytes);
+    ASSERT_EQUAL_INT(sizeof(data), nbytes);
+    ASSERT_EQUAL_MEM(data, buf, sizeof(data));
+    ASSERT_EQUAL_INT('\0', buf[nbytes]);
+    free(buf);
+
+    nbytes = 10;
+    buf = qfile_load(path, &nbytes);
+    ASSERT_EQUAL_INT(10, nbytes);
+    ASSERT_EQUAL_STR("abcdefghij", buf);
+    free(buf);
+
+    unlink(path);
+    free(path);
+
+    // pseudo files report zero size but have contents.
+    if (qfile_exist("/proc/self/status")) {
+        nbytes = 0;
+        buf = qfile_load("/proc/self/status", &nbytes);
+        ASSERT_NOT_NULL(buf);
+        ASSERT_TRUE(nbytes > 0);
+        ASSERT_EQUAL_INT(nbytes, strlen(buf));
+        free(buf);
+
+        // the limit holds for them too
+        nbytes = 5;
+        buf = qfile_load("/proc/self/status", &nbytes);
+        ASSERT_NOT_NULL(buf);
+        ASSERT_EQUAL_INT(5, nbytes);
+        ASSERT_EQUAL_STR("Name:", buf);
+        free(buf);
+    }
+}
+
+TEST("qfile_read()") {
+    FILE *fp = tmpfile();
+    ASSERT_NOT_NULL(fp);
+    ASSERT_NULL(qfile_read(fp, NULL));
+
+    int i;
+    for (i = 0; i < 100000; i++) {
+        fputc('0' + (i % 10), fp);
+    }
+    rewind(fp);
+
+    size_t nbytes = 0;
+    char *buf = qfile_read(fp, &nbytes);
+    ASSERT_EQUAL_INT(100000, nbytes);
+    ASSERT_EQUAL_INT(100000, strlen(buf));
+    ASSERT_EQUAL_MEM("0123456789", buf + 99990, 10);
+    free(buf);
+    fclose(fp);
+}
+
+TEST("qfile_map()/qfile_unmap()") {
+    char data[20000];
+    size_t i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (char) (i * 7);
+    }
+    char *path = make_tempfile(data, sizeof(data));
+    ASSERT_NOT_NULL(path);
+
+    qfile_view_t view;
+    ASSERT_TRUE(qfile_map(&view, path, 0, 0, QFILE_MAP_SEQUENTIAL));
+    ASSERT_EQUAL_INT(sizeof(data), view.size);
+    ASSERT_EQUAL_MEM(data, view.data, sizeof(data));
+    qfile_unmap(&view);
+    ASSERT_EQUAL_INT(0, view.size);
+
+    // unaligned offset and partial length
+    ASSERT_TRUE(qfile_map(&view, path, 5001, 100,
+                          QFILE_MAP_RANDOM | QFILE_MAP_WILLNEED));
+    ASSERT_EQUAL_INT(100, view.size);
+    ASSERT_EQUAL_MEM(data + 5001, view.data, 100);
+    qfile_unmap(&view);
+
+    ASSERT_TRUE(qfile_map(&view, path, sizeof(data), 0, 0));
+    ASSERT_EQUAL_INT(0, view.size);
+    qfile_unmap(&view);
+
+    unlink(path);
+    free(path);
+
+    ASSERT_FALSE(qfile_map(&view, "/nonexistent/file", 0, 0, 0));
+
+    if (qfile_exist("/proc/self/status")) {
+        ASSERT_TRUE(qfile_map(&view, "/proc/self/status", 0, 0, 0));
+        ASSERT_TRUE(view.size > 0);
+        qfile_unmap(&view);
+    }
+}
+
+TEST("qfile_save()/qfile_savev()") {
+    char path[] = "/tmp/test_qfile_save.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ASSERT_EQUAL_INT(5, qfile_save(path, "hello", 5, false));
+    ASSERT_EQUAL_INT(6, qfile_save(path, " world", 6, true));
+    char *buf = qfile_load(path, NULL);
+    ASSERT_EQUAL_STR("hello world", buf);
+    free(buf);
+
+    // many pieces cross the writev() batch size.
+    struct iovec iov[200];
+    char expected[200 * 3 + 1];
+    size_t off = 0;
+    int i;
+    for (i = 0; i < 200; i++) {
+        iov[i].iov_base = (i % 2) ? "ab" : "cde";
+        iov[i].iov_len = (i % 2) ? 2 : ((i % 3) ? 3 : 0);
+        memcpy(expected + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    expected[off] = '\0';
+    ASSERT_EQUAL_INT(strlen(expected),
+                     qfile_savev(path, iov, 200,
+                                 QFILE_SAVE_ATOMIC | QFILE_SAVE_SYNC));
+    buf = qfile_load(path, NULL);
+    ASSERT_EQUAL_STR(expected, buf);
+    free(buf);
+
+    ASSERT_EQUAL_INT(-1, qfile_savev(path, iov, 1,
+                                     QFILE_SAVE_ATOMIC | QFILE_SAVE_APPEND));
+    ASSERT_EQUAL_INT(-1, qfile_savev("/nonexistent/dir/file", iov, 1,
+                                     QFILE_SAVE_ATOMIC));
+    unlink(path);
+
+    // a new file gets the umask, an existing one keeps its permission.
+    struct stat st;
+    mode_t oldmask = umask(077);
+    ASSERT_EQUAL_INT(5, qfile_savev(path, iov, 3, QFILE_SAVE_ATOMIC));
+    ASSERT_EQUAL_INT(0, stat(path, &st));
+    ASSERT_EQUAL_INT(0600, (st.st_mode & 07777));
+    ASSERT_EQUAL_INT(0, chmod(path, 0640));
+    ASSERT_EQUAL_INT(5, qfile_savev(path, iov, 3, QFILE_SAVE_ATOMIC));
+    ASSERT_EQUAL_INT(0, stat(path, &st));
+    ASSERT_EQUAL_INT(0640, (st.st_mode & 07777));
+    umask(oldmask);
+    unlink(path);
+}
+
+QUNIT_END();
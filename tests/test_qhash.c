@@ -0,0 +1,167 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qhash.c");
+
+TEST("qhashxxh64()") {
+    ASSERT_EQUAL_INT(0xEF46DB3751D8E999ULL, qhashxxh64("", 0, 0));
+    ASSERT_EQUAL_INT(0x26C7827D889F6DA3ULL, qhashxxh64("hello", 5, 0));
+    ASSERT_EQUAL_INT(0x0B242D361FDA71BCULL,
+                     qhashxxh64("The quick brown fox jumps over the lazy dog",
+                                43, 0));
+}
+
+TEST("qhashxxh64_update()") {
+    unsigned char data[1000];
+    int i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char) (i * 7);
+    }
+    uint64_t expected = qhashxxh64(data, sizeof(data), 123);
+
+    // feed in odd sized pieces to cross the stripe boundaries.
+    size_t step;
+    for (step = 1; step < 70; step += 13) {
+        qhashxxh64_t ctx;
+        qhashxxh64_init(&ctx, 123);
+        size_t off;
+        for (off = 0; off < sizeof(data); off += step) {
+            size_t n = sizeof(data) - off;
+            ASSERT_TRUE(qhashxxh64_update(&ctx, data + off,
+                                          (n < step) ? n : step));
+        }
+        ASSERT_EQUAL_INT(expected, qhashxxh64_final(&ctx));
+    }
+}
+
+TEST("Streaming hash functions") {
+    unsigned char data[1000];
+    int i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char) (i * 7 + 1);
+    }
+
+    unsigned char expect[16], result[16];
+    qhashmd5_t md5;
+    qhashfnv1_32_t fnv32;
+    qhashfnv1_64_t fnv64;
+    qhashmurmur3_32_t mm32;
+    qhashmurmur3_128_t mm128;
+
+    size_t len, step;
+    for (len = 1; len <= sizeof(data); len += 111) {
+        for (step = 1; step < 40; step += 7) {
+            qhashmd5_init(&md5);
+            qhashfnv1_32_init(&fnv32);
+            qhashfnv1_64_init(&fnv64);
+            qhashmurmur3_32_init(&mm32);
+            qhashmurmur3_128_init(&mm128);
+
+            size_t off;
+            for (off = 0; off < len; off += step) {
+                size_t n = (len - off < step) ? len - off : step;
+                ASSERT_TRUE(qhashmd5_update(&md5, data + off, n));
+                ASSERT_TRUE(qhashfnv1_32_update(&fnv32, data + off, n));
+                ASSERT_TRUE(qhashfnv1_64_update(&fnv64, data + off, n));
+                ASSERT_TRUE(qhashmurmur3_32_update(&mm32, data + off, n));
+                ASSERT_TRUE(qhashmurmur3_128_update(&mm128, data + off, n));
+            }
+
+            qhashmd5(data, len, expect);
+            qhashmd5_final(&md5, result);
+            ASSERT_EQUAL_MEM(expect, result, 16);
+            ASSERT_EQUAL_INT(qhashfnv1_32(data, len),
+                             qhashfnv1_32_final(&fnv32));
+            ASSERT_EQUAL_INT(qhashfnv1_64(data, len),
+                             qhashfnv1_64_final(&fnv64));
+            ASSERT_EQUAL_INT(qhashmurmur3_32(data, len),
+                             qhashmurmur3_32_final(&mm32));
+            qhashmurmur3_128(data, len, expect);
+            qhashmurmur3_128_final(&mm128, result);
+            ASSERT_EQUAL_MEM(expect, result, 16);
+        }
+    }
+
+    // FNV1 stops at NUL like the one-shot version.
+    qhashfnv1_32_init(&fnv32);
+    qhashfnv1_32_update(&fnv32, "hel", 3);
+    qhashfnv1_32_update(&fnv32, "lo\0world", 8);
+    ASSERT_EQUAL_INT(qhashfnv1_32("hello", 5), qhashfnv1_32_final(&fnv32));
+
+    // known MD5
+    qhashmd5_init(&md5);
+    qhashmd5_update(&md5, "hello", 5);
+    qhashmd5_final(&md5, result);
+    ASSERT_EQUAL_MEM("\x5d\x41\x40\x2a\xbc\x4b\x2a\x76"
+                     "\xb9\x71\x9d\x91\x10\x17\xc5\x92", result, 16);
+}
+
+TEST("File hash functions") {
+    // bigger than the read buffer and not aligned to the page size.
+    size_t size = 3 * 1024 * 1024 + 123;
+    unsigned char *data = malloc(size);
+    size_t i;
+    for (i = 0; i < size; i++) {
+        data[i] = (unsigned char) (i * 31 + (i >> 12));
+    }
+
+    char filepath[] = "/tmp/test_qhash.XXXXXX";
+    int fd = mkstemp(filepath);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQUAL_INT(size, write(fd, data, size));
+    close(fd);
+
+    unsigned char expect[16], result[16];
+    uint64_t hashval;
+
+    // whole file
+    qhashmd5(data, size, expect);
+    ASSERT_TRUE(qhashmd5_file(filepath, 0, 0, result));
+    ASSERT_EQUAL_MEM(expect, result, 16);
+    ASSERT_TRUE(qhashxxh64_file(filepath, 0, 0, &hashval));
+    ASSERT_EQUAL_INT(qhashxxh64(data, size, 0), hashval);
+
+    // partial range
+    qhashmd5(data + 5000, 1234567, expect);
+    ASSERT_TRUE(qhashmd5_file(filepath, 5000, 1234567, result));
+    ASSERT_EQUAL_MEM(expect, result, 16);
+    ASSERT_TRUE(qhashxxh64_file(filepath, 5000, 0, &hashval));
+    ASSERT_EQUAL_INT(qhashxxh64(data + 5000, size - 5000, 0), hashval);
+
+    // out of range
+    ASSERT_FALSE(qhashmd5_file(filepath, size, 1, result));
+
+    unlink(filepath);
+    free(data);
+}
+
+QUNIT_END();
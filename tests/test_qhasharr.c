@@ -127,6 +127,68 @@ TEST("Test remove_by_idx()") {
     tbl->free(tbl);
 }
 
+TEST("Test key fingerprint types") {
+    const char *LONGKEY = "key-1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866";
+    const char *SAMEPREFIX = "key-1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539867";
+    int keyfps[] = {
+        QHASHARR_KEYFP_XXH64, QHASHARR_KEYFP_MURMUR3, QHASHARR_KEYFP_MD5,
+        QHASHARR_KEYFP_FULLKEY
+    };
+
+    int i;
+    for (i = 0; i < sizeof(keyfps) / sizeof(int); i++) {
+        char memory[qhasharr_calculate_memsize(100)];
+        qhasharr_t *tbl = qhasharr_keyfp(memory, sizeof(memory), keyfps[i]);
+        ASSERT_NOT_NULL(tbl);
+
+        ASSERT_TRUE(tbl->putstr(tbl, LONGKEY, "value1"));
+        ASSERT_TRUE(tbl->putstr(tbl, SAMEPREFIX, "value2"));
+        ASSERT_EQUAL_INT(2, tbl->size(tbl, NULL, NULL));
+
+        char *value = tbl->getstr(tbl, LONGKEY);
+        ASSERT_EQUAL_STR("value1", value);
+        free(value);
+        value = tbl->getstr(tbl, SAMEPREFIX);
+        ASSERT_EQUAL_STR("value2", value);
+        free(value);
+
+        // attach existing table
+        qhasharr_t *tbl2 = qhasharr(memory, 0);
+        ASSERT_NOT_NULL(tbl2);
+        value = tbl2->getstr(tbl2, LONGKEY);
+        ASSERT_EQUAL_STR("value1", value);
+        free(value);
+        tbl2->free(tbl2);
+        ASSERT_NULL(qhasharr_keyfp(memory, 0, (keyfps[i] % 4) + 1));
+
+        // full key is returned only when it is stored
+        int idx = 0;
+        qhasharr_obj_t obj;
+        while (tbl->getnext(tbl, &obj, &idx) == true) {
+            if (keyfps[i] == QHASHARR_KEYFP_FULLKEY) {
+                ASSERT_EQUAL_INT(strlen(LONGKEY) + 1, obj.namesize);
+            } else {
+                ASSERT_EQUAL_INT(Q_HASHARR_NAMESIZE, obj.namesize);
+            }
+            free(obj.name);
+            free(obj.data);
+        }
+
+        ASSERT_TRUE(tbl->remove(tbl, LONGKEY));
+        ASSERT_NULL(tbl->getstr(tbl, LONGKEY));
+        ASSERT_TRUE(tbl->remove(tbl, SAMEPREFIX));
+        int usedslots = -1;
+        ASSERT_EQUAL_INT(0, tbl->size(tbl, NULL, &usedslots));
+        ASSERT_EQUAL_INT(0, usedslots);
+        tbl->free(tbl);
+    }
+
+    // memory which is not a table
+    char memory[qhasharr_calculate_memsize(10)];
+    memset(memory, 0, sizeof(memory));
+    ASSERT_NULL(qhasharr(memory, 0));
+}
+
 QUNIT_END();
 
 
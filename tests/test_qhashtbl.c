@@ -63,8 +63,9 @@ TEST("Test basic but complete") {
     tbl->free(tbl);
 }
 
-void test_thousands_of_keys(int num_keys, char *key_postfix, char *value_postfix) {
-    qhashtbl_t *tbl = qhashtbl(0, 0);
+void test_thousands_of_keys(int num_keys, char *key_postfix, char *value_postfix,
+                            int options) {
+    qhashtbl_t *tbl = qhashtbl(0, options);
     ASSERT_EQUAL_INT(0, tbl->size(tbl));
 
     int i;
@@ -94,19 +95,23 @@ void test_thousands_of_keys(int num_keys, char *key_postfix, char *value_postfix
 
 
 TEST("Test thousands of keys insertion and removal: short key + short value") {
-    test_thousands_of_keys(10000, "", "");
+    test_thousands_of_keys(10000, "", "", 0);
 }
 
 TEST("Test thousands of keys insertion and removal: short key + long value") {
-    test_thousands_of_keys(10000, "", "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866");
+    test_thousands_of_keys(10000, "", "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", 0);
 }
 
 TEST("Test thousands of keys insertion and removal: long key + short value") {
-    test_thousands_of_keys(10000, "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", "");
+    test_thousands_of_keys(10000, "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", "", 0);
 }
 
 TEST("Test thousands of keys insertion and removal: long key + long value") {
-    test_thousands_of_keys(10000, "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866");
+    test_thousands_of_keys(10000, "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", 0);
+}
+
+TEST("Test thousands of keys insertion and removal: xxHash64 keys") {
+    test_thousands_of_keys(10000, "1a087a6982371bbfc9d4e14ae76e05ddd784a5d9c6b0fc9e6cd715baab66b90987b2ee054764e58fc04e449dfa060a68398601b64cf470cb6f0a260ec6539866", "", QHASHTBL_HASH_XXH64);
 }
 
 QUNIT_END();
@@ -0,0 +1,311 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include "qunit.h"
+#include "qlibc.h"
+#include "qlibcext.h"
+#include "httpd.h"
+
+// Outcome of a request.
+struct result {
+    int rescode;
+    int error;
+    bool done;
+    char body[32 * 1024];
+    size_t bodylen;
+};
+
+static int ndone;
+static int order[16];
+
+static bool onbody(qhttpasync_req_t *req, const void *data, size_t size) {
+    struct result *result = (struct result *) req->userdata;
+    if (result->bodylen + size >= sizeof(result->body))
+        return false;
+    memcpy(result->body + result->bodylen, data, size);
+    result->bodylen += size;
+    result->body[result->bodylen] = '\0';
+    return true;
+}
+
+static void ondone(qhttpasync_req_t *req, int rescode, int error) {
+    struct result *result = (struct result *) req->userdata;
+    result->rescode = rescode;
+    result->error = error;
+    result->done = true;
+    if (ndone < 16)
+        order[ndone] = atoi(result->body);
+    ndone++;
+}
+
+static void setreq(qhttpasync_req_t *req, struct result *result,
+                   const char *uri) {
+    memset((void *) req, 0, sizeof(qhttpasync_req_t));
+    memset((void *) result, 0, sizeof(struct result));
+    req->uri = uri;
+    req->timeoutms = 5000;
+    req->onbody = onbody;
+    req->ondone = ondone;
+    req->userdata = result;
+}
+
+static void run(qreactor_t *reactor, qhttpasync_t *async) {
+    while (qhttpasync_inflight(async) > 0) {
+        qreactor_run_once(reactor, 1000);
+    }
+}
+
+static httpd_t httpd;
+
+QUNIT_START("Test qhttpasync.c");
+
+TEST("Start a loopback server") {
+    signal(SIGPIPE, SIG_IGN);
+    ASSERT_TRUE(httpd_start(&httpd, false));
+}
+
+TEST("Test a GET request") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 0);
+    qhttpasync_req_t req;
+    struct result result;
+    setreq(&req, &result, "/hello");
+
+    ndone = 0;
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req));
+    ASSERT_EQUAL_INT(1, qhttpasync_inflight(async));
+    run(reactor, async);
+    ASSERT_TRUE(result.done);
+    ASSERT_EQUAL_INT(0, result.error);
+    ASSERT_EQUAL_INT(200, result.rescode);
+    ASSERT_EQUAL_STR("hello", result.body);
+    ASSERT_EQUAL_INT(1, ndone);
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+TEST("Test queueing on the per-host limit") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 1);
+    qhttpasync_req_t reqs[5];
+    struct result results[5];
+    char uris[5][16];
+    int i;
+
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    ndone = 0;
+    for (i = 0; i < 5; i++) {
+        snprintf(uris[i], sizeof(uris[i]), "/seq/%d", i);
+        setreq(&reqs[i], &results[i], uris[i]);
+        ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port,
+                                      &reqs[i]));
+    }
+    ASSERT_EQUAL_INT(5, qhttpasync_inflight(async));
+    run(reactor, async);
+
+    // one at a time on the same connection, in order
+    ASSERT_EQUAL_INT(5, ndone);
+    for (i = 0; i < 5; i++) {
+        ASSERT_EQUAL_INT(0, results[i].error);
+        ASSERT_EQUAL_INT(200, results[i].rescode);
+        ASSERT_EQUAL_INT(i, order[i]);
+    }
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+TEST("Test a request timeout") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 1);
+    qhttpasync_req_t req, req2;
+    struct result result, result2;
+    setreq(&req, &result, "/sleep/1000");
+    req.timeoutms = 100;
+    setreq(&req2, &result2, "/hello");
+    req2.timeoutms = 100;  // times out while waiting for the connection
+
+    ndone = 0;
+    long start = qtime_current_milli();
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req));
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req2));
+    run(reactor, async);
+    ASSERT_TRUE(qtime_current_milli() - start < 1000);
+    ASSERT_EQUAL_INT(ETIMEDOUT, result.error);
+    ASSERT_EQUAL_INT(ETIMEDOUT, result2.error);
+    ASSERT_EQUAL_INT(2, ndone);
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+TEST("Test a retry on a stale keep-alive connection") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 1);
+    qhttpasync_req_t req;
+    struct result result;
+
+    setreq(&req, &result, "/hello");
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req));
+    run(reactor, async);
+    ASSERT_EQUAL_INT(200, result.rescode);
+
+    // the server drops the request on the kept connection, and answers it
+    // only as the first request of a new one
+    setreq(&req, &result, "/fresh");
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req));
+    run(reactor, async);
+    ASSERT_EQUAL_INT(0, result.error);
+    ASSERT_EQUAL_INT(200, result.rescode);
+    ASSERT_EQUAL_STR("fresh", result.body);
+
+    // but doesn't replay a request which isn't idempotent
+    setreq(&req, &result, "/fresh");
+    req.method = "POST";
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port, &req));
+    run(reactor, async);
+    ASSERT_EQUAL_INT(ECONNRESET, result.error);
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+#ifdef ENABLE_ZLIB
+TEST("Test compressed responses") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 1);
+    const char *uris[] = { "/gzip/20000", "/deflate/20000",
+                           "/gzip/20000/chunked", "/deflate/20000/chunked" };
+    qhttpasync_req_t reqs[4];
+    struct result results[4];
+    char *expected = (char *) malloc(20000);
+    httpd_text(expected, 20000);
+    int i;
+
+    // one after another on a keep-alive connection
+    for (i = 0; i < 4; i++) {
+        setreq(&reqs[i], &results[i], uris[i]);
+        reqs[i].compression = true;
+        ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port,
+                                      &reqs[i]));
+    }
+    run(reactor, async);
+    for (i = 0; i < 4; i++) {
+        ASSERT_TRUE(results[i].done);
+        ASSERT_EQUAL_INT(0, results[i].error);
+        ASSERT_EQUAL_INT(200, results[i].rescode);
+        ASSERT_EQUAL_INT(20000, results[i].bodylen);
+        ASSERT_EQUAL_INT(0, memcmp(results[i].body, expected, 20000));
+    }
+
+    free(expected);
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+#endif
+
+TEST("Test a refused connection") {
+    httpd_t closed;
+    ASSERT_TRUE(httpd_start(&closed, false));
+    httpd_stop(&closed);
+
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 0);
+    qhttpasync_req_t req;
+    struct result result;
+    setreq(&req, &result, "/hello");
+
+    ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", closed.port, &req));
+    run(reactor, async);
+    ASSERT_TRUE(result.done);
+    ASSERT_EQUAL_INT(ECONNREFUSED, result.error);
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+TEST("Test failures reported from the reactor only") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 0);
+    qhttpasync_req_t reqs[2];
+    struct result results[2];
+    int i;
+
+    // a malformed name is never looked up on the network, so the second
+    // one finds it in the negative cache.
+    for (i = 0; i < 2; i++) {
+        setreq(&reqs[i], &results[i], "/hello");
+        ASSERT_TRUE(qhttpasync_submit(async, "nonexistent..invalid", 80,
+                                      &reqs[i]));
+        ASSERT_FALSE(results[i].done);
+        run(reactor, async);
+        ASSERT_TRUE(results[i].done);
+        ASSERT_EQUAL_INT(ENOENT, results[i].error);
+    }
+
+    qhttpasync_free(async);
+    qreactor_free(reactor);
+}
+
+TEST("Test qhttpasync_free() with requests in flight") {
+    qreactor_t *reactor = qreactor();
+    qhttpasync_t *async = qhttpasync(reactor, 2);
+    qhttpasync_req_t reqs[4];
+    struct result results[4];
+    int i;
+
+    ndone = 0;
+    for (i = 0; i < 4; i++) {
+        setreq(&reqs[i], &results[i], "/sleep/500");
+        ASSERT_TRUE(qhttpasync_submit(async, "127.0.0.1", httpd.port,
+                                      &reqs[i]));
+    }
+    // two are sent, the others wait for a connection
+    qreactor_run_once(reactor, 50);
+    qreactor_run_once(reactor, 50);
+    ASSERT_EQUAL_INT(4, qhttpasync_inflight(async));
+
+    qhttpasync_free(async);
+    ASSERT_EQUAL_INT(0, ndone);
+
+    // nothing is left behind on the reactor
+    ASSERT_TRUE(qreactor_run(reactor));
+    ASSERT_EQUAL_INT(0, ndone);
+    qreactor_free(reactor);
+}
+
+TEST("Stop the loopback server") {
+    httpd_stop(&httpd);
+}
+
+QUNIT_END();
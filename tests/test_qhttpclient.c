@@ -0,0 +1,562 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include "qunit.h"
+#include "qlibc.h"
+#include "qlibcext.h"
+#include "httpd.h"
+
+static httpd_t httpd;
+
+// Request a path and check the body.
+static bool request(qhttpclient_t *client, const char *uri,
+                    const char *expected) {
+    int rescode = 0;
+    size_t size = 0;
+    char *data = (char *) client->cmd(client, "GET", uri, NULL, 0, &rescode,
+                                      &size, NULL, NULL);
+    bool ok = (data != NULL && rescode == 200 && size == strlen(expected)
+               && !memcmp(data, expected, size));
+    free(data);
+    return ok;
+}
+
+// Pipeline callback, records the order of the answers.
+static int answers[64];
+static int nanswers;
+static int stopat;
+
+static bool on_answer(qhttpclient_req_t *req, int rescode, void *data,
+                      size_t size) {
+    answers[nanswers++] = (rescode == 200 && data != NULL) ?
+            atoi((char *) data) : -1;
+    return (nanswers != stopat);
+}
+
+static void pipeline_reqs(qhttpclient_req_t *reqs, int nreqs, char *uris) {
+    memset((void *) reqs, 0, sizeof(qhttpclient_req_t) * nreqs);
+    int i;
+    for (i = 0; i < nreqs; i++) {
+        snprintf(uris + (i * 16), 16, "/seq/%d", i);
+        reqs[i].uri = uris + (i * 16);
+        reqs[i].callback = on_answer;
+    }
+    nanswers = 0;
+    stopat = 0;
+}
+
+// Pipeline callback, compares the echoed header with the userdata.
+static int nechoes;
+
+static bool on_echo(qhttpclient_req_t *req, int rescode, void *data,
+                    size_t size) {
+    const char *expected = (const char *) req->userdata;
+    if (rescode == 200 && data != NULL && size == strlen(expected)
+            && !memcmp(data, expected, size)) {
+        nechoes++;
+    }
+    return true;
+}
+
+#ifdef ENABLE_ZLIB
+// Check data is the text of a /gzip or /deflate response of the size.
+static bool text_matches(const char *data, size_t datalen, size_t size) {
+    char *expected = (char *) malloc(size);
+    bool ok = (data != NULL && expected != NULL && datalen == size);
+    if (ok == true) {
+        httpd_text(expected, size);
+        ok = (memcmp(data, expected, size) == 0);
+    }
+    free(expected);
+    return ok;
+}
+
+// Pipeline callback, checks the text of the size in the userdata.
+static int ntexts;
+
+static bool on_text(qhttpclient_req_t *req, int rescode, void *data,
+                    size_t size) {
+    if (rescode == 200
+            && text_matches((char *) data, size, *(size_t *) req->userdata)) {
+        ntexts++;
+    }
+    return true;
+}
+#endif
+
+// Download into a temporary file. Returns the file or -1.
+static int download(const char *uri, int nconns, off_t *savesize,
+                    int *rescode,
+                    bool (*callback)(void *userdata, off_t recvbytes)) {
+    char path[] = "/tmp/test_qhttpclient.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    client->download(client, uri, fd, nconns, savesize, rescode, NULL,
+                     callback, NULL);
+    client->free(client);
+    return fd;
+}
+
+// Check the file has the bytes of a /blob of the size.
+static bool blob_matches(int fd, size_t size) {
+    char *data = (char *) malloc(size + 1);
+    char *expected = (char *) malloc(size);
+    bool ok = (data != NULL && expected != NULL
+               && pread(fd, data, size + 1, 0) == (ssize_t) size);
+    if (ok == true) {
+        httpd_blob(expected, 0, size);
+        ok = (memcmp(data, expected, size) == 0);
+    }
+    free(data);
+    free(expected);
+    return ok;
+}
+
+// Download callback, cancels once cancelsize bytes have arrived.
+static off_t cancelsize;
+
+static bool on_progress(void *userdata, off_t recvbytes) {
+    return (recvbytes < cancelsize);
+}
+
+QUNIT_START("Test qhttpclient.c");
+
+TEST("Start a loopback server") {
+    signal(SIGPIPE, SIG_IGN);
+    ASSERT_TRUE(httpd_start(&httpd, false));
+}
+
+TEST("qhttppool: reuse of a connection") {
+    qhttppool_t *pool = qhttppool(2, 200);
+    ASSERT_NOT_NULL(pool);
+
+    qhttpclient_t *client = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client);
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    qhttppool_put(pool, client);
+
+    qhttpclient_t *client2 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_EQUAL_PT(client, client2);
+    ASSERT_TRUE(request(client2, "/hello", "hello"));
+    qhttppool_put(pool, client2);
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+
+    qhttppool_free(pool);
+}
+
+TEST("qhttppool: per-host limit") {
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    qhttppool_t *pool = qhttppool(2, 200);
+
+    qhttpclient_t *client1 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    qhttpclient_t *client2 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client1);
+    ASSERT_NOT_NULL(client2);
+    ASSERT_TRUE(request(client1, "/hello", "hello"));
+    ASSERT_TRUE(request(client2, "/hello", "hello"));
+
+    errno = 0;
+    ASSERT_NULL(qhttppool_get(pool, "127.0.0.1", httpd.port));
+    ASSERT_EQUAL_INT(EBUSY, errno);
+
+    // other hosts have their own slots
+    qhttpclient_t *other = qhttppool_get(pool, "localhost", httpd.port);
+    ASSERT_NOT_NULL(other);
+    qhttppool_put(pool, other);
+
+    qhttppool_put(pool, client1);
+    qhttpclient_t *client3 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_EQUAL_PT(client1, client3);
+    qhttppool_put(pool, client3);
+
+    // a closed connection gives its slot back as well
+    client2->close(client2);
+    qhttppool_put(pool, client2);
+    client1 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    client2 = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client1);
+    ASSERT_NOT_NULL(client2);
+    qhttppool_put(pool, client1);
+    qhttppool_put(pool, client2);
+
+    qhttppool_free(pool);
+}
+
+TEST("qhttppool: idle timeout") {
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    qhttppool_t *pool = qhttppool(2, 200);
+
+    qhttpclient_t *client = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    qhttppool_put(pool, client);
+    usleep(300 * 1000);
+
+    client = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client);
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    qhttppool_put(pool, client);
+    ASSERT_EQUAL_INT(2, httpd_count(&httpd, &httpd.naccepted, 0));
+
+    qhttppool_free(pool);
+}
+
+#ifdef ENABLE_OPENSSL
+TEST("qhttppool: setssl() after qhttppool_get()") {
+    qhttppool_t *pool = qhttppool(1, 0);
+
+    // it's not kept, but the slot must come back to the host.
+    qhttpclient_t *client = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client);
+    client->setssl(client);
+    qhttppool_put(pool, client);
+
+    client = qhttppool_get(pool, "127.0.0.1", httpd.port);
+    ASSERT_NOT_NULL(client);
+    qhttppool_put(pool, client);
+
+    qhttppool_free(pool);
+}
+#endif
+
+TEST("readresponse(): a head larger than the read buffer") {
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    qlisttbl_t *resheaders = qlisttbl(QLISTTBL_CASEINSENSITIVE);
+    int rescode = 0;
+    size_t size = 0;
+    char *data = (char *) client->cmd(client, "GET", "/bighead/40000", NULL,
+                                      0, &rescode, &size, NULL, resheaders);
+    ASSERT_EQUAL_INT(200, rescode);
+    ASSERT_NOT_NULL(data);
+    ASSERT_EQUAL_INT(3, size);
+    ASSERT_EQUAL_MEM("big", data, 3);
+    ASSERT_NOT_NULL(resheaders->getstr(resheaders, "X-Fill-10", false));
+    free(data);
+    resheaders->free(resheaders);
+
+    // over the limit, it's refused and the connection isn't reused
+    data = (char *) client->cmd(client, "GET", "/bighead/80000", NULL, 0,
+                                &rescode, &size, NULL, NULL);
+    ASSERT_EQUAL_INT(0, rescode);
+    free(data);
+
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    client->free(client);
+}
+
+TEST("readresponse(): a HEAD response without Content-Length") {
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    client->setkeepalive(client, true);
+    int rescode = 0;
+    ASSERT_TRUE(client->head(client, "/nolength", &rescode, NULL, NULL));
+    ASSERT_EQUAL_INT(200, rescode);
+    ASSERT_FALSE(client->connclose);
+    ASSERT_TRUE(client->head(client, "/nolength", &rescode, NULL, NULL));
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+
+    // and in a pipeline
+    qhttpclient_req_t reqs[6];
+    char uris[6 * 16];
+    pipeline_reqs(reqs, 6, uris);
+    reqs[1].method = reqs[3].method = "HEAD";
+    reqs[1].uri = reqs[3].uri = "/nolength";
+    ASSERT_EQUAL_INT(6, client->pipeline(client, reqs, 6));
+    ASSERT_EQUAL_INT(6, nanswers);
+    ASSERT_EQUAL_INT(5, answers[5]);
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+    client->free(client);
+}
+
+TEST("pipeline(): responses in order") {
+    qhttpclient_req_t reqs[40];
+    char uris[40 * 16];
+    pipeline_reqs(reqs, 40, uris);
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_EQUAL_INT(40, client->pipeline(client, reqs, 40));
+    ASSERT_EQUAL_INT(40, nanswers);
+    int i;
+    for (i = 0; i < 40; i++) {
+        ASSERT_EQUAL_INT(i, answers[i]);
+    }
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+    client->free(client);
+}
+
+TEST("pipeline(): request heads batched in one buffer") {
+    // heads several times the initial request buffer, all in one write
+    qhttpclient_req_t reqs[8];
+    qlisttbl_t *headers[8];
+    char values[8][3001];
+    memset((void *) reqs, 0, sizeof(reqs));
+    int i;
+    for (i = 0; i < 8; i++) {
+        memset(values[i], 'a' + i, 3000);
+        values[i][3000] = '\0';
+        headers[i] = qlisttbl(0);
+        headers[i]->putstr(headers[i], "X-Echo", values[i]);
+        reqs[i].uri = "/echo";
+        reqs[i].reqheaders = headers[i];
+        reqs[i].callback = on_echo;
+        reqs[i].userdata = values[i];
+    }
+
+    nechoes = 0;
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_EQUAL_INT(8, client->pipeline(client, reqs, 8));
+    ASSERT_EQUAL_INT(8, nechoes);
+
+    // and a single one after those, reusing the buffer
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    client->free(client);
+
+    for (i = 0; i < 8; i++) {
+        headers[i]->free(headers[i]);
+    }
+}
+
+TEST("pipeline(): stopped by the callback") {
+    qhttpclient_req_t reqs[10];
+    char uris[10 * 16];
+    pipeline_reqs(reqs, 10, uris);
+    stopat = 3;
+
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_EQUAL_INT(3, client->pipeline(client, reqs, 10));
+    ASSERT_EQUAL_INT(3, nanswers);
+    client->free(client);
+}
+
+TEST("pipeline(): server closing the connection") {
+    qhttpclient_req_t reqs[12];
+    char uris[12 * 16];
+
+    // the rest is replayed on new connections
+    pipeline_reqs(reqs, 12, uris);
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    httpd.maxrequests = 5;
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_EQUAL_INT(12, client->pipeline(client, reqs, 12));
+    ASSERT_EQUAL_INT(12, nanswers);
+    ASSERT_EQUAL_INT(11, answers[11]);
+    ASSERT_EQUAL_INT(3, httpd_count(&httpd, &httpd.naccepted, 0));
+    httpd.maxrequests = 0;
+
+    // a request which is never answered ends the batch
+    pipeline_reqs(reqs, 12, uris);
+    reqs[5].uri = "/close";
+    ASSERT_EQUAL_INT(5, client->pipeline(client, reqs, 12));
+    ASSERT_EQUAL_INT(5, nanswers);
+    client->free(client);
+}
+
+#ifdef ENABLE_ZLIB
+TEST("setcompression(): get() and cmd() on a keep-alive connection") {
+    const char *uris[] = { "/gzip/20000", "/deflate/20000",
+                           "/gzip/20000/chunked", "/deflate/20000/chunked",
+                           NULL };
+    char path[] = "/tmp/test_qhttpclient.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    unlink(path);
+    char *data = (char *) malloc(20000 + 1);
+
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_TRUE(client->setcompression(client, true));
+    client->setkeepalive(client, true);
+    client->settimeout(client, 2000);
+    int i;
+    for (i = 0; uris[i] != NULL; i++) {
+        // the end of the body is found without waiting for more data
+        long start = qtime_current_milli();
+
+        int rescode = 0;
+        size_t size = 0;
+        char *content = (char *) client->cmd(client, "GET", uris[i], NULL, 0,
+                                             &rescode, &size, NULL, NULL);
+        ASSERT_EQUAL_INT(200, rescode);
+        ASSERT_TRUE(text_matches(content, size, 20000));
+        free(content);
+
+        off_t savesize = 0;
+        ASSERT_TRUE(ftruncate(fd, 0) == 0);
+        ASSERT_TRUE(lseek(fd, 0, SEEK_SET) == 0);
+        ASSERT_TRUE(client->get(client, uris[i], fd, &savesize, &rescode,
+                                NULL, NULL, NULL, NULL));
+        ASSERT_EQUAL_INT(200, rescode);
+        ASSERT_EQUAL_INT(20000, savesize);
+        ASSERT_TRUE(pread(fd, data, 20000 + 1, 0) == 20000);
+        ASSERT_TRUE(text_matches(data, 20000, 20000));
+
+        ASSERT(qtime_current_milli() - start < 1000);
+    }
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+    client->free(client);
+    free(data);
+    close(fd);
+}
+
+TEST("setcompression(): pipeline()") {
+    const char *uris[] = { "/gzip/20000", "/deflate/3000/chunked",
+                           "/deflate/20000", "/gzip/3000/chunked" };
+    size_t sizes[] = { 20000, 3000, 20000, 3000 };
+    qhttpclient_req_t reqs[4];
+    memset((void *) reqs, 0, sizeof(reqs));
+    int i;
+    for (i = 0; i < 4; i++) {
+        reqs[i].uri = uris[i];
+        reqs[i].callback = on_text;
+        reqs[i].userdata = &sizes[i];
+    }
+
+    ntexts = 0;
+    httpd_count(&httpd, &httpd.naccepted, -httpd.naccepted);
+    qhttpclient_t *client = qhttpclient("127.0.0.1", httpd.port);
+    ASSERT_TRUE(client->setcompression(client, true));
+    client->settimeout(client, 2000);
+    long start = qtime_current_milli();
+    ASSERT_EQUAL_INT(4, client->pipeline(client, reqs, 4));
+    ASSERT(qtime_current_milli() - start < 1000);
+    ASSERT_EQUAL_INT(4, ntexts);
+    ASSERT_EQUAL_INT(1, httpd_count(&httpd, &httpd.naccepted, 0));
+    client->free(client);
+}
+#endif
+
+#define BLOB_SIZE   (1024 * 1024)
+
+TEST("download(): ranges reassembled in place") {
+    off_t savesize = 0;
+    int rescode = 0;
+    httpd_count(&httpd, &httpd.nrequests, -httpd.nrequests);
+    int fd = download("/blob/1048576", 4, &savesize, &rescode, NULL);
+    ASSERT(fd >= 0);
+    ASSERT_EQUAL_INT(BLOB_SIZE, savesize);
+    ASSERT_EQUAL_INT(200, rescode);
+    ASSERT_TRUE(blob_matches(fd, BLOB_SIZE));
+    // HEAD, then one request per 256KB range
+    ASSERT_EQUAL_INT(5, httpd_count(&httpd, &httpd.nrequests, 0));
+    close(fd);
+}
+
+TEST("download(): broken ranges resumed where they stopped") {
+    off_t savesize = 0;
+    int rescode = 0;
+    httpd_count(&httpd, &httpd.nrequests, -httpd.nrequests);
+    int fd = download("/blob/1048576/break", 4, &savesize, &rescode, NULL);
+    ASSERT(fd >= 0);
+    // refetching a whole range would count its first bytes twice
+    ASSERT_EQUAL_INT(BLOB_SIZE, savesize);
+    ASSERT_EQUAL_INT(200, rescode);
+    ASSERT_TRUE(blob_matches(fd, BLOB_SIZE));
+    ASSERT_EQUAL_INT(1 + 4 + 4, httpd_count(&httpd, &httpd.nrequests, 0));
+    close(fd);
+}
+
+TEST("download(): get() without Accept-Ranges") {
+    off_t savesize = 0;
+    int rescode = 0;
+    httpd_count(&httpd, &httpd.nrequests, -httpd.nrequests);
+    int fd = download("/blob/1048576/norange", 4, &savesize, &rescode, NULL);
+    ASSERT(fd >= 0);
+    ASSERT_EQUAL_INT(BLOB_SIZE, savesize);
+    ASSERT_EQUAL_INT(200, rescode);
+    ASSERT_TRUE(blob_matches(fd, BLOB_SIZE));
+    ASSERT_EQUAL_INT(2, httpd_count(&httpd, &httpd.nrequests, 0));
+    close(fd);
+}
+
+TEST("download(): cancelled by the callback") {
+    off_t savesize = 0;
+    int rescode = 0;
+    cancelsize = BLOB_SIZE / 4;
+    int fd = download("/blob/1048576", 4, &savesize, &rescode, on_progress);
+    ASSERT(fd >= 0);
+    ASSERT(savesize >= cancelsize);
+    ASSERT(savesize < BLOB_SIZE);
+    ASSERT(rescode != 200);
+
+    // and so is the fallback
+    savesize = 0;
+    close(fd);
+    fd = download("/blob/1048576/norange", 4, &savesize, &rescode,
+                  on_progress);
+    ASSERT(fd >= 0);
+    ASSERT(savesize >= cancelsize);
+    ASSERT(savesize < BLOB_SIZE);
+    close(fd);
+}
+
+#if defined(ENABLE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+TEST("TLS session resumption") {
+    httpd_t tlsd;
+    ASSERT_TRUE(httpd_start(&tlsd, true));
+
+    // a full handshake, which leaves two tickets
+    qhttpclient_t *client = qhttpclient("127.0.0.1", tlsd.port);
+    ASSERT_TRUE(client->setssl(client));
+    ASSERT_TRUE(request(client, "/hello", "hello"));
+    client->free(client);
+
+    // then each connection uses a ticket of its own, they're single use.
+    qhttpclient_t *client1 = qhttpclient("127.0.0.1", tlsd.port);
+    qhttpclient_t *client2 = qhttpclient("127.0.0.1", tlsd.port);
+    client1->setssl(client1);
+    client2->setssl(client2);
+    ASSERT_TRUE(client1->open(client1));
+    ASSERT_TRUE(client2->open(client2));
+    int i;
+    for (i = 0; i < 100 && httpd_count(&tlsd, &tlsd.nhandshakes, 0) < 3;
+            i++) {
+        usleep(10 * 1000);
+    }
+    ASSERT_EQUAL_INT(3, httpd_count(&tlsd, &tlsd.nhandshakes, 0));
+    ASSERT_EQUAL_INT(2, httpd_count(&tlsd, &tlsd.nresumed, 0));
+    ASSERT_TRUE(request(client1, "/hello", "hello"));
+    ASSERT_TRUE(request(client2, "/hello", "hello"));
+    client1->free(client1);
+    client2->free(client2);
+
+    httpd_stop(&tlsd);
+}
+#endif
+
+TEST("Stop the loopback server") {
+    httpd_stop(&httpd);
+}
+
+QUNIT_END();
@@ -0,0 +1,359 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+#include "qlibcext.h"
+
+static size_t decodedlen;
+
+#ifdef ENABLE_ZLIB
+static char decoded[2048];
+
+static bool collect(void *userdata, const void *data, size_t size) {
+    if (decodedlen + size > sizeof(decoded))
+        return false;
+    memcpy(decoded + decodedlen, data, size);
+    decodedlen += size;
+    return true;
+}
+#endif
+
+QUNIT_START("Test qhttpparser.c");
+
+TEST("Test status line and headers") {
+    const char *res = "HTTP/1.1 200 OK\r\n"
+                      "content-type: text/plain\r\n"
+                      "X-Custom:   spaced value  \r\n"
+                      "Content-Length: 5\r\n"
+                      "\r\n"
+                      "hello";
+    qhttpparser_t parser;
+    qhttpparser_init(&parser, false);
+
+    size_t consumed;
+    ASSERT_EQUAL_INT(QHTTPPARSER_HEAD,
+                     qhttpparser_parse(&parser, res, strlen(res), &consumed,
+                                       NULL, NULL));
+    ASSERT_EQUAL_INT(11, parser.version);
+    ASSERT_EQUAL_INT(200, parser.status);
+    ASSERT_EQUAL_INT(2, parser.reasonlen);
+    ASSERT_EQUAL_INT(3, parser.nheaders);
+    ASSERT_EQUAL_INT(5, parser.contentlength);
+    ASSERT_TRUE(parser.keepalive);
+    ASSERT_FALSE(parser.chunked);
+
+    const qhttpparser_header_t *h;
+    h = qhttpparser_header(&parser, QHTTP_HDR_CONTENT_TYPE);
+    ASSERT_NOT_NULL(h);
+    ASSERT_EQUAL_INT(10, h->valuelen);
+    ASSERT_EQUAL_MEM("text/plain", h->value, h->valuelen);
+    ASSERT_NULL(qhttpparser_header(&parser, QHTTP_HDR_LOCATION));
+
+    h = qhttpparser_find(&parser, "x-custom");
+    ASSERT_NOT_NULL(h);
+    ASSERT_EQUAL_INT(12, h->valuelen);
+    ASSERT_EQUAL_MEM("spaced value", h->value, h->valuelen);
+
+    // body is a view into the buffer
+    const char *data;
+    size_t size;
+    size_t off = consumed;
+    ASSERT_EQUAL_INT(QHTTPPARSER_BODY,
+                     qhttpparser_parse(&parser, res + off, strlen(res) - off,
+                                       &consumed, &data, &size));
+    ASSERT_EQUAL_PT(res + off, data);
+    ASSERT_EQUAL_INT(5, size);
+    off += consumed;
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE,
+                     qhttpparser_parse(&parser, res + off, strlen(res) - off,
+                                       &consumed, &data, &size));
+
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_CASEINSENSITIVE);
+    ASSERT_TRUE(qhttpparser_copyheaders(&parser, tbl));
+    ASSERT_EQUAL_STR("spaced value", tbl->getstr(tbl, "X-CUSTOM", false));
+    tbl->free(tbl);
+}
+
+TEST("Test chunked body fed one byte at a time") {
+    const char *res = "HTTP/1.1 200 OK\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "\r\n"
+                      "5;ext=1\r\nhello\r\n"
+                      "7\r\n, world\r\n"
+                      "0\r\n"
+                      "X-Trailer: yes\r\n"
+                      "\r\n"
+                      "HTTP/1.1";
+    size_t total = strlen(res);
+
+    qhttpparser_t parser;
+    qhttpparser_init(&parser, false);
+
+    char body[64] = "";
+    size_t bodylen = 0;
+    size_t start = 0, end = 0;
+    int event, nheads = 0;
+    while (true) {
+        size_t consumed;
+        const char *data;
+        size_t size;
+        event = qhttpparser_parse(&parser, res + start, end - start,
+                                  &consumed, &data, &size);
+        start += consumed;
+        if (event == QHTTPPARSER_HEAD) {
+            nheads++;
+            ASSERT_TRUE(parser.chunked);
+            ASSERT_EQUAL_INT(-1, parser.contentlength);
+        } else if (event == QHTTPPARSER_BODY) {
+            memcpy(body + bodylen, data, size);
+            bodylen += size;
+        } else if (event == QHTTPPARSER_MORE) {
+            ASSERT_TRUE(end < total);
+            end++;
+        } else {
+            break;
+        }
+    }
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE, event);
+    ASSERT_EQUAL_INT(1, nheads);
+    ASSERT_EQUAL_INT(12, bodylen);
+    ASSERT_EQUAL_MEM("hello, world", body, bodylen);
+    ASSERT_EQUAL_STR("HTTP/1.1", res + start);
+}
+
+TEST("Test body framing and keep-alive") {
+    qhttpparser_t parser;
+    size_t consumed;
+    const char *data;
+    size_t size;
+
+    // HTTP/1.0 body delimited by close
+    const char *res = "HTTP/1.0 200 OK\r\n\r\nabc";
+    qhttpparser_init(&parser, false);
+    ASSERT_EQUAL_INT(QHTTPPARSER_HEAD,
+                     qhttpparser_parse(&parser, res, strlen(res), &consumed,
+                                       NULL, NULL));
+    ASSERT_FALSE(parser.keepalive);
+    ASSERT_EQUAL_INT(QHTTPPARSER_BODY,
+                     qhttpparser_parse(&parser, res + consumed, 3, &consumed,
+                                       &data, &size));
+    ASSERT_EQUAL_INT(3, size);
+    ASSERT_EQUAL_INT(QHTTPPARSER_MORE,
+                     qhttpparser_parse(&parser, "", 0, &consumed, &data,
+                                       &size));
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE, qhttpparser_eof(&parser));
+
+    // HTTP/1.0 keep-alive
+    res = "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\n"
+          "Content-Length: 0\r\n\r\n";
+    qhttpparser_init(&parser, false);
+    ASSERT_EQUAL_INT(QHTTPPARSER_HEAD,
+                     qhttpparser_parse(&parser, res, strlen(res), &consumed,
+                                       NULL, NULL));
+    ASSERT_TRUE(parser.keepalive);
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE,
+                     qhttpparser_parse(&parser, "", 0, &consumed, NULL,
+                                       NULL));
+
+    // HEAD and 304 never have a body
+    res = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    qhttpparser_init(&parser, true);
+    qhttpparser_parse(&parser, res, strlen(res), &consumed, NULL, NULL);
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE,
+                     qhttpparser_parse(&parser, "", 0, &consumed, NULL,
+                                       NULL));
+    res = "HTTP/1.1 304 Not Modified\r\nConnection: close\r\n\r\n";
+    qhttpparser_init(&parser, false);
+    qhttpparser_parse(&parser, res, strlen(res), &consumed, NULL, NULL);
+    ASSERT_FALSE(parser.keepalive);
+    ASSERT_EQUAL_INT(QHTTPPARSER_DONE,
+                     qhttpparser_parse(&parser, "", 0, &consumed, NULL,
+                                       NULL));
+
+    // truncated body
+    res = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n";
+    qhttpparser_init(&parser, false);
+    qhttpparser_parse(&parser, res, strlen(res), &consumed, NULL, NULL);
+    ASSERT_EQUAL_INT(QHTTPPARSER_ERROR, qhttpparser_eof(&parser));
+}
+
+TEST("Test malformed responses") {
+    const char *bad[] = {
+        "HTTP/1.1 20 OK\r\n\r\n",
+        "HTTPS/1.1 200 OK\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nno colon\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nA: 1\r\n folded\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        NULL
+    };
+    int i;
+    for (i = 0; bad[i] != NULL; i++) {
+        qhttpparser_t parser;
+        qhttpparser_init(&parser, false);
+        size_t consumed;
+        int event = qhttpparser_parse(&parser, bad[i], strlen(bad[i]),
+                                      &consumed, NULL, NULL);
+        if (event == QHTTPPARSER_HEAD) {
+            size_t off = consumed;
+            event = qhttpparser_parse(&parser, bad[i] + off,
+                                      strlen(bad[i]) - off, &consumed, NULL,
+                                      NULL);
+        }
+        ASSERT_EQUAL_INT(QHTTPPARSER_ERROR, event);
+        ASSERT_EQUAL_INT(EPROTO, errno);
+    }
+}
+
+qhttpdecoder_t *decoder_for(qhttpparser_t *parser, const char *encoding) {
+    char res[256];
+    snprintf(res, sizeof(res), "HTTP/1.1 200 OK\r\n"
+             "Content-Encoding: %s\r\n\r\n", encoding);
+    size_t consumed;
+    qhttpparser_init(parser, false);
+    ASSERT_EQUAL_INT(QHTTPPARSER_HEAD,
+                     qhttpparser_parse(parser, res, strlen(res), &consumed,
+                                       NULL, NULL));
+    decodedlen = 0;
+    return qhttpdecoder(parser);
+}
+
+TEST("Test content encodings") {
+    qhttpparser_t parser;
+
+    // not encoded or unknown encodings
+    ASSERT_NULL(decoder_for(&parser, "identity"));
+    ASSERT_EQUAL_INT(0, errno);
+    ASSERT_NULL(decoder_for(&parser, "br"));
+    ASSERT_EQUAL_INT(EPROTONOSUPPORT, errno);
+
+#ifndef ENABLE_ZLIB
+    ASSERT_NULL(decoder_for(&parser, "gzip"));
+    ASSERT_EQUAL_INT(EPROTONOSUPPORT, errno);
+#endif
+}
+
+#ifdef ENABLE_ZLIB
+TEST("Test gzip and deflate decoding") {
+    const unsigned char gz[] = {
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb,
+        0x48, 0xcd, 0xc9, 0xc9, 0xd7, 0x51, 0x48, 0xce, 0xcf, 0x2d, 0x28,
+        0x4a, 0x2d, 0x2e, 0x4e, 0x4d, 0x51, 0x28, 0xcf, 0x2f, 0xca, 0x49,
+        0x51, 0x54, 0xc8, 0x18, 0x95, 0x18, 0x95, 0x18, 0x95, 0x18, 0x2e,
+        0x12, 0x00, 0x3e, 0x06, 0xfc, 0x1e, 0xe8, 0x03, 0x00, 0x00
+    };
+    const unsigned char zlib[] = {
+        0x78, 0x9c, 0x4b, 0x49, 0x4d, 0xcb, 0x49, 0x2c, 0x49, 0x55, 0xc8,
+        0x4d, 0x55, 0x48, 0xa1, 0x3d, 0x13, 0x00, 0x88, 0xf1, 0x27, 0x07
+    };
+    const unsigned char raw[] = {
+        0x2b, 0x4a, 0x2c, 0x57, 0x48, 0x49, 0x4d, 0xcb, 0x49, 0x2c, 0x49,
+        0x05, 0x00
+    };
+    qhttpparser_t parser;
+    qhttpdecoder_t *decoder;
+
+    // gzip fed one byte at a time
+    decoder = decoder_for(&parser, "gzip");
+    ASSERT_NOT_NULL(decoder);
+    size_t i;
+    for (i = 0; i < sizeof(gz); i++) {
+        ASSERT_TRUE(qhttpdecoder_decode(decoder, gz + i, 1, collect, NULL));
+    }
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(1000, decodedlen);
+    ASSERT_EQUAL_MEM("hello, compressed world! hello", decoded, 30);
+
+    // deflate with and without the zlib wrapper
+    decoder = decoder_for(&parser, "deflate");
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, zlib, sizeof(zlib), collect,
+                                    NULL));
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(110, decodedlen);
+
+    decoder = decoder_for(&parser, "deflate");
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, raw, sizeof(raw), collect,
+                                    NULL));
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(11, decodedlen);
+    ASSERT_EQUAL_MEM("raw deflate", decoded, 11);
+
+    // the format is told apart across pieces
+    decoder = decoder_for(&parser, "deflate");
+    for (i = 0; i < sizeof(raw); i++) {
+        ASSERT_TRUE(qhttpdecoder_decode(decoder, raw + i, 1, collect, NULL));
+    }
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(11, decodedlen);
+    ASSERT_EQUAL_MEM("raw deflate", decoded, 11);
+
+    decoder = decoder_for(&parser, "deflate");
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, zlib, 1, collect, NULL));
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, zlib + 1, sizeof(zlib) - 1,
+                                    collect, NULL));
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(110, decodedlen);
+
+    // gzip members back to back, then zero padding
+    const unsigned char zeros[5] = { 0, 0, 0, 0, 0 };
+    decoder = decoder_for(&parser, "gzip");
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, gz, sizeof(gz), collect, NULL));
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, gz, 1, collect, NULL));
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, gz + 1, sizeof(gz) - 1,
+                                    collect, NULL));
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, zeros, sizeof(zeros), collect,
+                                    NULL));
+    ASSERT_TRUE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+    ASSERT_EQUAL_INT(2000, decodedlen);
+
+    // truncated and corrupted data
+    decoder = decoder_for(&parser, "gzip");
+    ASSERT_TRUE(qhttpdecoder_decode(decoder, gz, sizeof(gz) - 10, collect,
+                                    NULL));
+    ASSERT_FALSE(qhttpdecoder_finish(decoder));
+    qhttpdecoder_free(decoder);
+
+    decoder = decoder_for(&parser, "gzip");
+    ASSERT_FALSE(qhttpdecoder_decode(decoder, zlib, sizeof(zlib), collect,
+                                     NULL));
+    ASSERT_EQUAL_INT(EPROTO, errno);
+    qhttpdecoder_free(decoder);
+}
+#endif
+
+QUNIT_END();
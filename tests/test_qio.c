@@ -0,0 +1,297 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+#define TESTDATA_SIZE   (32 * 1024)
+
+static char testdata[TESTDATA_SIZE];
+
+static int make_tempfile(char *path, const void *data, size_t size) {
+    strcpy(path, "/tmp/test_qio.XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return -1;
+    if (write(fd, data, size) != (ssize_t) size
+            || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+static bool check_file(const char *path, const void *data, size_t size) {
+    size_t nbytes = 0;
+    char *buf = qfile_load(path, &nbytes);
+    bool match = (buf != NULL && nbytes == size
+                  && memcmp(buf, data, size) == 0);
+    free(buf);
+    return match;
+}
+
+QUNIT_START("Test qio.c");
+
+TEST("qio_send(): file to socket") {
+    size_t i;
+    for (i = 0; i < sizeof(testdata); i++) {
+        testdata[i] = 'a' + (i % 26);
+    }
+
+    char path[32];
+    int infd = make_tempfile(path, testdata, sizeof(testdata));
+    ASSERT(infd >= 0);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    ASSERT_EQUAL_INT(sizeof(testdata),
+                     qio_send(sv[0], infd, sizeof(testdata), 1000));
+    char buf[sizeof(testdata)];
+    ASSERT_EQUAL_INT(sizeof(buf), qio_read(sv[1], buf, sizeof(buf), 1000));
+    ASSERT_EQUAL_MEM(testdata, buf, sizeof(buf));
+
+    // reaching EOF before nbytes returns what was sent.
+    ASSERT(lseek(infd, sizeof(testdata) - 10, SEEK_SET) >= 0);
+    ASSERT_EQUAL_INT(10, qio_send(sv[0], infd, 100, 1000));
+
+    close(sv[0]);
+    close(sv[1]);
+    close(infd);
+    unlink(path);
+}
+
+TEST("qio_send(): socket to file") {
+    char path[32];
+    int outfd = make_tempfile(path, "", 0);
+    ASSERT(outfd >= 0);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    ASSERT_EQUAL_INT(sizeof(testdata),
+                     qio_write(sv[1], testdata, sizeof(testdata), 1000));
+    ASSERT_EQUAL_INT(sizeof(testdata),
+                     qio_send(outfd, sv[0], sizeof(testdata), 1000));
+    ASSERT_TRUE(check_file(path, testdata, sizeof(testdata)));
+
+    // nothing to read
+    ASSERT_EQUAL_INT(0, qio_send(outfd, sv[0], 10, 10));
+    ASSERT_EQUAL_INT(ETIMEDOUT, errno);
+
+    close(sv[0]);
+    close(sv[1]);
+    close(outfd);
+    unlink(path);
+}
+
+TEST("qio_send(): pipe to append-only file") {
+    char path[32];
+    int fd = make_tempfile(path, "", 0);
+    ASSERT(fd >= 0);
+    close(fd);
+    int outfd = open(path, O_WRONLY | O_APPEND);
+    ASSERT(outfd >= 0);
+    int pfd[2];
+    ASSERT_EQUAL_INT(0, pipe(pfd));
+
+    ASSERT_EQUAL_INT(sizeof(testdata) / 2,
+                     qio_write(pfd[1], testdata, sizeof(testdata) / 2, 1000));
+    close(pfd[1]);
+    ASSERT_EQUAL_INT(sizeof(testdata) / 2,
+                     qio_send(outfd, pfd[0], sizeof(testdata), 1000));
+    ASSERT_TRUE(check_file(path, testdata, sizeof(testdata) / 2));
+
+    close(pfd[0]);
+    close(outfd);
+    unlink(path);
+}
+
+TEST("qio_reader: readline, read_exact and peek") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    const char *msg = "HTTP/1.1 200 OK\r\nHost: a\r\n\r\nBODYbody";
+    ASSERT_EQUAL_INT(strlen(msg), qio_write(sv[1], msg, strlen(msg), 1000));
+
+    // small buffer to make lines cross buffer boundaries.
+    qio_reader_t *reader = qio_reader(sv[0], 8);
+    ASSERT_NOT_NULL(reader);
+
+    char line[64];
+    ASSERT_EQUAL_INT(17, qio_reader_readline(reader, line, sizeof(line), 1000));
+    ASSERT_EQUAL_STR("HTTP/1.1 200 OK", line);
+    ASSERT_EQUAL_INT(9, qio_reader_readline(reader, line, sizeof(line), 1000));
+    ASSERT_EQUAL_STR("Host: a", line);
+    ASSERT_EQUAL_INT(2, qio_reader_readline(reader, line, sizeof(line), 1000));
+    ASSERT_EQUAL_STR("", line);
+
+    const void *data;
+    ASSERT(qio_reader_peek(reader, &data, 4, 1000) >= 4);
+    ASSERT_EQUAL_MEM("BODY", data, 4);
+    ASSERT_EQUAL_INT(4, qio_reader_read_exact(reader, NULL, 4, 1000));
+    ASSERT_EQUAL_INT(4, qio_reader_read_exact(reader, line, 4, 1000));
+    ASSERT_EQUAL_MEM("body", line, 4);
+    ASSERT_EQUAL_INT(0, qio_reader_buffered(reader));
+
+    // timeout, then end of stream
+    ASSERT_EQUAL_INT(0, qio_reader_readline(reader, line, sizeof(line), 10));
+    close(sv[1]);
+    ASSERT_EQUAL_INT(-1, qio_reader_read(reader, line, sizeof(line), 1000));
+
+    qio_reader_free(reader);
+    close(sv[0]);
+}
+
+TEST("qio_reader: large reads bypass the buffer") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT_EQUAL_INT(sizeof(testdata),
+                     qio_write(sv[1], testdata, sizeof(testdata), 1000));
+    close(sv[1]);
+
+    qio_reader_t *reader = qio_reader(sv[0], 1024);
+    char line[16];
+    ASSERT_EQUAL_INT(10, qio_reader_read(reader, line, 10, 1000));
+    ASSERT_EQUAL_MEM(testdata, line, 10);
+
+    char buf[sizeof(testdata)];
+    ASSERT_EQUAL_INT(sizeof(buf) - 10,
+                     qio_reader_read_exact(reader, buf, sizeof(buf), 1000));
+    ASSERT_EQUAL_MEM(testdata + 10, buf, sizeof(buf) - 10);
+
+    qio_reader_free(reader);
+    close(sv[0]);
+}
+
+TEST("qio_reader: peek beyond the buffer after reserve") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT_EQUAL_INT(sizeof(testdata),
+                     qio_write(sv[1], testdata, sizeof(testdata), 1000));
+
+    qio_reader_t *reader = qio_reader(sv[0], 16);
+    char line[4];
+    ASSERT_EQUAL_INT(4, qio_reader_read(reader, line, 4, 1000));
+
+    // capped to the buffer, then the whole rest once it's large enough
+    const void *data;
+    ASSERT_EQUAL_INT(16, qio_reader_peek(reader, &data, 64, 1000));
+    ASSERT_TRUE(qio_reader_reserve(reader, 64));
+    ASSERT(qio_reader_peek(reader, &data, 64, 1000) >= 64);
+    ASSERT_EQUAL_MEM(testdata + 4, data, 64);
+    ASSERT_TRUE(qio_reader_reserve(reader, 8));  // never shrinks
+
+    qio_reader_free(reader);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+TEST("qio_read(): end of stream") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT_EQUAL_INT(5, write(sv[1], "hello", 5));
+    close(sv[1]);
+
+    char buf[16];
+    ASSERT_EQUAL_INT(5, qio_read(sv[0], buf, sizeof(buf), 1000));
+
+    // a stale errno from a non-blocking call must not make it spin.
+    errno = EINPROGRESS;
+    ASSERT_EQUAL_INT(-1, qio_read(sv[0], buf, sizeof(buf), 1000));
+
+    close(sv[0]);
+}
+
+TEST("qio_writev() and qio_readv()") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+    // more buffers than a single batch, with some empty ones.
+    struct iovec iov[200];
+    size_t i, total = 0;
+    for (i = 0; i < 200; i++) {
+        iov[i].iov_base = testdata + total;
+        iov[i].iov_len = (i % 7 == 0) ? 0 : i;
+        total += iov[i].iov_len;
+    }
+    ASSERT_EQUAL_INT(total, qio_writev(sv[1], iov, 200, 1000));
+
+    char buf[sizeof(testdata)];
+    struct iovec riov[3];
+    riov[0].iov_base = buf;
+    riov[0].iov_len = 10;
+    riov[1].iov_base = buf + 10;
+    riov[1].iov_len = 0;
+    riov[2].iov_base = buf + 10;
+    riov[2].iov_len = total - 10;
+    ASSERT_EQUAL_INT(total, qio_readv(sv[0], riov, 3, 1000));
+    ASSERT_EQUAL_MEM(testdata, buf, total);
+
+    // nothing to read
+    ASSERT_EQUAL_INT(0, qio_readv(sv[0], riov, 3, 10));
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+TEST("qio_sendmsgs() and qio_recvmsgs()") {
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, sv));
+
+    struct iovec msgs[100];
+    int i;
+    for (i = 0; i < 100; i++) {
+        msgs[i].iov_base = testdata + i;
+        msgs[i].iov_len = i + 1;
+    }
+    ASSERT_EQUAL_INT(100, qio_sendmsgs(sv[1], msgs, 100, 1000));
+
+    char bufs[150][128];
+    struct iovec rmsgs[150];
+    for (i = 0; i < 150; i++) {
+        rmsgs[i].iov_base = bufs[i];
+        rmsgs[i].iov_len = sizeof(bufs[i]);
+    }
+    ASSERT_EQUAL_INT(100, qio_recvmsgs(sv[0], rmsgs, 150, 1000));
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQUAL_INT(i + 1, rmsgs[i].iov_len);
+        ASSERT_EQUAL_MEM(testdata + i, bufs[i], i + 1);
+    }
+
+    // nothing queued
+    ASSERT_EQUAL_INT(0, qio_recvmsgs(sv[0], rmsgs, 150, 10));
+
+    close(sv[0]);
+    close(sv[1]);
+}
+
+QUNIT_END();
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static int fired[16];
+static int nfired;
+
+static void on_event(qreactor_t *reactor, int fd, int events, void *userdata) {
+    fired[nfired++] = events;
+    if (events & QREACTOR_READ) {
+        char buf[64];
+        while (read(fd, buf, sizeof(buf)) > 0);
+    }
+    if (userdata != NULL)
+        qreactor_del(reactor, fd);
+}
+
+static void on_task(qreactor_t *reactor, void *userdata) {
+    fired[nfired++] = (int) (intptr_t) userdata;
+}
+
+static void on_defer(qreactor_t *reactor, void *userdata) {
+    fired[nfired++] = (int) (intptr_t) userdata;
+    if ((intptr_t) userdata == 1)
+        qreactor_defer(reactor, on_task, (void *) 3);
+}
+
+QUNIT_START("Test qreactor.c");
+
+TEST("Test read and write readiness") {
+    qreactor_t *reactor = qreactor();
+    ASSERT_NOT_NULL(reactor);
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+    nfired = 0;
+    ASSERT_TRUE(qreactor_add(reactor, sv[0], QREACTOR_READ, -1, on_event,
+                             NULL));
+    ASSERT_FALSE(qreactor_add(reactor, sv[0], QREACTOR_READ, -1, on_event,
+                              NULL));
+    ASSERT_EQUAL_INT(EEXIST, errno);
+    ASSERT_EQUAL_INT(0, qreactor_run_once(reactor, 0));
+
+    ASSERT_EQUAL_INT(5, write(sv[1], "hello", 5));
+    ASSERT_EQUAL_INT(1, qreactor_run_once(reactor, 1000));
+    ASSERT_EQUAL_INT(QREACTOR_READ, fired[0]);
+
+    // edge-triggered, drained socket does not fire again.
+    ASSERT_EQUAL_INT(0, qreactor_run_once(reactor, 0));
+
+    ASSERT_TRUE(qreactor_mod(reactor, sv[0], QREACTOR_WRITE, -1));
+    ASSERT_EQUAL_INT(1, qreactor_run_once(reactor, 1000));
+    ASSERT_EQUAL_INT(QREACTOR_WRITE, fired[1]);
+
+    ASSERT_TRUE(qreactor_del(reactor, sv[0]));
+    ASSERT_FALSE(qreactor_del(reactor, sv[0]));
+    ASSERT_EQUAL_INT(ENOENT, errno);
+
+    close(sv[0]);
+    close(sv[1]);
+    qreactor_free(reactor);
+}
+
+TEST("Test idle timeout and delete in callback") {
+    qreactor_t *reactor = qreactor();
+    int sv[2];
+    ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+    nfired = 0;
+    ASSERT_TRUE(qreactor_add(reactor, sv[0], QREACTOR_READ, 50, on_event,
+                             NULL));
+    ASSERT_EQUAL_INT(0, qreactor_run_once(reactor, 0));
+    ASSERT_EQUAL_INT(1, qreactor_run_once(reactor, 5000));
+    ASSERT_EQUAL_INT(QREACTOR_TIMEOUT, fired[0]);
+
+    // not re-armed until modified.
+    ASSERT_EQUAL_INT(0, qreactor_run_once(reactor, 100));
+    ASSERT_TRUE(qreactor_del(reactor, sv[0]));
+
+    // the callback unregisters the descriptor, so the loop ends.
+    ASSERT_TRUE(qreactor_add(reactor, sv[0], QREACTOR_READ, 5000, on_event,
+                             reactor));
+    close(sv[1]);
+    ASSERT_TRUE(qreactor_run(reactor));
+    ASSERT_EQUAL_INT(2, nfired);
+    ASSERT(fired[1] & QREACTOR_READ);
+
+    close(sv[0]);
+    qreactor_free(reactor);
+}
+
+TEST("Test timers") {
+    qreactor_t *reactor = qreactor();
+
+    nfired = 0;
+    ASSERT_NOT_NULL(qreactor_timer(reactor, 60, on_task, (void *) 3));
+    ASSERT_NOT_NULL(qreactor_timer(reactor, 20, on_task, (void *) 2));
+    qreactor_timer_t *timer = qreactor_timer(reactor, 40, on_task,
+                                             (void *) 9);
+    ASSERT_NOT_NULL(qreactor_timer(reactor, 0, on_task, (void *) 1));
+    ASSERT_TRUE(qreactor_cancel(reactor, timer));
+
+    ASSERT_TRUE(qreactor_run(reactor));
+    ASSERT_EQUAL_INT(3, nfired);
+    ASSERT_EQUAL_INT(1, fired[0]);
+    ASSERT_EQUAL_INT(2, fired[1]);
+    ASSERT_EQUAL_INT(3, fired[2]);
+
+    // left over timers are released by qreactor_free().
+    ASSERT_NOT_NULL(qreactor_timer(reactor, 100000, on_task, NULL));
+    qreactor_free(reactor);
+}
+
+TEST("Test deferred tasks") {
+    qreactor_t *reactor = qreactor();
+
+    nfired = 0;
+    ASSERT_TRUE(qreactor_defer(reactor, on_defer, (void *) 1));
+    ASSERT_TRUE(qreactor_defer(reactor, on_defer, (void *) 2));
+
+    // tasks deferred from a task run in the next iteration.
+    ASSERT_EQUAL_INT(2, qreactor_run_once(reactor, -1));
+    ASSERT_EQUAL_INT(1, fired[0]);
+    ASSERT_EQUAL_INT(2, fired[1]);
+    ASSERT_EQUAL_INT(1, qreactor_run_once(reactor, -1));
+    ASSERT_EQUAL_INT(3, fired[2]);
+    ASSERT_EQUAL_INT(0, qreactor_run_once(reactor, 0));
+
+    qreactor_free(reactor);
+}
+
+QUNIT_END();
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2015 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// Listen on an ephemeral loopback port, or just reserve one to get refused.
+static int listen_loopback(int *port, bool listening) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *) &addr, len);
+    getsockname(fd, (struct sockaddr *) &addr, &len);
+    *port = ntohs(addr.sin_port);
+    if (listening == true) {
+        listen(fd, 8);
+    }
+    return fd;
+}
+
+QUNIT_START("Test qsocket.c");
+
+TEST("Test resolving address strings") {
+    qsocket_addr_t addrs[4];
+    ASSERT_EQUAL_INT(1, qsocket_resolve(addrs, 4, "127.0.0.1", 8080));
+    ASSERT_EQUAL_INT(AF_INET, addrs[0].addr.ss_family);
+    ASSERT_EQUAL_INT(sizeof(struct sockaddr_in), addrs[0].addrlen);
+    struct sockaddr_in *in = (struct sockaddr_in *) &addrs[0].addr;
+    ASSERT_EQUAL_INT(8080, ntohs(in->sin_port));
+    ASSERT_EQUAL_INT(htonl(INADDR_LOOPBACK), in->sin_addr.s_addr);
+
+    ASSERT_EQUAL_INT(1, qsocket_resolve(addrs, 4, "::1", 443));
+    ASSERT_EQUAL_INT(AF_INET6, addrs[0].addr.ss_family);
+    ASSERT_EQUAL_INT(sizeof(struct sockaddr_in6), addrs[0].addrlen);
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *) &addrs[0].addr;
+    ASSERT_EQUAL_INT(443, ntohs(in6->sin6_port));
+    ASSERT_TRUE(IN6_IS_ADDR_LOOPBACK(&in6->sin6_addr));
+
+    ASSERT_EQUAL_INT(-1, qsocket_resolve(addrs, 0, "127.0.0.1", 80));
+    ASSERT_EQUAL_INT(EINVAL, errno);
+}
+
+TEST("Test resolving and caching names") {
+    qsocket_addr_t addrs[4];
+    int naddrs = qsocket_resolve(addrs, 4, "localhost", 80);
+    ASSERT_TRUE(naddrs > 0);
+
+    // cached result, on another port
+    ASSERT_EQUAL_INT(naddrs, qsocket_resolve(addrs, 4, "localhost", 81));
+    if (addrs[0].addr.ss_family == AF_INET) {
+        ASSERT_EQUAL_INT(81,
+                ntohs(((struct sockaddr_in *) &addrs[0].addr)->sin_port));
+    }
+
+    ASSERT_EQUAL_INT(-1, qsocket_resolve(addrs, 4, "qlibc.invalid", 80));
+    ASSERT_EQUAL_INT(-1, qsocket_resolve(addrs, 4, "qlibc.invalid", 80));
+
+    struct sockaddr_in in;
+    ASSERT_TRUE(qsocket_get_addr(&in, "127.0.0.1", 80));
+    ASSERT_EQUAL_INT(AF_INET, in.sin_family);
+    ASSERT_FALSE(qsocket_get_addr(&in, "::1", 80));
+
+    qsocket_resolve_setttl(0, 0);
+    ASSERT_EQUAL_INT(naddrs, qsocket_resolve(addrs, 4, "localhost", 80));
+    qsocket_resolve_setttl(60, 5);
+    qsocket_resolve_flush();
+}
+
+TEST("Test asynchronous resolving") {
+    qsocket_addr_t addrs[4];
+    const char *names[] = { "127.0.0.1", "localhost", "localhost" };
+    int i;
+    for (i = 0; i < 3; i++) {
+        // the second one is looked up on a thread, the third one is cached.
+        qsocket_resolver_t *resolver = qsocket_resolve_async(names[i], 80);
+        ASSERT_NOT_NULL(resolver);
+        struct pollfd pfd = { qsocket_resolver_fd(resolver), POLLIN, 0 };
+        ASSERT_EQUAL_INT(1, poll(&pfd, 1, 5000));
+        ASSERT_TRUE(qsocket_resolver_result(resolver, addrs, 4) > 0);
+        qsocket_resolver_free(resolver);
+    }
+
+    // released before it's done
+    qsocket_resolve_flush();
+    qsocket_resolver_t *resolver = qsocket_resolve_async("localhost", 80);
+    ASSERT_NOT_NULL(resolver);
+    qsocket_resolver_free(resolver);
+    usleep(100 * 1000);
+}
+
+TEST("Test connecting to the first address which answers") {
+    int port, closedport;
+    int lfd = listen_loopback(&port, true);
+    int cfd = listen_loopback(&closedport, false);
+
+    // refused addresses are skipped without waiting for the delay
+    qsocket_addr_t addrs[3];
+    ASSERT_EQUAL_INT(1, qsocket_resolve(&addrs[0], 1, "127.0.0.1", closedport));
+    ASSERT_EQUAL_INT(1, qsocket_resolve(&addrs[1], 1, "127.0.0.1", closedport));
+    ASSERT_EQUAL_INT(1, qsocket_resolve(&addrs[2], 1, "127.0.0.1", port));
+    long start = qtime_current_milli();
+    int sockfd = qsocket_connect(addrs, 3, 1000);
+    ASSERT(sockfd >= 0);
+    ASSERT(qtime_current_milli() - start < 250);
+    ASSERT_EQUAL_INT(0, (fcntl(sockfd, F_GETFL, 0) & O_NONBLOCK));
+    close(sockfd);
+
+    ASSERT_EQUAL_INT(-3, qsocket_connect(addrs, 2, 1000));
+    ASSERT_EQUAL_INT(ECONNREFUSED, errno);
+    ASSERT_EQUAL_INT(-1, qsocket_connect(addrs, 0, 1000));
+
+    sockfd = qsocket_open("127.0.0.1", port, 1000);
+    ASSERT(sockfd >= 0);
+    close(sockfd);
+    ASSERT_EQUAL_INT(-3, qsocket_open("127.0.0.1", closedport, 1000));
+
+    close(cfd);
+    close(lfd);
+}
+
+QUNIT_END();
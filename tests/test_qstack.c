@@ -232,6 +232,74 @@ void test_thousands_of_values(int num_values, char *prefix, char *postfix)
     stack->free(stack);
 }
 
+TEST("Test array mode") {
+    const int array[] = {1, 2, 3, 4, 5, 6};
+    const char *string = "a test for string";
+
+    /*inline storage for two integers*/
+    qstack_t *stack = qstack_array(2 * QSTACK_ARRAY_SLOTSIZE(sizeof(int64_t)),
+                                   0);
+    ASSERT_NOT_NULL(stack);
+    ASSERT_EQUAL_INT(0, stack->size(stack));
+    ASSERT_NULL(stack->pop(stack, NULL));
+    ASSERT_EQUAL_INT(0, stack->popint(stack));
+
+    /*grow out of the inline storage*/
+    int64_t i;
+    for (i = 0; i < 10000; i++) {
+        ASSERT_TRUE(stack->pushint(stack, i * 3));
+    }
+    ASSERT_EQUAL_INT(10000, stack->size(stack));
+    ASSERT_EQUAL_INT(9999 * 3, stack->getint(stack));
+    for (i = 9999; i >= 0; i--) {
+        ASSERT_EQUAL_INT(i * 3, stack->popint(stack));
+    }
+    ASSERT_EQUAL_INT(0, stack->size(stack));
+
+    /*mixed element sizes*/
+    ASSERT_TRUE(stack->push(stack, array, sizeof(array)));
+    ASSERT_TRUE(stack->pushstr(stack, string));
+    ASSERT_TRUE(stack->pushint(stack, 7));
+    ASSERT_EQUAL_INT(3, stack->size(stack));
+
+    size_t size;
+    void *data = stack->getat(stack, -1, &size, false);
+    ASSERT_EQUAL_INT(sizeof(array), size);
+    ASSERT_EQUAL_MEM(array, data, sizeof(array));
+    char *str = stack->getstr(stack);
+    ASSERT_EQUAL_INT(7, *(int64_t *)str);
+    free(str);
+    ASSERT_NULL(stack->getat(stack, 3, NULL, false));
+
+    /*remove from the middle*/
+    str = stack->popat(stack, 1, &size);
+    ASSERT_EQUAL_INT(strlen(string) + 1, size);
+    ASSERT_EQUAL_STR(string, str);
+    free(str);
+    ASSERT_EQUAL_INT(2, stack->size(stack));
+    ASSERT_EQUAL_INT(7, stack->popint(stack));
+    data = stack->pop(stack, &size);
+    ASSERT_EQUAL_MEM(array, data, sizeof(array));
+    free(data);
+
+    /*max size*/
+    stack->setsize(stack, 1);
+    ASSERT_TRUE(stack->pushint(stack, 1));
+    ASSERT_FALSE(stack->pushint(stack, 2));
+    ASSERT_FALSE(stack->push(stack, NULL, 0));
+    stack->clear(stack);
+    ASSERT_EQUAL_INT(0, stack->size(stack));
+    stack->free(stack);
+
+    /*no inline storage*/
+    stack = qstack_array(0, QSTACK_THREADSAFE);
+    ASSERT_TRUE(stack->pushstr(stack, string));
+    str = stack->popstr(stack);
+    ASSERT_EQUAL_STR(string, str);
+    free(str);
+    stack->free(stack);
+}
+
 TEST("Test thousands of values: without prefix and postfix") {
     test_thousands_of_values(10000, "", "");
 }
@@ -69,4 +69,103 @@ TEST("qstrtrim_tail()") {
     ASSERT_EQUAL_STR(qstrtrim_tail(strdup(" a ")), " a");
 }
 
+TEST("qstrreplace()") {
+    char src[64];
+    char *ret;
+
+    strcpy(src, "Welcome to The qDecoder Project.");
+    ret = qstrreplace("tn", src, "The", "_");
+    ASSERT_EQUAL_STR("W_lcom_ to ___ qD_cod_r Proj_ct.", ret);
+    free(ret);
+
+    ret = qstrreplace("sn", src, "The", "_");
+    ASSERT_EQUAL_STR("Welcome to _ qDecoder Project.", ret);
+    free(ret);
+
+    ret = qstrreplace("sn", src, "o", "[oo]");
+    ASSERT_EQUAL_STR("Welc[oo]me t[oo] The qDec[oo]der Pr[oo]ject.", ret);
+    free(ret);
+
+    ret = qstrreplace("sr", src, "e", "");
+    ASSERT_EQUAL_PT(src, ret);
+    ASSERT_EQUAL_STR("Wlcom to Th qDcodr Projct.", src);
+
+    strcpy(src, "aaaa");
+    ret = qstrreplace("sn", src, "aa", "b");
+    ASSERT_EQUAL_STR("bb", ret);
+    free(ret);
+
+    ASSERT_NULL(qstrreplace("xn", src, "a", "b"));
+}
+
+TEST("qstrreplace_multi()") {
+    const char *toks[] = { "{name}", "{city}", "" };
+    const char *words[] = { "qLibc", "Seoul", "never" };
+    char *ret = qstrreplace_multi("Hi {name} from {city}{name}", toks, words,
+                                  3);
+    ASSERT_EQUAL_STR("Hi qLibc from SeoulqLibc", ret);
+    free(ret);
+
+    // leftmost wins, then longest at the same position.
+    const char *toks2[] = { "he", "she", "hers", "a", "ab", "abc", "bcd" };
+    const char *words2[] = { "1", "2", "3", "4", "5", "6", "7" };
+    ret = qstrreplace_multi("ushers abcd", toks2, words2, 7);
+    ASSERT_EQUAL_STR("u2rs 6d", ret);
+    free(ret);
+
+    // a short match inside a longer pending prefix must not be lost.
+    const char *toks3[] = { "abcdefX", "ab", "ef" };
+    const char *words3[] = { "0", "1", "2" };
+    ret = qstrreplace_multi("abcdefY", toks3, words3, 3);
+    ASSERT_EQUAL_STR("1cd2Y", ret);
+    free(ret);
+
+    ret = qstrreplace_multi("nothing", toks3, words3, 0);
+    ASSERT_EQUAL_STR("nothing", ret);
+    free(ret);
+}
+
+TEST("qstrtok()") {
+    char str[] = "a:b,,d:";
+    char stop;
+    int offset = 0;
+    ASSERT_EQUAL_STR("a", qstrtok(str, ":,", &stop, &offset));
+    ASSERT_EQUAL_INT(':', stop);
+    ASSERT_EQUAL_STR("b", qstrtok(str, ":,", &stop, &offset));
+    ASSERT_EQUAL_STR("", qstrtok(str, ":,", &stop, &offset));
+    ASSERT_EQUAL_STR("d", qstrtok(str, ":,", &stop, &offset));
+    ASSERT_NULL(qstrtok(str, ":,", &stop, &offset));
+}
+
+TEST("qstrtok_init()/qstrtok_next()") {
+    const char *EXPECTED[] = { "a", "b", "", "d", "long token" };
+    const char *multi = "a:b,,d:long token";
+    const char *single = "a,b,,d,long token,";
+    qstrtok_t tok;
+    const char *token;
+    size_t toklen;
+    char stop;
+    int i;
+
+    ASSERT_TRUE(qstrtok_init(&tok, multi, strlen(multi), ":,"));
+    for (i = 0; qstrtok_next(&tok, &token, &toklen, &stop); i++) {
+        ASSERT_TRUE(i < 5);
+        ASSERT_EQUAL_INT(strlen(EXPECTED[i]), toklen);
+        ASSERT_EQUAL_MEM(EXPECTED[i], token, toklen);
+    }
+    ASSERT_EQUAL_INT(5, i);
+    ASSERT_EQUAL_INT('\0', stop);
+
+    // single delimiter path, trailing delimiter gives no empty token.
+    ASSERT_TRUE(qstrtok_init(&tok, single, strlen(single), ","));
+    for (i = 0; qstrtok_next(&tok, &token, &toklen, &stop); i++) {
+        ASSERT_EQUAL_MEM(EXPECTED[i], token, toklen);
+        ASSERT_EQUAL_INT(',', stop);
+    }
+    ASSERT_EQUAL_INT(5, i);
+
+    ASSERT_TRUE(qstrtok_init(&tok, "", 0, ","));
+    ASSERT_FALSE(qstrtok_next(&tok, &token, &toklen, NULL));
+}
+
 QUNIT_END();